@@ -0,0 +1,173 @@
+// Echo canceller benchmark: processing cost per 10 ms frame at 48 kHz, mono and stereo.
+//
+// The far end is noise with a speech-like syllable envelope; the microphone picks it up through
+// a synthetic room (a bulk delay plus an exponentially decaying random impulse response, a
+// different one per channel) over a -60 dBFS noise floor. Each frame, the far-end frame is
+// handed to the canceller as the reference and the microphone frame is processed. Reported are
+// the time per frame against the 10 ms frame period and the ERLE reached, which checks that
+// the filter actually converged while it was being timed.
+//
+// Usage: aec_bench [seconds of audio per case]
+
+#include "EchoCanceller.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int kSampleRate = 48000;
+constexpr int kFrameSize = 480;     // 10 ms
+constexpr int kEchoDelayMs = 40;    // output buffering + acoustic path
+constexpr int kRoomMs = 50;         // decaying part of the impulse response
+
+struct BenchCase
+{
+    const char* name;
+    int channels;
+    int tailMs;
+};
+
+const BenchCase kCases[] = {
+    {"mono, 100 ms tail", 1, 100},
+    {"mono, 200 ms tail", 1, 200},
+    {"stereo, 200 ms tail", 2, 200},
+    {"stereo, 400 ms tail", 2, 400},
+};
+
+// Keeps the canceller's setup line off the table
+class QuietStdout
+{
+public:
+    QuietStdout() : m_Saved(std::cout.rdbuf(m_Sink.rdbuf())) {}
+    ~QuietStdout() { std::cout.rdbuf(m_Saved); }
+
+private:
+    std::ostringstream m_Sink;
+    std::streambuf* m_Saved;
+};
+
+std::vector<float> roomResponse(std::mt19937& rng)
+{
+    std::normal_distribution<float> noise(0.0f, 1.0f);
+    const int delay = kSampleRate * kEchoDelayMs / 1000;
+    const int decay = kSampleRate * kRoomMs / 1000;
+    std::vector<float> response(delay + decay, 0.0f);
+    double energy = 0.0;
+    for(int n = 0; n < decay; n++) {
+        response[delay + n] = noise(rng) * std::exp(-6.9f * n / decay);     // -60 dB at the end
+        energy += response[delay + n] * response[delay + n];
+    }
+    // Echo 6 dB below the far end
+    const float gain = static_cast<float>(0.5 / std::sqrt(energy));
+    for(float& tap : response) {
+        tap *= gain;
+    }
+    return response;
+}
+
+struct Result
+{
+    double meanUs = 0.0;
+    double p99Us = 0.0;
+    double maxUs = 0.0;
+    double erleDb = 0.0;
+    size_t partitions = 0;
+};
+
+Result runCase(const BenchCase& benchCase, int seconds)
+{
+    std::mt19937 rng(42);
+    std::normal_distribution<float> noise(0.0f, 1.0f);
+    const size_t samples = static_cast<size_t>(seconds) * kSampleRate;
+
+    // Far end: 4 Hz syllables of noise at about -16 dBFS
+    std::vector<float> far(samples);
+    for(size_t n = 0; n < samples; n++) {
+        const float envelope = 0.6f + 0.4f * std::sin(2.0f * 3.14159265f * 4.0f * n / kSampleRate);
+        far[n] = 0.15f * envelope * noise(rng);
+    }
+
+    // Microphone: far end through the room, per channel, plus the noise floor
+    std::vector<opus_int16> mic(samples * benchCase.channels);
+    for(int c = 0; c < benchCase.channels; c++) {
+        const std::vector<float> response = roomResponse(rng);
+        for(size_t n = 0; n < samples; n++) {
+            double echo = 0.0;
+            const size_t taps = std::min(response.size(), n + 1);
+            for(size_t t = 0; t < taps; t++) {
+                echo += response[t] * far[n - t];
+            }
+            const double sample = (echo + 0.001 * noise(rng)) * 32768.0;
+            mic[n * benchCase.channels + c] = static_cast<opus_int16>(std::max(-32768.0, std::min(32767.0, sample)));
+        }
+    }
+    std::vector<opus_int16> farPcm(samples * benchCase.channels);
+    for(size_t n = 0; n < samples; n++) {
+        for(int c = 0; c < benchCase.channels; c++) {
+            farPcm[n * benchCase.channels + c] = static_cast<opus_int16>(far[n] * 32768.0f);
+        }
+    }
+
+    QuietStdout quiet;
+    EchoCanceller canceller(kSampleRate, benchCase.channels, benchCase.tailMs);
+    std::vector<double> frameUs;
+    for(size_t offset = 0; offset + kFrameSize <= samples; offset += kFrameSize) {
+        const size_t index = offset * benchCase.channels;
+        const auto begin = Clock::now();
+        canceller.addReference(farPcm.data() + index, kFrameSize);
+        canceller.process(mic.data() + index, kFrameSize);
+        frameUs.push_back(std::chrono::duration<double, std::micro>(Clock::now() - begin).count());
+    }
+
+    Result result;
+    for(double us : frameUs) {
+        result.meanUs += us;
+    }
+    result.meanUs /= frameUs.size();
+    std::sort(frameUs.begin(), frameUs.end());
+    result.p99Us = frameUs[frameUs.size() * 99 / 100];
+    result.maxUs = frameUs.back();
+    result.erleDb = canceller.erleDb();
+    result.partitions = canceller.partitions();
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const int seconds = argc > 1 ? std::atoi(argv[1]) : 10;
+    if(seconds < 2) {
+        std::cerr << "Usage: " << argv[0] << " [seconds of audio per case, >= 2]" << std::endl;
+        return 1;
+    }
+
+    const double frameUs = 1e6 * kFrameSize / kSampleRate;
+    std::cout << "Echo canceller, " << kSampleRate << " Hz, " << kFrameSize << "-sample frames, " << seconds
+        << " s per case" << std::endl;
+    std::cout << std::left << std::setw(22) << "case" << std::right << std::setw(12) << "partitions"
+        << std::setw(11) << "mean us" << std::setw(11) << "p99 us" << std::setw(11) << "max us"
+        << std::setw(10) << "% frame" << std::setw(10) << "ERLE dB" << std::endl;
+
+    bool converged = true;
+    for(const BenchCase& benchCase : kCases) {
+        const Result result = runCase(benchCase, seconds);
+        converged = converged && result.erleDb > 10.0;
+
+        std::cout << std::left << std::setw(22) << benchCase.name << std::right << std::fixed << std::setprecision(1)
+            << std::setw(12) << result.partitions << std::setw(11) << result.meanUs << std::setw(11) << result.p99Us
+            << std::setw(11) << result.maxUs << std::setw(10) << 100.0 * result.meanUs / frameUs
+            << std::setw(10) << result.erleDb << std::endl;
+    }
+    return converged ? 0 : 1;
+}
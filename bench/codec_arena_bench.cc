@@ -0,0 +1,206 @@
+// Codec state arena benchmark: resident memory and decode throughput with many streams.
+//
+// For each stream count, N decoders are created either individually on the heap
+// (opus_decoder_create, the layout before CodecStateArena) or through AudioCodec from the
+// arena. Every round then decodes one packet on every stream, the access pattern of a server
+// receiving from N peers. Finally streams are churned (released and re-acquired) to time
+// reuse from the pool against create/destroy.
+
+#include "AudioCodec.hpp"
+#include "CodecStateArena.hpp"
+#include "opus_defines.h"
+
+#include <unistd.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int kSampleRate = 48000;
+constexpr int kFrameSize = 480;
+constexpr int kPacketCount = 50;
+
+// Resident set size in bytes, from /proc/self/statm
+size_t residentBytes()
+{
+    std::ifstream statm("/proc/self/statm");
+    size_t total = 0, resident = 0;
+    statm >> total >> resident;
+    return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+// Keeps the constructor/destructor chatter of thousands of codecs off the terminal
+class QuietStdout
+{
+public:
+    QuietStdout() : m_Saved(std::cout.rdbuf(m_Sink.rdbuf())) {}
+    ~QuietStdout() { std::cout.rdbuf(m_Saved); }
+
+private:
+    std::ostringstream m_Sink;
+    std::streambuf* m_Saved;
+};
+
+std::vector<std::vector<unsigned char>> encodePackets(int channels)
+{
+    AudioCodec encoder;
+    if(!encoder.initEncoder(kSampleRate, channels, OPUS_APPLICATION_VOIP)) {
+        std::exit(1);
+    }
+    std::vector<opus_int16> pcm(kFrameSize * channels);
+    std::vector<unsigned char> buffer(4000);
+    std::vector<std::vector<unsigned char>> packets;
+    for(int p = 0; p < kPacketCount; p++) {
+        for(int i = 0; i < kFrameSize; i++) {
+            double t = static_cast<double>(p * kFrameSize + i) / kSampleRate;
+            for(int ch = 0; ch < channels; ch++) {
+                pcm[i * channels + ch] = static_cast<opus_int16>(6000.0 * std::sin(2.0 * 3.14159265358979 * (300.0 + 40.0 * ch) * t));
+            }
+        }
+        int bytes = encoder.encode(pcm.data(), kFrameSize, buffer.data(), static_cast<int>(buffer.size()));
+        if(bytes < 0) {
+            std::exit(1);
+        }
+        packets.emplace_back(buffer.begin(), buffer.begin() + bytes);
+    }
+    return packets;
+}
+
+struct Result
+{
+    double setupMs;
+    size_t rssBytes;
+    double framesPerSecond;
+    double churnUs;
+};
+
+template <typename DecodeFn>
+double decodeRounds(int streams, int rounds, int channels, const std::vector<std::vector<unsigned char>>& packets, DecodeFn decode)
+{
+    std::vector<opus_int16> pcm(kFrameSize * channels);
+    auto begin = Clock::now();
+    for(int round = 0; round < rounds; round++) {
+        for(int s = 0; s < streams; s++) {
+            const auto& packet = packets[(s + round) % packets.size()];
+            decode(s, packet, pcm.data());
+        }
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+    return static_cast<double>(streams) * rounds / seconds;
+}
+
+Result runHeap(int streams, int rounds, int channels, const std::vector<std::vector<unsigned char>>& packets)
+{
+    Result result{};
+    size_t rssBefore = residentBytes();
+    auto begin = Clock::now();
+    std::vector<OpusDecoder*> decoders(streams);
+    for(int s = 0; s < streams; s++) {
+        int error = OPUS_OK;
+        decoders[s] = opus_decoder_create(kSampleRate, channels, &error);
+    }
+    result.setupMs = std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+    result.rssBytes = residentBytes() - rssBefore;
+
+    result.framesPerSecond = decodeRounds(streams, rounds, channels, packets,
+        [&](int s, const std::vector<unsigned char>& packet, opus_int16* pcm) {
+            opus_decode(decoders[s], packet.data(), static_cast<opus_int32>(packet.size()), pcm, kFrameSize, 0);
+        });
+
+    // Churn: a stream leaves and another one joins
+    begin = Clock::now();
+    for(int s = 0; s < streams; s++) {
+        int error = OPUS_OK;
+        opus_decoder_destroy(decoders[s]);
+        decoders[s] = opus_decoder_create(kSampleRate, channels, &error);
+    }
+    result.churnUs = std::chrono::duration<double, std::micro>(Clock::now() - begin).count() / streams;
+
+    for(OpusDecoder* decoder : decoders) {
+        opus_decoder_destroy(decoder);
+    }
+    return result;
+}
+
+Result runArena(int streams, int rounds, int channels, const std::vector<std::vector<unsigned char>>& packets)
+{
+    Result result{};
+    QuietStdout quiet;
+    CodecStateArena arena;
+    size_t rssBefore = residentBytes();
+    auto begin = Clock::now();
+    std::vector<std::unique_ptr<AudioCodec>> codecs(streams);
+    for(int s = 0; s < streams; s++) {
+        codecs[s] = std::make_unique<AudioCodec>(arena);
+        codecs[s]->initDecoder(kSampleRate, channels);
+    }
+    result.setupMs = std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+    result.rssBytes = residentBytes() - rssBefore;
+
+    result.framesPerSecond = decodeRounds(streams, rounds, channels, packets,
+        [&](int s, const std::vector<unsigned char>& packet, opus_int16* pcm) {
+            codecs[s]->decode(packet.data(), static_cast<int>(packet.size()), pcm, kFrameSize);
+        });
+
+    // Churn: the state goes back to the pool and is handed out again to the next stream
+    begin = Clock::now();
+    for(int s = 0; s < streams; s++) {
+        codecs[s] = std::make_unique<AudioCodec>(arena);
+        codecs[s]->initDecoder(kSampleRate, channels);
+    }
+    result.churnUs = std::chrono::duration<double, std::micro>(Clock::now() - begin).count() / streams;
+    return result;
+}
+
+void printRow(const char* layout, int streams, const Result& result)
+{
+    std::cout << std::left << std::setw(8) << layout << std::right
+        << std::setw(8) << streams
+        << std::setw(12) << std::fixed << std::setprecision(1) << result.setupMs
+        << std::setw(12) << std::setprecision(1) << result.rssBytes / (1024.0 * 1024.0)
+        << std::setw(14) << std::setprecision(0) << result.framesPerSecond
+        << std::setw(12) << std::setprecision(2) << result.churnUs << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    // Usage: codec_arena_bench [channels] [rounds]
+    const int channels = argc > 1 ? std::atoi(argv[1]) : 2;
+    const int rounds = argc > 2 ? std::atoi(argv[2]) : 20;
+    if(channels < 1 || channels > 2 || rounds < 1) {
+        std::cerr << "Usage: " << argv[0] << " [channels (1-2)] [rounds]" << std::endl;
+        return 1;
+    }
+
+    std::vector<std::vector<unsigned char>> packets;
+    {
+        QuietStdout quiet;
+        packets = encodePackets(channels);
+    }
+
+    std::cout << "Decoder state: " << opus_decoder_get_size(channels) << " bytes, " << channels << " channel(s), "
+        << kFrameSize << " samples/frame, " << rounds << " rounds" << std::endl;
+    std::cout << std::left << std::setw(8) << "layout" << std::right << std::setw(8) << "streams"
+        << std::setw(12) << "setup ms" << std::setw(12) << "RSS MiB" << std::setw(14) << "frames/s"
+        << std::setw(12) << "churn us" << std::endl;
+
+    // Arena first at each size: the heap run would otherwise leave freed pages behind for it
+    for(int streams : {1000, 10000}) {
+        printRow("arena", streams, runArena(streams, rounds, channels, packets));
+        printRow("heap", streams, runHeap(streams, rounds, channels, packets));
+    }
+    return 0;
+}
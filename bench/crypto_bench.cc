@@ -0,0 +1,142 @@
+// Media encryption benchmark: what AES-128-GCM adds per datagram, the number a server budgets
+// per stream on top of forwarding.
+//
+// Seals and opens batches of 64 audio datagrams (what the receive handler drains per wakeup)
+// at payload sizes from a low bitrate Opus frame up to a datagram full of redundant copies,
+// with the cipher context kept across packets as the stages do, and once with a context set up
+// per packet to show what the key schedule costs. Reports ns per packet, throughput and how
+// many 50 packet/s streams one core opens and seals again, as an encrypted echo server does.
+//
+// Usage: crypto_bench [batches per case]
+
+#include "MediaCrypto.hpp"
+#include "PacketHeader.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t kBatchSize = 64;
+constexpr double kPacketsPerSecond = 50.0;   // 20 ms packets
+
+const size_t kPayloadSizes[] = {40, 80, 160, 400, 1200};
+
+struct Result
+{
+    double sealNs = 0.0;
+    double openNs = 0.0;
+    double freshSealNs = 0.0;
+};
+
+// A batch of cleartext audio datagrams of one stream, sequence numbers starting at `first`
+void fillBatch(const std::vector<unsigned char>& payload, uint32_t first, std::vector<Datagram>& batch)
+{
+    for(size_t i = 0; i < batch.size(); i++) {
+        const uint32_t index = first + static_cast<uint32_t>(i);
+        PacketHeader header;
+        header.sequence = static_cast<uint16_t>(index);
+        header.timestamp = index * 960;
+        header.ssrc = 0x1234abcd;
+        NetworkPacket& packet = batch[i].payload;
+        packet.resize(PacketHeader::kSize + payload.size());
+        header.write(reinterpret_cast<unsigned char*>(packet.data()));
+        std::copy(payload.begin(), payload.end(), packet.begin() + PacketHeader::kSize);
+        batch[i].rollover = index >> 16;
+        batch[i].stream = 0;
+    }
+}
+
+Result runCase(const MediaKey& key, size_t payloadSize, int batches)
+{
+    std::mt19937 rng(7);
+    std::vector<unsigned char> payload(payloadSize);
+    for(unsigned char& byte : payload) {
+        byte = static_cast<unsigned char>(rng());
+    }
+    std::vector<Datagram> batch(kBatchSize);
+    for(Datagram& datagram : batch) {
+        datagram.payload.reserve(PacketHeader::kSize + payloadSize + MediaCrypto::kOverhead);
+    }
+
+    MediaSealer sealer(key);
+    MediaOpener opener(key);
+    Clock::duration sealTime{};
+    Clock::duration openTime{};
+    Clock::duration freshTime{};
+    for(int b = 0; b < batches; b++) {
+        fillBatch(payload, static_cast<uint32_t>(b) * kBatchSize, batch);
+        auto begin = Clock::now();
+        for(Datagram& datagram : batch) {
+            sealer.seal(datagram);
+        }
+        sealTime += Clock::now() - begin;
+
+        begin = Clock::now();
+        for(Datagram& datagram : batch) {
+            if(!opener.open(datagram) || !opener.accept(datagram)) {
+                std::cerr << "Datagram failed to open" << std::endl;
+                std::exit(1);
+            }
+        }
+        openTime += Clock::now() - begin;
+    }
+
+    // A new session (key derivation and key schedule) per packet, on a tenth of the batches
+    const int freshBatches = std::max(1, batches / 10);
+    for(int b = 0; b < freshBatches; b++) {
+        fillBatch(payload, static_cast<uint32_t>(b) * kBatchSize, batch);
+        const auto begin = Clock::now();
+        for(Datagram& datagram : batch) {
+            MediaSealer fresh(key);
+            fresh.seal(datagram);
+        }
+        freshTime += Clock::now() - begin;
+    }
+
+    Result result;
+    const double packets = static_cast<double>(batches) * kBatchSize;
+    result.sealNs = std::chrono::duration<double, std::nano>(sealTime).count() / packets;
+    result.openNs = std::chrono::duration<double, std::nano>(openTime).count() / packets;
+    result.freshSealNs = std::chrono::duration<double, std::nano>(freshTime).count() / (freshBatches * kBatchSize);
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const int batches = argc > 1 ? std::atoi(argv[1]) : 4000;
+    if(batches < 1) {
+        std::cerr << "Usage: " << argv[0] << " [batches per case, >= 1]" << std::endl;
+        return 1;
+    }
+    MediaKey key;
+    if(!MediaKey::derive("crypto_bench", key)) {
+        std::cerr << "Media encryption is not available in this build (no OpenSSL)." << std::endl;
+        return 1;
+    }
+
+    std::cout << "AES-128-GCM, batches of " << kBatchSize << " datagrams, " << batches << " batches per case, +"
+        << MediaCrypto::kOverhead << " bytes per datagram" << std::endl;
+    std::cout << std::right << std::setw(8) << "payload" << std::setw(11) << "seal ns" << std::setw(11) << "open ns"
+        << std::setw(15) << "fresh ctx ns" << std::setw(10) << "MB/s" << std::setw(16) << "streams/core" << std::endl;
+
+    for(size_t payloadSize : kPayloadSizes) {
+        const Result result = runCase(key, payloadSize, batches);
+        const double roundTripNs = result.sealNs + result.openNs;
+        std::cout << std::setw(8) << payloadSize << std::fixed << std::setprecision(0)
+            << std::setw(11) << result.sealNs << std::setw(11) << result.openNs
+            << std::setw(15) << result.freshSealNs
+            << std::setw(10) << 1e3 * payloadSize / result.sealNs
+            << std::setw(16) << 1e9 / (kPacketsPerSecond * roundTripNs) << std::endl;
+    }
+    return 0;
+}
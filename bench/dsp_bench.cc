@@ -0,0 +1,125 @@
+// DSP chain benchmark: processing cost per frame, the number a server budgets per stream.
+//
+// Runs the chain over a few seconds of noise with a DC offset and a slow level envelope, so the
+// gate opens and closes and the AGC and limiter have work to do, and reports the mean and p99
+// time per frame, the share of the frame period that is and how many streams one core keeps up
+// with in real time.
+//
+// Usage: dsp_bench [seconds of audio per case]
+
+#include "DspChain.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int kSampleRate = 48000;
+
+struct BenchCase
+{
+    const char* spec;
+    int channels;
+    int frameSize;
+};
+
+const BenchCase kCases[] = {
+    {"dc", 1, 480},
+    {"gate,agc", 1, 480},
+    {"all", 1, 480},
+    {"all", 2, 480},
+    {"all", 1, 120},
+    {"all", 2, 960},
+};
+
+// Keeps the chain's setup line off the table
+class QuietStdout
+{
+public:
+    QuietStdout() : m_Saved(std::cout.rdbuf(m_Sink.rdbuf())) {}
+    ~QuietStdout() { std::cout.rdbuf(m_Saved); }
+
+private:
+    std::ostringstream m_Sink;
+    std::streambuf* m_Saved;
+};
+
+struct Result
+{
+    double meanNs = 0.0;
+    double p99Ns = 0.0;
+};
+
+Result runCase(const BenchCase& benchCase, int seconds)
+{
+    std::mt19937 rng(3);
+    std::normal_distribution<float> noise(0.0f, 1.0f);
+    const size_t frames = static_cast<size_t>(seconds) * kSampleRate;
+    std::vector<opus_int16> input(frames * benchCase.channels);
+    for(size_t n = 0; n < frames; n++) {
+        // Between about -60 and -10 dBFS, changing every 2 s, with a DC offset of 1000
+        const float envelope = 0.001f + 0.3f * (0.5f + 0.5f * std::sin(2.0f * 3.14159265f * 0.25f * n / kSampleRate));
+        for(int c = 0; c < benchCase.channels; c++) {
+            const float sample = 32768.0f * envelope * noise(rng) + 1000.0f;
+            input[n * benchCase.channels + c] = static_cast<opus_int16>(std::max(-32768.0f, std::min(32767.0f, sample)));
+        }
+    }
+
+    DspConfig config;
+    DspConfig::parse(benchCase.spec, config);
+    QuietStdout quiet;
+    DspChain chain(kSampleRate, benchCase.channels, benchCase.frameSize, config);
+    std::vector<float> output(static_cast<size_t>(benchCase.frameSize) * benchCase.channels);
+    std::vector<double> frameNs;
+    for(size_t offset = 0; offset + benchCase.frameSize <= frames; offset += benchCase.frameSize) {
+        const auto begin = Clock::now();
+        chain.process(input.data() + offset * benchCase.channels, output.data());
+        frameNs.push_back(std::chrono::duration<double, std::nano>(Clock::now() - begin).count());
+    }
+
+    Result result;
+    for(double ns : frameNs) {
+        result.meanNs += ns;
+    }
+    result.meanNs /= frameNs.size();
+    std::sort(frameNs.begin(), frameNs.end());
+    result.p99Ns = frameNs[frameNs.size() * 99 / 100];
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const int seconds = argc > 1 ? std::atoi(argv[1]) : 10;
+    if(seconds < 1) {
+        std::cerr << "Usage: " << argv[0] << " [seconds of audio per case, >= 1]" << std::endl;
+        return 1;
+    }
+
+    std::cout << "DSP chain (" << DspChain::kernelName() << " kernels), " << kSampleRate << " Hz, " << seconds
+        << " s per case" << std::endl;
+    std::cout << std::left << std::setw(12) << "chain" << std::right << std::setw(10) << "channels"
+        << std::setw(8) << "frame" << std::setw(11) << "mean ns" << std::setw(11) << "p99 ns"
+        << std::setw(10) << "% frame" << std::setw(16) << "streams/core" << std::endl;
+
+    for(const BenchCase& benchCase : kCases) {
+        const Result result = runCase(benchCase, seconds);
+        const double frameNs = 1e9 * benchCase.frameSize / kSampleRate;
+        std::cout << std::left << std::setw(12) << benchCase.spec << std::right << std::setw(10) << benchCase.channels
+            << std::setw(8) << benchCase.frameSize << std::fixed << std::setprecision(0)
+            << std::setw(11) << result.meanNs << std::setw(11) << result.p99Ns << std::setprecision(3)
+            << std::setw(10) << 100.0 * result.meanNs / frameNs << std::setprecision(0)
+            << std::setw(16) << frameNs / result.meanNs << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,132 @@
+// End-to-end latency regression benchmark.
+//
+// Runs the real pipeline headless with the probe backends (a burst injected at the capture
+// end, found again by cross-correlation at the playback end) in a few fixed configurations:
+// local loopback at several frame sizes and packet times, and over UDP through an echo server
+// on localhost. Prints mouth-to-ear latency and its spread per configuration, so a pipeline
+// change that adds buffering or jitter shows up as a number that moved.
+//
+// Usage: latency_bench [seconds per case] [chirp|mls]
+
+#include "Application.hpp"
+#include "LatencyProbe.hpp"
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr unsigned short kServerPort = 47311;
+constexpr unsigned short kClientPort = 47312;
+
+struct BenchCase
+{
+    const char* name;
+    int frameSize;
+    int framesPerPacket;
+    bool network;
+};
+
+const BenchCase kCases[] = {
+    {"loopback 10 ms", 480, 1, false},
+    {"loopback 20 ms", 960, 1, false},
+    {"loopback 2.5 ms", 120, 1, false},
+    {"loopback 10 ms x3", 480, 3, false},
+    {"udp echo 10 ms", 480, 1, true},
+    {"udp echo 20 ms", 960, 1, true},
+};
+
+// Keeps the pipeline's start/stop chatter and metric dumps off the terminal
+class QuietStdout
+{
+public:
+    QuietStdout() : m_Saved(std::cout.rdbuf(m_Sink.rdbuf())) {}
+    ~QuietStdout() { std::cout.rdbuf(m_Saved); }
+
+private:
+    std::ostringstream m_Sink;
+    std::streambuf* m_Saved;
+};
+
+LatencySummary runCase(const BenchCase& benchCase, const std::string& signal, int seconds)
+{
+    ApplicationConfig config;
+    config.frameSize = benchCase.frameSize;
+    config.framesPerPacket = benchCase.framesPerPacket;
+    config.audioSource = "probe:" + signal;
+    config.audioSink = "probe:" + signal;
+    config.durationSeconds = seconds;
+
+    QuietStdout quiet;
+    if(!benchCase.network) {
+        config.topology = "loopback";
+        Application app(config);
+        app.run();
+        app.stop();
+        return LatencyProbe::instance().summary();
+    }
+
+    // The client sends to an echo server in the same process and plays what comes back
+    ApplicationConfig serverConfig;
+    serverConfig.topology = "server";
+    serverConfig.localPort = kServerPort;
+    serverConfig.durationSeconds = seconds + 1;
+    Application server(serverConfig);
+    std::thread serverThread([&server]() { server.run(); });
+
+    config.topology = "p2p";
+    config.localPort = kClientPort;
+    config.remoteIp = "127.0.0.1";
+    config.remotePort = kServerPort;
+    Application client(config);
+    client.run();
+    client.stop();
+    const LatencySummary summary = LatencyProbe::instance().summary();
+
+    serverThread.join();
+    server.stop();
+    return summary;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const int seconds = argc > 1 ? std::atoi(argv[1]) : 10;
+    const std::string signal = argc > 2 ? argv[2] : "chirp";
+    ProbeSignal parsed;
+    if(seconds < 3 || !LatencyProbe::parseSignal(signal, parsed)) {
+        std::cerr << "Usage: " << argv[0] << " [seconds per case, >= 3] [chirp|mls]" << std::endl;
+        return 1;
+    }
+
+    std::cout << "End-to-end latency, " << signal << " probe, " << seconds << " s per case" << std::endl;
+    std::cout << std::left << std::setw(20) << "case" << std::right
+        << std::setw(8) << "bursts" << std::setw(8) << "missed"
+        << std::setw(11) << "mean ms" << std::setw(11) << "stddev ms"
+        << std::setw(11) << "p95 ms" << std::setw(11) << "max ms" << std::endl;
+
+    bool allMeasured = true;
+    for(const BenchCase& benchCase : kCases) {
+        LatencySummary summary;
+        try {
+            summary = runCase(benchCase, signal, seconds);
+        } catch(const std::exception& e) {
+            std::cerr << benchCase.name << ": " << e.what() << std::endl;
+            allMeasured = false;
+            continue;
+        }
+        allMeasured = allMeasured && summary.bursts > 0;
+
+        std::cout << std::left << std::setw(20) << benchCase.name << std::right << std::fixed << std::setprecision(2)
+            << std::setw(8) << summary.bursts << std::setw(8) << summary.missed
+            << std::setw(11) << summary.meanUs / 1000.0 << std::setw(11) << summary.stddevUs / 1000.0
+            << std::setw(11) << summary.p95Us / 1000.0 << std::setw(11) << summary.maxUs / 1000.0 << std::endl;
+    }
+    return allMeasured ? 0 : 1;
+}
@@ -0,0 +1,129 @@
+// Peer table benchmark: cost of resolving a received datagram to its stream.
+//
+// N streams with random IPv4 endpoints and SSRCs are registered, then looked up in a
+// shuffled order (packets of many peers interleave on a server socket). Compared are the
+// flat PeerTable, StreamDirectory::resolve (the full receive path lookup) and
+// std::unordered_map keyed by the same (endpoint, SSRC) and by SSRC alone, the map the
+// decode side used before. Misses and erase/insert churn are timed for the two tables.
+
+#include "PeerTable.hpp"
+#include "StreamDirectory.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct PeerKeyHash
+{
+    size_t operator()(const PeerKey& key) const { return static_cast<size_t>(PeerTable::hash(key)); }
+};
+
+std::vector<PeerKey> randomKeys(size_t count, std::mt19937& rng)
+{
+    std::uniform_int_distribution<uint32_t> any;
+    std::vector<PeerKey> keys;
+    keys.reserve(count);
+    while(keys.size() < count) {
+        const asio::ip::address_v4 address(any(rng));
+        const asio::ip::udp::endpoint endpoint(address, static_cast<unsigned short>(1024 + any(rng) % 60000));
+        keys.push_back(PeerKey::from(endpoint, any(rng)));
+    }
+    return keys;
+}
+
+// ns per call of lookup(i) over the shuffled order, sum keeps the work observable
+template <typename Lookup>
+double timeLookups(const std::vector<uint32_t>& order, size_t lookups, Lookup lookup)
+{
+    uint64_t sum = 0;
+    auto begin = Clock::now();
+    for(size_t n = 0; n < lookups; n++) {
+        sum += lookup(order[n % order.size()]);
+    }
+    double ns = std::chrono::duration<double, std::nano>(Clock::now() - begin).count() / lookups;
+    if(sum == 0x5EED) {
+        std::cout << "";
+    }
+    return ns;
+}
+
+void printRow(const char* what, double ns)
+{
+    std::cout << std::left << std::setw(36) << what << std::right << std::setw(10) << std::fixed
+        << std::setprecision(1) << ns << " ns" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    // Usage: peer_table_bench [peers] [lookups]
+    const long peers = argc > 1 ? std::atol(argv[1]) : 10000;
+    const long lookups = argc > 2 ? std::atol(argv[2]) : 20000000;
+    if(peers < 1 || static_cast<size_t>(peers) > StreamDirectory::kMaxStreams || lookups < 1) {
+        std::cerr << "Usage: " << argv[0] << " [peers (1-" << StreamDirectory::kMaxStreams << ")] [lookups]" << std::endl;
+        return 1;
+    }
+
+    std::mt19937 rng(42);
+    const std::vector<PeerKey> keys = randomKeys(static_cast<size_t>(peers) * 2, rng);
+    const size_t count = static_cast<size_t>(peers);     // keys[count..] are never inserted
+
+    std::vector<uint32_t> order(count * 4);
+    for(size_t i = 0; i < order.size(); i++) {
+        order[i] = static_cast<uint32_t>(i % count);
+    }
+    std::shuffle(order.begin(), order.end(), rng);
+
+    PeerTable table(count);
+    StreamDirectory directory(count);
+    std::unordered_map<PeerKey, uint32_t, PeerKeyHash> map;
+    std::unordered_map<uint32_t, uint32_t> mapBySsrc;
+    const auto now = StreamDirectory::Clock::now();
+    for(size_t i = 0; i < count; i++) {
+        table.insert(keys[i], static_cast<uint32_t>(i));
+        directory.resolve(keys[i], now);
+        map.emplace(keys[i], static_cast<uint32_t>(i));
+        mapBySsrc.emplace(keys[i].ssrc, static_cast<uint32_t>(i));
+    }
+
+    const size_t n = static_cast<size_t>(lookups);
+    std::cout << peers << " peers, " << lookups << " lookups in shuffled order, PeerTable: " << table.bucketCount()
+        << " buckets (" << table.bucketCount() * 32 / 1024 << " KiB)" << std::endl;
+
+    printRow("PeerTable::find hit", timeLookups(order, n, [&](uint32_t i) { return table.find(keys[i]); }));
+    printRow("StreamDirectory::resolve hit", timeLookups(order, n, [&](uint32_t i) { return directory.resolve(keys[i], now); }));
+    printRow("unordered_map<PeerKey> find hit", timeLookups(order, n, [&](uint32_t i) { return map.find(keys[i])->second; }));
+    printRow("unordered_map<ssrc> find hit", timeLookups(order, n, [&](uint32_t i) { return mapBySsrc.find(keys[i].ssrc)->second; }));
+
+    printRow("PeerTable::find miss", timeLookups(order, n, [&](uint32_t i) { return table.find(keys[count + i]); }));
+    printRow("unordered_map<PeerKey> find miss", timeLookups(order, n, [&](uint32_t i) {
+        return static_cast<uint32_t>(map.count(keys[count + i])); }));
+
+    // Churn: a stream leaves and a new one takes its place, toggling between keys[i] and keys[count + i]
+    const size_t churn = std::min<size_t>(n, count * 100);
+    printRow("PeerTable erase + insert", timeLookups(order, churn, [&](uint32_t i) {
+        if(table.erase(keys[i])) {
+            return static_cast<uint32_t>(table.insert(keys[count + i], i));
+        }
+        table.erase(keys[count + i]);
+        return static_cast<uint32_t>(table.insert(keys[i], i));
+    }));
+    printRow("unordered_map<PeerKey> erase + insert", timeLookups(order, churn, [&](uint32_t i) {
+        if(map.erase(keys[i]) > 0) {
+            return static_cast<uint32_t>(map.emplace(keys[count + i], i).second);
+        }
+        map.erase(keys[count + i]);
+        return static_cast<uint32_t>(map.emplace(keys[i], i).second);
+    }));
+    return 0;
+}
@@ -0,0 +1,253 @@
+// Shared-memory ring vs UDP loopback benchmark: the per-datagram cost of the two ways two
+// echo-link processes on one host can talk.
+//
+// Latency: two threads bounce a datagram back and forth (ping-pong), each blocking until the
+// other's arrives (futex wait on the ring, recv() on the socket); reports the one-way time.
+// Throughput: one thread sends as fast as the channel takes datagrams, the other receives;
+// reports datagrams per second and, for UDP, how many the kernel dropped. The threads stand
+// in for the two processes, the ring is the same shared mapping either way.
+//
+// Usage: shm_bench [datagrams per case]
+
+#include "ShmRing.hpp"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t kPayloadSizes[] = {160, 1200};
+constexpr std::chrono::milliseconds kWait{100};
+
+struct Latency
+{
+    double meanNs = 0.0;
+    double p50Ns = 0.0;
+    double p99Ns = 0.0;
+};
+
+struct Throughput
+{
+    double packetsPerSecond = 0.0;
+    double lossPercent = 0.0;
+};
+
+Latency summarize(std::vector<double>& oneWayNs)
+{
+    Latency latency;
+    for(double ns : oneWayNs) {
+        latency.meanNs += ns;
+    }
+    latency.meanNs /= oneWayNs.size();
+    std::sort(oneWayNs.begin(), oneWayNs.end());
+    latency.p50Ns = oneWayNs[oneWayNs.size() / 2];
+    latency.p99Ns = oneWayNs[oneWayNs.size() * 99 / 100];
+    return latency;
+}
+
+// --- Shared memory ---
+
+struct RingPair
+{
+    ShmRing inbox;
+    ShmRing outbox;
+};
+
+// Both directions of a channel between two endpoints "a" and "b"
+bool openRings(const std::string& prefix, RingPair& a, RingPair& b)
+{
+    return a.inbox.create(prefix + ".a") && b.inbox.create(prefix + ".b")
+        && a.outbox.attach(prefix + ".b") && b.outbox.attach(prefix + ".a");
+}
+
+void sendRing(ShmRing& ring, const std::vector<unsigned char>& payload)
+{
+    unsigned char* record;
+    while(!(record = ring.reserve(payload.size()))) {
+        std::this_thread::yield();     // full, the reader catches up
+    }
+    std::memcpy(record, payload.data(), payload.size());
+    ring.commit();
+}
+
+void receiveRing(ShmRing& ring)
+{
+    size_t size = 0;
+    while(!ring.peek(size)) {
+        ring.wait(kWait);
+    }
+    ring.release();
+}
+
+Latency ringLatency(size_t payloadSize, int count)
+{
+    RingPair a;
+    RingPair b;
+    if(!openRings("shm_bench." + std::to_string(::getpid()) + ".lat", a, b)) {
+        std::exit(1);
+    }
+    const std::vector<unsigned char> payload(payloadSize, 0x5a);
+    std::thread echo([&]() {
+        for(int i = 0; i < count; i++) {
+            receiveRing(b.inbox);
+            sendRing(b.outbox, payload);
+        }
+    });
+    std::vector<double> oneWayNs;
+    for(int i = 0; i < count; i++) {
+        const auto begin = Clock::now();
+        sendRing(a.outbox, payload);
+        receiveRing(a.inbox);
+        oneWayNs.push_back(std::chrono::duration<double, std::nano>(Clock::now() - begin).count() / 2.0);
+    }
+    echo.join();
+    return summarize(oneWayNs);
+}
+
+Throughput ringThroughput(size_t payloadSize, int count)
+{
+    RingPair a;
+    RingPair b;
+    if(!openRings("shm_bench." + std::to_string(::getpid()) + ".tput", a, b)) {
+        std::exit(1);
+    }
+    const std::vector<unsigned char> payload(payloadSize, 0x5a);
+    const auto begin = Clock::now();
+    std::thread receiver([&]() {
+        for(int i = 0; i < count; i++) {
+            receiveRing(b.inbox);
+        }
+    });
+    for(int i = 0; i < count; i++) {
+        sendRing(a.outbox, payload);
+    }
+    receiver.join();
+    Throughput throughput;
+    throughput.packetsPerSecond = count / std::chrono::duration<double>(Clock::now() - begin).count();
+    return throughput;
+}
+
+// --- UDP loopback ---
+
+int openSocket(sockaddr_in& address)
+{
+    const int fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    const int buffer = 4 * 1024 * 1024;
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buffer, sizeof(buffer));
+    timeval timeout{0, 200000};     // the throughput receiver gives up on dropped datagrams
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    if(::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+        || ::getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+        std::cerr << "UDP socket setup failed: " << std::strerror(errno) << std::endl;
+        std::exit(1);
+    }
+    return fd;
+}
+
+Latency udpLatency(size_t payloadSize, int count)
+{
+    sockaddr_in addressA;
+    sockaddr_in addressB;
+    const int a = openSocket(addressA);
+    const int b = openSocket(addressB);
+    std::vector<char> payload(payloadSize, 0x5a);
+    std::thread echo([&]() {
+        std::vector<char> buffer(2048);
+        for(int i = 0; i < count; i++) {
+            if(::recv(b, buffer.data(), buffer.size(), 0) < 0) {
+                break;
+            }
+            ::sendto(b, payload.data(), payload.size(), 0, reinterpret_cast<sockaddr*>(&addressA), sizeof(addressA));
+        }
+    });
+    std::vector<char> buffer(2048);
+    std::vector<double> oneWayNs;
+    for(int i = 0; i < count; i++) {
+        const auto begin = Clock::now();
+        ::sendto(a, payload.data(), payload.size(), 0, reinterpret_cast<sockaddr*>(&addressB), sizeof(addressB));
+        if(::recv(a, buffer.data(), buffer.size(), 0) < 0) {
+            break;
+        }
+        oneWayNs.push_back(std::chrono::duration<double, std::nano>(Clock::now() - begin).count() / 2.0);
+    }
+    echo.join();
+    ::close(a);
+    ::close(b);
+    return summarize(oneWayNs);
+}
+
+Throughput udpThroughput(size_t payloadSize, int count)
+{
+    sockaddr_in addressA;
+    sockaddr_in addressB;
+    const int a = openSocket(addressA);
+    const int b = openSocket(addressB);
+    std::vector<char> payload(payloadSize, 0x5a);
+    std::atomic<int> received{0};
+    auto lastReceive = Clock::now();
+    const auto begin = Clock::now();
+    std::thread receiver([&]() {
+        std::vector<char> buffer(2048);
+        while(received.load() < count && ::recv(b, buffer.data(), buffer.size(), 0) >= 0) {
+            received++;
+            lastReceive = Clock::now();
+        }
+    });
+    for(int i = 0; i < count; i++) {
+        ::sendto(a, payload.data(), payload.size(), 0, reinterpret_cast<sockaddr*>(&addressB), sizeof(addressB));
+    }
+    receiver.join();
+    ::close(a);
+    ::close(b);
+    Throughput throughput;
+    throughput.packetsPerSecond = received.load() / std::chrono::duration<double>(lastReceive - begin).count();
+    throughput.lossPercent = 100.0 * (count - received.load()) / count;
+    return throughput;
+}
+
+void printRow(const char* transport, size_t payloadSize, const Latency& latency, const Throughput& throughput)
+{
+    std::cout << std::left << std::setw(8) << transport << std::right << std::setw(8) << payloadSize
+        << std::fixed << std::setprecision(0) << std::setw(11) << latency.meanNs << std::setw(11) << latency.p50Ns
+        << std::setw(11) << latency.p99Ns << std::setw(14) << throughput.packetsPerSecond
+        << std::setprecision(2) << std::setw(9) << throughput.lossPercent << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const int count = argc > 1 ? std::atoi(argv[1]) : 200000;
+    if(count < 100) {
+        std::cerr << "Usage: " << argv[0] << " [datagrams per case, >= 100]" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Shared-memory ring vs UDP loopback, " << count << " datagrams per case" << std::endl;
+    std::cout << std::left << std::setw(8) << "channel" << std::right << std::setw(8) << "bytes"
+        << std::setw(11) << "mean ns" << std::setw(11) << "p50 ns" << std::setw(11) << "p99 ns"
+        << std::setw(14) << "datagrams/s" << std::setw(9) << "loss %" << std::endl;
+    for(size_t payloadSize : kPayloadSizes) {
+        printRow("shm", payloadSize, ringLatency(payloadSize, count / 4), ringThroughput(payloadSize, count));
+        printRow("udp", payloadSize, udpLatency(payloadSize, count / 4), udpThroughput(payloadSize, count));
+    }
+    return 0;
+}
@@ -0,0 +1,74 @@
+#ifndef ALSA_AUDIO_DEVICE_HPP
+#define ALSA_AUDIO_DEVICE_HPP
+
+#include "ThreadSafeQueue.hpp"
+#include "interfaces/IAudioPlayback.hpp"
+#include "interfaces/IAudioSource.hpp"
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+// Direct ALSA backend (only built when alsa-lib is found, see ECHOLINK_HAVE_ALSA).
+// Uses mmap interleaved access so samples are copied straight between the DMA ring and
+// our frames, with one period of buffering on each side, skipping the PortAudio layers.
+
+typedef struct _snd_pcm snd_pcm_t;
+
+class AlsaCapture : public IAudioSource
+{
+public:
+    AlsaCapture(const std::string& device, int sampleRate, int channels, int frameSize);
+    ~AlsaCapture();
+
+    bool start() override;
+    void stop() override;
+    void setOutputQueue(std::shared_ptr<ThreadSafeQueue<AudioFrame>> queue) override { m_OutputQueue = std::move(queue); }
+
+    int getSampleRate() const override { return m_SampleRate; }
+    int getChannels() const override { return m_Channels; }
+    int getFrameSize() const override { return m_FrameSize; }
+
+private:
+    void captureLoop();
+
+    std::string m_Device;
+    snd_pcm_t* m_Pcm = nullptr;
+    std::shared_ptr<ThreadSafeQueue<AudioFrame>> m_OutputQueue = nullptr;
+    std::thread m_CaptureThread;
+    std::atomic_bool a_IsRunning = false;
+
+    int m_SampleRate;
+    int m_Channels;
+    int m_FrameSize;
+};
+
+class AlsaPlayback : public IAudioPlayback
+{
+public:
+    AlsaPlayback(const std::string& device, int sampleRate, int channels, int frameSize);
+    ~AlsaPlayback();
+
+    bool start() override;
+    void stop() override;
+    void setInputQueue(std::shared_ptr<ThreadSafeQueue<AudioFrame>> queue) override { m_InputQueue = std::move(queue); }
+
+    int getSampleRate() const override { return m_SampleRate; }
+    int getChannels() const override { return m_Channels; }
+    int getFrameSize() const override { return m_FrameSize; }
+
+private:
+    void playbackLoop();
+
+    std::string m_Device;
+    snd_pcm_t* m_Pcm = nullptr;
+    std::shared_ptr<ThreadSafeQueue<AudioFrame>> m_InputQueue = nullptr;
+    std::thread m_PlaybackThread;
+    std::atomic_bool a_IsRunning = false;
+
+    int m_SampleRate;
+    int m_Channels;
+    int m_FrameSize;
+};
+
+#endif // ALSA_AUDIO_DEVICE_HPP
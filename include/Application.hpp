@@ -2,17 +2,100 @@
 #define APPLICATION_HPP
 
 #include "AudioCodec.hpp"
+#include "Bridge.hpp"
+#include "EchoCanceller.hpp"
+#include "MediaCrypto.hpp"
 #include "NetworkManager.hpp"
-#include "ThreadSafeQueue.hpp"
+#include "Pipeline.hpp"
+#include "Redundancy.hpp"
+#include "Resampler.hpp"
+#include "ShmTransport.hpp"
 #include "interfaces/IAudioPlayback.hpp"
 #include "interfaces/IAudioSource.hpp"
 
 #include <optional>
 #include <asio/io_context.hpp>
 #include <memory>
+#include <string>
 
-void InitPortAudio();
-void TerminatePortAudio();
+struct ApplicationConfig
+{
+    int sampleRate = 48000;
+    int channels = 2;
+    int frameSize = 480;
+
+    // Rate the audio devices run at, resampled to/from sampleRate next to capture/playback
+    // (0 = sampleRate, no conversion)
+    int deviceSampleRate = 0;
+    ResamplerQuality resampleQuality = ResamplerQuality::Balanced;
+
+    // Built-in topology name (loopback, p2p, p2p-aec, record, server, relay, bridge, replay) or a pipeline description,
+    // e.g. "capture > encode > send; receive > decode > playback"
+    std::string topology = "loopback";
+
+    // Audio backends as "name[:argument]": portaudio, null, file:<path>, alsa[:<device>]
+    // (only created when the topology has capture/playback stages)
+    std::string audioSource = "portaudio";
+    std::string audioSink = "portaudio";
+
+    // Network (only used when the topology has send/receive/reflect/bridge stages)
+    unsigned short localPort = 0;
+    std::string remoteIp;
+    unsigned short remotePort = 0;
+    SocketOptions socketOptions;        // buffer sizes, DSCP, busy polling, kernel timestamps
+
+    // Shared-memory channel to another process on this host instead of UDP: read the inbox
+    // shmLocal, write to the inbox shmRemote (empty = receive only). Empty shmLocal = UDP.
+    std::string shmLocal;
+    std::string shmRemote;
+
+    // Pre-shared secret every end derives the media key from: audio is sent sealed with AES-GCM
+    // and only sealed audio is accepted (empty = in the clear, see MediaCrypto.hpp)
+    std::string mediaSecret;
+
+    // Trunks to the bridges on other nodes (only used when the topology has a bridge stage)
+    BridgeConfig bridge;
+
+    // Echo path length the echo canceller models (only used when the topology has aec/echoref stages)
+    int echoTailMs = EchoCanceller::kDefaultTailMs;
+
+    // Time-stretch decoded audio right before playback to keep stretchTargetMs queued for it
+    // (inserts the stretch stage)
+    bool timeStretch = false;
+    int stretchTargetMs = 20;
+
+    // Float32 processing (DC filter, noise gate, AGC, limiter) of the captured stream before encoding
+    DspConfig dsp;
+
+    // Earlier payloads repeated in every sent datagram, fixed or following the loss bursts the
+    // receivers report (only used when the topology has encode/decode stages)
+    RedundancyConfig redundancy;
+
+    int framesPerPacket = 1;            // encoded frames carried per datagram (packet time = frameSize * this)
+    double encodeBudgetShare = 0.0;     // share of the frame period the encoder may use, 0 = fixed complexity
+    std::string recordPath = "echo-link.rec";
+
+    // Packet traces: record every received datagram to tracePath (empty = off),
+    // read replayPath for the replay stage, with the recorded timing or as fast as possible
+    std::string tracePath;
+    std::string replayPath;
+    bool replayRealtime = true;
+
+    // Received streams silent for this long are marked idle (decoder reset) / evicted (state pooled)
+    int peerIdleTimeoutMs = 2000;
+    int peerExpiryTimeoutMs = 30000;
+
+    // Run this long, then stop (0 = until 'exit' is typed)
+    int durationSeconds = 0;
+
+    // Hardware performance counters around codec calls, network handlers and audio callbacks
+    // (perf.* metrics, see PerfCounters.hpp)
+    bool perfCounters = false;
+
+    // Per-frame spans of every thread, written to this file as Chrome trace-event JSON when
+    // the application stops (empty = off, see FrameTracer.hpp)
+    std::string frameTracePath;
+};
 
 class Application
 {
@@ -20,34 +103,29 @@ private:
     asio::io_context m_Context;
     std::optional<asio::executor_work_guard<asio::io_context::executor_type>> m_WorkGuard;   // intial work
 
-    // Modules
+    ApplicationConfig m_Config;
+
+    // Modules (only the ones the topology needs are created)
     std::unique_ptr<IAudioSource> m_AudioSource;
     std::unique_ptr<IAudioPlayback> m_AudioPlayback;
     std::unique_ptr<AudioCodec> m_AudioCodec;
+    std::unique_ptr<EchoCanceller> m_EchoCanceller;
+    std::unique_ptr<RedundancyController> m_Redundancy;
+    std::unique_ptr<MediaKey> m_MediaKey;
     std::unique_ptr<NetworkManager> m_NetworkManager;
+    std::unique_ptr<ShmTransport> m_ShmTransport;   // replaces the NetworkManager when configured
 
-    // Queues
-    std::shared_ptr<ThreadSafeQueue<AudioFrame>> m_CapturedAudioQueue;
-    std::shared_ptr<ThreadSafeQueue<std::vector<char>>> m_EncodedAudioQueue;
-    std::shared_ptr<ThreadSafeQueue<std::vector<char>>> m_IncomingNetworkQueue;
-    std::shared_ptr<ThreadSafeQueue<AudioFrame>> m_DecodedAudioQueue;
+    // Stage graph, owns the queues and the encode/decode/send threads
+    PipelineContext m_PipelineContext;
+    std::unique_ptr<PipelineGraph> m_Pipeline;
 
     // Threads
-    std::thread m_EncodingThread;
-    std::thread m_DecodingThread;
-    std::thread m_NetworkSendThread;
     std::thread m_AsioRunnerThread;
 
-    // Helper functions
-    void encodingLoop();
-    void decodingLoop();
-    void networkSendLoop();
-
-    bool b_NetworkEnabled;
+    bool b_Stopped = false;
 
 public:
-    Application(int sampleRate, int channels, int frameSize, bool networkEnabled,
-        unsigned short localPort, const std::string& remoteIp = "", unsigned short remotePort = 0);
+    explicit Application(const ApplicationConfig& config);
 
     ~Application();
 
@@ -0,0 +1,55 @@
+#ifndef AUDIO_BACKENDS_HPP
+#define AUDIO_BACKENDS_HPP
+
+#include "interfaces/IAudioPlayback.hpp"
+#include "interfaces/IAudioSource.hpp"
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Parameters handed to a backend factory
+struct AudioBackendParams
+{
+    int sampleRate = 48000;
+    int channels = 2;
+    int frameSize = 480;
+    std::string argument;   // backend specific: file path, ALSA device name, ...
+};
+
+// Runtime registry of audio source/sink backends, selected with a spec string "name[:argument]",
+// e.g. "portaudio", "null", "file:input.raw", "alsa:hw:0".
+// Built-in backends: portaudio, file, null and (when built with alsa-lib) alsa.
+class AudioBackendRegistry
+{
+public:
+    using SourceFactory = std::function<std::unique_ptr<IAudioSource>(const AudioBackendParams&)>;
+    using PlaybackFactory = std::function<std::unique_ptr<IAudioPlayback>(const AudioBackendParams&)>;
+
+    static AudioBackendRegistry& instance();
+
+    void registerSource(const std::string& name, SourceFactory factory);
+    void registerPlayback(const std::string& name, PlaybackFactory factory);
+
+    // Creates the backend named in `spec`, timing its construction (reported as the
+    // audio.source.<name>.init_us / audio.playback.<name>.init_us metrics).
+    // Throws std::runtime_error for unknown backends.
+    std::unique_ptr<IAudioSource> createSource(const std::string& spec, AudioBackendParams params) const;
+    std::unique_ptr<IAudioPlayback> createPlayback(const std::string& spec, AudioBackendParams params) const;
+
+    std::vector<std::string> sourceNames() const;
+    std::vector<std::string> playbackNames() const;
+
+    // Splits "name:argument" (argument may itself contain ':')
+    static std::pair<std::string, std::string> parseSpec(const std::string& spec);
+
+private:
+    AudioBackendRegistry();
+
+    std::map<std::string, SourceFactory> m_Sources;
+    std::map<std::string, PlaybackFactory> m_Playbacks;
+};
+
+#endif // AUDIO_BACKENDS_HPP
@@ -1,22 +1,52 @@
 #ifndef AUDIO_CODEC_HPP
 #define AUDIO_CODEC_HPP
 
+#include "CodecStateArena.hpp"
+#include "ComplexityTuner.hpp"
+#include "Metrics.hpp"
+#include "PerfCounters.hpp"
+
 #include <opus.h>
 #include <opus_custom.h>
+#include <memory>
 
 class AudioCodec
 {
 private:
+    // Encoder/decoder states live in m_Arena, sized by opus_*_get_size()
+    CodecStateArena& m_Arena;
     OpusEncoder* m_Encoder = nullptr;
     OpusDecoder* m_Decoder = nullptr;
+    size_t m_EncoderStateSize = 0;
+    size_t m_DecoderStateSize = 0;
 
     int m_SampleRate{0};
     int m_Channels{0};
+    int m_Complexity{kDefaultComplexity};
+
+    // Set by enableComplexityAutotune(), null means fixed complexity
+    std::unique_ptr<ComplexityTuner> m_ComplexityTuner;
+    MetricValue& m_ComplexityMetric;
+    MetricValue& m_ComplexityChangesMetric;
+    MetricValue& m_EncodeLoadMetric;
+    MetricValue& m_DeadlineMissMetric;
+    PerfSite& m_EncodePerf;     // perf.encode.*
+    PerfSite& m_DecodePerf;     // perf.decode.*
+
+    // Argument checks, timing and complexity autotuning around one opus_encode*() call
+    template<typename EncodeCall>
+    int encodeTimed(int frameSize, unsigned char* opusPacket, int maxPacketSize, EncodeCall&& encodeCall);
 
 public:
-    AudioCodec() = default;
+    static constexpr int kDefaultComplexity = 8;
+
+    AudioCodec();
+    explicit AudioCodec(CodecStateArena& arena);
     ~AudioCodec();
 
+    AudioCodec(const AudioCodec&) = delete;
+    AudioCodec& operator=(const AudioCodec&) = delete;
+
     // returns true on success
     bool initEncoder(int sampleRate, int channels, int application);
     // returns true on success
@@ -29,6 +59,13 @@ public:
     // maxPacketSize: Maximum size of the opusPacket buffer in bytes.
     // Returns the number of bytes encoded, or a negative Opus error code on failure.
     int encode(const opus_int16* pcm, int frameSize, unsigned char* opusPacket, int maxPacketSize);
+    // Same for float PCM (full scale = 1.0), e.g. the output of a DspChain
+    int encodeFloat(const float* pcm, int frameSize, unsigned char* opusPacket, int maxPacketSize);
+
+    // Resets the encoder/decoder to its freshly initialized state, keeping the allocation
+    // (for reusing a codec when a stream ends and another one starts)
+    void resetEncoder();
+    void resetDecoder();
 
     // Decodes an Opus packet back into raw PCM audio
     // opusPacket: Pointer to the opus encoded packet.
@@ -38,6 +75,12 @@ public:
     // Returns the number of samples decoded per channel, or a negative Opus error code on failure.
     int decode(const unsigned char* opusPacket, int packetSize, opus_int16* pcm, int maxFrameSize);
 
+    // Measure the time spent in encode() and adapt the encoder complexity so that
+    // encoding takes at most `budgetShare` of the frame period (e.g. 0.5 = 5 ms of a 10 ms frame).
+    // Call after initEncoder().
+    void enableComplexityAutotune(double budgetShare);
+
+    int getComplexity() const { return m_Complexity; }
     int getSampleRate() const { return m_SampleRate; }
     int getChannels() const { return m_Channels; }
 };
@@ -0,0 +1,20 @@
+#ifndef AUDIO_FRAME_HPP
+#define AUDIO_FRAME_HPP
+
+#include "opus_types.h"
+
+#include <cstdint>
+#include <vector>
+
+// Interleaved 16-bit PCM, the item of every Pcm port. traceId ties the frame to its spans in a
+// frame trace (see FrameTracer.hpp): the capture count where the frame was captured, the packet
+// sequence it was decoded from after decode, -1 where nobody set it. Stages that turn one frame
+// into another pass it on.
+struct AudioFrame : std::vector<opus_int16>
+{
+    using std::vector<opus_int16>::vector;
+
+    int64_t traceId = -1;
+};
+
+#endif // AUDIO_FRAME_HPP
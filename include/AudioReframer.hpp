@@ -0,0 +1,127 @@
+#ifndef AUDIO_REFRAMER_HPP
+#define AUDIO_REFRAMER_HPP
+
+#include "interfaces/IAudioSource.hpp"
+
+#include <algorithm>
+#include <cstddef>
+
+// Device callbacks deliver and request whatever buffer size the driver settled on, the codec
+// works on exact frames. These two adapters sit between the device's own ring buffer and the
+// frame queues and copy every sample exactly once.
+
+// Capture side: collects chunks of any size into frames of exactly frameSize samples per
+// channel. A chunk larger than a frame yields several frames, a remainder is kept for the next
+// chunk, so nothing is dropped or padded. Frames are numbered in their traceId as they complete.
+class FrameAssembler
+{
+public:
+    FrameAssembler(int frameSize, int channels)
+        : m_FrameSamples(static_cast<size_t>(frameSize) * channels), m_Channels(channels),
+        m_Current(m_FrameSamples)
+    {}
+
+    // Copies `frames` interleaved sample frames and calls onFrame(AudioFrame&) for every frame
+    // completed. onFrame may move the frame out, a new one is allocated then.
+    template <typename OnFrame>
+    void push(const opus_int16* samples, size_t frames, OnFrame&& onFrame)
+    {
+        size_t remaining = frames * m_Channels;
+        while(remaining > 0) {
+            if(m_Current.size() != m_FrameSamples) {
+                m_Current.resize(m_FrameSamples);
+            }
+            const size_t chunk = std::min(remaining, m_FrameSamples - m_Filled);
+            std::copy(samples, samples + chunk, m_Current.data() + m_Filled);
+            samples += chunk;
+            remaining -= chunk;
+            m_Filled += chunk;
+            if(m_Filled == m_FrameSamples) {
+                m_Filled = 0;
+                m_Current.traceId = m_NextTraceId++;
+                onFrame(m_Current);
+            }
+        }
+    }
+
+    // Completes a partial frame with silence and hands it out, e.g. when the device stops.
+    // Returns false if no samples were pending.
+    template <typename OnFrame>
+    bool flush(OnFrame&& onFrame)
+    {
+        if(m_Filled == 0) {
+            return false;
+        }
+        std::fill(m_Current.begin() + m_Filled, m_Current.end(), 0);
+        m_Filled = 0;
+        m_Current.traceId = m_NextTraceId++;
+        onFrame(m_Current);
+        return true;
+    }
+
+    // Sample frames (per channel) waiting for the rest of their frame
+    size_t pendingFrames() const { return m_Filled / m_Channels; }
+
+    // traceId of the frame being filled, the capture span tag
+    int64_t nextTraceId() const { return m_NextTraceId; }
+
+private:
+    size_t m_FrameSamples;
+    int m_Channels;
+    AudioFrame m_Current;
+    size_t m_Filled = 0;    // samples of m_Current already written
+    int64_t m_NextTraceId = 0;
+};
+
+// Playback side: fills device buffers of any size from a sequence of decoded frames of any
+// size. The frame being played out is kept with a read offset, so a frame larger than the
+// device buffer is spread over several callbacks instead of being truncated.
+class FrameSplitter
+{
+public:
+    explicit FrameSplitter(int channels) : m_Channels(channels) {}
+
+    // Fills `frames` interleaved sample frames of `out`, taking the next decoded frame with
+    // nextFrame(AudioFrame&) -> bool whenever the current one is used up. Returns the number
+    // of sample frames filled with silence because nextFrame had nothing.
+    template <typename NextFrame>
+    size_t pull(opus_int16* out, size_t frames, NextFrame&& nextFrame)
+    {
+        m_FirstTraceId = -1;
+        size_t needed = frames * m_Channels;
+        while(needed > 0) {
+            if(m_Offset == m_Current.size()) {
+                m_Offset = 0;
+                if(!nextFrame(m_Current)) {
+                    m_Current.clear();
+                    break;
+                }
+                continue;
+            }
+            if(m_FirstTraceId < 0) {
+                m_FirstTraceId = m_Current.traceId;
+            }
+            const size_t chunk = std::min(needed, m_Current.size() - m_Offset);
+            std::copy(m_Current.data() + m_Offset, m_Current.data() + m_Offset + chunk, out);
+            m_Offset += chunk;
+            out += chunk;
+            needed -= chunk;
+        }
+        std::fill(out, out + needed, 0);
+        return needed / m_Channels;
+    }
+
+    // Sample frames (per channel) left of the frame being played out
+    size_t bufferedFrames() const { return (m_Current.size() - m_Offset) / m_Channels; }
+
+    // traceId of the first frame the last pull() played from, -1 if it played only silence
+    int64_t firstTraceId() const { return m_FirstTraceId; }
+
+private:
+    int m_Channels;
+    AudioFrame m_Current;
+    size_t m_Offset = 0;    // samples of m_Current already played
+    int64_t m_FirstTraceId = -1;
+};
+
+#endif // AUDIO_REFRAMER_HPP
@@ -0,0 +1,194 @@
+#ifndef BRIDGE_HPP
+#define BRIDGE_HPP
+
+#include "MediaCrypto.hpp"
+#include "Metrics.hpp"
+#include "PacketHeader.hpp"
+#include "Redundancy.hpp"
+#include "SpeakerSelector.hpp"
+#include "interfaces/ITransport.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Conference bridge: every participant's audio datagrams are forwarded to all other
+// participants (not mixed), and bridges on other nodes link up through trunks so one room
+// spans several server processes.
+//
+// A trunk is one UDP association between two bridges. Everything one bridge forwards to another
+// is bundled into trunk datagrams of up to kMaxTrunkDatagramSize bytes, flushed every
+// BridgeConfig::flushMs, so the packet rate between nodes doesn't grow with the number of streams:
+//
+//   PacketHeader    type Trunk, sequence +1 per trunk datagram, SSRC = id of the sending bridge
+//   entries         u32 origin bridge id | u8 hops | u16 length | the audio datagram as received
+//
+// Loops are broken three ways: an entry is never sent back over the trunk it came in on, a
+// bridge drops entries it originated itself or that went through kMaxHops trunks, and every
+// stream's recent sequence numbers are remembered so a copy arriving over a second path is
+// dropped. A stream is its SSRC together with its source, the participant that sends it or the
+// bridge it entered the trunks at; a second source picking an SSRC in use is dropped, not merged
+// into the first one's stream, until that one has been silent for the timeout. A header-only trunk datagram is sent as keepalive, so a bridge learns about trunks
+// only the far end configured.
+//
+// With BridgeConfig::maxSpeakers, a SpeakerSelector ranks all streams the bridge sees and only the
+// loudest go to participants and trunks. Datagrams are forwarded with the sender's sequence
+// numbers, which a sealed stream's nonce is made of; the first kResumeMarks datagrams after a
+// stream was left out carry PacketHeader::kFlagResumed instead, so the gap doesn't read as loss.
+struct BridgeConfig
+{
+    // Trunks to open, as "ip:port"; bridges that trunk to us are learned from their datagrams
+    std::vector<std::string> trunks;
+
+    int flushMs = 5;            // longest an entry waits for others to share its trunk datagram
+
+    // Tree: streams from one trunk are passed on to the others. Mesh (every bridge trunks to
+    // every other): only local participants' streams go out, each bridge hears all directly.
+    bool mesh = false;
+
+    uint32_t nodeId = 0;        // 0 = random
+
+    // Forward only the N loudest streams, by the audio level in their headers (0 = all)
+    size_t maxSpeakers = 0;
+
+    // Splits "ip:port" into an endpoint; false if it isn't one
+    static bool parseTrunk(const std::string& text, asio::ip::udp::endpoint& endpoint);
+};
+
+namespace TrunkFormat {
+
+constexpr size_t kEntryHeaderSize = 7;
+
+struct Entry
+{
+    uint32_t origin;
+    uint8_t hops;
+    const unsigned char* data;
+    size_t size;
+};
+
+// Appends an entry to a trunk datagram
+void append(const Entry& entry, NetworkPacket& out);
+
+// Splits the entries after the PacketHeader; false if the datagram is malformed
+bool read(const unsigned char* data, size_t size, std::vector<Entry>& entries);
+
+} // namespace TrunkFormat
+
+class Bridge
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr uint8_t kMaxHops = 8;
+    static constexpr uint8_t kResumeMarks = 3;      // flagged datagrams after a gap, in case the first is lost
+    static constexpr size_t kMaxTrunkDatagramSize = 1200;   // never fragments
+    static constexpr std::chrono::milliseconds kKeepaliveInterval{1000};
+
+    // Participants and learned trunks silent for `timeout` are dropped. With a key, every
+    // datagram to a participant is sealed (trunks carry the streams as received).
+    Bridge(const BridgeConfig& config, ITransport& transport, const MediaKey* key, std::chrono::milliseconds timeout);
+
+    uint32_t nodeId() const { return m_NodeId; }
+
+    // Routes a received datagram: audio from a participant, or a trunk datagram from a bridge
+    void onDatagram(const Datagram& datagram, Clock::time_point now);
+
+    // Sends trunk datagrams that are due (flush interval, keepalives) and expires the silent
+    void tick(Clock::time_point now);
+
+private:
+    struct Participant
+    {
+        asio::ip::udp::endpoint endpoint;
+        Clock::time_point lastSeen;
+    };
+
+    struct Trunk
+    {
+        asio::ip::udp::endpoint endpoint;
+        bool configured = false;        // from BridgeConfig, kept while silent
+        Clock::time_point lastHeard;
+        Clock::time_point lastSent;
+        uint16_t sequence = 0;
+        NetworkPacket pending;          // trunk datagram being filled, header only when empty
+        size_t pendingEntries = 0;
+    };
+
+    // Where a stream comes from: a local participant, or the bridge it entered the trunks at
+    struct StreamSource
+    {
+        uint32_t origin = 0;
+        asio::ip::udp::endpoint participant;    // local streams only
+
+        bool operator==(const StreamSource& other) const
+        {
+            return origin == other.origin && participant == other.participant;
+        }
+    };
+
+    struct SeenStream
+    {
+        StreamSource source;        // the first to use the SSRC, others are dropped while it sends
+        bool collisionLogged = false;
+        DecodeHistory sequences;
+        Clock::time_point lastSeen;
+        uint8_t resumeMarks = 0;    // forwarded datagrams still to be flagged kFlagResumed
+    };
+
+    void onParticipantAudio(const Datagram& datagram, const PacketHeader& header, SeenStream& stream,
+        Clock::time_point now);
+    void onTrunkDatagram(const Datagram& datagram, uint32_t sender, Clock::time_point now);
+
+    // True if the stream is to be forwarded. A datagram left out makes the next ones resumed.
+    bool isSelected(const PacketHeader& header, SeenStream& stream, Clock::time_point now);
+    // Whether the forwarded datagram gets kFlagResumed, counts the marks down
+    static bool takeResumeMark(SeenStream& stream);
+
+    // Sends a media datagram of sender session `session` (sealing) to every participant but
+    // `except`, with kFlagResumed if `resumed`
+    void deliver(const unsigned char* data, size_t size, uint32_t rollover, uint64_t session, bool resumed,
+        const asio::ip::udp::endpoint* except);
+    // Adds an entry to every trunk but `except`, sending the ones that fill up
+    void forward(const TrunkFormat::Entry& entry, const Trunk* except, bool resumed, Clock::time_point now);
+    void sendTrunk(Trunk& trunk, Clock::time_point now);
+    void resetPending(Trunk& trunk);
+
+    Trunk* findTrunk(const asio::ip::udp::endpoint& endpoint);
+    void touchParticipant(const asio::ip::udp::endpoint& endpoint, Clock::time_point now);
+
+    // The stream the first time its sequence number shows up. Null for a copy, and for a second
+    // source using the SSRC of a stream that is still sending (both counted).
+    SeenStream* firstSighting(const StreamSource& source, uint32_t ssrc, uint16_t sequence, Clock::time_point now);
+
+    ITransport& m_Transport;
+    std::unique_ptr<MediaResealer> m_Sealer;    // null = participants get the clear datagrams
+    std::unique_ptr<SpeakerSelector> m_Speakers;    // null = every stream is forwarded
+    uint32_t m_NodeId;
+    bool b_Mesh;
+    std::chrono::milliseconds m_FlushInterval;
+    std::chrono::milliseconds m_Timeout;
+    Clock::time_point m_NextFlush;
+
+    std::vector<Participant> m_Participants;    // rooms are small, a scan beats hashing endpoints
+    std::vector<Trunk> m_Trunks;
+    std::unordered_map<uint32_t, SeenStream> m_SeenStreams;   // by SSRC
+    std::vector<TrunkFormat::Entry> m_Entries;
+    Datagram m_Outgoing;                        // delivery copy, sealed in place
+
+    MetricValue& m_ParticipantsMetric;      // bridge.participants
+    MetricValue& m_TrunksMetric;            // bridge.trunks
+    MetricValue& m_ForwardedMetric;         // bridge.forwarded: datagrams sent to participants
+    MetricValue& m_TrunkEntriesMetric;      // bridge.trunk_entries_sent
+    MetricValue& m_TrunkDatagramsMetric;    // bridge.trunk_datagrams_sent
+    MetricValue& m_LoopsMetric;             // bridge.loops_dropped: own or too many hops
+    MetricValue& m_DuplicatesMetric;        // bridge.duplicates_dropped: arrived over a second path
+    MetricValue& m_CollisionsMetric;        // bridge.ssrc_collisions: another source's SSRC, dropped
+    MetricValue& m_MalformedMetric;         // bridge.malformed
+};
+
+#endif // BRIDGE_HPP
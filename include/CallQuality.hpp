@@ -0,0 +1,68 @@
+#ifndef CALL_QUALITY_HPP
+#define CALL_QUALITY_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// E-model (ITU-T G.107) rating of one received stream, updated as its packets arrive:
+//
+//   R = 93.2 - Id - Ie,eff        Id: delay impairment, Ie,eff: codec and loss impairment
+//   Ie,eff = Ie + (95 - Ie) * Ppl / (Ppl / BurstR + Bpl)
+//   MOS = 1 + 0.035 R + R (R - 60) (100 - R) * 7e-6
+//
+// Ppl is the share of packets that had to be concealed (lost and not recovered from a redundant
+// copy), BurstR how bursty the loss is: 1 for random loss, more when losses cluster, from a
+// two-state Markov model of the receive sequence. Id uses the Cole-Rosenbluth approximation on
+// the mouth-to-ear delay: network one-way delay (once the sender's clock is known), packet time
+// and the decoded audio queued ahead of playback. Opus has no Ie/Bpl values in G.113, Ie is a
+// rough fit over the bitrate and Bpl that of a codec with packet loss concealment.
+//
+// Every update is O(1): the counters are halved whenever kWindowPackets arrived, so the figure
+// follows the last one to two windows (20-40 s at 20 ms packets) rather than the whole call.
+class CallQuality
+{
+public:
+    static constexpr uint64_t kWindowPackets = 1000;
+    static constexpr double kLossRobustness = 25.0;     // Bpl
+    static constexpr double kPoorMos = 3.1;             // below: "many users dissatisfied" (G.109)
+
+    void reset() { *this = CallQuality{}; }
+
+    // A packet arrived after `missing` packets that never did (so far)
+    void onReceived(uint32_t missing);
+    // A packet counted missing arrived after all; `recovered` if a redundant copy stood in for it
+    void onLate(bool recovered);
+    // A missing packet was decoded from a redundant copy
+    void onRecovered();
+
+    // A payload of `bytes` carrying `samples` per channel was decoded (codec bitrate)
+    void onPayload(size_t bytes, int samples, int sampleRate);
+
+    void setNetworkDelayMs(double ms) { m_NetworkDelayMs = ms; }
+    void setPlayoutDelayMs(double ms);      // smoothed, it is sampled per packet
+    void setPacketTimeMs(double ms) { m_PacketTimeMs = ms; }
+
+    double lossPercent() const;             // Ppl, concealed share
+    double burstRatio() const;              // BurstR
+    double bitrateKbps() const { return m_BitrateKbps; }
+    double mouthToEarMs() const;
+
+    double rFactor() const;
+    double mos() const { return toMos(rFactor()); }
+
+    static double toMos(double r);
+
+private:
+    void halveIfFull();
+
+    double m_Received = 0.0;
+    double m_Missing = 0.0;         // net of late arrivals
+    double m_Recovered = 0.0;
+    double m_LossEvents = 0.0;      // received -> missing transitions, one per gap
+    double m_BitrateKbps = -1.0;    // -1 until the first payload
+    double m_NetworkDelayMs = 0.0;
+    double m_PlayoutDelayMs = -1.0; // -1 until the first sample
+    double m_PacketTimeMs = 0.0;
+};
+
+#endif // CALL_QUALITY_HPP
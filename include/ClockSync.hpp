@@ -0,0 +1,135 @@
+#ifndef CLOCK_SYNC_HPP
+#define CLOCK_SYNC_HPP
+
+#include "Metrics.hpp"
+#include "PacketHeader.hpp"
+
+#include <asio.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+
+// Clock messages share the media socket and start with a PacketHeader (type ClockPing or
+// ClockPong). The header's timestamp and SSRC carry the sender's media anchor: the media
+// timestamp of the last audio packet it sent on stream SSRC (0 if none yet), sent at
+// anchorNs on its wall clock. All times are ns since the Unix epoch, big endian:
+//
+//     ping:  header | u64 originNs (ping sent) | u64 anchorNs
+//     pong:  header (sequence of the ping) | u64 originNs (copied from the ping)
+//            | u64 receiveNs (ping received) | u64 transmitNs (pong sent) | u64 anchorNs
+//
+// With a media key both end in a kTagSize HMAC tag, see ClockAuthenticator in MediaCrypto.hpp.
+struct ClockMessage
+{
+    static constexpr size_t kPingSize = PacketHeader::kSize + 16;
+    static constexpr size_t kPongSize = PacketHeader::kSize + 32;
+    static constexpr size_t kTagSize = 16;
+
+    PacketHeader header;
+    int64_t originNs = 0;
+    int64_t receiveNs = 0;      // pong only
+    int64_t transmitNs = 0;     // pong only
+    int64_t anchorNs = 0;
+
+    // Writes kPingSize or kPongSize bytes depending on header.type, returns the size
+    size_t write(unsigned char* out) const;
+    // false if `data` is not a complete clock message
+    static bool read(const unsigned char* data, size_t len, ClockMessage& message);
+};
+
+// Media timestamp `timestamp` of stream `ssrc` was sent at `wallNs` on the sender's clock
+struct MediaAnchor
+{
+    uint32_t ssrc = 0;
+    uint32_t timestamp = 0;
+    int64_t wallNs = 0;
+};
+
+struct ClockEstimate
+{
+    int64_t offsetNs = 0;       // peer clock - local clock
+    int64_t rttNs = 0;          // network round trip, the peer's turnaround excluded
+    size_t samples = 0;         // exchanges the estimate is based on
+};
+
+// NTP-style clock offset and round-trip estimation per peer endpoint. Every exchange gives
+//     offset = ((t2 - t1) + (t3 - t4)) / 2,   rtt = (t4 - t1) - (t3 - t2)
+// with t1/t4 taken on this host and t2/t3 on the peer (receive times are kernel timestamps).
+// Queueing delay only ever inflates the RTT and skews the offset with it, so the estimate
+// is the exchange with the lowest RTT among the last kFilterSamples (NTP's clock filter).
+// Peers are remembered while they keep exchanging pings; both sides ping each other, so both
+// learn the offset. Only a pong that answers the last ping sent to its peer (same sequence and
+// origin time) counts, anything else is dropped as stale or forged.
+// Messages are handled on the network thread, estimates can be read from any thread.
+class ClockSync
+{
+public:
+    static constexpr std::chrono::milliseconds kPingInterval{1000};
+    static constexpr std::chrono::seconds kPeerTimeout{30};
+    static constexpr size_t kFilterSamples = 8;
+    static constexpr size_t kMaxPeers = 4096;
+
+    ClockSync();
+
+    ClockSync(const ClockSync&) = delete;
+    ClockSync& operator=(const ClockSync&) = delete;
+
+    // A ping arrived: remembers the peer (it is pinged back from now on) and its media
+    // anchor, and fills in the pong to answer with (transmitNs is left for the sender)
+    void onPing(const asio::ip::udp::endpoint& peer, const ClockMessage& ping, int64_t receivedNs,
+        const MediaAnchor& localAnchor, ClockMessage& pong);
+    // A ping went out to `peer` (originNs set): the pong to expect from it
+    void onPingSent(const asio::ip::udp::endpoint& peer, const ClockMessage& ping);
+    // A pong arrived: adds the exchange to the peer's filter if it answers the outstanding ping
+    void onPong(const asio::ip::udp::endpoint& peer, const ClockMessage& pong, int64_t receivedNs);
+
+    // Fills in the next ping (originNs is left for the sender)
+    void makePing(const MediaAnchor& localAnchor, ClockMessage& ping);
+    // Peers to ping this round (`always` included); forgets peers silent for kPeerTimeout
+    std::vector<asio::ip::udp::endpoint> pingTargets(const asio::ip::udp::endpoint& always, int64_t nowNs);
+
+    // Filtered offset/RTT to `peer`, false before the first exchange completed
+    bool estimate(const asio::ip::udp::endpoint& peer, ClockEstimate& estimate) const;
+    // Local wall clock time (ns since the epoch) at which the peer sent media timestamp
+    // `timestamp` of stream `ssrc`, false without a clock estimate or media anchor for it
+    bool toLocalTime(const asio::ip::udp::endpoint& peer, uint32_t ssrc, uint32_t timestamp, int sampleRate,
+        int64_t& localNs) const;
+
+private:
+    struct Exchange
+    {
+        int64_t offsetNs = 0;
+        int64_t rttNs = 0;
+    };
+
+    struct PeerClock
+    {
+        std::array<Exchange, kFilterSamples> exchanges;
+        size_t exchangeCount = 0;       // total, the filter holds the last kFilterSamples
+        ClockEstimate estimate;
+        MediaAnchor anchor;
+        int64_t lastHeardNs = 0;
+        int64_t pendingOriginNs = 0;    // of the ping awaiting its pong, 0 if none
+        uint16_t pendingSequence = 0;
+    };
+
+    // The peer's entry, created (counting as heard at `nowNs`) if there is room
+    PeerClock* find(const asio::ip::udp::endpoint& peer, int64_t nowNs);
+
+    mutable std::mutex m_Mutex;
+    std::map<asio::ip::udp::endpoint, PeerClock> m_Peers;
+    uint16_t m_NextSequence = 0;
+
+    MetricValue& m_PeersMetric;
+    MetricValue& m_PingsMetric;
+    MetricValue& m_PongsMetric;
+    MetricValue& m_UnmatchedMetric;
+    MetricValue& m_RttMetric;
+    MetricValue& m_OffsetMetric;
+};
+
+#endif // CLOCK_SYNC_HPP
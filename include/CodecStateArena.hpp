@@ -0,0 +1,62 @@
+#ifndef CODEC_STATE_ARENA_HPP
+#define CODEC_STATE_ARENA_HPP
+
+#include "Metrics.hpp"
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+// Slab allocator for Opus encoder/decoder states.
+// States are carved out of cache-line aligned slabs, one pool per (rounded) state size, so
+// thousands of streams sit next to each other instead of being scattered over the heap.
+// Released blocks go back to their pool and are handed out again before a new slab is
+// allocated; slabs are only freed when the arena is destroyed, so memory is bounded by the
+// peak number of simultaneous streams.
+class CodecStateArena
+{
+public:
+    static constexpr size_t kAlignment = 64;        // cache line
+    static constexpr size_t kFirstSlabBlocks = 4;   // slabs double in size up to kMaxSlabBlocks
+    static constexpr size_t kMaxSlabBlocks = 256;
+
+    // Process-wide arena used by AudioCodec
+    static CodecStateArena& instance();
+
+    CodecStateArena();
+    ~CodecStateArena();
+
+    CodecStateArena(const CodecStateArena&) = delete;
+    CodecStateArena& operator=(const CodecStateArena&) = delete;
+
+    // Returns a kAlignment aligned block of at least `size` bytes. Throws std::bad_alloc.
+    void* allocate(size_t size);
+    // Returns a block from allocate() with the same `size` to its pool
+    void deallocate(void* block, size_t size);
+
+    size_t bytesReserved() const;   // total size of all slabs
+    size_t blocksInUse() const;
+
+private:
+    struct Pool
+    {
+        size_t blockSize;
+        size_t nextSlabBlocks;
+        std::vector<void*> freeBlocks;   // LIFO: the most recently released (cache-warm) block is reused first
+    };
+
+    static size_t roundToAlignment(size_t size) { return (size + kAlignment - 1) & ~(kAlignment - 1); }
+    Pool& poolFor(size_t blockSize);
+    void addSlab(Pool& pool);
+
+    mutable std::mutex m_Mutex;
+    std::vector<Pool> m_Pools;          // a handful of size classes (encoder/decoder x mono/stereo)
+    std::vector<void*> m_Slabs;
+    size_t m_BytesReserved = 0;
+    size_t m_BlocksInUse = 0;
+
+    MetricValue& m_BytesReservedMetric;
+    MetricValue& m_BlocksInUseMetric;
+};
+
+#endif // CODEC_STATE_ARENA_HPP
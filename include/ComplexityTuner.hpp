@@ -0,0 +1,45 @@
+#ifndef COMPLEXITY_TUNER_HPP
+#define COMPLEXITY_TUNER_HPP
+
+#include <chrono>
+
+// Keeps the Opus encoder inside a CPU budget.
+// Fed with the measured encode time of every frame, it tracks the smoothed share of the
+// frame period spent encoding and steps OPUS_SET_COMPLEXITY down when that share exceeds
+// the budget, and back up when there is plenty of headroom again.
+// Hysteresis: going down needs a short streak over budget, going up a long streak below
+// half the budget, and every change is followed by a cooldown.
+class ComplexityTuner
+{
+public:
+    static constexpr int kMinComplexity = 0;
+    static constexpr int kMaxComplexity = 10;
+
+    // budgetShare: allowed fraction of the frame period spent in the encoder (0, 1]
+    ComplexityTuner(int initialComplexity, double budgetShare);
+
+    // Records one encode and returns the complexity to use for the next frame.
+    int update(std::chrono::nanoseconds encodeTime, std::chrono::nanoseconds framePeriod);
+
+    int getComplexity() const { return m_Complexity; }
+    double getBudgetShare() const { return m_BudgetShare; }
+    double getLoad() const { return m_Load; }   // smoothed encode time / frame period
+
+private:
+    static constexpr double kLoadSmoothing = 1.0 / 16.0;  // EWMA weight of the newest frame
+    static constexpr double kRaiseThreshold = 0.5;        // raise below this share of the budget
+    static constexpr int kLowerStreak = 8;                // frames over budget before lowering
+    static constexpr int kRaiseStreak = 200;              // frames with headroom before raising
+    static constexpr int kCooldownFrames = 50;            // frames to settle after a change
+
+    int m_Complexity;
+    double m_BudgetShare;
+    double m_Load = 0.0;
+    bool b_LoadPrimed = false;
+
+    int m_OverBudgetFrames = 0;
+    int m_HeadroomFrames = 0;
+    int m_Cooldown = 0;
+};
+
+#endif // COMPLEXITY_TUNER_HPP
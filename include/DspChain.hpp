@@ -0,0 +1,92 @@
+#ifndef DSP_CHAIN_HPP
+#define DSP_CHAIN_HPP
+
+#include "Metrics.hpp"
+#include "PerfCounters.hpp"
+#include "interfaces/IAudioSource.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Which processors a DspChain runs and their settings, parsed from a comma separated spec:
+//     "dc,gate,agc,limiter", "all", "agc=-20,gate=-45", "off"
+// A value after '=' sets the processor's level in dBFS (gate threshold, AGC target RMS,
+// limiter ceiling).
+struct DspConfig
+{
+    bool dcFilter = false;          // removes a constant offset, tracked over about a second
+    bool noiseGate = false;         // attenuates frames quieter than gateThresholdDb by 40 dB
+    bool agc = false;               // steers the speech level towards agcTargetDb
+    bool limiter = false;           // keeps peaks below limiterCeilingDb
+
+    float gateThresholdDb = -50.0f;
+    float agcTargetDb = -20.0f;
+    float agcMaxGainDb = 24.0f;
+    float limiterCeilingDb = -1.0f;
+
+    bool enabled() const { return dcFilter || noiseGate || agc || limiter; }
+
+    // Returns false (config unchanged) on an unknown processor or a malformed value
+    static bool parse(const std::string& spec, DspConfig& config);
+    std::string describe() const;
+};
+
+// Float32 processing of one stream's captured frames ahead of the encoder: DC filter, noise
+// gate, AGC and limiter, in that order. The 16-bit input is converted once and the float result
+// goes to opus_encode_float, so the gain stages don't requantize.
+//
+// All processors work per frame: one pass converts the frame, removes the DC estimate and
+// measures the RMS and peak; the gate, AGC and limiter gains are then combined into one gain
+// ramped linearly across the frame, applied in a second pass. Both passes run with AVX2 when the
+// CPU has it (checked once at runtime), otherwise SSE2, or scalar code on other targets.
+//
+// The time each frame takes is published as <prefix>.frame_ns (smoothed) and
+// <prefix>.frame_ns_max, for budgeting streams on a busy host.
+class DspChain
+{
+public:
+    // Throws std::invalid_argument unless the channel count divides 8 (1, 2, 4 or 8)
+    DspChain(int sampleRate, int channels, int frameSize, const DspConfig& config,
+        const std::string& metricPrefix = "dsp");
+
+    // Processes one frame of frameSize interleaved samples per channel into `out`
+    // (same layout, full scale = 1.0)
+    void process(const opus_int16* in, float* out);
+
+    const DspConfig& config() const { return m_Config; }
+    int64_t lastFrameNs() const { return m_LastFrameNs; }
+    // Name of the kernels in use: "avx2", "sse" or "scalar"
+    static const char* kernelName();
+
+private:
+    void updateGains(float rms, float peak, float& gainStart, float& gainEnd);
+
+    DspConfig m_Config;
+    int m_Channels;
+    int m_FrameSize;
+    double m_FrameSeconds;
+
+    // Per channel, repeated across the 8 lanes of a vector (lane l holds channel l % channels)
+    float m_DcLanes[8] = {};
+    bool b_DcInitialized = false;
+
+    // Gains of the last sample of the previous frame, where the next ramp starts
+    bool b_GateOpen = false;
+    int m_GateHoldFrames = 0;
+    float m_GateGain = 1.0f;
+    float m_AgcLevelDb;
+    float m_AgcGainDb = 0.0f;
+    float m_LimiterGain = 1.0f;
+
+    int64_t m_LastFrameNs = 0;
+    double m_SmoothedFrameNs = 0.0;
+    MetricValue& m_FrameNsMetric;
+    MetricValue& m_FrameNsMaxMetric;
+    MetricValue& m_GateOpenMetric;
+    MetricValue& m_AgcGainMetric;       // dB
+    MetricValue& m_LimitedFramesMetric;
+    PerfSite& m_Perf;                   // perf.<prefix>.*
+};
+
+#endif // DSP_CHAIN_HPP
@@ -0,0 +1,112 @@
+#ifndef ECHO_CANCELLER_HPP
+#define ECHO_CANCELLER_HPP
+
+#include "Fft.hpp"
+#include "Metrics.hpp"
+
+#include "opus_types.h"
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+// Acoustic echo canceller: removes the far end's audio, played by the speakers and picked up
+// again by the microphone, from the captured signal before it is encoded.
+//
+// A partitioned-block frequency-domain adaptive filter (PBFDAF, overlap-save): the echo path is
+// modelled by an FIR filter of tailMs, cut into partitions of kBlockSize taps that are applied
+// and adapted in the frequency domain, one FFT of 2 * kBlockSize per block instead of one per
+// tail length. This keeps the added latency at one block (2.7 ms at 48 kHz) for any tail.
+// Per frequency bin, the update is NLMS normalized by the smoothed far-end power; the filter
+// is constrained back to kBlockSize taps per partition round-robin, a few partitions per block.
+//
+// The reference is the decoded far-end audio on its way to playback (mixed down to mono),
+// every captured channel gets its own filter. The delay between the two, output buffering and
+// the acoustic path, has to fit in the tail. There is no residual echo suppression, what the
+// linear filter can't model (speaker distortion) is left in.
+class EchoCanceller
+{
+public:
+    static constexpr size_t kBlockSize = 128;
+    static constexpr int kDefaultTailMs = 200;
+    static constexpr int kMaxTailMs = 1000;
+
+    EchoCanceller(int sampleRate, int channels, int tailMs = kDefaultTailMs);
+
+    EchoCanceller(const EchoCanceller&) = delete;
+    EchoCanceller& operator=(const EchoCanceller&) = delete;
+
+    // Far end: `frames` interleaved sample frames about to be played. Called from any thread.
+    void addReference(const opus_int16* pcm, size_t frames);
+
+    // Near end: cancels the echo in `frames` interleaved captured sample frames, in place.
+    // The output lags the input by kBlockSize samples. Called from one thread.
+    void process(opus_int16* pcm, size_t frames);
+
+    size_t partitions() const { return m_Partitions; }
+    // Echo return loss enhancement over the last second of far-end activity, in dB
+    double erleDb() const { return m_ErleDb; }
+
+private:
+    static constexpr size_t kFftSize = 2 * kBlockSize;
+    static constexpr size_t kBins = kBlockSize + 1;
+    static constexpr size_t kBinStride = (kBins + 3) & ~size_t(3);     // bins padded to whole SSE vectors
+
+    struct ChannelState
+    {
+        std::vector<float> weightsRe;   // partitions x kBinStride
+        std::vector<float> weightsIm;
+        std::vector<float> nearBlock;   // kBlockSize samples being collected
+        double nearEnergy = 0.0;        // smoothed over far-active blocks, for the ERLE
+        double errorEnergy = 0.0;
+    };
+
+    void processBlock();
+    void filterAndAdapt(ChannelState& channel);
+    // Forces partition `partition` of `channel` back to kBlockSize taps
+    void constrain(ChannelState& channel, size_t partition);
+    // Pops kBlockSize reference samples into the second half of m_FarTime
+    void takeReference();
+
+    int m_SampleRate;
+    int m_Channels;
+    size_t m_Partitions;
+    RealFft m_Fft;
+
+    // Far end reference FIFO, mono, filled by addReference()
+    std::mutex m_ReferenceMutex;
+    std::vector<float> m_Reference;     // ring of m_ReferenceCapacity samples
+    size_t m_ReferenceCapacity;
+    size_t m_ReferenceRead = 0;
+    size_t m_ReferenceCount = 0;
+    bool b_ReferenceStarted = false;
+
+    // Far end spectra of the last m_Partitions blocks, newest at m_Newest
+    std::vector<float> m_FarRe;         // partitions x kBinStride
+    std::vector<float> m_FarIm;
+    size_t m_Newest = 0;
+    std::vector<float> m_FarTime;       // last two reference blocks
+    std::vector<float> m_FarPower;      // smoothed |X|^2 per bin
+    bool b_FarActive = false;           // far end above the noise floor this block
+
+    std::vector<ChannelState> m_State;
+    size_t m_Fill = 0;                  // sample frames collected for the current block
+    std::vector<opus_int16> m_Output;   // previous block's output, interleaved, played while collecting
+    size_t m_NextConstrained = 0;
+    double m_ErleDb = 0.0;
+
+    // Work buffers, one block
+    std::vector<float> m_TimeBuffer;
+    std::vector<float> m_SpecRe;
+    std::vector<float> m_SpecIm;
+    std::vector<float> m_StepRe;
+    std::vector<float> m_StepIm;
+
+    MetricValue& m_BlocksMetric;
+    MetricValue& m_ErleMetric;
+    MetricValue& m_UnderrunMetric;
+    MetricValue& m_OverrunMetric;
+    MetricValue& m_ResetMetric;
+};
+
+#endif // ECHO_CANCELLER_HPP
@@ -0,0 +1,52 @@
+#ifndef FFT_HPP
+#define FFT_HPP
+
+#include <cstddef>
+#include <vector>
+
+// Real-input FFT of a power-of-two size N, for block DSP such as the echo canceller.
+//
+// Spectra are split: separate real and imaginary arrays holding bins 0..N/2. Internally this
+// is a complex FFT of N/2 points on the even/odd samples (Stockham autosort, so no bit
+// reversal pass) followed by the usual split step. Every Stockham stage reads and writes
+// contiguous runs with one twiddle per run, so with SSE each instruction does four
+// butterflies; other targets run the same loops in scalar code.
+//
+// An instance keeps its work buffers, so it is cheap to call but not thread-safe.
+class RealFft
+{
+public:
+    // `size` must be a power of two of at least 16
+    explicit RealFft(size_t size);
+
+    size_t size() const { return m_Size; }
+    size_t bins() const { return m_Half + 1; }
+
+    // size() samples -> bins() values in re and im (im[0] and im[size() / 2] are 0)
+    void forward(const float* in, float* re, float* im);
+    // bins() values -> size() samples, scaled by 1/size() so it exactly inverts forward().
+    // The imaginary parts of bin 0 and bin size() / 2 are ignored.
+    void inverse(const float* re, const float* im, float* out);
+
+private:
+    // Complex FFT of m_Half points of (m_WorkRe, m_WorkIm); returns the buffers with the result
+    void transform(float*& re, float*& im);
+
+    size_t m_Size;
+    size_t m_Half;      // complex points
+    size_t m_Stages;
+
+    // Stockham twiddles, m_Half / 2 per stage, one per butterfly
+    std::vector<float> m_StageRe;
+    std::vector<float> m_StageIm;
+    // exp(-2 pi i k / N), k < m_Half, for the split step
+    std::vector<float> m_SplitRe;
+    std::vector<float> m_SplitIm;
+
+    std::vector<float> m_WorkRe;
+    std::vector<float> m_WorkIm;
+    std::vector<float> m_ScratchRe;
+    std::vector<float> m_ScratchIm;
+};
+
+#endif // FFT_HPP
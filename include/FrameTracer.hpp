@@ -0,0 +1,115 @@
+#ifndef FRAME_TRACER_HPP
+#define FRAME_TRACER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Optional timeline of what every thread did with every frame: device callbacks, queue waits,
+// stage work, codec calls and socket handlers, written as Chrome trace-event JSON that
+// chrome://tracing and ui.perfetto.dev open. Histograms say that frames were late, the timeline
+// shows where one particular frame spent its time.
+//
+// Each thread records complete spans (begin and end) into its own ring buffer, registered under
+// a lock the first time the thread records and never touched by another thread until write().
+// Threads the program starts register at their start (nameThread); a callback thread of an audio
+// API gets a buffer reserved before the stream starts (reserveThread) and adopts it, so the
+// callback never allocates. From then on recording is a clock read and a store, no lock and no
+// allocation; a thread that records more than kEventsPerThread spans keeps the latest ones. Spans carry the frame they belong to as an
+// argument: "frame", the AudioFrame::traceId (capture count up to encode, packet sequence from
+// decode on), or "seq", the packet sequence of datagrams. The encode span of a packet is nested
+// in the consume span of the frame that completed it, which maps capture counts to sequences.
+//
+// Costs: built without ECHOLINK_FRAME_TRACE, TraceScope is an empty object. Built with it
+// (the default) but not enabled at runtime, a scope costs one relaxed atomic load.
+
+struct TraceBuffer;     // one thread's spans, FrameTracer.cc
+
+struct TraceEvent
+{
+    const char* category = nullptr;     // string literals, they are written out after the fact
+    const char* name = nullptr;
+    const char* argName = nullptr;      // "seq", "frame" or nullptr
+    int64_t arg = 0;
+    int64_t beginNs = 0;                // steady clock
+    int64_t endNs = 0;
+};
+
+class FrameTracer
+{
+public:
+    static constexpr size_t kEventsPerThread = 1 << 16;
+
+    // Turns recording on for all threads (off by default)
+    static void enable();
+    static bool enabled() { return s_Enabled.load(std::memory_order_relaxed); }
+
+    static int64_t nowNs();
+
+    // Appends a span to the calling thread's buffer
+    static void record(const TraceEvent& event);
+
+    // Names the calling thread's track in the timeline, if it has no name yet. Registers the
+    // thread's buffer, so call it where the thread starts rather than on a real-time path.
+    static void nameThread(const char* name);
+
+    // A buffer for a thread the program doesn't start, e.g. a device callback: reserve it before
+    // the callback can run and adoptThread() it from the callback. Null while not enabled.
+    static TraceBuffer* reserveThread(const char* name);
+
+    // Makes the calling thread record into `buffer` unless it has its own; lock-free, null is fine
+    static void adoptThread(TraceBuffer* buffer);
+
+    // Writes the spans of all threads as Chrome trace-event JSON. Call once the recording
+    // threads have stopped. False if the file can't be written (logged).
+    static bool write(const std::string& path);
+
+private:
+    static std::atomic_bool s_Enabled;
+};
+
+// Records the enclosing scope as one span
+class TraceScope
+{
+public:
+#ifdef ECHOLINK_FRAME_TRACE
+    TraceScope(const char* category, const char* name, const char* argName = nullptr, int64_t arg = 0)
+    {
+        if(FrameTracer::enabled()) {
+            m_Event.category = category;
+            m_Event.name = name;
+            m_Event.argName = argName;
+            m_Event.arg = arg;
+            m_Event.beginNs = FrameTracer::nowNs();
+        }
+    }
+
+    ~TraceScope()
+    {
+        if(m_Event.category) {
+            m_Event.endNs = FrameTracer::nowNs();
+            FrameTracer::record(m_Event);
+        }
+    }
+
+    // Sets the frame the span belongs to once it is known, e.g. after a queue pop
+    void tag(const char* argName, int64_t arg)
+    {
+        m_Event.argName = argName;
+        m_Event.arg = arg;
+    }
+#else
+    TraceScope(const char*, const char*, const char* = nullptr, int64_t = 0) {}
+    void tag(const char*, int64_t) {}
+#endif
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+#ifdef ECHOLINK_FRAME_TRACE
+private:
+    TraceEvent m_Event;
+#endif
+};
+
+#endif // FRAME_TRACER_HPP
@@ -0,0 +1,153 @@
+#ifndef LATENCY_PROBE_HPP
+#define LATENCY_PROBE_HPP
+
+#include "Metrics.hpp"
+#include "NullAudioDevice.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Active end-to-end latency measurement. The "probe" source injects a known burst once per
+// kBurstPeriod, the "probe" sink cross-correlates what it plays against the same burst and
+// times the arrival, so the result covers everything in between (framing, codec, jitter
+// buffering, the network) exactly as configured. Both probe ends must run in the same process
+// since they share the clock; the path between them can leave it, e.g. to a reflecting server.
+
+enum class ProbeSignal { Chirp, Mls };
+
+struct LatencySummary
+{
+    size_t bursts = 0;          // bursts measured
+    uint64_t missed = 0;        // bursts sent but never detected
+    double meanUs = 0.0;
+    double stddevUs = 0.0;
+    int64_t minUs = 0;
+    int64_t p50Us = 0;
+    int64_t p95Us = 0;
+    int64_t maxUs = 0;
+};
+
+// Bookkeeping shared by the probe source and sink: when each burst left the source and the
+// latencies measured so far. Thread-safe (the two ends run on their own clock threads).
+class LatencyProbe
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr std::chrono::milliseconds kBurstPeriod{1000};
+    static constexpr size_t kMaxPendingBursts = 64;
+
+    static LatencyProbe& instance();
+
+    // "chirp" (also the empty string) or "mls"
+    static bool parseSignal(const std::string& name, ProbeSignal& signal);
+    static const char* signalName(ProbeSignal signal);
+    // Reference burst with samples in [-1, 1]: a Hann-tapered linear chirp of ~40 ms or one
+    // period of a maximum length sequence of about the same length
+    static std::vector<float> makeReference(ProbeSignal signal, int sampleRate);
+
+    // Source side: the first sample of a burst was captured at `at`
+    void burstEmitted(Clock::time_point at);
+    // Sink side: the first sample of a burst was played at `at`. Matched to the latest burst
+    // emitted before it; earlier unmatched bursts count as missed. Returns the latency, or a
+    // negative duration if no burst was pending.
+    std::chrono::microseconds burstArrived(Clock::time_point at);
+
+    // Forgets all bursts and measurements (a new measurement run)
+    void reset();
+    // Statistics over the run so far, also published as latency.probe.* metrics
+    LatencySummary summary();
+    // Writes the summary line
+    void report(std::ostream& out, ProbeSignal signal);
+
+private:
+    LatencyProbe();
+
+    struct Emission
+    {
+        Clock::time_point at;
+        bool matched = false;
+    };
+
+    std::mutex m_Mutex;
+    std::deque<Emission> m_Emissions;
+    std::vector<int64_t> m_LatenciesUs;
+    double m_MeanUs = 0.0;      // running mean/variance (Welford)
+    double m_M2 = 0.0;
+    uint64_t m_Missed = 0;
+
+    MetricValue& m_SentMetric;
+    MetricValue& m_DetectedMetric;
+    MetricValue& m_MissedMetric;
+    MetricValue& m_LastMetric;
+    MetricValue& m_MeanMetric;
+    MetricValue& m_StddevMetric;
+    MetricValue& m_P95Metric;
+    MetricValue& m_MaxMetric;
+};
+
+// Clocked source that emits silence with a probe burst every kBurstPeriod, starting one period
+// in. Each burst's capture time is the time its first sample would have reached a microphone:
+// the frame is handed out at the end of its period, like a device callback.
+class ProbeAudioSource : public NullAudioSource
+{
+public:
+    static constexpr double kAmplitude = 0.5;
+
+    ProbeAudioSource(ProbeSignal signal, int sampleRate, int channels, int frameSize);
+    ~ProbeAudioSource() override;
+
+protected:
+    void fillFrame(AudioFrame& frame) override;
+
+private:
+    std::vector<opus_int16> m_Burst;
+    int64_t m_PeriodSamples;
+    int64_t m_SamplesCaptured = 0;
+};
+
+// Clocked sink that looks for the probe burst in channel 0 of what it plays. The normalized
+// cross-correlation is only evaluated where the signal energy is within 20 dB of a burst, so
+// the silence between bursts costs next to nothing; a burst is taken at the correlation peak
+// above kDetectionThreshold.
+class ProbeAudioPlayback : public NullAudioPlayback
+{
+public:
+    static constexpr double kDetectionThreshold = 0.5;
+
+    ProbeAudioPlayback(ProbeSignal signal, int sampleRate, int channels, int frameSize);
+    ~ProbeAudioPlayback() override;
+
+    bool start() override;
+    // Stops the clock and prints the latency summary
+    void stop() override;
+
+protected:
+    void renderFrame(const AudioFrame& frame) override;
+
+private:
+    ProbeSignal m_Signal;
+    std::vector<float> m_Reference;
+    double m_ReferenceNorm;
+    double m_GateEnergy;
+
+    // Last m_Reference.size() samples played, followed by the frame being analysed
+    std::vector<float> m_History;
+    double m_WindowEnergy = 0.0;    // sum of squares over the window ending at the last sample
+    int64_t m_SamplesPlayed = 0;
+
+    // Correlation peak being tracked (sample index of the burst start it implies)
+    bool b_Tracking = false;
+    double m_BestScore = 0.0;
+    int64_t m_BestStart = 0;
+    int64_t m_HoldUntil = 0;        // no new burst can start before this sample
+
+    bool b_Started = false;
+};
+
+#endif // LATENCY_PROBE_HPP
@@ -0,0 +1,230 @@
+#ifndef MEDIA_CRYPTO_HPP
+#define MEDIA_CRYPTO_HPP
+
+#include "Metrics.hpp"
+#include "NetworkManager.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+// Authenticated encryption of audio datagrams with AES-128-GCM (OpenSSL's EVP interface, which
+// picks the AES-NI/VAES and carry-less multiply code paths of the CPU). Only built with
+// libcrypto, see ECHOLINK_HAVE_OPENSSL; MediaKey::available() tells at runtime.
+//
+// A sealed datagram keeps its PacketHeader in the clear with kFlagEncrypted set and carries
+// the sender's session id and rollover counter after it:
+//
+//   bytes 0-11    PacketHeader (authenticated, not encrypted)
+//   bytes 12-19   session id: random per MediaSealer (authenticated)
+//   bytes 20-23   rollover counter: sequence number wraps so far (authenticated)
+//   bytes 24-     encrypted payload
+//   last 16       GCM tag
+//
+// The pre-shared secret only gives the master key. Every sealer draws a random 64-bit session id
+// and seals under its own session key and salt, HKDF-SHA256 over the master with the session id
+// as HKDF salt, so no two sessions share a key however often senders restart with sequence 0.
+// The 96-bit nonce is the session salt XOR (00 00 | SSRC | rollover counter | sequence), as in
+// SRTP's AES-GCM mode (RFC 7714): within a session, the SSRC and the packet index keep the nonces
+// apart. Only the sending session keeps them unique, senders in different sessions may well use
+// the same SSRC and packet index, so a relay reseals under one session per source session
+// (MediaResealer). Receivers derive a session's key the first time one of its datagrams
+// arrives and keep their replay windows per session and SSRC, so a recorded session is rejected
+// after its stream expired too, as long as the receiver still remembers the session.
+//
+// Clock messages (see ClockSync.hpp) carry nothing secret and stay in the clear, but with a key
+// they end in an HMAC-SHA256 tag (ClockAuthenticator) so nobody without it can forge offsets.
+
+struct evp_cipher_ctx_st;
+
+// AES key and nonce salt: the master derived from a pre-shared secret, or one session's
+struct MediaKey
+{
+    static constexpr size_t kKeySize = 16;
+    static constexpr size_t kSaltSize = 12;
+    static constexpr int kDerivationRounds = 100000;   // PBKDF2-HMAC-SHA256, the secret may be a passphrase
+
+    std::array<uint8_t, kKeySize> key{};
+    std::array<uint8_t, kSaltSize> salt{};
+
+    // Whether this build can encrypt at all
+    static bool available();
+
+    // Derives the master key and salt from `secret`; false if it is empty or encryption is unavailable
+    static bool derive(const std::string& secret, MediaKey& out);
+
+    // Derives the key and salt of session `session` from the master (HKDF-SHA256)
+    static bool deriveSession(const MediaKey& master, uint64_t session, MediaKey& out);
+};
+
+namespace MediaCrypto {
+
+constexpr size_t kSessionSize = 8;
+constexpr size_t kRolloverSize = 4;
+constexpr size_t kTagSize = 16;
+constexpr size_t kOverhead = kSessionSize + kRolloverSize + kTagSize;  // bytes a sealed datagram grows by
+
+} // namespace MediaCrypto
+
+// Encrypts outgoing datagrams in place under a session of its own. Keeps one cipher context
+// with the key schedule expanded once, so use one per sending thread.
+class MediaSealer
+{
+public:
+    explicit MediaSealer(const MediaKey& master);
+    ~MediaSealer();
+
+    MediaSealer(const MediaSealer&) = delete;
+    MediaSealer& operator=(const MediaSealer&) = delete;
+
+    // Encrypts an audio datagram with its rollover counter, growing it by MediaCrypto::kOverhead
+    // (no reallocation if the capacity is there). Returns false, leaving it unchanged, for
+    // anything but a cleartext audio datagram.
+    bool seal(Datagram& datagram);
+
+    uint64_t session() const { return m_Session; }
+
+private:
+    evp_cipher_ctx_st* m_Cipher;
+    uint64_t m_Session = 0;
+    MediaKey m_Key;                     // the session's
+    MetricValue& m_SealedMetric;        // crypto.sealed
+};
+
+// Seals relayed datagrams (reflector, bridge) under one session of its own per sender session.
+// A resealed datagram keeps its sender's SSRC and packet index, and so its nonce; the receive
+// path's replay window lets each index of a sender session through once, so every nonce of a
+// relay session seals one plaintext. Use one per sending thread.
+class MediaResealer
+{
+public:
+    static constexpr size_t kMaxSessions = 4096;        // sealers kept, least recently used go first
+
+    explicit MediaResealer(const MediaKey& master);
+
+    // Seals an opened datagram under the session that belongs to datagram.session. Returns
+    // false, leaving it unchanged, if it has no sender session or can't be sealed.
+    bool seal(Datagram& datagram);
+
+private:
+    struct Entry
+    {
+        std::unique_ptr<MediaSealer> sealer;
+        uint64_t lastUsed = 0;
+    };
+
+    MediaKey m_Master;
+    std::unordered_map<uint64_t, Entry> m_Sealers;     // by sender session
+    uint64_t m_Uses = 0;
+    MetricValue& m_SessionsMetric;      // crypto.reseal_sessions
+};
+
+// Authenticates and decrypts incoming datagrams in place and rejects replays. Use one per
+// receiving thread.
+class MediaOpener
+{
+public:
+    static constexpr uint64_t kReplayWindow = 64;       // packets behind the newest one still accepted
+    static constexpr size_t kMaxSessions = 4096;        // cipher contexts kept, least recently used go first
+    static constexpr size_t kMaxReplayWindows = 65536;  // (session, SSRC) windows remembered
+    static constexpr int kMaxNewSessionsPerSecond = 1000;   // key derivations for unknown session ids
+
+    explicit MediaOpener(const MediaKey& master);
+    ~MediaOpener();
+
+    MediaOpener(const MediaOpener&) = delete;
+    MediaOpener& operator=(const MediaOpener&) = delete;
+
+    // Checks the tag and decrypts: on success the datagram is a cleartext audio datagram again
+    // and its session and rollover counter are set. A session's key is derived on its first
+    // datagram and kept only once that one authenticates, so forged datagrams are dropped
+    // without taking up any state; unknown session ids beyond kMaxNewSessionsPerSecond are
+    // dropped without deriving. Returns false for unencrypted or forged datagrams.
+    bool open(Datagram& datagram);
+
+    // Replay check for an opened datagram, by its session and SSRC: false if the same packet
+    // index was accepted before or is too old to tell. Run it before the datagram gets a
+    // StreamId, so a replay doesn't open a stream for whoever sent it.
+    bool accept(const Datagram& datagram);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Session
+    {
+        evp_cipher_ctx_st* cipher = nullptr;
+        MediaKey key;
+        uint64_t lastUsed = 0;          // m_Uses at the last datagram, for eviction
+    };
+
+    struct WindowKey
+    {
+        uint64_t session;
+        uint32_t ssrc;
+        bool operator==(const WindowKey& other) const { return session == other.session && ssrc == other.ssrc; }
+    };
+
+    struct WindowKeyHash
+    {
+        size_t operator()(const WindowKey& key) const
+        {
+            return std::hash<uint64_t>()(key.session ^ (static_cast<uint64_t>(key.ssrc) * 0x9E3779B97F4A7C15ull));
+        }
+    };
+
+    struct ReplayWindow
+    {
+        uint64_t highest = 0;           // newest packet index (rollover << 16 | sequence)
+        uint64_t mask = 0;              // bit n = highest - n was accepted
+        uint64_t lastUsed = 0;
+    };
+
+    Session* findSession(uint64_t id);
+
+    MediaKey m_Master;
+    std::unordered_map<uint64_t, Session> m_Sessions;
+    std::unordered_map<WindowKey, ReplayWindow, WindowKeyHash> m_Windows;
+    Session m_Candidate;                // context for a session not yet authenticated
+    uint64_t m_Uses = 0;
+    Clock::time_point m_DerivationWindowStart;
+    int m_DerivationsInWindow = 0;
+    MetricValue& m_OpenedMetric;        // crypto.opened
+    MetricValue& m_AuthFailuresMetric;  // crypto.auth_failures
+    MetricValue& m_ReplaysMetric;       // crypto.replays
+    MetricValue& m_UnencryptedMetric;   // crypto.unencrypted_dropped
+    MetricValue& m_SessionsMetric;      // crypto.sessions: session keys held
+    MetricValue& m_ThrottledMetric;     // crypto.sessions_throttled: unknown sessions dropped unchecked
+};
+
+// Tags clock messages with a truncated HMAC-SHA256, under a key derived from the master with
+// a label of its own. Replays are caught by ClockSync: a pong has to answer a ping we sent.
+class ClockAuthenticator
+{
+public:
+    explicit ClockAuthenticator(const MediaKey& master);
+    ~ClockAuthenticator();
+
+    ClockAuthenticator(const ClockAuthenticator&) = delete;
+    ClockAuthenticator& operator=(const ClockAuthenticator&) = delete;
+
+    // Appends the tag to the `size` bytes at `data` (room for ClockMessage::kTagSize more
+    // needed), returns the new size, 0 if it can't be computed
+    size_t sign(unsigned char* data, size_t size) const;
+    // Checks the tag at the end of a received message: the size without it, 0 if it is wrong
+    // or missing (counted as net.clock.rejected)
+    size_t verify(const unsigned char* data, size_t size) const;
+
+private:
+    bool computeTag(const unsigned char* data, size_t size, unsigned char* tag) const;
+
+    std::array<uint8_t, 32> m_Key{};
+    bool b_Ready = false;
+    MetricValue& m_RejectedMetric;      // net.clock.rejected
+};
+
+#endif // MEDIA_CRYPTO_HPP
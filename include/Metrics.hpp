@@ -0,0 +1,44 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+using MetricValue = std::atomic<int64_t>;
+
+// Process-wide registry of named integer metrics (gauges and counters).
+// Modules look a metric up once and keep the returned reference, so the hot path
+// is a single relaxed atomic operation.
+class Metrics
+{
+public:
+    static Metrics& instance();
+
+    // Returns the metric with the given name, registering it (as 0) on first use.
+    // The reference stays valid for the lifetime of the process.
+    MetricValue& get(const std::string& name);
+
+    static void set(MetricValue& metric, int64_t value) { metric.store(value, std::memory_order_relaxed); }
+    static void add(MetricValue& metric, int64_t delta) { metric.fetch_add(delta, std::memory_order_relaxed); }
+
+    // Name-ordered copy of all metrics
+    std::vector<std::pair<std::string, int64_t>> snapshot() const;
+
+    // Writes "name value" lines
+    void dump(std::ostream& out) const;
+
+private:
+    Metrics() = default;
+
+    mutable std::mutex m_Mutex;
+    std::map<std::string, std::unique_ptr<MetricValue>> m_Metrics;
+};
+
+#endif // METRICS_HPP
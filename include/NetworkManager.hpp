@@ -3,41 +3,84 @@
 
 #include <asio.hpp>
 #include <asio/io_context.hpp>
+#include <chrono>
 #include <vector>
 
+#include "ClockSync.hpp"
+#include "FrameTracer.hpp"
+#include "Metrics.hpp"
+#include "PerfCounters.hpp"
+#include "StreamDirectory.hpp"
 #include "ThreadSafeQueue.hpp"
+#include "interfaces/ITransport.hpp"
 
-using NetworkPacket = std::vector<char>;
+class ClockAuthenticator;
+class MediaOpener;
+struct MediaKey;
+class PacketTraceWriter;
 
-class NetworkManager
+// Socket tuning applied by NetworkManager::init, zero/negative values keep the system default
+struct SocketOptions
+{
+    int receiveBufferBytes = 4 * 1024 * 1024;   // SO_RCVBUF, absorbs bursts while the io thread is busy
+    int sendBufferBytes = 1024 * 1024;          // SO_SNDBUF
+    int dscp = -1;                              // DSCP code point for IP_TOS (46 = EF, voice), -1 = unmarked
+    int busyPollUs = 0;                         // SO_BUSY_POLL: spin this long in the kernel before sleeping
+    bool kernelTimestamps = true;               // SO_TIMESTAMPNS: Datagram::receivedNs stamped by the kernel
+};
+
+class NetworkManager : public ITransport
 {
 public:
+    static constexpr size_t kMaxStreams = 16384;                            // streams tracked by the receive path
+    static constexpr std::chrono::milliseconds kStreamSweepInterval{1000};
+
     explicit NetworkManager(asio::io_context& io_context);
 
-    ~NetworkManager();
+    ~NetworkManager() override;
 
-    // Initialize the UDP socket and bind it to a local port
-    // returns true on success, false on failure
-    bool init(unsigned short localPort);
+    // Initialize the UDP socket, apply `options` and bind it to a local port
+    // returns true on success, false on failure (options the kernel refuses only log a warning)
+    bool init(unsigned short localPort, const SocketOptions& options = SocketOptions());
 
     // Sets the IP Address and port for the remote peer to senb data to
     void setRemoteEndpoint(const std::string& ipAddress, unsigned short port);
 
     // Sets the queue to recieve Network Packets into
-    void setIncomingQueue(std::shared_ptr<ThreadSafeQueue<NetworkPacket>> queue);
+    void setIncomingQueue(std::shared_ptr<ThreadSafeQueue<Datagram>> queue) override;
+
+    // Streams silent for longer than this give up their StreamId (default 30 s)
+    void setStreamTimeout(std::chrono::milliseconds timeout);
+
+    // Records every received datagram with its receive timestamp and sender to a packet
+    // trace (see PacketTrace.hpp) until stop(). Call before startReceive().
+    bool startTrace(const std::string& path);
+
+    // Accepts only audio datagrams sealed with `key` from now on (see MediaCrypto.hpp): they are
+    // authenticated, checked for replays and decrypted before they reach the incoming queue,
+    // everything else is dropped. Clock messages stay in the clear but are signed, unsigned ones
+    // are dropped too. Call before startReceive().
+    void enableEncryption(const MediaKey& key);
 
     // [ASYNC] send a network packet asynchronously
     // This method will push the packet to an internal queue and then initiate an async send.
     // It's designed to be called by a dedicated "network send thread" in VoiceChatApplication.
-    void sendPacket(const NetworkPacket& data);
+    void sendPacket(const NetworkPacket& data) override;
+
+    // [ASYNC] Same as sendPacket, but to an explicit peer instead of the remote endpoint
+    void sendPacketTo(const NetworkPacket& data, const asio::ip::udp::endpoint& peer) override;
 
     // [ASYNC] Starts the asynchronous receive operations.
     // Call this once after initialization to begin listening for incoming data.
-    void startReceive();
+    void startReceive() override;
+
+    // Clock offset/RTT estimates for the peers this socket exchanges clock pings with: the
+    // remote endpoint, and everyone who pings us. Readable from any thread.
+    const ClockSync& clockSync() const { return m_ClockSync; }
 
     // Gracefully stops all network operations and closes the socket.
     // Should be called during application shutdown.
-    void stop();
+    void stop() override;
 
 private:
     asio::io_context& m_Context;        // Reference to the application's IO context
@@ -45,23 +88,98 @@ private:
 
     asio::ip::udp::endpoint m_Remote;   // Remote endpoint to send packets to
 
+    static constexpr int kMaxDatagramsPerWakeup = 64;   // drained per readiness callback before re-arming
+
     std::array<char, 2048> m_RecvBuffer; // temporary buffer for ASYNC recieve operations
+    alignas(8) std::array<char, 128> m_ControlBuffer;   // recvmsg ancillary data (timestamp, overflow counter)
+    int64_t m_ReceivedNs = 0;           // receive time of the datagram in m_RecvBuffer
+    uint32_t m_RxQueueDrops = 0;        // last SO_RXQ_OVFL value
 
     asio::ip::udp::endpoint m_SenderEndpoint; // Endpoint of the sender for recieved packets
 
-    std::shared_ptr<ThreadSafeQueue<NetworkPacket>> m_IncomingQueue;    // Queue to store incoming packets from the network
+    std::shared_ptr<ThreadSafeQueue<Datagram>> m_IncomingQueue;    // Queue to store incoming packets from the network
+
+    StreamDirectory m_Streams;                  // (sender, SSRC) -> StreamId, io_context thread only
+    asio::steady_timer m_StreamSweepTimer;
+    std::chrono::milliseconds m_StreamTimeout{30000};
+
+    std::unique_ptr<PacketTraceWriter> m_Trace;  // null unless tracing
+
+    std::unique_ptr<MediaOpener> m_Opener;      // null = datagrams in the clear
+    std::vector<Datagram> m_SealedBatch;        // read in one wakeup, opened together
+
+    ClockSync m_ClockSync;
+    asio::steady_timer m_ClockSyncTimer;
+    MediaAnchor m_LocalAnchor;                  // last audio packet sent, io_context thread only
+    std::unique_ptr<ClockAuthenticator> m_ClockAuth;    // null = clock messages unsigned
+    std::array<unsigned char, ClockMessage::kPongSize + ClockMessage::kTagSize> m_ClockBuffer;   // outgoing ping/pong
+
+    // Posts an async send; `ownStream` packets are ours (not reflected) and update m_LocalAnchor
+    void queueSend(const NetworkPacket& packet, const asio::ip::udp::endpoint& peer, bool ownStream);
+
+    // Waits for the socket to become readable, handleReceive re-arms through this after draining it
+    void receiveNext();
+
+    // Reads one datagram with recvmsg into m_RecvBuffer/m_SenderEndpoint, picking up the kernel
+    // timestamp and overflow counter. Datagrams too large for the buffer are counted and skipped.
+    // Returns its size, -1 if none is pending (or on error).
+    std::ptrdiff_t receiveOne();
+
+    // Sets buffer sizes, TOS, busy polling, timestamping and overflow reporting on the socket
+    void applySocketOptions(const SocketOptions& options);
+
+    // Tags a received datagram with its StreamId (left unset if it has no PacketHeader)
+    void resolveStream(Datagram& datagram);
+
+    // Opens m_SealedBatch back to back and queues what passes; forged and replayed datagrams never
+    // get a StreamId
+    void openSealedBatch();
+
+    // Releases the ids of silent streams, re-arms itself every kStreamSweepInterval
+    void scheduleStreamSweep();
+
+    // Pings the remote endpoint and every clock peer, re-arms itself every ClockSync::kPingInterval
+    void scheduleClockSync();
+
+    // Answers a clock ping / takes in a pong in m_RecvBuffer. Returns false if the datagram
+    // is not a clock message.
+    bool handleClockMessage(size_t size);
+
+    // Pings are answered (and the sender pinged from then on) only for the remote endpoint and
+    // endpoints with a stream in m_Streams, so a spoofed source can't turn us into a reflector
+    bool admitsClockPeer(const asio::ip::udp::endpoint& peer, uint32_t ssrc) const;
+
+    // Sends a clock message right away from the io_context thread, stamping its transmit time last
+    void sendClockMessage(ClockMessage& message, const asio::ip::udp::endpoint& peer);
 
     // --- [ASYNC] Callbacks ---
-    // Callback for when an asynchronous receive operation completes
-    void handleReceive(const asio::error_code& error, std::size_t bytesTransferred);
+    // Callback for when the socket becomes readable: drains up to kMaxDatagramsPerWakeup datagrams
+    void handleReceive(const asio::error_code& error);
 
     // Callback for when an asynchronous send operation completes
     // The `std::shared_ptr<NetworkPacket> packet_ptr` ensures the data stays alive
     // until the send operation is finished.
-    void handleSend(const asio::error_code& error, std::size_t bytesTransferred, std::shared_ptr<NetworkPacket> packet_ptr);
+    void handleSend(const asio::error_code& error, std::size_t bytesTransferred, std::shared_ptr<NetworkPacket> packet_ptr,
+        const asio::ip::udp::endpoint& destination);
 
     // Flag to indicate if the manager is actively running/receiving
     std::atomic_bool a_IsRunning;
+
+    // Per-packet accounting (net.*), logging every datagram doesn't scale past a few streams
+    MetricValue& m_PacketsSentMetric;
+    MetricValue& m_BytesSentMetric;
+    MetricValue& m_SendErrorsMetric;
+    MetricValue& m_PacketsReceivedMetric;
+    MetricValue& m_BytesReceivedMetric;
+    MetricValue& m_ReceiveErrorsMetric;
+    MetricValue& m_RxQueueDropsMetric;      // datagrams the kernel dropped on a full receive buffer (SO_RXQ_OVFL)
+    MetricValue& m_TruncatedMetric;         // datagrams larger than m_RecvBuffer, dropped
+    MetricValue& m_StreamsMetric;
+    MetricValue& m_StreamsRejectedMetric;
+    MetricValue& m_StreamsExpiredMetric;
+    MetricValue& m_ClockIgnoredMetric;      // pings from endpoints without a known stream, not answered
+    PerfSite& m_ReceivePerf;    // perf.net.receive.*
+    PerfSite& m_SendPerf;       // perf.net.send.*
 };
 
 #endif // NETWORK_MANAGER_HPP
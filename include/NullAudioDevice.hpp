@@ -0,0 +1,105 @@
+#ifndef NULL_AUDIO_DEVICE_HPP
+#define NULL_AUDIO_DEVICE_HPP
+
+#include "ThreadSafeQueue.hpp"
+#include "interfaces/IAudioPlayback.hpp"
+#include "interfaces/IAudioSource.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <thread>
+
+// Headless audio source: produces silent frames on a steady clock (one frame per frame period,
+// scheduled with sleep_until so it doesn't drift). Lets relays, servers and benchmarks run
+// the full pipeline on machines without audio hardware.
+class NullAudioSource : public IAudioSource
+{
+public:
+    NullAudioSource(int sampleRate, int channels, int frameSize);
+    virtual ~NullAudioSource();
+
+    bool start() override;
+    void stop() override;
+    void setOutputQueue(std::shared_ptr<ThreadSafeQueue<AudioFrame>> queue) override { m_OutputQueue = std::move(queue); }
+
+    int getSampleRate() const override { return m_SampleRate; }
+    int getChannels() const override { return m_Channels; }
+    int getFrameSize() const override { return m_FrameSize; }
+
+protected:
+    // Called on the clock thread for every frame period with a silent frame about to be
+    // "captured". Subclasses can fill in a signal.
+    virtual void fillFrame(AudioFrame& frame) {}
+
+    const char* m_LogName = "NullAudioSource";
+
+private:
+    void clockLoop();
+
+    std::shared_ptr<ThreadSafeQueue<AudioFrame>> m_OutputQueue = nullptr;
+    std::thread m_ClockThread;
+    std::atomic_bool a_IsRunning = false;
+
+    int m_SampleRate;
+    int m_Channels;
+    int m_FrameSize;
+};
+
+// Headless audio sink: consumes one frame per frame period like a sound card would,
+// counting underruns when the queue is empty. Rendered frames are discarded.
+class NullAudioPlayback : public IAudioPlayback
+{
+public:
+    NullAudioPlayback(int sampleRate, int channels, int frameSize);
+    virtual ~NullAudioPlayback();
+
+    bool start() override;
+    void stop() override;
+    void setInputQueue(std::shared_ptr<ThreadSafeQueue<AudioFrame>> queue) override { m_InputQueue = std::move(queue); }
+
+    int getSampleRate() const override { return m_SampleRate; }
+    int getChannels() const override { return m_Channels; }
+    int getFrameSize() const override { return m_FrameSize; }
+
+protected:
+    // Called on the clock thread for every frame period with the frame to "play"
+    // (silence on underrun). Subclasses can write it somewhere.
+    virtual void renderFrame(const AudioFrame& frame) {}
+
+    const char* m_LogName = "NullAudioPlayback";
+
+private:
+    void clockLoop();
+
+    std::shared_ptr<ThreadSafeQueue<AudioFrame>> m_InputQueue = nullptr;
+    std::thread m_ClockThread;
+    std::atomic_bool a_IsRunning = false;
+    uint64_t m_FramesPlayed = 0;
+    uint64_t m_Underruns = 0;
+
+    int m_SampleRate;
+    int m_Channels;
+    int m_FrameSize;
+};
+
+// Clocked sink that writes the played PCM (raw interleaved 16-bit) to a file,
+// the counterpart of FakeAudioSource
+class FileAudioPlayback : public NullAudioPlayback
+{
+public:
+    FileAudioPlayback(const std::string& filePath, int sampleRate, int channels, int frameSize);
+    ~FileAudioPlayback() override;
+
+    bool start() override;
+
+protected:
+    void renderFrame(const AudioFrame& frame) override;
+
+private:
+    std::string m_FilePath;
+    std::ofstream m_AudioFile;
+};
+
+#endif // NULL_AUDIO_DEVICE_HPP
@@ -0,0 +1,80 @@
+#ifndef PACKET_HEADER_HPP
+#define PACKET_HEADER_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+enum class PacketType : uint8_t
+{
+    Audio = 0,      // Opus payload (possibly several frames, see Repacketizer)
+    ClockPing = 1,  // clock synchronization, handled by the NetworkManager (see ClockSync.hpp)
+    ClockPong = 2,
+    Trunk = 3       // streams bundled between conference bridges (see Bridge.hpp)
+};
+
+// Header prepended to every media datagram, 12 bytes in network byte order:
+//
+//   byte 0      version (2 bits) | type (6 bits)
+//   byte 1      flags: bit 7 = payload carries redundant copies (see Redundancy.hpp),
+//               bit 6 = payload is encrypted (see MediaCrypto.hpp),
+//               bit 5 = audio level byte follows,
+//               bit 4 = a bridge held back datagrams of the stream right before this one,
+//               the gap in the sequence numbers is not loss (see Bridge.hpp),
+//               bits 0-2 = redundancy depth the sender asks its peers for, bit 3 0
+//   bytes 2-3   sequence number, +1 per datagram
+//   bytes 4-7   timestamp of the first frame, in samples per channel
+//   bytes 8-11  SSRC, random per sending stream
+//   byte 12     with bit 5 only: audio level of the datagram's frames, 0-127 = -dBov
+//               (127 = silence, as RFC 6464), bit 7 reserved
+//
+// The sequence number and timestamp let receivers detect loss and reordering and
+// measure jitter; the SSRC tells streams apart that share a socket. Control messages
+// (clock pings) use the same header with their own type. A sealed datagram carries the
+// level byte encrypted with the payload, it is read once the datagram is opened.
+struct PacketHeader
+{
+    static constexpr uint8_t kVersion = 1;
+    static constexpr size_t kSize = 12;
+    static constexpr uint8_t kFlagRedundancy = 0x80;
+    static constexpr uint8_t kFlagEncrypted = 0x40;
+    static constexpr uint8_t kFlagAudioLevel = 0x20;
+    static constexpr uint8_t kFlagResumed = 0x10;
+    static constexpr uint8_t kSilentLevel = 127;
+    static constexpr uint8_t kRequestMask = 0x07;
+
+    PacketType type = PacketType::Audio;
+    uint8_t flags = 0;
+    uint16_t sequence = 0;
+    uint32_t timestamp = 0;
+    uint32_t ssrc = 0;
+    uint8_t audioLevel = kSilentLevel;  // -dBov, only sent with kFlagAudioLevel
+
+    bool hasRedundancy() const { return (flags & kFlagRedundancy) != 0; }
+    bool hasAudioLevel() const { return (flags & kFlagAudioLevel) != 0; }
+    bool isResumed() const { return (flags & kFlagResumed) != 0; }
+    void setAudioLevel(uint8_t level)
+    {
+        audioLevel = level < kSilentLevel ? level : kSilentLevel;
+        flags |= kFlagAudioLevel;
+    }
+
+    // Bytes before the payload of a clear datagram: kSize, plus the level byte
+    size_t size() const { return hasAudioLevel() ? kSize + 1 : kSize; }
+    int requestedRedundancy() const { return flags & kRequestMask; }
+    void setRequestedRedundancy(int depth)
+    {
+        flags = static_cast<uint8_t>((flags & ~kRequestMask) | (depth & kRequestMask));
+    }
+
+    // Writes size() bytes to `out`
+    void write(unsigned char* out) const;
+
+    // Parses the header at the start of `data`, the level too unless the datagram is sealed.
+    // Returns false if the packet is too short or has an unknown version.
+    static bool read(const unsigned char* data, size_t len, PacketHeader& header);
+
+    // Random non-zero stream identifier
+    static uint32_t randomSsrc();
+};
+
+#endif // PACKET_HEADER_HPP
@@ -0,0 +1,88 @@
+#ifndef PACKET_TRACE_HPP
+#define PACKET_TRACE_HPP
+
+#include "Metrics.hpp"
+#include "NetworkManager.hpp"
+
+#include <asio.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Packet trace file: an append-only log of received datagrams for offline debugging and replay.
+// All integers big endian.
+//
+//     file header:  "ELTR" | u16 version (1) | u16 reserved
+//     record:       u64 receive time (ns since the Unix epoch, kernel timestamp when available)
+//                   u8 address family (4 or 6) | sender address (4 or 16 bytes) | u16 sender port
+//                   u16 payload length | payload (PacketHeader + Opus packet, as received)
+struct TraceRecord
+{
+    int64_t timestampNs = 0;
+    asio::ip::udp::endpoint sender;
+    NetworkPacket payload;
+};
+
+// Appends records from the receive path without touching the disk there: record() serializes
+// into an in-memory buffer, a background thread swaps it out and writes it. If the disk falls
+// behind by more than kMaxBufferedBytes, records are dropped and counted (trace.dropped).
+class PacketTraceWriter
+{
+public:
+    static constexpr uint16_t kVersion = 1;
+    static constexpr size_t kMaxBufferedBytes = 8 * 1024 * 1024;
+    static constexpr size_t kWakeBytes = 64 * 1024;                 // wake the writer early above this
+    static constexpr std::chrono::milliseconds kFlushInterval{200};
+
+    PacketTraceWriter();
+    ~PacketTraceWriter();
+
+    PacketTraceWriter(const PacketTraceWriter&) = delete;
+    PacketTraceWriter& operator=(const PacketTraceWriter&) = delete;
+
+    // Creates/truncates `path`, writes the file header and starts the writer thread
+    bool open(const std::string& path);
+    // Thread-safe, never blocks on I/O
+    void record(int64_t timestampNs, const asio::ip::udp::endpoint& sender, const char* data, size_t size);
+    // Writes everything still buffered and joins the writer thread. Idempotent.
+    void close();
+
+private:
+    void writerLoop();
+
+    std::string m_Path;
+    std::ofstream m_File;
+    std::thread m_Thread;
+
+    std::mutex m_Mutex;
+    std::condition_variable m_Wake;
+    std::vector<char> m_Pending;    // filled by record(), guarded by m_Mutex
+    std::vector<char> m_Writing;    // owned by the writer thread
+    bool b_Closing = false;
+
+    MetricValue& m_RecordsMetric;
+    MetricValue& m_BytesMetric;
+    MetricValue& m_DroppedMetric;
+};
+
+// Reads a trace file record by record
+class PacketTraceReader
+{
+public:
+    // Opens `path` and checks the file header
+    bool open(const std::string& path);
+    // false at the end of the file (a truncated last record, e.g. after a crash, also ends it)
+    bool next(TraceRecord& record);
+
+private:
+    std::string m_Path;
+    std::ifstream m_File;
+};
+
+#endif // PACKET_TRACE_HPP
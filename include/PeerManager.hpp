@@ -0,0 +1,135 @@
+#ifndef PEER_MANAGER_HPP
+#define PEER_MANAGER_HPP
+
+#include "AudioCodec.hpp"
+#include "CallQuality.hpp"
+#include "ClockSync.hpp"
+#include "Metrics.hpp"
+#include "NetworkManager.hpp"
+#include "PacketHeader.hpp"
+#include "Redundancy.hpp"
+#include "StreamDirectory.hpp"
+#include "TimerWheel.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct PeerStats
+{
+    uint64_t packets = 0;
+    uint64_t bytes = 0;
+    uint64_t lost = 0;          // sequence gaps, reduced again by late arrivals
+    uint64_t reordered = 0;
+    uint64_t duplicates = 0;
+    double jitterSamples = 0.0; // RFC 3550 interarrival jitter, in media clock units (samples)
+    int64_t oneWayDelayNs = -1; // send to receive of the last packet, -1 until the sender's clock is known
+};
+
+// Receive-side state of one remote stream
+struct Peer
+{
+    StreamId stream = kNoStreamId;
+    bool localStream = false;       // id came from the PeerManager's own directory, not the receive path
+    uint32_t ssrc = 0;
+    asio::ip::udp::endpoint endpoint;
+    AudioCodec decoder;
+    PeerStats stats;
+    CallQuality quality;            // loss and delay fed here, recovery, bitrate and playout by the decoder
+    uint16_t highestSequence = 0;
+    bool haveSequence = false;
+    int64_t lastTransit = 0;        // arrival - media timestamp of the previous packet, in samples
+    DecodeHistory decoded;          // sequences already decoded, originals or redundant copies
+    bool idle = false;
+    TimerWheel::Clock::time_point lastSeen;
+};
+
+struct PeerManagerConfig
+{
+    int sampleRate = 48000;
+    int channels = 2;
+    std::chrono::milliseconds idleTimeout{2000};    // silent this long: decoder reset, peer counted idle
+    std::chrono::milliseconds expiryTimeout{30000}; // silent this long: state handed back to the pool
+    size_t maxPooledPeers = 64;                     // spare states kept for peers that join later
+    size_t maxPeers = 4096;                         // packets of further streams are rejected
+    const ClockSync* clockSync = nullptr;           // sender clocks, for one-way delay (optional)
+    RedundancyController* redundancy = nullptr;     // gets loss bursts and redundancy requests (optional)
+};
+
+// Tracks the streams arriving on a socket, one Peer (decoder + stats) per StreamId.
+// The receive path already resolved (endpoint, SSRC) to a StreamId, so finding a peer is an
+// array index; datagrams that didn't come from a NetworkManager (loopback chains) get an id
+// from a local StreamDirectory. A peer whose slot turns up with a newer id generation belongs
+// to a stream the receive path already forgot and is replaced. Liveness is checked lazily on a
+// hashed timer wheel: packets only stamp `lastSeen`, the peer's single timer re-arms itself
+// when it fires early. Expired peers go back to a small pool and are handed to the next new
+// stream after a cheap decoder reset, so memory stays bounded by the peak number of
+// simultaneous peers under any amount of churn.
+// Not thread-safe, owned by the stage that decodes.
+class PeerManager
+{
+public:
+    using Clock = TimerWheel::Clock;
+
+    static constexpr std::chrono::milliseconds kTimerTick{100};
+    static constexpr size_t kTimerSlots = 512;   // ~51 s per revolution at 100 ms ticks
+    static constexpr std::chrono::milliseconds kQualityInterval{1000};
+
+    explicit PeerManager(const PeerManagerConfig& config);
+    ~PeerManager();     // reports the streams still active, like expiry does
+
+    PeerManager(const PeerManager&) = delete;
+    PeerManager& operator=(const PeerManager&) = delete;
+
+    // Returns the peer a datagram belongs to and updates its stats. New streams get a peer
+    // (from the pool if possible), idle peers wake up. Jitter uses the datagram's receive
+    // timestamp, `now` for datagrams that didn't come from a socket. Returns nullptr if the
+    // stream can't be admitted (maxPeers reached or the decoder failed to initialize).
+    Peer* onPacket(const Datagram& datagram, const PacketHeader& header, Clock::time_point now);
+
+    // Runs the liveness timers: marks silent peers idle and evicts expired ones. Once per
+    // kQualityInterval, also exports the quality.* gauges over the active peers.
+    void expire(Clock::time_point now);
+
+    size_t peerCount() const { return m_PeerCount; }
+    size_t idleCount() const { return m_IdleCount; }
+    size_t pooledCount() const { return m_Pool.size(); }
+
+private:
+    using Slot = TimerWheel::TimerId;
+
+    Peer* admit(StreamId stream, bool localStream, uint32_t ssrc, const asio::ip::udp::endpoint& endpoint,
+        Clock::time_point now);
+    void onTimer(Slot slot, Clock::time_point now);
+    void evict(Slot slot);
+    void updateGauges();
+    void updateQualityGauges();
+    // Logs a stream's totals and call quality
+    void report(const Peer& peer, const char* event) const;
+
+    PeerManagerConfig m_Config;
+    TimerWheel m_Timers;
+
+    StreamDirectory m_LocalStreams;
+    std::vector<std::unique_ptr<Peer>> m_Slots;       // indexed by StreamDirectory::indexOf(stream), also the timer id
+    std::vector<std::unique_ptr<Peer>> m_Pool;        // evicted peers, decoder still allocated
+    size_t m_PeerCount = 0;
+    size_t m_IdleCount = 0;
+    Clock::time_point m_NextQualityUpdate;
+
+    MetricValue& m_ActiveMetric;
+    MetricValue& m_IdleMetric;
+    MetricValue& m_PooledMetric;
+    MetricValue& m_JoinedMetric;
+    MetricValue& m_ReusedMetric;
+    MetricValue& m_ExpiredMetric;
+    MetricValue& m_RejectedMetric;
+    MetricValue& m_OneWayDelayMetric;   // last measured, any peer
+    MetricValue& m_MosMinMetric;        // quality.mos_min_x100: worst active stream, MOS * 100
+    MetricValue& m_MosMeanMetric;       // quality.mos_mean_x100
+    MetricValue& m_RMinMetric;          // quality.r_min: worst R-factor
+    MetricValue& m_PoorMetric;          // quality.streams_poor: active streams below CallQuality::kPoorMos
+};
+
+#endif // PEER_MANAGER_HPP
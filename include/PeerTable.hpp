@@ -0,0 +1,69 @@
+#ifndef PEER_TABLE_HPP
+#define PEER_TABLE_HPP
+
+#include <asio.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Identifies a stream: the sender's transport address plus the SSRC from its PacketHeader.
+// IPv4 addresses are stored IPv4-mapped so both families share one layout.
+struct PeerKey
+{
+    std::array<uint8_t, 16> address{};
+    uint16_t port = 0;
+    uint32_t ssrc = 0;
+
+    static PeerKey from(const asio::ip::udp::endpoint& endpoint, uint32_t ssrc);
+
+    bool operator==(const PeerKey& other) const
+    {
+        return ssrc == other.ssrc && port == other.port && address == other.address;
+    }
+    bool operator!=(const PeerKey& other) const { return !(*this == other); }
+};
+
+// Open-addressing hash table PeerKey -> uint32_t with linear probing.
+// The bucket array is allocated once (a power of two, at most half full), lookups and
+// inserts never allocate, and erase uses backward-shift deletion instead of tombstones so
+// probe sequences stay short under heavy churn.
+class PeerTable
+{
+public:
+    static constexpr uint32_t kNotFound = 0xFFFFFFFFu;
+
+    explicit PeerTable(size_t maxEntries);
+
+    // Value stored for `key`, kNotFound if absent
+    uint32_t find(const PeerKey& key) const;
+    // false if the key is already present or the table holds maxEntries() entries.
+    // kNotFound can't be stored.
+    bool insert(const PeerKey& key, uint32_t value);
+    // false if the key was absent
+    bool erase(const PeerKey& key);
+
+    size_t size() const { return m_Size; }
+    size_t maxEntries() const { return m_MaxEntries; }
+    size_t bucketCount() const { return m_Buckets.size(); }
+
+    static uint64_t hash(const PeerKey& key);
+
+private:
+    // 32 bytes, two buckets per cache line. An empty bucket has value == kNotFound.
+    struct alignas(32) Bucket
+    {
+        PeerKey key;
+        uint32_t value = kNotFound;
+    };
+
+    size_t home(const PeerKey& key) const { return static_cast<size_t>(hash(key)) & m_Mask; }
+
+    std::vector<Bucket> m_Buckets;
+    size_t m_Mask;
+    size_t m_Size = 0;
+    size_t m_MaxEntries;
+};
+
+#endif // PEER_TABLE_HPP
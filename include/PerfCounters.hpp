@@ -0,0 +1,102 @@
+#ifndef PERF_COUNTERS_HPP
+#define PERF_COUNTERS_HPP
+
+#include "Metrics.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// Optional hardware performance counters around the hot paths (codec calls, network handlers,
+// audio device callbacks), to tell why a stage slows down on a particular host: cache misses,
+// a low clock (frequency scaling), a low IPC (a busy SMT sibling), context switches.
+//
+// Counters are read with perf_event_open(2): one counter group per thread, opened the first
+// time the thread enters a measured scope, read with a single read() on entry and exit.
+// Each measured site accumulates the deltas into perf.<site>.* metrics.
+//
+// Costs: built without ECHOLINK_PERF_COUNTERS, PerfScope is an empty object. Built with it
+// (the default) but not enabled at runtime, a scope costs one relaxed atomic load.
+
+struct PerfSample
+{
+    enum Event { Cycles, Instructions, CacheMisses, ContextSwitches, TaskClockNs, kEventCount };
+
+    std::array<uint64_t, kEventCount> values{};
+};
+
+// Accumulated counters of one measured site, registered once and kept by reference
+class PerfSite
+{
+public:
+    explicit PerfSite(const std::string& name);
+
+    const std::string& name() const { return m_Name; }
+    void add(const PerfSample& begin, const PerfSample& end);
+    // Writes one summary line, nothing if the site was never measured
+    void report(std::ostream& out) const;
+
+private:
+    std::string m_Name;
+    MetricValue& m_Calls;
+    std::array<MetricValue*, PerfSample::kEventCount> m_Totals;
+};
+
+class PerfCounters
+{
+public:
+    // Turns measuring on for all threads (off by default)
+    static void enable();
+    static bool enabled() { return s_Enabled.load(std::memory_order_relaxed); }
+
+    // Returns the site with the given name, registering it on first use.
+    // The reference stays valid for the lifetime of the process.
+    static PerfSite& site(const std::string& name);
+
+    // Reads the calling thread's counters, opening them on first use. Events the host doesn't
+    // support read as 0; false if no counter could be opened at all (logged once).
+    static bool read(PerfSample& sample);
+
+    // Writes a summary line per measured site: cycles and cache misses per call, IPC, clock rate
+    static void report(std::ostream& out);
+
+private:
+    static std::atomic_bool s_Enabled;
+};
+
+// Measures the enclosing scope into `site`
+class PerfScope
+{
+public:
+#ifdef ECHOLINK_PERF_COUNTERS
+    explicit PerfScope(PerfSite& site)
+    {
+        if(PerfCounters::enabled() && PerfCounters::read(m_Begin)) {
+            m_Site = &site;
+        }
+    }
+
+    ~PerfScope()
+    {
+        PerfSample end;
+        if(m_Site && PerfCounters::read(end)) {
+            m_Site->add(m_Begin, end);
+        }
+    }
+#else
+    explicit PerfScope(PerfSite&) {}
+#endif
+
+    PerfScope(const PerfScope&) = delete;
+    PerfScope& operator=(const PerfScope&) = delete;
+
+#ifdef ECHOLINK_PERF_COUNTERS
+private:
+    PerfSite* m_Site = nullptr;
+    PerfSample m_Begin;
+#endif
+};
+
+#endif // PERF_COUNTERS_HPP
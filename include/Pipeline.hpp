@@ -0,0 +1,369 @@
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include "DspChain.hpp"
+#include "FrameTracer.hpp"
+#include "NetworkManager.hpp"
+#include "PacketHeader.hpp"
+#include "Resampler.hpp"
+#include "ThreadSafeQueue.hpp"
+#include "interfaces/IAudioSource.hpp"
+
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// --- Ports ---
+// Stages are connected by typed ports. A port is a ThreadSafeQueue owned by the graph,
+// shutting it down is how the graph tells the consuming stage to finish.
+
+enum class PortType
+{
+    None,       // stage has no input/output on this side
+    Pcm,        // AudioFrame
+    Encoded     // Datagram (Opus payload + peer)
+};
+
+const char* toString(PortType type);
+
+template <typename T>
+using Port = std::shared_ptr<ThreadSafeQueue<T>>;
+
+// traceTag() names the frame an item belongs to for its "wait" and "consume" spans (nullptr if
+// it can't tell): an AudioFrame's traceId, an audio datagram's sequence number
+template <typename T> struct PortTraits;
+template <> struct PortTraits<AudioFrame>
+{
+    static constexpr PortType type = PortType::Pcm;
+    static const char* traceTag(const AudioFrame& frame, int64_t& arg)
+    {
+        arg = frame.traceId;
+        return frame.traceId >= 0 ? "frame" : nullptr;
+    }
+};
+template <> struct PortTraits<Datagram>
+{
+    static constexpr PortType type = PortType::Encoded;
+    static const char* traceTag(const Datagram& datagram, int64_t& arg)
+    {
+        PacketHeader header;
+        if(!PacketHeader::read(reinterpret_cast<const unsigned char*>(datagram.payload.data()), datagram.payload.size(), header)
+            || header.type != PacketType::Audio) {
+            return nullptr;
+        }
+        arg = header.sequence;
+        return "seq";
+    }
+};
+
+// Type-erased handle to a port, used by the graph to wire stages it only knows by name
+class PortHandle
+{
+public:
+    PortHandle() = default;
+
+    // Creates a new queue for the given type (None gives an unconnected handle)
+    static PortHandle create(PortType type);
+
+    PortType type() const { return m_Type; }
+    bool connected() const { return m_Queue != nullptr; }
+
+    // Returns the typed queue, nullptr if unconnected.
+    // Throws std::logic_error if T doesn't match the port type.
+    template <typename T>
+    Port<T> get() const
+    {
+        if(!m_Queue) {
+            return nullptr;
+        }
+        if(PortTraits<T>::type != m_Type) {
+            throw std::logic_error(std::string("Port type mismatch: port carries ") + toString(m_Type)
+                + ", stage expects " + toString(PortTraits<T>::type));
+        }
+        return std::static_pointer_cast<ThreadSafeQueue<T>>(m_Queue);
+    }
+
+    void shutdown() const
+    {
+        if(m_Shutdown) {
+            m_Shutdown();
+        }
+    }
+
+private:
+    template <typename T>
+    static PortHandle createTyped();
+
+    PortType m_Type = PortType::None;
+    std::shared_ptr<void> m_Queue;
+    std::function<void()> m_Shutdown;
+};
+
+template <typename T>
+PortHandle PortHandle::createTyped()
+{
+    auto queue = std::make_shared<ThreadSafeQueue<T>>();
+    PortHandle handle;
+    handle.m_Type = PortTraits<T>::type;
+    handle.m_Queue = queue;
+    handle.m_Shutdown = [queue]() { queue->Shutdown(); };
+    return handle;
+}
+
+// --- Stages ---
+
+enum class ThreadingPolicy
+{
+    Dedicated,  // stage owns a thread that blocks on its input port
+    Callback    // stage is driven by someone else's thread (audio device callback, io_context)
+};
+
+struct IStage
+{
+public:
+    virtual ~IStage() = default;
+    virtual const char* name() const = 0;
+    virtual ThreadingPolicy threading() const = 0;
+    virtual bool start() = 0;   // Start producing/consuming
+    // Stop producing and release any thread. The graph calls this after the stage's
+    // input port has been shut down, so consumer threads are guaranteed to wake up.
+    virtual void stop() = 0;
+};
+
+// Base for stages that only produce data, driven by a callback (device, socket)
+template <typename Out>
+class SourceStage : public IStage
+{
+public:
+    explicit SourceStage(Port<Out> output) : m_Output(std::move(output)) {}
+    ThreadingPolicy threading() const override { return ThreadingPolicy::Callback; }
+
+protected:
+    Port<Out> m_Output;
+};
+
+// Base for stages with a dedicated thread that consumes their input port until it is shut down
+template <typename In>
+class ConsumerStage : public IStage
+{
+public:
+    explicit ConsumerStage(Port<In> input) : m_Input(std::move(input)) {}
+    ~ConsumerStage() override
+    {
+        // The graph stops stages before destroying them, this only guards against misuse
+        if(m_Thread.joinable()) {
+            std::cerr << "[Pipeline] Stage destroyed while running, input port never shut down." << std::endl;
+            std::terminate();
+        }
+    }
+
+    ThreadingPolicy threading() const override { return ThreadingPolicy::Dedicated; }
+
+    bool start() override
+    {
+        if(!m_Input) {
+            std::cerr << "[" << name() << " Stage] Error: Input port not connected." << std::endl;
+            return false;
+        }
+        if(m_Thread.joinable()) {
+            return true;
+        }
+        m_Thread = std::thread(&ConsumerStage::run, this);
+        return true;
+    }
+
+    void stop() override
+    {
+        if(m_Thread.joinable()) {
+            m_Thread.join();
+        }
+    }
+
+protected:
+    // Handles one item from the input port, runs on the stage thread
+    virtual void consume(In& item) = 0;
+
+    // Stages with periodic work (timers) return a non-zero interval; housekeeping() then runs
+    // on the stage thread after every item, and at least once per interval while the input is quiet
+    virtual std::chrono::milliseconds housekeepingInterval() const { return std::chrono::milliseconds::zero(); }
+    virtual void housekeeping() {}
+
+private:
+    void run()
+    {
+        std::cout << "[" << name() << " Stage] Started." << std::endl;
+        FrameTracer::nameThread(name());
+        In item;
+        const std::chrono::milliseconds interval = housekeepingInterval();
+        if(interval == std::chrono::milliseconds::zero()) {
+            while(popTraced(item)) {
+                TraceScope span("stage", "consume");
+                tagSpan(span, item);
+                consume(item);
+            }
+        } else {
+            while(true) {
+                if(popTraced(item, interval)) {
+                    TraceScope span("stage", "consume");
+                    tagSpan(span, item);
+                    consume(item);
+                } else if(m_Input->is_shutting_down()) {
+                    break;
+                }
+                housekeeping();
+            }
+        }
+        std::cout << "[" << name() << " Stage] Input closed. Exited." << std::endl;
+    }
+
+    // The time a stage sits idle on its input shows up as a "wait" span, tagged with the frame
+    // it waited for
+    bool popTraced(In& item)
+    {
+        TraceScope span("queue", "wait");
+        if(!m_Input->pop(item)) {
+            return false;
+        }
+        tagSpan(span, item);
+        return true;
+    }
+
+    bool popTraced(In& item, std::chrono::milliseconds timeout)
+    {
+        TraceScope span("queue", "wait");
+        if(!m_Input->pop_for(item, timeout)) {
+            return false;
+        }
+        tagSpan(span, item);
+        return true;
+    }
+
+    static void tagSpan(TraceScope& span, const In& item)
+    {
+        int64_t arg = 0;
+        if(FrameTracer::enabled()) {
+            if(const char* argName = PortTraits<In>::traceTag(item, arg)) {
+                span.tag(argName, arg);
+            }
+        }
+    }
+
+    Port<In> m_Input;
+    std::thread m_Thread;
+};
+
+// Consumer stage that also produces. An unconnected output (last stage of a chain) drops its items.
+template <typename In, typename Out>
+class TransformStage : public ConsumerStage<In>
+{
+public:
+    TransformStage(Port<In> input, Port<Out> output)
+        : ConsumerStage<In>(std::move(input)), m_Output(std::move(output)) {}
+
+protected:
+    void emit(Out item)
+    {
+        if(m_Output) {
+            m_Output->push(std::move(item));
+        }
+    }
+
+    // Items waiting in the output port, i.e. the next stage's backlog
+    size_t outputDepth() const { return m_Output ? m_Output->size() : 0; }
+
+private:
+    Port<Out> m_Output;
+};
+
+// --- Graph ---
+
+class AudioCodec;
+class EchoCanceller;
+class RedundancyController;
+struct BridgeConfig;
+struct MediaKey;
+struct IAudioPlayback;
+
+// Resources shared by the stages, owned by whoever builds the graph
+struct PipelineContext
+{
+    int sampleRate = 48000;
+    int channels = 2;
+    int frameSize = 480;
+    int framesPerPacket = 1;
+    int deviceSampleRate = 48000;       // audio devices run at this rate, the resample stages convert
+    ResamplerQuality resampleQuality = ResamplerQuality::Balanced;
+    DspConfig dsp;                      // float processing of captured frames in every encode stage
+    int stretchTargetMs = 20;           // audio the stretch stage keeps queued for playback
+
+    IAudioSource* audioSource = nullptr;
+    std::string audioSourceName;        // backend name, used to label startup metrics
+    IAudioPlayback* audioPlayback = nullptr;
+    std::string audioPlaybackName;
+    AudioCodec* codec = nullptr;
+    EchoCanceller* echoCanceller = nullptr;     // shared by the aec and echoref stages
+    RedundancyController* redundancy = nullptr; // shared by the encode and decode stages, null = off
+    ITransport* transport = nullptr;            // the network or a shared-memory channel
+    NetworkManager* network = nullptr;          // set when the transport is UDP (clock sync)
+    const MediaKey* mediaKey = nullptr;         // seals sent / opens replayed datagrams, null = clear
+    const BridgeConfig* bridge = nullptr;       // trunks of the bridge stage
+    std::string recordPath;
+    std::string replayPath;             // packet trace read by the replay stage
+    bool replayRealtime = true;         // keep the recorded packet spacing, else replay as fast as possible
+
+    // Receive side peer liveness (see PeerManager)
+    int peerIdleTimeoutMs = 2000;
+    int peerExpiryTimeoutMs = 30000;
+};
+
+// A set of linear stage chains built from a declarative description, e.g.
+//     "capture > encode > send; receive > decode > playback"
+// Stages are connected by ports in the order written; types are checked while building.
+class PipelineGraph
+{
+public:
+    using Description = std::vector<std::vector<std::string>>;   // chains of stage names
+
+    // Returns the description of a built-in topology (loopback, p2p, p2p-aec, record, server, relay, bridge, replay),
+    // or `nameOrDescription` unchanged if it isn't one.
+    static std::string resolveTopology(const std::string& nameOrDescription);
+
+    // Splits a description into chains of stage names. Throws std::runtime_error on syntax errors.
+    static Description parse(const std::string& description);
+
+    // true if any chain of `description` uses the stage `stageName`
+    static bool uses(const Description& description, const std::string& stageName);
+
+    // Instantiates all stages. Throws std::runtime_error on unknown stages, port type mismatches
+    // or resources missing from `context`.
+    PipelineGraph(const Description& description, PipelineContext& context);
+    ~PipelineGraph();
+
+    PipelineGraph(const PipelineGraph&) = delete;
+    PipelineGraph& operator=(const PipelineGraph&) = delete;
+
+    // Starts every chain sink-first so nothing is produced before it can be consumed.
+    // On failure the already started stages are stopped again.
+    bool start();
+
+    // Stops every chain source-first: stop the stage, shut down its output port, move downstream.
+    // Each consumer wakes up on its shut-down input, so the order always terminates. Idempotent.
+    void stop();
+
+private:
+    struct Chain
+    {
+        std::vector<std::unique_ptr<IStage>> stages;
+        std::vector<PortHandle> ports;  // ports[i] connects stages[i] -> stages[i + 1]
+    };
+
+    std::vector<Chain> m_Chains;
+    bool b_Started = false;
+};
+
+#endif // PIPELINE_HPP
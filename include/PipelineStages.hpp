@@ -0,0 +1,372 @@
+#ifndef PIPELINE_STAGES_HPP
+#define PIPELINE_STAGES_HPP
+
+#include "AudioCodec.hpp"
+#include "AudioReframer.hpp"
+#include "Bridge.hpp"
+#include "DspChain.hpp"
+#include "EchoCanceller.hpp"
+#include "FrameTracer.hpp"
+#include "MediaCrypto.hpp"
+#include "PacketHeader.hpp"
+#include "PacketTrace.hpp"
+#include "PeerManager.hpp"
+#include "PerfCounters.hpp"
+#include "Pipeline.hpp"
+#include "Redundancy.hpp"
+#include "Repacketizer.hpp"
+#include "Resampler.hpp"
+#include "StreamMixer.hpp"
+#include "TimeStretcher.hpp"
+#include "interfaces/IAudioPlayback.hpp"
+#include "interfaces/IAudioSource.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Describes a stage kind that can be named in a pipeline description
+struct StageDescriptor
+{
+    const char* name;
+    PortType input;
+    PortType output;
+    bool singleInstance;    // stage binds a shared resource (device, socket receive, codec) and may appear once
+    std::function<std::unique_ptr<IStage>(const PortHandle& input, const PortHandle& output, PipelineContext& context)> create;
+};
+
+// Returns the descriptor for `name`, nullptr if unknown
+const StageDescriptor* findStageDescriptor(const std::string& name);
+// Space separated list of all stage names, for error messages
+std::string stageNames();
+
+// --- Sources ---
+
+// Pushes captured PCM frames from an IAudioSource (device callback thread)
+class CaptureStage : public SourceStage<AudioFrame>
+{
+public:
+    CaptureStage(IAudioSource& source, const std::string& backendName, Port<AudioFrame> output);
+    const char* name() const override { return "Capture"; }
+    bool start() override;
+    void stop() override;
+
+private:
+    IAudioSource& m_Source;
+    std::string m_BackendName;
+};
+
+// Pushes datagrams received by the transport (NetworkManager io_context thread, ShmTransport
+// receive thread)
+class ReceiveStage : public SourceStage<Datagram>
+{
+public:
+    ReceiveStage(ITransport& transport, Port<Datagram> output);
+    const char* name() const override { return "Receive"; }
+    bool start() override;
+    void stop() override;
+
+private:
+    ITransport& m_Transport;
+};
+
+// Pushes the datagrams of a packet trace (see PacketTrace.hpp) from its own thread, with their
+// original spacing or as fast as the pipeline takes them. Each datagram carries its recorded
+// sender, so streams are told apart as they were on the socket. With a key, sealed audio is
+// opened first and everything else dropped; there is no replay check, the trace is local.
+class ReplayStage : public SourceStage<Datagram>
+{
+public:
+    ReplayStage(const std::string& path, bool realtime, const MediaKey* key, Port<Datagram> output);
+    ~ReplayStage() override;
+    const char* name() const override { return "Replay"; }
+    bool start() override;
+    void stop() override;
+
+private:
+    void replayLoop();
+
+    std::string m_Path;
+    bool b_Realtime;
+    PacketTraceReader m_Reader;
+    std::thread m_Thread;
+    std::mutex m_Mutex;
+    std::condition_variable m_Wake;     // interrupts the wait for the next packet's time on stop()
+    bool b_Stopping = false;
+    std::unique_ptr<MediaOpener> m_Opener;  // null = trace in the clear
+};
+
+// --- Transforms ---
+
+// Encodes PCM frames to Opus, optionally bundling several frames per datagram,
+// and prefixes every datagram with a PacketHeader. Input chunks of another size than the
+// frame size are reframed first. Every header carries the RMS level of the frames in the
+// datagram (see PacketHeader). With an enabled DspConfig, every frame goes through the
+// stream's own DspChain and is encoded from float. With a RedundancyController, every datagram
+// also repeats the payloads of the ones before it, as many as the controller asks for.
+class EncodeStage : public TransformStage<AudioFrame, Datagram>
+{
+public:
+    EncodeStage(AudioCodec& codec, int sampleRate, int frameSize, int channels, int framesPerPacket,
+        const DspConfig& dsp, RedundancyController* redundancy, Port<AudioFrame> input, Port<Datagram> output);
+    const char* name() const override { return "Encode"; }
+
+protected:
+    void consume(AudioFrame& rawFrame) override;
+
+private:
+    static constexpr int kMaxOpusPacketSize = 4000;
+    // Worst case bundle: every frame at max size plus the multi-frame packet header
+    static constexpr int kMaxBundledPacketSize = Repacketizer::kMaxFramesPerPacket * Repacketizer::kMaxFrameBytes + 64;
+    // Redundant copies never grow a datagram beyond this, IP fragments would multiply the loss
+    static constexpr size_t kMaxRedundantDatagramSize = 1200;
+
+    void encodeFrame(const opus_int16* pcm);
+    void emitBundle();
+    void emitPacket(const unsigned char* payload, int payloadSize);
+
+    AudioCodec& m_Codec;
+    int m_FrameSize;
+    int m_Channels;
+    std::unique_ptr<DspChain> m_Dsp;    // null = encode the 16-bit frames as they are
+    std::vector<float> m_ProcessedFrame;
+    FrameAssembler m_Assembler;
+    Repacketizer m_Packetizer;
+    PacketHeader m_Header;          // sequence/timestamp of the next datagram
+    uint32_t m_Rollover = 0;        // sequence number wraps so far
+    uint32_t m_NextTimestamp = 0;   // media clock of the next encoded frame
+    double m_LevelEnergy = 0.0;     // sum of squares of the frames in the next datagram, for its audio level
+    size_t m_LevelSamples = 0;
+    std::vector<unsigned char> m_OpusPacket;
+    std::vector<unsigned char> m_BundledPacket;
+
+    RedundancyController* m_Redundancy;             // null = no redundancy, flags stay 0
+    std::vector<std::vector<unsigned char>> m_RecentPayloads;  // ring of the last payloads sent
+    size_t m_RecentNewest = 0;
+    size_t m_RecentCount = 0;
+    std::vector<const std::vector<unsigned char>*> m_Repeated;
+    std::vector<unsigned char> m_FramedPayload;
+    MetricValue& m_RedundantBytesMetric;            // redundancy.bytes_sent
+};
+
+// Strips the PacketHeader, splits bundled packets and decodes them back to capture-sized PCM frames.
+// Every stream (SSRC) gets its own decoder from a PeerManager, which evicts streams that went silent.
+// Frames of concurrent streams are mixed (StreamMixer), one frame per period goes out. Datagrams that
+// repeat earlier payloads (see Redundancy.hpp) first fill the gap before them with the copies,
+// and a datagram whose sequence was already decoded is skipped. Each peer's CallQuality gets the
+// recovered copies, the codec bitrate and the decoded audio queued for playback.
+class DecodeStage : public TransformStage<Datagram, AudioFrame>
+{
+public:
+    DecodeStage(const PeerManagerConfig& peerConfig, int frameSize, int channels,
+        Port<Datagram> input, Port<AudioFrame> output);
+    const char* name() const override { return "Decode"; }
+
+protected:
+    void consume(Datagram& datagram) override;
+    std::chrono::milliseconds housekeepingInterval() const override { return PeerManager::kTimerTick; }
+    void housekeeping() override;
+
+private:
+    // Decodes one datagram payload (single or bundled Opus packet) with the peer's decoder,
+    // `sequence` is the datagram's (for the frame trace)
+    void decodePayload(Peer& peer, const unsigned char* payload, int payloadSize, uint16_t sequence);
+
+    PeerManager m_Peers;
+    StreamMixer m_Mixer;
+    int m_SampleRate;
+    int m_FrameSize;
+    int m_Channels;
+    Repacketizer m_Depacketizer;
+    AudioFrame m_DecodedPcm;
+    std::vector<NetworkPacket> m_SplitFrames;
+    std::vector<RedundancyFormat::Block> m_RepeatedBlocks;
+    MetricValue& m_RecoveredMetric;     // redundancy.recovered
+    MetricValue& m_DuplicatesMetric;    // redundancy.duplicates_skipped
+    MetricValue& m_EncryptedMetric;     // crypto.undecryptable_dropped
+};
+
+// Converts PCM between the audio device rate and the codec rate (resample-in after capture,
+// resample-out before playback). Output chunks vary by a sample around the frame duration;
+// encode reassembles codec frames and playback spreads chunks over device buffers, so
+// reframing here would only add a frame of delay.
+class ResampleStage : public TransformStage<AudioFrame, AudioFrame>
+{
+public:
+    ResampleStage(int inputRate, int outputRate, int channels, ResamplerQuality quality, const char* perfSite,
+        Port<AudioFrame> input, Port<AudioFrame> output);
+    const char* name() const override { return "Resample"; }
+
+protected:
+    void consume(AudioFrame& frame) override;
+
+private:
+    Resampler m_Resampler;
+    int m_Channels;
+    PerfSite& m_Perf;       // perf.resample.in.* / perf.resample.out.*
+};
+
+// Keeps the audio queued for playback near a target by time-stretching decoded PCM a few
+// percent (TimeStretcher) instead of letting it underrun or pile up. Has to be the stage right
+// before playback: the backlog of its output port is what it steers.
+//
+// Every decision window (0.5 s) the smallest backlog seen is compared to the target: below it
+// the next good period is inserted, above it by more than what a compression holds back plus
+// a frame, the next good period is removed. One period (2.5-10 ms) per window is at most ~2%.
+class StretchStage : public TransformStage<AudioFrame, AudioFrame>
+{
+public:
+    StretchStage(int sampleRate, int channels, int frameSize, int targetMs, Port<AudioFrame> input,
+        Port<AudioFrame> output);
+    const char* name() const override { return "Stretch"; }
+
+protected:
+    void consume(AudioFrame& frame) override;
+
+private:
+    void startWindow();
+
+    TimeStretcher m_Stretcher;
+    int m_Channels;
+    int m_FrameSize;
+    int m_SampleRate;
+    size_t m_TargetFrames;              // sample frames queued for playback
+    size_t m_WindowFrames;
+    TimeStretcher::Mode m_Mode = TimeStretcher::Mode::Normal;
+    size_t m_WindowSeen = 0;            // sample frames consumed in the current window
+    size_t m_WindowMin = 0;             // smallest backlog in the current window
+
+    MetricValue& m_BacklogMetric;       // stretch.backlog_min_ms
+    MetricValue& m_InsertedMetric;      // stretch.inserted_ms
+    MetricValue& m_RemovedMetric;       // stretch.removed_ms
+    MetricValue& m_InsertedCount;       // stretch.insertions
+    MetricValue& m_RemovedCount;        // stretch.removals
+    int64_t m_InsertedFrames = 0;
+    int64_t m_RemovedFrames = 0;
+    PerfSite& m_Perf;                   // perf.stretch.*
+};
+
+// Removes the far end's echo from captured frames with the shared EchoCanceller. The echoref
+// stage on the playback chain feeds it the reference; without one, frames pass unchanged.
+class EchoCancelStage : public TransformStage<AudioFrame, AudioFrame>
+{
+public:
+    EchoCancelStage(EchoCanceller& canceller, int channels, Port<AudioFrame> input, Port<AudioFrame> output);
+    const char* name() const override { return "EchoCancel"; }
+
+protected:
+    void consume(AudioFrame& frame) override;
+
+private:
+    EchoCanceller& m_Canceller;
+    int m_Channels;
+    PerfSite& m_Perf;       // perf.aec.*
+};
+
+// Passes decoded frames on to playback and hands them to the shared EchoCanceller as the
+// echo reference
+class EchoReferenceStage : public TransformStage<AudioFrame, AudioFrame>
+{
+public:
+    EchoReferenceStage(EchoCanceller& canceller, int channels, Port<AudioFrame> input, Port<AudioFrame> output);
+    const char* name() const override { return "EchoReference"; }
+
+protected:
+    void consume(AudioFrame& frame) override;
+
+private:
+    EchoCanceller& m_Canceller;
+    int m_Channels;
+};
+
+// Appends every datagram to a recording file ([u16 big endian length][payload] records)
+// and passes it on unchanged, so it can end a chain or tap into one
+class RecordStage : public TransformStage<Datagram, Datagram>
+{
+public:
+    RecordStage(const std::string& path, Port<Datagram> input, Port<Datagram> output);
+    ~RecordStage() override;
+    const char* name() const override { return "Record"; }
+    bool start() override;
+
+protected:
+    void consume(Datagram& datagram) override;
+
+private:
+    std::string m_Path;
+    std::ofstream m_File;
+};
+
+// --- Sinks ---
+
+// Sends datagrams to the configured remote peer, sealed in place first when there is a key
+class SendStage : public ConsumerStage<Datagram>
+{
+public:
+    SendStage(ITransport& transport, const MediaKey* key, Port<Datagram> input);
+    const char* name() const override { return "Send"; }
+
+protected:
+    void consume(Datagram& datagram) override;
+
+private:
+    ITransport& m_Transport;
+    std::unique_ptr<MediaSealer> m_Sealer;  // null = send in the clear
+};
+
+// Sends every datagram back to the peer it was received from (echo server), sealed in place
+// first when there is a key
+class ReflectStage : public ConsumerStage<Datagram>
+{
+public:
+    ReflectStage(ITransport& transport, const MediaKey* key, Port<Datagram> input);
+    const char* name() const override { return "Reflect"; }
+
+protected:
+    void consume(Datagram& datagram) override;
+
+private:
+    ITransport& m_Transport;
+    std::unique_ptr<MediaResealer> m_Sealer;    // null = send in the clear
+};
+
+// Conference bridge (see Bridge.hpp): forwards every participant's datagrams to the others
+// and exchanges streams with bridges on other nodes over trunks
+class BridgeStage : public ConsumerStage<Datagram>
+{
+public:
+    BridgeStage(const BridgeConfig& config, ITransport& transport, const MediaKey* key,
+        std::chrono::milliseconds timeout, Port<Datagram> input);
+    const char* name() const override { return "Bridge"; }
+
+protected:
+    void consume(Datagram& datagram) override;
+    std::chrono::milliseconds housekeepingInterval() const override { return m_FlushInterval; }
+    void housekeeping() override;
+
+private:
+    Bridge m_Bridge;
+    std::chrono::milliseconds m_FlushInterval;
+};
+
+// Feeds decoded PCM frames to an IAudioPlayback (device callback thread)
+class PlaybackStage : public IStage
+{
+public:
+    PlaybackStage(IAudioPlayback& playback, const std::string& backendName, Port<AudioFrame> input);
+    const char* name() const override { return "Playback"; }
+    ThreadingPolicy threading() const override { return ThreadingPolicy::Callback; }
+    bool start() override;
+    void stop() override;
+
+private:
+    IAudioPlayback& m_Playback;
+    std::string m_BackendName;
+};
+
+#endif // PIPELINE_STAGES_HPP
@@ -1,6 +1,9 @@
 #ifndef PORTAUDIO_CAPTURE_HPP
 #define PORTAUDIO_CAPTURE_HPP
 
+#include "AudioReframer.hpp"
+#include "FrameTracer.hpp"
+#include "PerfCounters.hpp"
 #include "ThreadSafeQueue.hpp"
 #include "interfaces/IAudioSource.hpp"
 #include <portaudio.h>
@@ -16,6 +19,9 @@ private:
     int m_Channels;
     int m_FrameSize;
     std::atomic<bool> a_IsRunning;
+    FrameAssembler m_Assembler;     // device buffers -> exact codec frames, callback thread only
+    PerfSite& m_CallbackPerf;       // perf.audio.capture.*
+    TraceBuffer* m_TraceBuffer = nullptr;   // reserved for the callback thread, null if not tracing
 
     // static callback to read PCM from kernel
     static int paInputCallback(const void* inputBuffer, void* outputBuffer,
@@ -0,0 +1,11 @@
+#ifndef PORTAUDIO_GLOBAL_HPP
+#define PORTAUDIO_GLOBAL_HPP
+
+// Reference counted Pa_Initialize/Pa_Terminate. Every PortAudio device calls InitPortAudio()
+// when it is created and TerminatePortAudio() when it is destroyed, so PortAudio is only
+// initialized while a PortAudio backend is actually in use. InitPortAudio() throws on failure,
+// TerminatePortAudio() never throws (it runs in destructors) and logs a failure instead.
+void InitPortAudio();
+void TerminatePortAudio();
+
+#endif // PORTAUDIO_GLOBAL_HPP
@@ -1,6 +1,10 @@
 #ifndef PORT_AUDIO_PLAYBACK_HPP
 #define PORT_AUDIO_PLAYBACK_HPP
 
+#include "AudioReframer.hpp"
+#include "FrameTracer.hpp"
+#include "Metrics.hpp"
+#include "PerfCounters.hpp"
 #include "ThreadSafeQueue.hpp"
 #include "interfaces/IAudioPlayback.hpp"
 #include <atomic>
@@ -28,6 +32,10 @@ private:
     int m_Channels;
     int m_FrameSize;
     std::atomic_bool a_IsRunning = false;
+    FrameSplitter m_Splitter;       // decoded frames -> host buffers, callback thread only
+    MetricValue& m_UnderrunMetric;  // audio.playback.underrun_frames
+    PerfSite& m_CallbackPerf;       // perf.audio.playback.*
+    TraceBuffer* m_TraceBuffer = nullptr;   // reserved for the callback thread, null if not tracing
 
     // Callback function for PortAudio output stream
     static int paOutputCallback(const void* inputBuffer,
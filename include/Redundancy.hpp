@@ -0,0 +1,142 @@
+#ifndef REDUNDANCY_HPP
+#define REDUNDANCY_HPP
+
+#include "Metrics.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// How many earlier payloads every datagram repeats, parsed from "off", "<depth>" (fixed) or
+// "auto[=<max depth>]" (follows the loss bursts the receivers report, 0 on a clean link)
+struct RedundancyConfig
+{
+    static constexpr int kMaxDepth = 7;     // 3 bits in the header flags
+
+    bool enabled = false;
+    bool adaptive = false;
+    int depth = 0;                  // fixed mode: payloads repeated; adaptive: the upper bound
+
+    // Returns false (config unchanged) on a malformed spec or a depth outside 0-kMaxDepth
+    static bool parse(const std::string& spec, RedundancyConfig& config);
+    std::string describe() const;
+};
+
+// Framing of a datagram whose header has PacketHeader::kFlagRedundancy set: the payloads of the
+// `count` datagrams before it (sequence - count ... sequence - 1, oldest first) ahead of its own:
+//
+//     u8 count | count lengths | count payloads | own payload
+//
+// A length below 0x80 takes one byte, longer ones two (big endian, high bit set, up to 32767).
+// A 10 ms voice frame is well below 128 bytes, so repeating it costs one byte of overhead.
+namespace RedundancyFormat {
+
+struct Block
+{
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+};
+
+constexpr size_t kMaxBlockSize = 0x7FFF;
+
+// Appends the framed payload to `out`; `previous` holds the repeated payloads, oldest first
+void write(const std::vector<const std::vector<unsigned char>*>& previous, const unsigned char* payload,
+    size_t payloadSize, std::vector<unsigned char>& out);
+
+// Splits a framed payload into the repeated blocks (oldest first) and the datagram's own payload.
+// Returns false if it is truncated or malformed.
+bool read(const unsigned char* data, size_t size, std::vector<Block>& previous, Block& payload);
+
+} // namespace RedundancyFormat
+
+// Sequence numbers of one stream that were already decoded, within the last 64 datagrams. Lets
+// the decode side skip what a redundant copy already filled in and find the gaps to fill.
+class DecodeHistory
+{
+public:
+    void reset() { b_Started = false; m_Mask = 0; }
+
+    bool started() const { return b_Started; }
+    uint16_t highest() const { return m_Highest; }
+    // false for sequences older than the window, so very late datagrams still get decoded
+    bool contains(uint16_t sequence) const;
+    void mark(uint16_t sequence);
+
+private:
+    bool b_Started = false;
+    uint16_t m_Highest = 0;
+    uint64_t m_Mask = 0;        // bit i: m_Highest - i was decoded
+};
+
+// Steers the redundancy depth of the local encoder from loss bursts measured at the remote end,
+// with the receivers' reports riding in the header flags of the media they send back:
+//
+//   - the decode side reports every sequence gap it sees (onLossBurst) and the depth each
+//     remote stream asks for (onPeerRequest)
+//   - the encode side writes requestedDepth() into its own outgoing headers and repeats
+//     sendDepth() earlier payloads in every datagram
+//
+// Both values are the largest seen over a sliding window (kBurstWindow for bursts, kRequestWindow
+// for requests), so a burst raises the depth right away and a clean link brings it back to 0.
+// In fixed mode sendDepth() is the configured depth regardless. Through an echo server the
+// requests come back to their sender, which then covers the loss of the round trip.
+// Updated from the decode thread (including its housekeeping ticks), read from the encode thread.
+class RedundancyController
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr std::chrono::seconds kBurstWindow{10};
+    static constexpr std::chrono::seconds kRequestWindow{3};
+
+    explicit RedundancyController(const RedundancyConfig& config);
+
+    RedundancyController(const RedundancyController&) = delete;
+    RedundancyController& operator=(const RedundancyController&) = delete;
+
+    // `length` consecutive datagrams of a received stream went missing
+    void onLossBurst(int length, Clock::time_point now);
+    // A received stream's sender asks for `depth` repeated payloads
+    void onPeerRequest(int depth, Clock::time_point now);
+    // Ages out old bursts and requests, called periodically by the decode side
+    void tick(Clock::time_point now);
+
+    // Payloads the encoder repeats in every datagram
+    int sendDepth() const { return a_SendDepth.load(std::memory_order_relaxed); }
+    // Depth to ask the remote senders for, written into outgoing headers
+    int requestedDepth() const { return a_RequestedDepth.load(std::memory_order_relaxed); }
+
+    const RedundancyConfig& config() const { return m_Config; }
+
+private:
+    // Largest value seen over the last one to two windows: two buckets, the older one dropped
+    // when a window has passed
+    struct WindowedMax
+    {
+        int current = 0;
+        int previous = 0;
+        Clock::time_point windowStart{};
+
+        void add(int value, Clock::time_point now, Clock::duration window);
+        void advance(Clock::time_point now, Clock::duration window);
+        int value() const { return current > previous ? current : previous; }
+    };
+
+    void publish();
+
+    RedundancyConfig m_Config;
+    WindowedMax m_Bursts;
+    WindowedMax m_Requests;
+    std::atomic<int> a_SendDepth{0};
+    std::atomic<int> a_RequestedDepth{0};
+
+    MetricValue& m_SendDepthMetric;
+    MetricValue& m_RequestedDepthMetric;
+    MetricValue& m_BurstsMetric;
+    MetricValue& m_LongestBurstMetric;
+};
+
+#endif // REDUNDANCY_HPP
@@ -0,0 +1,58 @@
+#ifndef REPACKETIZER_HPP
+#define REPACKETIZER_HPP
+
+#include <opus.h>
+#include <vector>
+
+// Thin wrapper around the Opus repacketizer (`opus_repacketizer_*`).
+// On the send side it bundles several small encoded frames into a single
+// multi-frame Opus packet so that one UDP datagram carries e.g. 40 ms of
+// audio while capture keeps running at 10 ms frames.
+// On the receive side it splits such a packet back into single-frame packets.
+class Repacketizer
+{
+public:
+    // Opus allows at most 120 ms of audio (and 48 frames) per packet,
+    // we cap the aggregation factor well below that.
+    static constexpr int kMinFramesPerPacket = 1;
+    static constexpr int kMaxFramesPerPacket = 6;
+    static constexpr int kMaxPacketDurationMs = 120;
+    static constexpr int kMaxFrameBytes = 1275; // largest single Opus frame
+
+    explicit Repacketizer(int framesPerPacket = kMinFramesPerPacket);
+    ~Repacketizer();
+
+    Repacketizer(const Repacketizer&) = delete;
+    Repacketizer& operator=(const Repacketizer&) = delete;
+
+    // Appends one single-frame Opus packet to the pending bundle. The data is copied.
+    // Returns OPUS_OK on success, OPUS_INVALID_PACKET if the frame has a different TOC
+    // than the pending ones (caller should flush() and append again), or another Opus error.
+    int append(const unsigned char* data, int len);
+
+    // Writes all pending frames as one Opus packet into `out` and resets the bundle.
+    // Returns the packet size in bytes, 0 if nothing is pending, or a negative Opus error code.
+    int flush(unsigned char* out, int maxLen);
+
+    // Splits `packet` into one single-frame Opus packet per contained frame.
+    // Returns the number of frames written to `frames`, or a negative Opus error code.
+    int split(const unsigned char* packet, int len, std::vector<std::vector<char>>& frames);
+
+    int pendingFrames() const { return m_Pending; }
+    int framesPerPacket() const { return m_FramesPerPacket; }
+    bool isFull() const { return m_Pending >= m_FramesPerPacket; }
+
+    // true if `framesPerPacket` frames of `frameSize` samples fit into a single Opus packet
+    static bool isValidPacketTime(int framesPerPacket, int frameSize, int sampleRate);
+
+private:
+    OpusRepacketizer* m_State = nullptr;
+    int m_FramesPerPacket;
+    int m_Pending = 0;
+
+    // The repacketizer keeps pointers into the appended data until it is re-initialized,
+    // so every pending frame lives in a fixed slot of this buffer.
+    std::vector<unsigned char> m_FrameStorage;
+};
+
+#endif // REPACKETIZER_HPP
@@ -0,0 +1,63 @@
+#ifndef RESAMPLER_HPP
+#define RESAMPLER_HPP
+
+#include "interfaces/IAudioSource.hpp"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Quality/latency trade-off of the Resampler: longer filters have a sharper cutoff and less
+// aliasing, and delay the signal by half their length.
+enum class ResamplerQuality
+{
+    Fast,       // 16 taps, passband to 85% of Nyquist, ~0.17 ms at 48 kHz
+    Balanced,   // 32 taps, 91%, ~0.33 ms
+    High        // 64 taps, 95%, ~0.67 ms
+};
+
+// Polyphase sample-rate converter for interleaved 16-bit PCM, between any two rates whose
+// ratio reduces to L/M with L up to kMaxPhases (44.1 <-> 48 kHz is 147/160).
+//
+// Each output sample is one dot product of a Kaiser-windowed sinc, precomputed for each of the
+// L fractional positions (phases), against a contiguous window of one channel's input history.
+// The dot product runs with AVX2/FMA when the CPU has it (checked once at runtime), otherwise
+// SSE, or scalar code on other targets.
+class Resampler
+{
+public:
+    static constexpr int kMaxPhases = 1024;
+
+    // Throws std::invalid_argument for rates whose ratio needs more than kMaxPhases phases
+    Resampler(int inputRate, int outputRate, int channels, ResamplerQuality quality = ResamplerQuality::Balanced);
+
+    // "fast", "balanced" (also the empty string) or "high"
+    static bool parseQuality(const std::string& name, ResamplerQuality& quality);
+    static const char* qualityName(ResamplerQuality quality);
+    // Name of the dot product implementation in use: "avx2", "sse" or "scalar"
+    static const char* kernelName();
+
+    // Converts `frames` interleaved input sample frames and appends the output to `out`.
+    // Returns the number of sample frames appended.
+    size_t process(const opus_int16* in, size_t frames, AudioFrame& out);
+
+    int inputRate() const { return m_InputRate; }
+    int outputRate() const { return m_OutputRate; }
+    // Delay added to the signal, in input samples
+    int latencyFrames() const { return m_Taps / 2; }
+
+private:
+    int m_InputRate;
+    int m_OutputRate;
+    int m_Channels;
+    int m_Taps;
+    int m_Interpolation;    // L: output rate / gcd
+    int m_Decimation;       // M: input rate / gcd
+
+    std::vector<float> m_Filters;               // L phases x m_Taps coefficients
+    std::vector<std::vector<float>> m_History;  // per channel, input not yet fully consumed
+    size_t m_Position = 0;                      // window start in m_History
+    int m_Phase = 0;
+};
+
+#endif // RESAMPLER_HPP
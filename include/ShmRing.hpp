@@ -0,0 +1,88 @@
+#ifndef SHM_RING_HPP
+#define SHM_RING_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Single-producer single-consumer ring of variable-size records in a POSIX shared-memory
+// segment ("/echo-link.<name>"), for datagrams between two processes on the same host.
+//
+// The reader creates the segment (its inbox) and removes it on close; the writer attaches to
+// it by name. Records are a u32 length and the bytes, 8-byte aligned; a record that doesn't fit
+// before the end of the buffer starts over at offset 0 behind a skip marker. Producer and
+// consumer positions are free-running 64-bit byte counts on their own cache lines.
+//
+// Records are written in place (reserve/commit) and read in place (peek/release), so a
+// payload is copied once, straight into the shared buffer. A reader with nothing to read sleeps
+// on a futex in the segment; writers only make the wake-up syscall when it actually sleeps.
+class ShmRing
+{
+public:
+    static constexpr size_t kDefaultCapacity = 1 << 20;    // bytes of records, a power of two
+    static constexpr size_t kMaxRecordSize = 65536;
+
+    ShmRing() = default;
+    ~ShmRing();
+
+    ShmRing(const ShmRing&) = delete;
+    ShmRing& operator=(const ShmRing&) = delete;
+
+    // Reader side: creates the inbox `name` with `capacity` bytes (rounded up to a power of two).
+    // A segment left behind by a reader that died is replaced; false if a live reader has it.
+    bool create(const std::string& name, size_t capacity = kDefaultCapacity);
+
+    // Writer side: attaches to the inbox `name` and claims its writer slot. False if there is no
+    // such inbox (yet), its reader is gone or another live process writes to it.
+    bool attach(const std::string& name);
+
+    // Unmaps the segment: the reader marks it closed and removes the name, the writer frees its slot
+    void close();
+
+    bool isOpen() const { return m_Header != nullptr; }
+
+    // --- Producer ---
+
+    // Space for a record of `size` bytes, written in place until commit(); null if the ring is
+    // full or the record too large
+    unsigned char* reserve(size_t size);
+    // Publishes the reserved record and wakes the reader if it sleeps
+    void commit();
+    // reserve + copy + commit
+    bool write(const void* data, size_t size);
+    // Whether the reader still has the inbox open (it may have stopped or died since attach())
+    bool readerAlive() const;
+
+    // --- Consumer ---
+
+    // The oldest record in place, null if the ring is empty. Valid until release().
+    const unsigned char* peek(size_t& size);
+    // Frees the record returned by peek()
+    void release();
+    // Sleeps until a record is published, wake() is called or `timeout` passes
+    void wait(std::chrono::milliseconds timeout);
+    // Interrupts wait() (from any thread or process)
+    void wake();
+
+    static std::string segmentName(const std::string& name) { return "/echo-link." + name; }
+
+private:
+    struct Header;
+
+    bool map(int fd, size_t size);
+    void wakeReader();
+
+    Header* m_Header = nullptr;
+    unsigned char* m_Data = nullptr;
+    size_t m_MappedSize = 0;
+    uint64_t m_Mask = 0;
+    bool b_Reader = false;
+    std::string m_Name;
+
+    uint64_t m_Position = 0;    // producer: head of the reserved record, consumer: tail
+    uint64_t m_RecordEnd = 0;   // end of the reserved / peeked record
+};
+
+#endif // SHM_RING_HPP
@@ -0,0 +1,72 @@
+#ifndef SHM_TRANSPORT_HPP
+#define SHM_TRANSPORT_HPP
+
+#include "Metrics.hpp"
+#include "ShmRing.hpp"
+#include "interfaces/ITransport.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Datagrams to/from another echo-link process on the same host through two shared-memory
+// rings (see ShmRing.hpp) instead of UDP loopback: each process reads its own inbox and writes
+// into the inbox of the process it talks to, like a local and a remote port. No syscalls per
+// datagram while both sides are busy; a full ring or a missing peer drops the datagram, as UDP
+// would. Point to point: every datagram goes to the remote inbox, whoever it came from.
+class ShmTransport : public ITransport
+{
+public:
+    static constexpr std::chrono::milliseconds kAttachRetryInterval{1000};  // remote inbox not there (yet)
+    static constexpr std::chrono::milliseconds kWaitTimeout{100};           // receive thread checks for stop()
+    static constexpr int kMaxRecordsPerWakeup = 64;
+
+    ShmTransport();
+    ~ShmTransport() override;
+
+    // Creates the inbox `localName` and remembers `remoteName` (empty = receive only), attached
+    // on the first send. Returns false if the inbox can't be created.
+    bool init(const std::string& localName, const std::string& remoteName, size_t capacity = ShmRing::kDefaultCapacity);
+
+    void setIncomingQueue(std::shared_ptr<ThreadSafeQueue<Datagram>> queue) override;
+
+    // Starts the receive thread
+    void startReceive() override;
+
+    // Copies the datagram into the remote inbox; safe to call from several threads
+    void sendPacket(const NetworkPacket& data) override;
+
+    // Same as sendPacket: the channel has a single peer
+    void sendPacketTo(const NetworkPacket& data, const asio::ip::udp::endpoint& peer) override;
+
+    // Stops the receive thread and removes the inbox
+    void stop() override;
+
+private:
+    void receiveLoop();
+
+    // Attaches to the remote inbox if not attached, at most every kAttachRetryInterval
+    bool ensureAttached(std::chrono::steady_clock::time_point now);
+
+    ShmRing m_Inbox;
+    std::string m_LocalName;
+    std::shared_ptr<ThreadSafeQueue<Datagram>> m_IncomingQueue;
+    std::thread m_ReceiveThread;
+    std::atomic_bool a_IsRunning{false};
+
+    std::mutex m_SendMutex;             // the ring takes one producer at a time
+    ShmRing m_Outbox;
+    std::string m_RemoteName;
+    std::chrono::steady_clock::time_point m_NextAttach{};   // also when the reader is checked for liveness
+
+    MetricValue& m_PacketsSentMetric;       // shm.packets_sent
+    MetricValue& m_BytesSentMetric;         // shm.bytes_sent
+    MetricValue& m_SendDropsMetric;         // shm.send_drops: ring full or no reader
+    MetricValue& m_PacketsReceivedMetric;   // shm.packets_received
+    MetricValue& m_BytesReceivedMetric;     // shm.bytes_received
+    MetricValue& m_WakeupsMetric;           // shm.wakeups: receive thread woke up with work
+};
+
+#endif // SHM_TRANSPORT_HPP
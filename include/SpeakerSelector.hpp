@@ -0,0 +1,70 @@
+#ifndef SPEAKER_SELECTOR_HPP
+#define SPEAKER_SELECTOR_HPP
+
+#include "Metrics.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Picks the N loudest of many streams from the audio level in their headers (see PacketHeader),
+// so a bridge forwards only those and nobody has to decode the rest.
+//
+// Every stream's level is smoothed with a fast attack and a slow release, so a talker keeps their
+// slot through the pauses between words. The ranking is redone every kReselectInterval. A stream
+// only takes a slot from a selected one that is kHysteresisDb quieter and held its slot for
+// kMinHold, so the set doesn't flap between talkers of about the same loudness. Free slots are
+// given out right away, a room with fewer than N streams forwards them all.
+class SpeakerSelector
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr double kAttack = 0.3;          // smoothing per datagram while the level rises
+    static constexpr double kRelease = 0.02;        // and while it falls (about 1 s at 20 ms packets)
+    static constexpr double kHysteresisDb = 6.0;
+    static constexpr std::chrono::milliseconds kMinHold{1000};
+    static constexpr std::chrono::milliseconds kReselectInterval{100};
+
+    // Streams silent for `timeout` are forgotten and free their slot
+    SpeakerSelector(size_t maxSpeakers, std::chrono::milliseconds timeout);
+
+    size_t maxSpeakers() const { return m_MaxSpeakers; }
+
+    // Records a datagram's level (-dBov, see PacketHeader). True if the stream is selected.
+    bool onLevel(uint32_t ssrc, uint8_t level, Clock::time_point now);
+
+    // Re-ranks the streams once per kReselectInterval and forgets the silent ones
+    void update(Clock::time_point now);
+
+private:
+    struct Speaker
+    {
+        uint32_t ssrc = 0;
+        double levelDb = -127.0;            // smoothed, dBov
+        Clock::time_point lastSeen;
+        Clock::time_point selectedSince;
+        bool selected = false;
+    };
+
+    void select(Speaker& speaker, Clock::time_point now);
+    void deselect(Speaker& speaker);
+
+    size_t m_MaxSpeakers;
+    std::chrono::milliseconds m_Timeout;
+    Clock::time_point m_NextReselect;
+    size_t m_SelectedCount = 0;
+
+    std::unordered_map<uint32_t, Speaker> m_Speakers;   // by SSRC
+    std::vector<Speaker*> m_Candidates;                 // scratch for the ranking
+    std::vector<Speaker*> m_Holders;
+
+    MetricValue& m_StreamsMetric;       // speakers.streams: streams being ranked
+    MetricValue& m_SelectedMetric;      // speakers.selected
+    MetricValue& m_SwitchesMetric;      // speakers.switches: slots handed to a louder stream
+    MetricValue& m_FilteredMetric;      // speakers.filtered: datagrams of streams not selected
+};
+
+#endif // SPEAKER_SELECTOR_HPP
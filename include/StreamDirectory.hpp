@@ -0,0 +1,58 @@
+#ifndef STREAM_DIRECTORY_HPP
+#define STREAM_DIRECTORY_HPP
+
+#include "PeerTable.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// Compact handle of a received stream: slot index in the low kIndexBits, generation above.
+// The generation changes every time a slot is reused, so a holder of a stale id can tell.
+using StreamId = uint32_t;
+constexpr StreamId kNoStreamId = 0xFFFFFFFFu;
+
+// Assigns StreamIds to (endpoint, SSRC) keys through a PeerTable, so the receive path does
+// one flat-table lookup per datagram and everything downstream indexes per-stream state
+// directly by id. Streams not seen for a while are released by expire().
+// Not thread-safe.
+class StreamDirectory
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr unsigned kIndexBits = 20;
+    static constexpr uint32_t kIndexMask = (1u << kIndexBits) - 1;
+    static constexpr size_t kMaxStreams = kIndexMask;   // keeps every id distinct from kNoStreamId
+
+    explicit StreamDirectory(size_t maxStreams);
+
+    // Id of the stream `key` belongs to, assigning one to new streams; kNoStreamId when full
+    StreamId resolve(const PeerKey& key, Clock::time_point now);
+    // True if `key` has an id, without touching its last-seen time
+    bool contains(const PeerKey& key) const { return m_Table.find(key) != PeerTable::kNotFound; }
+    // Frees the id's slot; false (and no effect) if the id is stale
+    bool release(StreamId id);
+    // Releases every stream last seen before `cutoff`, returns how many
+    size_t expire(Clock::time_point cutoff);
+
+    size_t size() const { return m_Table.size(); }
+    size_t maxStreams() const { return m_Slots.size(); }
+
+    static uint32_t indexOf(StreamId id) { return id & kIndexMask; }
+
+private:
+    struct Slot
+    {
+        PeerKey key;
+        Clock::time_point lastSeen;
+        StreamId id = kNoStreamId;      // kNoStreamId while free
+        uint32_t generation = 0;
+    };
+
+    PeerTable m_Table;                  // key -> id
+    std::vector<Slot> m_Slots;
+    std::vector<uint32_t> m_FreeSlots;
+};
+
+#endif // STREAM_DIRECTORY_HPP
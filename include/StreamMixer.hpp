@@ -0,0 +1,68 @@
+#ifndef STREAM_MIXER_HPP
+#define STREAM_MIXER_HPP
+
+#include "AudioFrame.hpp"
+#include "Metrics.hpp"
+#include "StreamDirectory.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <utility>
+#include <vector>
+
+// Mixes the decoded frames of concurrent streams into one, so playback gets one frame per frame
+// period however many participants talk (a bridge forwards every stream unmixed).
+//
+// Every stream queues its frames in a short FIFO, its jitter buffer. A mixed frame goes out as
+// soon as every stream in the mix has a frame queued, or once one stream has more than
+// kJitterFrames queued: the others are late or lost, a late frame is mixed into a later period.
+// A single stream is passed through as it arrives. Samples are summed in 32 bits and clipped to
+// 16. A stream that had nothing for kMaxMissedMixes mixes in a row leaves the mix, so a sender
+// that stopped doesn't hold the others back. One running fast (burst, clock drift) pushes the
+// mix along instead of queueing up, so no stream holds more than kJitterFrames.
+// Not thread-safe, owned by the stage that decodes.
+class StreamMixer
+{
+public:
+    static constexpr size_t kJitterFrames = 2;
+    static constexpr int kMaxMissedMixes = 25;      // 0.5 s at 20 ms frames
+
+    StreamMixer();
+
+    // Queues a decoded frame of `stream` and calls onFrame(AudioFrame&&) for every mixed frame
+    // that is due
+    template <typename OnFrame>
+    void push(StreamId stream, AudioFrame&& frame, OnFrame&& onFrame)
+    {
+        queue(stream, std::move(frame));
+        while(due()) {
+            AudioFrame mixed;
+            mix(mixed);
+            onFrame(std::move(mixed));
+        }
+    }
+
+    size_t streamCount() const { return m_Streams.size(); }
+    // Frames of `stream` waiting for the others, part of its playout delay
+    size_t queuedFrames(StreamId stream) const;
+
+private:
+    struct Stream
+    {
+        StreamId id = kNoStreamId;
+        std::deque<AudioFrame> frames;
+        int missed = 0;             // mixes in a row without a frame
+    };
+
+    void queue(StreamId stream, AudioFrame&& frame);
+    bool due() const;
+    // Takes the oldest frame of every stream that has one and sums them into `out`
+    void mix(AudioFrame& out);
+
+    std::vector<Stream> m_Streams;      // a handful, a scan beats hashing
+    std::vector<int32_t> m_Sum;
+    MetricValue& m_StreamsMetric;       // mix.streams
+};
+
+#endif // STREAM_MIXER_HPP
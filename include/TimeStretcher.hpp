@@ -0,0 +1,60 @@
+#ifndef TIME_STRETCHER_HPP
+#define TIME_STRETCHER_HPP
+
+#include "interfaces/IAudioSource.hpp"
+
+#include <cstddef>
+#include <vector>
+
+// Pitch-preserving time-scale modification of interleaved 16-bit PCM, for trimming or growing
+// the audio buffered ahead of playback without dropping frames or inserting silence.
+//
+// WSOLA-style, one pitch period at a time: the period T (2.5-10 ms) is the lag where two
+// adjacent segments of length T match best (normalized cross-correlation over a mono mix, coarse
+// on a decimated signal, refined at full rate). Compressing cross-fades such a segment pair into
+// one, removing T samples; expanding cross-fades the newest period back into the one before it,
+// inserting T samples. Either happens only where the signal is periodic enough (voiced speech,
+// steady tones) or quiet, so the splice lands on a waveform that continues smoothly.
+class TimeStretcher
+{
+public:
+    enum class Mode
+    {
+        Normal,     // pass audio through
+        Compress,   // remove one period as soon as a good one is found (holds back up to 2 periods)
+        Expand      // insert one period as soon as a good one is found
+    };
+
+    TimeStretcher(int sampleRate, int channels);
+
+    // Appends `frames` sample frames, then appends to `out` whatever is ready for playback.
+    // Returns the number of sample frames inserted (> 0) or removed (< 0) by this call.
+    long process(const opus_int16* in, size_t frames, Mode mode, AudioFrame& out);
+
+    // Hands out audio held back for a compression, e.g. when the mode goes back to Normal
+    void flush(AudioFrame& out);
+
+    size_t pendingFrames() const { return m_Pending.size() / m_Channels; }
+    // Longest audio held back while compressing, in sample frames
+    size_t maxHoldbackFrames() const { return 2 * static_cast<size_t>(m_MaxPeriod); }
+
+private:
+    // Best period T in [m_MinPeriod, maxPeriod] for the segment pair mono[0, T) / mono[T, 2T),
+    // or the last 2T samples of `mono` when `endAligned`. Quiet audio gets maxPeriod, 0 means
+    // no period matches well enough.
+    int findPeriod(const std::vector<float>& mono, int maxPeriod, bool endAligned);
+    void appendCrossFade(const opus_int16* fadeOut, const opus_int16* fadeIn, int period, AudioFrame& out) const;
+    void emit(const opus_int16* data, size_t frames, AudioFrame& out);
+
+    int m_Channels;
+    int m_MinPeriod;
+    int m_MaxPeriod;
+    int m_Decimation;           // coarse search rate = sample rate / m_Decimation (~8 kHz)
+
+    AudioFrame m_Pending;       // not handed out yet
+    AudioFrame m_History;       // the newest m_MaxPeriod sample frames handed out
+    std::vector<float> m_Mono;
+    std::vector<float> m_Coarse;
+};
+
+#endif // TIME_STRETCHER_HPP
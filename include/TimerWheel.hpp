@@ -0,0 +1,104 @@
+#ifndef TIMER_WHEEL_HPP
+#define TIMER_WHEEL_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Hashed timing wheel. Timers are identified by small integer ids (e.g. a slot index) and
+// hashed into a ring of buckets by their expiry tick, so scheduling, re-scheduling and
+// cancelling are O(1) no matter how many timers are pending. advance() only walks the
+// buckets of the ticks that passed; a timer further away than one revolution stays in its
+// bucket until its tick comes round.
+class TimerWheel
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    using TimerId = uint32_t;
+
+    // tick: resolution of the wheel, timers fire up to one tick late
+    // slots: number of buckets, rounded up to a power of two
+    TimerWheel(std::chrono::milliseconds tick, size_t slots, Clock::time_point origin = Clock::now());
+
+    // Arms timer `id` to fire `delay` after `now`, replacing any pending expiry of `id`
+    void schedule(TimerId id, Clock::time_point now, std::chrono::milliseconds delay);
+    void cancel(TimerId id);
+    bool isScheduled(TimerId id) const;
+
+    // Fires every timer that expired up to `now`, calling onExpire(id) for each.
+    // onExpire may re-schedule the timer that fired, but must not cancel other timers.
+    template <typename Callback>
+    void advance(Clock::time_point now, Callback&& onExpire);
+
+    size_t pending() const { return m_Pending; }
+
+private:
+    static constexpr TimerId kNone = 0xFFFFFFFFu;
+
+    struct Node
+    {
+        TimerId prev = kNone;
+        TimerId next = kNone;
+        uint64_t expiryTick = 0;
+        bool armed = false;
+    };
+
+    uint64_t tickAt(Clock::time_point time) const;
+    size_t slotOf(uint64_t tick) const { return static_cast<size_t>(tick) & m_SlotMask; }
+    void link(TimerId id);
+    void unlink(TimerId id);
+    // Fires the expired timers of one bucket
+    template <typename Callback>
+    void expireSlot(size_t slot, uint64_t upToTick, Callback& onExpire);
+
+    std::chrono::milliseconds m_Tick;
+    Clock::time_point m_Origin;
+    size_t m_SlotMask;
+    uint64_t m_CurrentTick = 0;     // every tick up to this one has been processed
+    size_t m_Pending = 0;
+
+    std::vector<TimerId> m_Slots;   // head of each bucket's list
+    std::vector<Node> m_Nodes;      // indexed by TimerId, grows to the largest id used
+};
+
+template <typename Callback>
+void TimerWheel::advance(Clock::time_point now, Callback&& onExpire)
+{
+    const uint64_t target = tickAt(now);
+    if(target <= m_CurrentTick) {
+        return;
+    }
+
+    if(target - m_CurrentTick >= m_Slots.size()) {
+        // More than a revolution passed, every bucket is due once
+        for(size_t slot = 0; slot < m_Slots.size(); slot++) {
+            expireSlot(slot, target, onExpire);
+        }
+        m_CurrentTick = target;
+        return;
+    }
+
+    while(m_CurrentTick < target) {
+        m_CurrentTick++;
+        expireSlot(slotOf(m_CurrentTick), m_CurrentTick, onExpire);
+    }
+}
+
+template <typename Callback>
+void TimerWheel::expireSlot(size_t slot, uint64_t upToTick, Callback& onExpire)
+{
+    TimerId id = m_Slots[slot];
+    while(id != kNone) {
+        // Read the successor first, the callback may re-link `id` (always at a bucket head,
+        // so it won't be visited again in this pass)
+        TimerId next = m_Nodes[id].next;
+        if(m_Nodes[id].armed && m_Nodes[id].expiryTick <= upToTick) {
+            unlink(id);
+            onExpire(id);
+        }
+        id = next;
+    }
+}
+
+#endif // TIMER_WHEEL_HPP
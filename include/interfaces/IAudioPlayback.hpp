@@ -1,13 +1,12 @@
 #ifndef I_AUDIO_PLAYBACK_HPP
 #define I_AUDIO_PLAYBACK_HPP
 
+#include "../AudioFrame.hpp"
 #include "../ThreadSafeQueue.hpp"
 
 #include "opus_types.h"
 #include <vector>
 
-using AudioFrame = std::vector<opus_int16>;
-
 struct IAudioPlayback
 {
 public:
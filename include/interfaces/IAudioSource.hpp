@@ -4,12 +4,7 @@
 #include <opus/opus.h>
 #include <vector>
 #include "./ThreadSafeQueue.hpp"
-
-// Define the type of audio frame we'll be pushing
-// For raw PCM, opus_int16 (short) is common.
-// Let's assume 16-bit stereo for now.
-
-using AudioFrame = std::vector<opus_int16>;
+#include "../AudioFrame.hpp"
 
 struct IAudioSource
 {
@@ -0,0 +1,39 @@
+#ifndef I_TRANSPORT_HPP
+#define I_TRANSPORT_HPP
+
+#include <asio.hpp>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "StreamDirectory.hpp"
+#include "ThreadSafeQueue.hpp"
+
+using NetworkPacket = std::vector<char>;
+
+// A packet together with the peer it was received from (or should be sent back to)
+struct Datagram
+{
+    NetworkPacket payload;
+    asio::ip::udp::endpoint peer;
+    StreamId stream = kNoStreamId;  // resolved by the receive handler, kNoStreamId if not from the network
+    int64_t receivedNs = 0;         // receive time, ns since the Unix epoch (kernel timestamp when enabled),
+                                    // 0 if not received from a socket
+    uint32_t rollover = 0;          // sequence number wraps of the stream so far, part of the
+                                    // encryption nonce (see MediaCrypto.hpp)
+    uint64_t session = 0;           // sealing session of the sender, set when opened (MediaCrypto.hpp)
+};
+
+// Carries datagrams between echo-link processes: UDP (NetworkManager) or a shared-memory
+// channel on the same host (ShmTransport). The receive, send and reflect stages use this.
+struct ITransport
+{
+public:
+    virtual ~ITransport() = default;
+    virtual void setIncomingQueue(std::shared_ptr<ThreadSafeQueue<Datagram>> queue) = 0; // Set where to push received datagrams
+    virtual void startReceive() = 0;                                                    // Start pushing them
+    virtual void sendPacket(const NetworkPacket& data) = 0;                             // Send to the configured remote
+    virtual void sendPacketTo(const NetworkPacket& data, const asio::ip::udp::endpoint& peer) = 0; // Send to the peer a datagram came from
+    virtual void stop() = 0;                                                            // Stop receiving and sending
+};
+
+#endif // I_TRANSPORT_HPP
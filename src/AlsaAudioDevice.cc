@@ -0,0 +1,283 @@
+#ifdef ECHOLINK_HAVE_ALSA
+
+#include "AlsaAudioDevice.hpp"
+#include "AudioReframer.hpp"
+#include "Metrics.hpp"
+#include "FrameTracer.hpp"
+#include "PerfCounters.hpp"
+
+#include <alsa/asoundlib.h>
+#include <cerrno>
+#include <iostream>
+
+namespace {
+
+constexpr int kWaitTimeoutMs = 100;     // wake up regularly to notice stop()
+constexpr int kBufferPeriods = 2;       // DMA ring size in periods (one in flight, one being filled)
+
+// Opens `device` for mmap interleaved S16 access with a period of `frameSize` frames.
+// Returns nullptr (and logs) on failure.
+snd_pcm_t* openPcm(const char* logName, const std::string& device, snd_pcm_stream_t stream,
+    int sampleRate, int channels, int frameSize)
+{
+    snd_pcm_t* pcm = nullptr;
+    int err = snd_pcm_open(&pcm, device.c_str(), stream, 0);
+    if(err < 0) {
+        std::cerr << "[" << logName << "] Failed to open '" << device << "': " << snd_strerror(err) << std::endl;
+        return nullptr;
+    }
+
+    snd_pcm_hw_params_t* hw = nullptr;
+    snd_pcm_hw_params_malloc(&hw);
+    unsigned int rate = sampleRate;
+    snd_pcm_uframes_t period = frameSize;
+    snd_pcm_uframes_t buffer = static_cast<snd_pcm_uframes_t>(frameSize) * kBufferPeriods;
+
+    const char* step = nullptr;
+    if((err = snd_pcm_hw_params_any(pcm, hw)) < 0) step = "hw_params_any";
+    else if((err = snd_pcm_hw_params_set_access(pcm, hw, SND_PCM_ACCESS_MMAP_INTERLEAVED)) < 0) step = "set_access(mmap)";
+    else if((err = snd_pcm_hw_params_set_format(pcm, hw, SND_PCM_FORMAT_S16_LE)) < 0) step = "set_format(S16_LE)";
+    else if((err = snd_pcm_hw_params_set_channels(pcm, hw, channels)) < 0) step = "set_channels";
+    else if((err = snd_pcm_hw_params_set_rate_near(pcm, hw, &rate, nullptr)) < 0) step = "set_rate";
+    else if((err = snd_pcm_hw_params_set_period_size_near(pcm, hw, &period, nullptr)) < 0) step = "set_period_size";
+    else if((err = snd_pcm_hw_params_set_buffer_size_near(pcm, hw, &buffer)) < 0) step = "set_buffer_size";
+    else if((err = snd_pcm_hw_params(pcm, hw)) < 0) step = "hw_params";
+    snd_pcm_hw_params_free(hw);
+
+    if(step == nullptr && rate != static_cast<unsigned int>(sampleRate)) {
+        err = -EINVAL;
+        step = "rate (device does not support the codec rate)";
+    }
+    if(step != nullptr) {
+        std::cerr << "[" << logName << "] Failed to configure '" << device << "' (" << step << "): "
+            << snd_strerror(err) << std::endl;
+        snd_pcm_close(pcm);
+        return nullptr;
+    }
+
+    snd_pcm_sw_params_t* sw = nullptr;
+    snd_pcm_sw_params_malloc(&sw);
+    snd_pcm_sw_params_current(pcm, sw);
+    snd_pcm_sw_params_set_avail_min(pcm, sw, period);
+    // Playback starts explicitly once the first period is written, capture on snd_pcm_start()
+    snd_pcm_sw_params_set_start_threshold(pcm, sw, buffer * 2);
+    err = snd_pcm_sw_params(pcm, sw);
+    snd_pcm_sw_params_free(sw);
+    if(err < 0) {
+        std::cerr << "[" << logName << "] Failed to set sw params: " << snd_strerror(err) << std::endl;
+        snd_pcm_close(pcm);
+        return nullptr;
+    }
+
+    std::cout << "[" << logName << "] Opened '" << device << "' (SR: " << rate << ", CH: " << channels
+        << ", Period: " << period << ", Buffer: " << buffer << ")" << std::endl;
+    return pcm;
+}
+
+// Address of frame `offset` in an interleaved mmap area
+opus_int16* areaFrame(const snd_pcm_channel_area_t* areas, snd_pcm_uframes_t offset)
+{
+    return reinterpret_cast<opus_int16*>(static_cast<char*>(areas[0].addr)
+        + areas[0].first / 8 + offset * (areas[0].step / 8));
+}
+
+// Waits until at least `minFrames` can be transferred. Returns available frames, 0 on timeout,
+// or a negative error that could not be recovered.
+snd_pcm_sframes_t waitAvailable(const char* logName, snd_pcm_t* pcm, snd_pcm_uframes_t minFrames)
+{
+    snd_pcm_sframes_t avail = snd_pcm_avail_update(pcm);
+    if(avail < 0) {
+        std::cerr << "[" << logName << "] xrun: " << snd_strerror(avail) << ", recovering" << std::endl;
+        int err = snd_pcm_recover(pcm, avail, 1);
+        return (err < 0) ? err : 0;
+    }
+    if(static_cast<snd_pcm_uframes_t>(avail) < minFrames) {
+        snd_pcm_wait(pcm, kWaitTimeoutMs);
+        return 0;
+    }
+    return avail;
+}
+
+} // namespace
+
+// --- AlsaCapture ---
+
+AlsaCapture::AlsaCapture(const std::string& device, int sampleRate, int channels, int frameSize)
+    : m_Device(device), m_SampleRate(sampleRate), m_Channels(channels), m_FrameSize(frameSize)
+{}
+
+AlsaCapture::~AlsaCapture()
+{
+    stop();
+}
+
+bool AlsaCapture::start()
+{
+    if(m_OutputQueue == nullptr) {
+        std::cerr << "[AlsaCapture] Output queue not set. cannot start capture" << std::endl;
+        return false;
+    }
+    if(a_IsRunning.load()) {
+        return true;
+    }
+
+    m_Pcm = openPcm("AlsaCapture", m_Device, SND_PCM_STREAM_CAPTURE, m_SampleRate, m_Channels, m_FrameSize);
+    if(!m_Pcm) {
+        return false;
+    }
+    int err = snd_pcm_start(m_Pcm);
+    if(err < 0) {
+        std::cerr << "[AlsaCapture] Failed to start capture: " << snd_strerror(err) << std::endl;
+        snd_pcm_close(m_Pcm);
+        m_Pcm = nullptr;
+        return false;
+    }
+
+    a_IsRunning.store(true);
+    m_CaptureThread = std::thread(&AlsaCapture::captureLoop, this);
+    std::cout << "[AlsaCapture] Started audio capture" << std::endl;
+    return true;
+}
+
+void AlsaCapture::stop()
+{
+    if(a_IsRunning.load()) {
+        a_IsRunning.store(false);
+        if(m_CaptureThread.joinable()) {
+            m_CaptureThread.join();
+        }
+        snd_pcm_drop(m_Pcm);
+        snd_pcm_close(m_Pcm);
+        m_Pcm = nullptr;
+        std::cout << "[AlsaCapture] Audio capture stopped." << std::endl;
+    }
+}
+
+void AlsaCapture::captureLoop()
+{
+    FrameAssembler assembler(m_FrameSize, m_Channels);
+    PerfSite& perfSite = PerfCounters::site("audio.capture");
+    FrameTracer::nameThread("audio.capture");
+
+    while(a_IsRunning.load()) {
+        snd_pcm_sframes_t avail = waitAvailable("AlsaCapture", m_Pcm, m_FrameSize);
+        if(avail < 0) {
+            break;
+        }
+        PerfScope perf(perfSite);
+        TraceScope span("audio", "capture", "frame", assembler.nextTraceId());
+
+        snd_pcm_uframes_t remaining = avail;
+        while(remaining > 0) {
+            const snd_pcm_channel_area_t* areas = nullptr;
+            snd_pcm_uframes_t offset = 0;
+            snd_pcm_uframes_t frames = remaining;
+            if(snd_pcm_mmap_begin(m_Pcm, &areas, &offset, &frames) < 0) {
+                break;
+            }
+
+            // Copy straight out of the DMA ring into the frame being assembled
+            assembler.push(areaFrame(areas, offset), frames,
+                [this](AudioFrame& frame) { m_OutputQueue->push(std::move(frame)); });   // no-op once the queue is shut down
+
+            snd_pcm_mmap_commit(m_Pcm, offset, frames);
+            remaining -= frames;
+        }
+    }
+}
+
+// --- AlsaPlayback ---
+
+AlsaPlayback::AlsaPlayback(const std::string& device, int sampleRate, int channels, int frameSize)
+    : m_Device(device), m_SampleRate(sampleRate), m_Channels(channels), m_FrameSize(frameSize)
+{}
+
+AlsaPlayback::~AlsaPlayback()
+{
+    stop();
+}
+
+bool AlsaPlayback::start()
+{
+    if(m_InputQueue == nullptr) {
+        std::cerr << "[AlsaPlayback] Error: Input queue is not initialized." << std::endl;
+        return false;
+    }
+    if(a_IsRunning.load()) {
+        std::cerr << "[AlsaPlayback] Error: Already running." << std::endl;
+        return false;
+    }
+
+    m_Pcm = openPcm("AlsaPlayback", m_Device, SND_PCM_STREAM_PLAYBACK, m_SampleRate, m_Channels, m_FrameSize);
+    if(!m_Pcm) {
+        return false;
+    }
+
+    a_IsRunning.store(true);
+    m_PlaybackThread = std::thread(&AlsaPlayback::playbackLoop, this);
+    std::cout << "[AlsaPlayback] Started playback" << std::endl;
+    return true;
+}
+
+void AlsaPlayback::stop()
+{
+    if(a_IsRunning.load()) {
+        a_IsRunning.store(false);
+        if(m_PlaybackThread.joinable()) {
+            m_PlaybackThread.join();
+        }
+        snd_pcm_drop(m_Pcm);
+        snd_pcm_close(m_Pcm);
+        m_Pcm = nullptr;
+        std::cout << "[AlsaPlayback] Stopped playback" << std::endl;
+    }
+}
+
+void AlsaPlayback::playbackLoop()
+{
+    FrameSplitter splitter(m_Channels);
+    MetricValue& underruns = Metrics::instance().get("audio.playback.underrun_frames");
+    PerfSite& perfSite = PerfCounters::site("audio.playback");
+    FrameTracer::nameThread("audio.playback");
+
+    while(a_IsRunning.load()) {
+        snd_pcm_sframes_t avail = waitAvailable("AlsaPlayback", m_Pcm, m_FrameSize);
+        if(avail < 0) {
+            break;
+        }
+        PerfScope perf(perfSite);
+        TraceScope span("audio", "playback");
+        int64_t firstTraceId = -1;
+
+        snd_pcm_uframes_t remaining = avail;
+        while(remaining > 0) {
+            const snd_pcm_channel_area_t* areas = nullptr;
+            snd_pcm_uframes_t offset = 0;
+            snd_pcm_uframes_t frames = remaining;
+            if(snd_pcm_mmap_begin(m_Pcm, &areas, &offset, &frames) < 0) {
+                break;
+            }
+
+            // Copy decoded frames straight into the DMA ring, silence where the queue ran dry
+            size_t silentFrames = splitter.pull(areaFrame(areas, offset), frames,
+                [this](AudioFrame& frame) { return m_InputQueue->try_pop(frame); });
+            Metrics::add(underruns, static_cast<int64_t>(silentFrames));
+            if(firstTraceId < 0 && splitter.firstTraceId() >= 0) {
+                firstTraceId = splitter.firstTraceId();
+                span.tag("frame", firstTraceId);
+            }
+
+            snd_pcm_mmap_commit(m_Pcm, offset, frames);
+            remaining -= frames;
+        }
+
+        if(snd_pcm_state(m_Pcm) == SND_PCM_STATE_PREPARED) {
+            snd_pcm_start(m_Pcm);
+        }
+        if(m_InputQueue->is_shutting_down()) {
+            break;
+        }
+    }
+}
+
+#endif // ECHOLINK_HAVE_ALSA
@@ -1,98 +1,192 @@
 #include "Application.hpp"
+#include "AudioBackends.hpp"
+#include "FrameTracer.hpp"
+#include "Metrics.hpp"
 #include "NetworkManager.hpp"
-#include "PortAudioCapture.hpp"
-#include "PortAudioPlayback.hpp"
+#include "PerfCounters.hpp"
+#include "Repacketizer.hpp"
+#include "Resampler.hpp"
 #include "opus_defines.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
 #include <exception>
 #include <iostream>
 #include <memory>
 #include <mutex>
-#include <portaudio.h>
 #include <stdexcept>
+#include <thread>
 #include <vector>
 
-// Port Audio status flags
-static bool g_Pa_Initialized = false;
-static int g_Pa_RefCount = 0;
-std::mutex g_Pa_Mutex;
+namespace {
 
-void InitPortAudio()
+// Puts `stage` right before (or after) every occurrence of `anchor`
+void insertStage(PipelineGraph::Description& topology, const std::string& anchor, const std::string& stage, bool after)
 {
-    std::lock_guard<std::mutex> lock(g_Pa_Mutex);
-    if(!g_Pa_Initialized)
-    {
-        PaError err = Pa_Initialize();
-        if(err != paNoError)
-        {
-            throw std::runtime_error("Failed to initialize PortAudio: " + std::string(Pa_GetErrorText(err)));
+    for(std::vector<std::string>& chain : topology) {
+        std::vector<std::string> rewritten;
+        for(const std::string& name : chain) {
+            if(name == anchor && !after) {
+                rewritten.push_back(stage);
+            }
+            rewritten.push_back(name);
+            if(name == anchor && after) {
+                rewritten.push_back(stage);
+            }
         }
-        g_Pa_Initialized = true;
-        std::cout << "[PortAudio Global] initialized successfully." << std::endl;
+        chain = std::move(rewritten);
     }
-    g_Pa_RefCount++;
 }
 
-void TerminatePortAudio()
+} // namespace
+
+Application::Application(const ApplicationConfig& config)
+    : m_Config(config),
+    m_AudioCodec(std::make_unique<AudioCodec>())
 {
-    std::lock_guard<std::mutex> lock(g_Pa_Mutex);
-    g_Pa_RefCount--;
-    if(g_Pa_RefCount == 0 && g_Pa_Initialized)
-    {
-        PaError err = Pa_Terminate();
-        if(err != paNoError)
-        {
-            throw std::runtime_error("Failed to terminate PortAudio: " + std::string(Pa_GetErrorText(err)));
+    if(m_Config.perfCounters) {
+        PerfCounters::enable();
+    }
+    if(!m_Config.frameTracePath.empty()) {
+        FrameTracer::enable();
+    }
+
+    // Resolve the topology first, it decides which modules are needed
+    PipelineGraph::Description topology = PipelineGraph::parse(PipelineGraph::resolveTopology(m_Config.topology));
+    const bool needsCapture = PipelineGraph::uses(topology, "capture");
+    const bool needsPlayback = PipelineGraph::uses(topology, "playback");
+    const int deviceRate = (m_Config.deviceSampleRate > 0) ? m_Config.deviceSampleRate : m_Config.sampleRate;
+    const bool needsEncoder = PipelineGraph::uses(topology, "encode");
+    const bool needsEchoCanceller = PipelineGraph::uses(topology, "aec") || PipelineGraph::uses(topology, "echoref");
+    const bool needsNetwork = PipelineGraph::uses(topology, "send") || PipelineGraph::uses(topology, "receive")
+        || PipelineGraph::uses(topology, "reflect") || PipelineGraph::uses(topology, "bridge");
+
+    // Initialize Audio Source/Playback backends (PortAudio is only initialized if one of them uses it)
+    // (at the device rate, with frames of the same duration as the codec's)
+    AudioBackendParams backendParams;
+    backendParams.sampleRate = deviceRate;
+    backendParams.channels = m_Config.channels;
+    backendParams.frameSize = std::max(1, static_cast<int>((static_cast<int64_t>(m_Config.frameSize) * deviceRate
+        + m_Config.sampleRate / 2) / m_Config.sampleRate));
+    if(needsCapture) {
+        m_AudioSource = AudioBackendRegistry::instance().createSource(m_Config.audioSource, backendParams);
+        std::cout << "[Application] Using '" << m_Config.audioSource << "' for input." << std::endl;
+    }
+    if(needsPlayback) {
+        m_AudioPlayback = AudioBackendRegistry::instance().createPlayback(m_Config.audioSink, backendParams);
+        std::cout << "[Application] Using '" << m_Config.audioSink << "' for output." << std::endl;
+    }
+
+    // Initialize Sample Rate Conversion between the devices and the codec
+    if(deviceRate != m_Config.sampleRate && (needsCapture || needsPlayback)) {
+        // Fail here rather than in a stage constructor if the ratio isn't supported
+        Resampler check(deviceRate, m_Config.sampleRate, m_Config.channels, m_Config.resampleQuality);
+        // Converts right at the audio devices: "capture > resample-in > ...", "... > resample-out > playback"
+        insertStage(topology, "capture", "resample-in", true);
+        insertStage(topology, "playback", "resample-out", false);
+        std::cout << "[Application] Resampling " << deviceRate << " Hz audio devices to the " << m_Config.sampleRate
+            << " Hz codec (" << Resampler::qualityName(m_Config.resampleQuality) << " quality)." << std::endl;
+    }
+
+    // Initialize Playout Time-Stretching, it steers the playback queue so it goes last
+    if(m_Config.timeStretch && needsPlayback) {
+        insertStage(topology, "playback", "stretch", false);
+        std::cout << "[Application] Time-stretching playout to keep " << m_Config.stretchTargetMs << " ms queued." << std::endl;
+    }
+
+    // Initialize Audio Codec
+    if(needsEncoder) {
+        if(!m_AudioCodec->initEncoder(m_Config.sampleRate, m_Config.channels, OPUS_APPLICATION_VOIP)) {
+            throw std::runtime_error("Failed to initialize Opus Encoder.");
+        }
+        if(m_Config.encodeBudgetShare > 0.0) {
+            m_AudioCodec->enableComplexityAutotune(m_Config.encodeBudgetShare);
         }
-        g_Pa_Initialized = false;
-        std::cout << "[PortAudio Global] terminated successfully." << std::endl;
     }
-}
+    // Decoders are created per received stream by the decode stage
 
-Application::Application(int sampleRate, int channels, int frameSize, bool networkEnabled,
-    unsigned short localPort, const std::string& remoteIp, unsigned short remotePort)
+    // Initialize Echo Cancellation, shared by the capture (aec) and playback (echoref) chains
+    if(needsEchoCanceller) {
+        if(!PipelineGraph::uses(topology, "aec") || !PipelineGraph::uses(topology, "echoref")) {
+            std::cerr << "[Application] Warning: Echo cancellation needs both the 'aec' and 'echoref' stages." << std::endl;
+        }
+        m_EchoCanceller = std::make_unique<EchoCanceller>(m_Config.sampleRate, m_Config.channels, m_Config.echoTailMs);
+    }
 
-    : b_NetworkEnabled(networkEnabled),
-    m_AudioCodec(std::make_unique<AudioCodec>()),
-    m_CapturedAudioQueue(std::make_shared<ThreadSafeQueue<AudioFrame>>()),
-    m_EncodedAudioQueue(std::make_shared<ThreadSafeQueue<std::vector<char>>>()),
-    m_IncomingNetworkQueue(std::make_shared<ThreadSafeQueue<std::vector<char>>>()),
-    m_DecodedAudioQueue(std::make_shared<ThreadSafeQueue<AudioFrame>>())
-{
-    // Init Port Audio
-    InitPortAudio();
+    // Initialize Redundancy, the decode side measures the loss bursts the encode side covers
+    if(m_Config.redundancy.enabled && (needsEncoder || PipelineGraph::uses(topology, "decode"))) {
+        m_Redundancy = std::make_unique<RedundancyController>(m_Config.redundancy);
+        std::cout << "[Application] Redundancy: " << m_Config.redundancy.describe() << "." << std::endl;
+    }
 
-    // Initialize Audio Source
-    m_AudioSource = std::make_unique<PortAudioCapture>(sampleRate, channels, frameSize);
-    std::cout << "[Application] Using PortAudioCapture (live microphone) for input." << std::endl;
-    m_AudioSource->setOutputQueue(m_CapturedAudioQueue);
+    // Initialize Repacketization (packet time = frameSize * framesPerPacket)
+    if(!Repacketizer::isValidPacketTime(m_Config.framesPerPacket, m_Config.frameSize, m_Config.sampleRate)) {
+        throw std::runtime_error("Invalid frames per packet: " + std::to_string(m_Config.framesPerPacket)
+            + " (1-" + std::to_string(Repacketizer::kMaxFramesPerPacket) + ", at most "
+            + std::to_string(Repacketizer::kMaxPacketDurationMs) + " ms per packet).");
+    }
+    if(needsEncoder) {
+        std::cout << "[Application] Packet time: " << (m_Config.frameSize * m_Config.framesPerPacket * 1000 / m_Config.sampleRate)
+            << " ms (" << m_Config.framesPerPacket << " frame(s) per packet)." << std::endl;
+    }
 
-    // Initialize Audio Playback
-    m_AudioPlayback = std::make_unique<PortAudioPlayback>(sampleRate, channels, frameSize);
-    m_AudioPlayback->setInputQueue(m_DecodedAudioQueue);
+    // Initialize Media Encryption, the network and the replay stage need the key
+    if(!m_Config.mediaSecret.empty()) {
+        m_MediaKey = std::make_unique<MediaKey>();
+        if(!MediaKey::derive(m_Config.mediaSecret, *m_MediaKey)) {
+            throw std::runtime_error(MediaKey::available()
+                ? "Failed to derive the media key."
+                : "Media encryption needs OpenSSL, this build has none.");
+        }
+        std::cout << "[Application] Media encrypted with AES-128-GCM." << std::endl;
+    }
 
-    // Initialize Audio Codec
-    if(!m_AudioCodec->initEncoder(sampleRate, channels, OPUS_APPLICATION_VOIP)) {
-        throw std::runtime_error("Failed to initialize Opus Encoder.");
+    // Conference bridges trunk over UDP, and the receive side only lets sealed audio through
+    if(PipelineGraph::uses(topology, "bridge")) {
+        if(!m_Config.shmLocal.empty()) {
+            throw std::runtime_error("The bridge needs the UDP transport, not --shm.");
+        }
+        if(m_MediaKey && !m_Config.bridge.trunks.empty()) {
+            throw std::runtime_error("Bridge trunks can't be encrypted, use trunks or a pre-shared secret.");
+        }
     }
-    if(!m_AudioCodec->initDecoder(sampleRate, channels)) {
-        throw std::runtime_error("Failed to initialize Opus Decoder.");
+
+    // Initialize the Shared-Memory Transport, the network for processes on the same host
+    if(needsNetwork && !m_Config.shmLocal.empty()) {
+        if(m_MediaKey || !m_Config.tracePath.empty()) {
+            throw std::runtime_error("Encryption and packet traces need the UDP transport, not --shm.");
+        }
+        m_ShmTransport = std::make_unique<ShmTransport>();
+        if(!m_ShmTransport->init(m_Config.shmLocal, m_Config.shmRemote)) {
+            throw std::runtime_error("Failed to initialize the shared-memory transport.");
+        }
     }
 
     // Initialize Network
-    if(b_NetworkEnabled) {
+    if(needsNetwork && !m_ShmTransport) {
         m_WorkGuard.emplace(m_Context.get_executor());
 
         m_NetworkManager = std::make_unique<NetworkManager>(m_Context);
-        if(!m_NetworkManager->init(localPort)) {
+        if(!m_NetworkManager->init(m_Config.localPort, m_Config.socketOptions)) {
             throw std::runtime_error("Failed to initialize NetworkManager.");
         }
-        m_NetworkManager->setRemoteEndpoint(remoteIp, remotePort);
-        m_NetworkManager->setIncomingQueue(m_IncomingNetworkQueue);
+        if(!m_Config.remoteIp.empty()) {
+            m_NetworkManager->setRemoteEndpoint(m_Config.remoteIp, m_Config.remotePort);
+        }
+        // Release stream ids on the schedule the decode side expires its peers
+        m_NetworkManager->setStreamTimeout(std::chrono::milliseconds(m_Config.peerExpiryTimeoutMs));
+        if(m_MediaKey) {
+            m_NetworkManager->enableEncryption(*m_MediaKey);
+        }
+        if(!m_Config.tracePath.empty() && !m_NetworkManager->startTrace(m_Config.tracePath)) {
+            throw std::runtime_error("Failed to open packet trace: " + m_Config.tracePath);
+        }
 
         // Run Asio thread
         m_AsioRunnerThread = std::thread([this](){
             std::cout << "[AsioRunner] io_context runner thread started." << std::endl;
+            FrameTracer::nameThread("asio");
             try {
                 m_Context.run();
             } catch(const std::exception &e) {
@@ -100,13 +194,40 @@ Application::Application(int sampleRate, int channels, int frameSize, bool netwo
             }
             std::cout << "[AsioRunner] io_context runner thread stopped." << std::endl;
         });
-
-        m_NetworkSendThread = std::thread(&Application::networkSendLoop, this);
     }
 
-    // Start encodin and decoding threads
-    m_EncodingThread = std::thread(&Application::encodingLoop, this);
-    m_DecodingThread = std::thread(&Application::decodingLoop, this);
+    // Build the stage graph
+    m_PipelineContext.sampleRate = m_Config.sampleRate;
+    m_PipelineContext.channels = m_Config.channels;
+    m_PipelineContext.frameSize = m_Config.frameSize;
+    m_PipelineContext.framesPerPacket = m_Config.framesPerPacket;
+    m_PipelineContext.deviceSampleRate = deviceRate;
+    m_PipelineContext.resampleQuality = m_Config.resampleQuality;
+    m_PipelineContext.dsp = m_Config.dsp;
+    m_PipelineContext.stretchTargetMs = m_Config.stretchTargetMs;
+    m_PipelineContext.audioSource = m_AudioSource.get();
+    m_PipelineContext.audioSourceName = AudioBackendRegistry::parseSpec(m_Config.audioSource).first;
+    m_PipelineContext.audioPlayback = m_AudioPlayback.get();
+    m_PipelineContext.audioPlaybackName = AudioBackendRegistry::parseSpec(m_Config.audioSink).first;
+    m_PipelineContext.codec = m_AudioCodec.get();
+    m_PipelineContext.echoCanceller = m_EchoCanceller.get();
+    m_PipelineContext.redundancy = m_Redundancy.get();
+    m_PipelineContext.network = m_NetworkManager.get();
+    m_PipelineContext.transport = m_ShmTransport ? static_cast<ITransport*>(m_ShmTransport.get()) : m_NetworkManager.get();
+    m_PipelineContext.mediaKey = m_MediaKey.get();
+    m_PipelineContext.bridge = &m_Config.bridge;
+    m_PipelineContext.recordPath = m_Config.recordPath;
+    m_PipelineContext.replayPath = m_Config.replayPath;
+    m_PipelineContext.replayRealtime = m_Config.replayRealtime;
+    m_PipelineContext.peerIdleTimeoutMs = m_Config.peerIdleTimeoutMs;
+    m_PipelineContext.peerExpiryTimeoutMs = m_Config.peerExpiryTimeoutMs;
+
+    try {
+        m_Pipeline = std::make_unique<PipelineGraph>(topology, m_PipelineContext);
+    } catch(...) {
+        stop();
+        throw;
+    }
 
     std::cout << "[Application] Setup Complete." << std::endl;
 }
@@ -114,29 +235,24 @@ Application::Application(int sampleRate, int channels, int frameSize, bool netwo
 Application::~Application()
 {
     stop();
-    TerminatePortAudio();
 }
 
 void Application::run()
 {
     std::cout << "[Application] Running.." << std::endl;
 
-    if(!m_AudioSource->start()) {
-        std::cerr << "[Application] Failed to start audio source. Exiting\n";
+    if(!m_Pipeline->start()) {
+        std::cerr << "[Application] Failed to start the pipeline. Exiting" << std::endl;
         stop();
         return;
     }
 
-    if (!m_AudioPlayback->start()) {
-        std::cerr << "[Application] Failed to start audio playback. Exiting." << std::endl;
-        stop();
+    if (m_Config.durationSeconds > 0) {
+        std::cout << "Running for " << m_Config.durationSeconds << " s." << std::endl;
+        std::this_thread::sleep_for(std::chrono::seconds(m_Config.durationSeconds));
         return;
     }
 
-    if (b_NetworkEnabled && m_NetworkManager) {
-        m_NetworkManager->startReceive();
-    }
-
     std::string line;
     std::cout << "Type 'exit' to stop." << std::endl;
     while (std::getline(std::cin, line)) {
@@ -148,17 +264,22 @@ void Application::run()
 }
 
 void Application::stop() {
+    if (b_Stopped) {
+        return;
+    }
+    b_Stopped = true;
     std::cout << "[Application] Stopping..." << std::endl;
 
-    m_CapturedAudioQueue->Shutdown();
-    m_EncodedAudioQueue->Shutdown();
-    m_IncomingNetworkQueue->Shutdown();
-    m_DecodedAudioQueue->Shutdown();
+    // Sources first, then every downstream stage once its input is closed
+    if (m_Pipeline) {
+        m_Pipeline->stop();
+    }
 
-    m_AudioSource->stop();
-    m_AudioPlayback->stop();
+    if (m_ShmTransport) {
+        m_ShmTransport->stop();
+    }
 
-    if (b_NetworkEnabled && m_NetworkManager) {
+    if (m_NetworkManager) {
         m_NetworkManager->stop();
         if (m_WorkGuard.has_value()) {
             m_WorkGuard->reset(); // This signals io_context.run() to stop if no other work is pending
@@ -166,102 +287,16 @@ void Application::stop() {
         m_Context.stop();
     }
 
-    if (m_EncodingThread.joinable()) {
-        m_EncodingThread.join();
-    }
-    if (m_DecodingThread.joinable()) {
-        m_DecodingThread.join();
-    }
-    if (b_NetworkEnabled) {
-        if (m_NetworkSendThread.joinable()) {
-            m_NetworkSendThread.join();
-        }
-        if (m_AsioRunnerThread.joinable()) {
-            m_AsioRunnerThread.join();
-        }
+    if (m_AsioRunnerThread.joinable()) {
+        m_AsioRunnerThread.join();
     }
 
-    std::cout << "[Application] Stopped." << std::endl;
-}
-
-void Application::encodingLoop() {
-    std::cout << "[Encoding Thread] Started." << std::endl;
-    const int maxOpusPacketSize = 4000;
-    std::vector<char> opusPacket(maxOpusPacketSize);
-
-    while (true) {
-        AudioFrame rawFrame;
-        if (!m_CapturedAudioQueue->pop(rawFrame)) {
-            std::cout << "[Encoding Thread] Source audio queue shut down. Exiting." << std::endl;
-            break;
-        }
-
-        if (rawFrame.size() != static_cast<size_t>(m_AudioSource->getFrameSize() * m_AudioSource->getChannels())) {
-            std::cerr << "[Encoding Thread] Warning: Raw frame size mismatch (" << rawFrame.size()
-                << " vs expected " << (m_AudioSource->getFrameSize() * m_AudioSource->getChannels())
-                << "). Skipping frame." << std::endl;
-            continue;
-        }
-
-        int encodedBytes = m_AudioCodec->encode(rawFrame.data(), m_AudioSource->getFrameSize(),
-            reinterpret_cast<unsigned char*>(opusPacket.data()), maxOpusPacketSize);
-
-        if (encodedBytes < 0) {
-            std::cerr << "[Encoding Thread] Opus encoding error: " << encodedBytes << std::endl;
-            continue;
-        }
-
-        NetworkPacket packet(opusPacket.data(), opusPacket.data() + encodedBytes);
-
-        if (b_NetworkEnabled && m_NetworkManager) {
-            m_EncodedAudioQueue->push(packet);
-        } else {
-            m_IncomingNetworkQueue->push(packet);
-        }
-    }
-    std::cout << "[Encoding Thread] Exited." << std::endl;
-}
-
-void Application::decodingLoop() {
-    std::cout << "[Decoding Thread] Started." << std::endl;
-    AudioFrame decodedPcm(
-        m_AudioSource->getFrameSize() * m_AudioSource->getChannels()
-    );
-
-    while (true) {
-        NetworkPacket encodedPacket;
-        if (!m_IncomingNetworkQueue->pop(encodedPacket)) {
-            std::cout << "[Decoding Thread] Incoming packet queue shut down. Exiting." << std::endl;
-            break;
-        }
-
-        int decodedSamples = m_AudioCodec->decode(
-            reinterpret_cast<const unsigned char*>(encodedPacket.data()),
-            encodedPacket.size(),
-            decodedPcm.data(),
-            m_AudioSource->getFrameSize()
-        );
-
-        if (decodedSamples < 0) {
-            std::cerr << "[Decoding Thread] Opus decoding error: " << decodedSamples << std::endl;
-            continue;
-        }
-
-        m_DecodedAudioQueue->push(AudioFrame(decodedPcm.begin(), decodedPcm.begin() + (decodedSamples * m_AudioSource->getChannels())));
+    if (PerfCounters::enabled()) {
+        PerfCounters::report(std::cout);
     }
-    std::cout << "[Decoding Thread] Exited." << std::endl;
-}
-
-void Application::networkSendLoop() {
-    if (!b_NetworkEnabled || !m_NetworkManager) {
-        return;
-    }
-    std::cout << "[Network Send Thread] Started." << std::endl;
-    while (true) {
-        NetworkPacket packetToSend;
-        if (m_EncodedAudioQueue->pop(packetToSend)) {
-            m_NetworkManager->sendPacket(packetToSend);
-        }
+    if (FrameTracer::enabled()) {
+        FrameTracer::write(m_Config.frameTracePath);
     }
-    std::cout << "[Network Send Thread] Exited." << std::endl;
+    std::cout << "[Application] Stopped. Metrics:" << std::endl;
+    Metrics::instance().dump(std::cout);
 }
@@ -0,0 +1,164 @@
+#include "AudioBackends.hpp"
+#include "FakeAudioSource.hpp"
+#include "LatencyProbe.hpp"
+#include "Metrics.hpp"
+#include "NullAudioDevice.hpp"
+#include "PortAudioCapture.hpp"
+#include "PortAudioPlayback.hpp"
+#ifdef ECHOLINK_HAVE_ALSA
+#include "AlsaAudioDevice.hpp"
+#endif
+
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+template <typename Factories>
+std::string joinNames(const Factories& factories)
+{
+    std::string names;
+    for(const auto& entry : factories) {
+        names += (names.empty() ? "" : ", ") + entry.first;
+    }
+    return names;
+}
+
+// Runs `create` and records how long the backend took to come up
+template <typename Result, typename Factory>
+Result timedCreate(const char* kind, const std::string& name, const Factory& create, const AudioBackendParams& params)
+{
+    auto begin = std::chrono::steady_clock::now();
+    Result backend = create(params);
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin);
+
+    Metrics::set(Metrics::instance().get(std::string("audio.") + kind + "." + name + ".init_us"), elapsed.count());
+    std::cout << "[AudioBackends] Created " << kind << " backend '" << name << "' in "
+        << elapsed.count() << " us" << std::endl;
+    return backend;
+}
+
+ProbeSignal probeSignal(const std::string& argument)
+{
+    ProbeSignal signal;
+    if(!LatencyProbe::parseSignal(argument, signal)) {
+        throw std::runtime_error("Unknown probe signal '" + argument + "' (probe[:chirp|mls]).");
+    }
+    return signal;
+}
+
+} // namespace
+
+AudioBackendRegistry& AudioBackendRegistry::instance()
+{
+    static AudioBackendRegistry registry;
+    return registry;
+}
+
+AudioBackendRegistry::AudioBackendRegistry()
+{
+    registerSource("portaudio", [](const AudioBackendParams& p) -> std::unique_ptr<IAudioSource> {
+        return std::make_unique<PortAudioCapture>(p.sampleRate, p.channels, p.frameSize);
+    });
+    registerPlayback("portaudio", [](const AudioBackendParams& p) -> std::unique_ptr<IAudioPlayback> {
+        return std::make_unique<PortAudioPlayback>(p.sampleRate, p.channels, p.frameSize);
+    });
+
+    registerSource("file", [](const AudioBackendParams& p) -> std::unique_ptr<IAudioSource> {
+        if(p.argument.empty()) {
+            throw std::runtime_error("The file audio source needs a path (file:<path>).");
+        }
+        return std::make_unique<FakeAudioSource>(p.argument, p.sampleRate, p.channels, p.frameSize);
+    });
+    registerPlayback("file", [](const AudioBackendParams& p) -> std::unique_ptr<IAudioPlayback> {
+        if(p.argument.empty()) {
+            throw std::runtime_error("The file audio sink needs a path (file:<path>).");
+        }
+        return std::make_unique<FileAudioPlayback>(p.argument, p.sampleRate, p.channels, p.frameSize);
+    });
+
+    registerSource("null", [](const AudioBackendParams& p) -> std::unique_ptr<IAudioSource> {
+        return std::make_unique<NullAudioSource>(p.sampleRate, p.channels, p.frameSize);
+    });
+    registerPlayback("null", [](const AudioBackendParams& p) -> std::unique_ptr<IAudioPlayback> {
+        return std::make_unique<NullAudioPlayback>(p.sampleRate, p.channels, p.frameSize);
+    });
+
+    registerSource("probe", [](const AudioBackendParams& p) -> std::unique_ptr<IAudioSource> {
+        return std::make_unique<ProbeAudioSource>(probeSignal(p.argument), p.sampleRate, p.channels, p.frameSize);
+    });
+    registerPlayback("probe", [](const AudioBackendParams& p) -> std::unique_ptr<IAudioPlayback> {
+        return std::make_unique<ProbeAudioPlayback>(probeSignal(p.argument), p.sampleRate, p.channels, p.frameSize);
+    });
+
+#ifdef ECHOLINK_HAVE_ALSA
+    registerSource("alsa", [](const AudioBackendParams& p) -> std::unique_ptr<IAudioSource> {
+        return std::make_unique<AlsaCapture>(p.argument.empty() ? "default" : p.argument,
+            p.sampleRate, p.channels, p.frameSize);
+    });
+    registerPlayback("alsa", [](const AudioBackendParams& p) -> std::unique_ptr<IAudioPlayback> {
+        return std::make_unique<AlsaPlayback>(p.argument.empty() ? "default" : p.argument,
+            p.sampleRate, p.channels, p.frameSize);
+    });
+#endif
+}
+
+void AudioBackendRegistry::registerSource(const std::string& name, SourceFactory factory)
+{
+    m_Sources[name] = std::move(factory);
+}
+
+void AudioBackendRegistry::registerPlayback(const std::string& name, PlaybackFactory factory)
+{
+    m_Playbacks[name] = std::move(factory);
+}
+
+std::unique_ptr<IAudioSource> AudioBackendRegistry::createSource(const std::string& spec, AudioBackendParams params) const
+{
+    auto [name, argument] = parseSpec(spec);
+    auto it = m_Sources.find(name);
+    if(it == m_Sources.end()) {
+        throw std::runtime_error("Unknown audio source backend '" + name + "' (available: " + joinNames(m_Sources) + ")");
+    }
+    params.argument = argument;
+    return timedCreate<std::unique_ptr<IAudioSource>>("source", name, it->second, params);
+}
+
+std::unique_ptr<IAudioPlayback> AudioBackendRegistry::createPlayback(const std::string& spec, AudioBackendParams params) const
+{
+    auto [name, argument] = parseSpec(spec);
+    auto it = m_Playbacks.find(name);
+    if(it == m_Playbacks.end()) {
+        throw std::runtime_error("Unknown audio sink backend '" + name + "' (available: " + joinNames(m_Playbacks) + ")");
+    }
+    params.argument = argument;
+    return timedCreate<std::unique_ptr<IAudioPlayback>>("playback", name, it->second, params);
+}
+
+std::vector<std::string> AudioBackendRegistry::sourceNames() const
+{
+    std::vector<std::string> names;
+    for(const auto& entry : m_Sources) {
+        names.push_back(entry.first);
+    }
+    return names;
+}
+
+std::vector<std::string> AudioBackendRegistry::playbackNames() const
+{
+    std::vector<std::string> names;
+    for(const auto& entry : m_Playbacks) {
+        names.push_back(entry.first);
+    }
+    return names;
+}
+
+std::pair<std::string, std::string> AudioBackendRegistry::parseSpec(const std::string& spec)
+{
+    size_t colon = spec.find(':');
+    if(colon == std::string::npos) {
+        return {spec, ""};
+    }
+    return {spec.substr(0, colon), spec.substr(colon + 1)};
+}
@@ -2,17 +2,35 @@
 #include "opus.h"
 #include "opus_defines.h"
 #include "opus_types.h"
+#include <chrono>
 #include <iostream>
+#include <new>
+
+AudioCodec::AudioCodec()
+    : AudioCodec(CodecStateArena::instance())
+{}
+
+AudioCodec::AudioCodec(CodecStateArena& arena)
+    : m_Arena(arena),
+    m_ComplexityMetric(Metrics::instance().get("codec.encoder_complexity")),
+    m_ComplexityChangesMetric(Metrics::instance().get("codec.complexity_changes")),
+    m_EncodeLoadMetric(Metrics::instance().get("codec.encode_load_permille")),
+    m_DeadlineMissMetric(Metrics::instance().get("codec.encode_deadline_misses")),
+    m_EncodePerf(PerfCounters::site("encode")),
+    m_DecodePerf(PerfCounters::site("decode"))
+{}
 
 AudioCodec::~AudioCodec()
 {
+    // The states were initialized in place with opus_*_init(), so they go back to the arena
+    // (opus_*_destroy() would free() memory that malloc() never handed out)
     if(m_Encoder) {
-        opus_encoder_destroy(m_Encoder);
+        m_Arena.deallocate(m_Encoder, m_EncoderStateSize);
         m_Encoder = nullptr;
         std::cout << "[AudioCodec] Opus Encoder destroyed.\n";
     }
     if(m_Decoder) {
-        opus_decoder_destroy(m_Decoder);
+        m_Arena.deallocate(m_Decoder, m_DecoderStateSize);
         m_Decoder = nullptr;
         std::cout << "[AudioCodec] Opus Decoder destroyed.\n";
     }
@@ -27,17 +45,23 @@ bool AudioCodec::initEncoder(int sampleRate, int channels, int application)
 
     int error;
     int size = opus_encoder_get_size(channels);       // memory needed for encoder state
-    m_Encoder = (OpusEncoder*)new char[size];           // allocate memory
-    if(!m_Encoder) {
+    if(size <= 0) {
+        std::cerr << "[AudioCodec] Invalid channel count for Opus Encoder: " << channels << std::endl;
+        return false;
+    }
+    try {
+        m_Encoder = static_cast<OpusEncoder*>(m_Arena.allocate(size));
+    } catch(const std::bad_alloc&) {
         std::cerr << "[AudioCodec] Failed to allocate memory for Opus Encoder.\n";
         return false;
     }
+    m_EncoderStateSize = size;
 
     // Initialize the encoder
     error = opus_encoder_init(m_Encoder, sampleRate, channels, application);
     if(error != OPUS_OK) {
         std::cerr << "[AudioCodec] Failed to initialize Opus Encoder: " << opus_strerror(error) << std::endl;
-        delete[] (char*)m_Encoder;
+        m_Arena.deallocate(m_Encoder, m_EncoderStateSize);
         m_Encoder = nullptr;
         return false;
     }
@@ -48,7 +72,8 @@ bool AudioCodec::initEncoder(int sampleRate, int channels, int application)
     // Configure Encoder
     opus_encoder_ctl(m_Encoder, OPUS_SET_BITRATE(20000));     // Target bitrate 20kbps
     opus_encoder_ctl(m_Encoder, OPUS_SET_VBR(0));             // Disable VBR (Constant Bit Rate)
-    opus_encoder_ctl(m_Encoder, OPUS_SET_COMPLEXITY(8));      // Medium complexity
+    opus_encoder_ctl(m_Encoder, OPUS_SET_COMPLEXITY(m_Complexity));  // Medium complexity, may be autotuned
+    Metrics::set(m_ComplexityMetric, m_Complexity);
 
     std::cout << "[AudioCodec] Opus encoder initialized (SR: " << m_SampleRate
         << ", CH: " << m_Channels << ", App: " << application << ")" << std::endl;
@@ -64,16 +89,22 @@ bool AudioCodec::initDecoder(int sampleRate, int channels)
 
     int error;
     int size = opus_decoder_get_size(channels);     // memory for decoder state
-    m_Decoder = (OpusDecoder*)new char[size];       // allocate memory
-    if (!m_Decoder) {
+    if(size <= 0) {
+        std::cerr << "[AudioCodec] Invalid channel count for Opus decoder: " << channels << std::endl;
+        return false;
+    }
+    try {
+        m_Decoder = static_cast<OpusDecoder*>(m_Arena.allocate(size));
+    } catch(const std::bad_alloc&) {
         std::cerr << "[AudioCodec] Failed to allocate memory for Opus decoder." << std::endl;
         return false;
     }
+    m_DecoderStateSize = size;
 
     error = opus_decoder_init(m_Decoder, sampleRate, channels);
     if(error != OPUS_OK) {
         std::cerr << "[AudioCodec] Failed to initialize Opus Decoder: " << opus_strerror(error) << std::endl;
-        delete[] (char*)m_Decoder;
+        m_Arena.deallocate(m_Decoder, m_DecoderStateSize);
         m_Decoder = nullptr;
         return false;
     }
@@ -85,23 +116,101 @@ bool AudioCodec::initDecoder(int sampleRate, int channels)
     return true;
 }
 
-int AudioCodec::encode(const opus_int16* pcm, int frameSize, unsigned char* opusPacket, int maxPacketSize)
+template<typename EncodeCall>
+int AudioCodec::encodeTimed(int frameSize, unsigned char* opusPacket, int maxPacketSize, EncodeCall&& encodeCall)
 {
     if(!m_Encoder) {
         std::cerr << "[AudioCodec] Error: Encoder not initialized." << std::endl;
         return OPUS_BAD_ARG;
     }
-    if (!pcm || !opusPacket || maxPacketSize <= 0 || frameSize <= 0) {
+    if (!opusPacket || maxPacketSize <= 0 || frameSize <= 0) {
         std::cerr << "[AudioCodec] Error: Invalid arguments for encode." << std::endl;
         return OPUS_BAD_ARG;
     }
 
-    // `opus_encode` expects frameSize to be number of samples PER CHANNEL
-    int result = opus_encode(m_Encoder, pcm, frameSize, opusPacket, maxPacketSize);
+    PerfScope perf(m_EncodePerf);
+
+    if (!m_ComplexityTuner) {
+        int result = encodeCall();
+        if (result < 0) {
+            std::cerr << "[AudioCodec] Opus encoding failed: " << opus_strerror(result) << std::endl;
+        }
+        return result; // Returns number of bytes in encoded packet, or error code
+    }
+
+    auto encodeStart = std::chrono::steady_clock::now();
+    int result = encodeCall();
+    auto encodeTime = std::chrono::steady_clock::now() - encodeStart;
     if (result < 0) {
         std::cerr << "[AudioCodec] Opus encoding failed: " << opus_strerror(result) << std::endl;
+        return result;
+    }
+
+    const std::chrono::nanoseconds framePeriod(static_cast<int64_t>(frameSize) * 1000000000LL / m_SampleRate);
+    if (encodeTime > framePeriod) {
+        Metrics::add(m_DeadlineMissMetric, 1);
+    }
+
+    int complexity = m_ComplexityTuner->update(encodeTime, framePeriod);
+    Metrics::set(m_EncodeLoadMetric, static_cast<int64_t>(m_ComplexityTuner->getLoad() * 1000.0));
+    if (complexity != m_Complexity) {
+        std::cout << "[AudioCodec] Encoder complexity " << m_Complexity << " -> " << complexity
+            << " (encode load " << static_cast<int>(m_ComplexityTuner->getLoad() * 100.0) << "% of frame, budget "
+            << static_cast<int>(m_ComplexityTuner->getBudgetShare() * 100.0) << "%)" << std::endl;
+        opus_encoder_ctl(m_Encoder, OPUS_SET_COMPLEXITY(complexity));
+        m_Complexity = complexity;
+        Metrics::set(m_ComplexityMetric, m_Complexity);
+        Metrics::add(m_ComplexityChangesMetric, 1);
+    }
+    return result;
+}
+
+int AudioCodec::encode(const opus_int16* pcm, int frameSize, unsigned char* opusPacket, int maxPacketSize)
+{
+    if (!pcm) {
+        std::cerr << "[AudioCodec] Error: Invalid arguments for encode." << std::endl;
+        return OPUS_BAD_ARG;
+    }
+    // `opus_encode` expects frameSize to be number of samples PER CHANNEL
+    return encodeTimed(frameSize, opusPacket, maxPacketSize, [&]() {
+        return opus_encode(m_Encoder, pcm, frameSize, opusPacket, maxPacketSize);
+    });
+}
+
+int AudioCodec::encodeFloat(const float* pcm, int frameSize, unsigned char* opusPacket, int maxPacketSize)
+{
+    if (!pcm) {
+        std::cerr << "[AudioCodec] Error: Invalid arguments for encode." << std::endl;
+        return OPUS_BAD_ARG;
+    }
+    return encodeTimed(frameSize, opusPacket, maxPacketSize, [&]() {
+        return opus_encode_float(m_Encoder, pcm, frameSize, opusPacket, maxPacketSize);
+    });
+}
+
+void AudioCodec::enableComplexityAutotune(double budgetShare)
+{
+    if (!m_Encoder) {
+        std::cerr << "[AudioCodec] Error: Cannot autotune complexity, encoder not initialized." << std::endl;
+        return;
+    }
+    m_ComplexityTuner = std::make_unique<ComplexityTuner>(m_Complexity, budgetShare);
+    std::cout << "[AudioCodec] Complexity autotune enabled (budget: "
+        << static_cast<int>(m_ComplexityTuner->getBudgetShare() * 100.0) << "% of frame period)" << std::endl;
+}
+
+void AudioCodec::resetEncoder()
+{
+    if (m_Encoder) {
+        opus_encoder_ctl(m_Encoder, OPUS_RESET_STATE);
+    }
+}
+
+void AudioCodec::resetDecoder()
+{
+    if (m_Decoder) {
+        opus_decoder_ctl(m_Decoder, OPUS_RESET_STATE);
     }
-    return result; // Returns number of bytes in encoded packet, or error code
 }
 
 int AudioCodec::decode(const unsigned char* opusPacket, int packetSize, opus_int16* pcm, int maxFrameSize) {
@@ -115,6 +224,7 @@ int AudioCodec::decode(const unsigned char* opusPacket, int packetSize, opus_int
     }
 
     // `opus_decode` expects maxFrameSize to be number of samples PER CHANNEL
+    PerfScope perf(m_DecodePerf);
     int result = opus_decode(m_Decoder, opusPacket, packetSize, pcm, maxFrameSize, 0); // 0 for FEC, not needed for now
 
     if (result < 0) {
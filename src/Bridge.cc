@@ -0,0 +1,370 @@
+#include "Bridge.hpp"
+#include "PacketHeader.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+bool BridgeConfig::parseTrunk(const std::string& text, asio::ip::udp::endpoint& endpoint)
+{
+    const size_t colon = text.rfind(':');
+    if(colon == std::string::npos || colon == 0 || colon + 1 == text.size()) {
+        return false;
+    }
+    std::string host = text.substr(0, colon);
+    if(host.size() > 2 && host.front() == '[' && host.back() == ']') {
+        host = host.substr(1, host.size() - 2);     // [v6 address]:port
+    }
+    const std::string portText = text.substr(colon + 1);
+    if(portText.find_first_not_of("0123456789") != std::string::npos || portText.size() > 5) {
+        return false;
+    }
+    const int port = std::stoi(portText);
+    asio::error_code error;
+    const asio::ip::address address = asio::ip::make_address(host, error);
+    if(error || port <= 0 || port > 65535) {
+        return false;
+    }
+    endpoint = asio::ip::udp::endpoint(address, static_cast<unsigned short>(port));
+    return true;
+}
+
+// --- TrunkFormat ---
+
+void TrunkFormat::append(const Entry& entry, NetworkPacket& out)
+{
+    const size_t offset = out.size();
+    out.resize(offset + kEntryHeaderSize + entry.size);
+    auto* write = reinterpret_cast<unsigned char*>(out.data()) + offset;
+    write[0] = static_cast<unsigned char>(entry.origin >> 24);
+    write[1] = static_cast<unsigned char>(entry.origin >> 16);
+    write[2] = static_cast<unsigned char>(entry.origin >> 8);
+    write[3] = static_cast<unsigned char>(entry.origin);
+    write[4] = entry.hops;
+    write[5] = static_cast<unsigned char>(entry.size >> 8);
+    write[6] = static_cast<unsigned char>(entry.size);
+    std::copy(entry.data, entry.data + entry.size, write + kEntryHeaderSize);
+}
+
+bool TrunkFormat::read(const unsigned char* data, size_t size, std::vector<Entry>& entries)
+{
+    entries.clear();
+    if(size < PacketHeader::kSize) {
+        return false;
+    }
+    size_t offset = PacketHeader::kSize;
+    while(offset < size) {
+        if(size - offset < kEntryHeaderSize) {
+            return false;
+        }
+        const unsigned char* entry = data + offset;
+        const size_t length = (static_cast<size_t>(entry[5]) << 8) | entry[6];
+        if(length < PacketHeader::kSize || size - offset - kEntryHeaderSize < length) {
+            return false;
+        }
+        const uint32_t origin = (static_cast<uint32_t>(entry[0]) << 24) | (static_cast<uint32_t>(entry[1]) << 16)
+            | (static_cast<uint32_t>(entry[2]) << 8) | entry[3];
+        entries.push_back({origin, entry[4], entry + kEntryHeaderSize, length});
+        offset += kEntryHeaderSize + length;
+    }
+    return true;
+}
+
+// --- Bridge ---
+
+Bridge::Bridge(const BridgeConfig& config, ITransport& transport, const MediaKey* key, std::chrono::milliseconds timeout)
+    : m_Transport(transport),
+    m_Sealer(key ? std::make_unique<MediaResealer>(*key) : nullptr),
+    m_Speakers(config.maxSpeakers > 0 ? std::make_unique<SpeakerSelector>(config.maxSpeakers, timeout) : nullptr),
+    m_NodeId(config.nodeId != 0 ? config.nodeId : PacketHeader::randomSsrc()),
+    b_Mesh(config.mesh),
+    m_FlushInterval(std::max(1, config.flushMs)),
+    m_Timeout(timeout),
+    m_ParticipantsMetric(Metrics::instance().get("bridge.participants")),
+    m_TrunksMetric(Metrics::instance().get("bridge.trunks")),
+    m_ForwardedMetric(Metrics::instance().get("bridge.forwarded")),
+    m_TrunkEntriesMetric(Metrics::instance().get("bridge.trunk_entries_sent")),
+    m_TrunkDatagramsMetric(Metrics::instance().get("bridge.trunk_datagrams_sent")),
+    m_LoopsMetric(Metrics::instance().get("bridge.loops_dropped")),
+    m_DuplicatesMetric(Metrics::instance().get("bridge.duplicates_dropped")),
+    m_CollisionsMetric(Metrics::instance().get("bridge.ssrc_collisions")),
+    m_MalformedMetric(Metrics::instance().get("bridge.malformed"))
+{
+    const Clock::time_point now = Clock::now();
+    for(const std::string& text : config.trunks) {
+        Trunk trunk;
+        if(!BridgeConfig::parseTrunk(text, trunk.endpoint)) {
+            std::cerr << "[Bridge] Ignoring trunk '" << text << "', expected ip:port." << std::endl;
+            continue;
+        }
+        trunk.configured = true;
+        trunk.lastHeard = now;
+        trunk.lastSent = now - kKeepaliveInterval;      // announce ourselves right away
+        resetPending(trunk);
+        m_Trunks.push_back(std::move(trunk));
+    }
+    m_NextFlush = now + m_FlushInterval;
+    Metrics::set(m_TrunksMetric, static_cast<int64_t>(m_Trunks.size()));
+    std::cout << "[Bridge] Node 0x" << std::hex << m_NodeId << std::dec << ", " << m_Trunks.size()
+        << " trunk(s), " << (b_Mesh ? "mesh" : "tree") << " forwarding";
+    if(m_Speakers) {
+        std::cout << ", " << m_Speakers->maxSpeakers() << " loudest speaker(s)";
+    }
+    std::cout << "." << std::endl;
+}
+
+void Bridge::onDatagram(const Datagram& datagram, Clock::time_point now)
+{
+    PacketHeader header;
+    if(!PacketHeader::read(reinterpret_cast<const unsigned char*>(datagram.payload.data()), datagram.payload.size(), header)) {
+        Metrics::add(m_MalformedMetric, 1);
+        return;
+    }
+    if(header.type == PacketType::Trunk) {
+        onTrunkDatagram(datagram, header.ssrc, now);
+    } else if(header.type == PacketType::Audio) {
+        touchParticipant(datagram.peer, now);   // senders that are left out still hear the others
+        SeenStream* stream = firstSighting({m_NodeId, datagram.peer}, header.ssrc, header.sequence, now);
+        if(!stream) {
+            return;
+        }
+        onParticipantAudio(datagram, header, *stream, now);
+    }
+    // clock messages in a replayed trace are the NetworkManager's business
+}
+
+void Bridge::onParticipantAudio(const Datagram& datagram, const PacketHeader& header, SeenStream& stream,
+    Clock::time_point now)
+{
+    if(!isSelected(header, stream, now)) {
+        return;
+    }
+    const auto* data = reinterpret_cast<const unsigned char*>(datagram.payload.data());
+    const bool resumed = takeResumeMark(stream);
+    deliver(data, datagram.payload.size(), datagram.rollover, datagram.session, resumed, &datagram.peer);
+    forward({m_NodeId, 0, data, datagram.payload.size()}, nullptr, resumed, now);
+}
+
+void Bridge::onTrunkDatagram(const Datagram& datagram, uint32_t sender, Clock::time_point now)
+{
+    if(sender == m_NodeId) {
+        Metrics::add(m_LoopsMetric, 1);     // our own, or a bridge with the same id
+        return;
+    }
+    Trunk* trunk = findTrunk(datagram.peer);
+    if(!trunk) {
+        // Learned: the far end configured this trunk
+        Trunk learned;
+        learned.endpoint = datagram.peer;
+        learned.lastSent = now - kKeepaliveInterval;
+        resetPending(learned);
+        m_Trunks.push_back(std::move(learned));
+        trunk = &m_Trunks.back();
+        Metrics::set(m_TrunksMetric, static_cast<int64_t>(m_Trunks.size()));
+        std::cout << "[Bridge] Trunk from node 0x" << std::hex << sender << std::dec << " at " << datagram.peer
+            << "." << std::endl;
+    }
+    trunk->lastHeard = now;
+
+    const auto* data = reinterpret_cast<const unsigned char*>(datagram.payload.data());
+    if(!TrunkFormat::read(data, datagram.payload.size(), m_Entries)) {
+        Metrics::add(m_MalformedMetric, 1);
+        return;
+    }
+    const size_t trunkIndex = static_cast<size_t>(trunk - m_Trunks.data());
+    for(const TrunkFormat::Entry& entry : m_Entries) {
+        PacketHeader header;
+        if(!PacketHeader::read(entry.data, entry.size, header) || header.type != PacketType::Audio) {
+            Metrics::add(m_MalformedMetric, 1);
+            continue;
+        }
+        if(entry.origin == m_NodeId || entry.hops >= kMaxHops) {
+            Metrics::add(m_LoopsMetric, 1);
+            continue;
+        }
+        SeenStream* stream = firstSighting({entry.origin, {}}, header.ssrc, header.sequence, now);
+        if(!stream) {
+            continue;
+        }
+        if(!isSelected(header, *stream, now)) {
+            continue;
+        }
+        const bool resumed = takeResumeMark(*stream);
+        deliver(entry.data, entry.size, 0, 0, resumed, nullptr);     // trunks never carry sealed streams
+        if(!b_Mesh) {
+            // forward() may send, but never adds or removes trunks, so the index stays valid
+            forward({entry.origin, static_cast<uint8_t>(entry.hops + 1), entry.data, entry.size},
+                &m_Trunks[trunkIndex], resumed, now);
+        }
+    }
+}
+
+bool Bridge::isSelected(const PacketHeader& header, SeenStream& stream, Clock::time_point now)
+{
+    if(!m_Speakers || m_Speakers->onLevel(header.ssrc, header.audioLevel, now)) {
+        return true;
+    }
+    stream.resumeMarks = kResumeMarks;
+    return false;
+}
+
+bool Bridge::takeResumeMark(SeenStream& stream)
+{
+    if(stream.resumeMarks == 0) {
+        return false;
+    }
+    stream.resumeMarks--;
+    return true;
+}
+
+void Bridge::deliver(const unsigned char* data, size_t size, uint32_t rollover, uint64_t session, bool resumed,
+    const asio::ip::udp::endpoint* except)
+{
+    // Sequence number and rollover stay the sender's, so the nonce does too: resealed under a
+    // session the bridge keeps for this sender session alone (MediaResealer)
+    for(const Participant& participant : m_Participants) {
+        if(except && participant.endpoint == *except) {
+            continue;
+        }
+        m_Outgoing.payload.assign(data, data + size);
+        m_Outgoing.rollover = rollover;
+        m_Outgoing.session = session;
+        if(resumed) {
+            m_Outgoing.payload[1] = static_cast<char>(m_Outgoing.payload[1] | PacketHeader::kFlagResumed);
+        }
+        if(m_Sealer && !m_Sealer->seal(m_Outgoing)) {
+            continue;
+        }
+        m_Transport.sendPacketTo(m_Outgoing.payload, participant.endpoint);
+        Metrics::add(m_ForwardedMetric, 1);
+    }
+}
+
+void Bridge::forward(const TrunkFormat::Entry& entry, const Trunk* except, bool resumed, Clock::time_point now)
+{
+    const size_t entrySize = TrunkFormat::kEntryHeaderSize + entry.size;
+    for(Trunk& trunk : m_Trunks) {
+        if(&trunk == except) {
+            continue;
+        }
+        if(trunk.pendingEntries > 0 && trunk.pending.size() + entrySize > kMaxTrunkDatagramSize) {
+            sendTrunk(trunk, now);
+        }
+        const size_t offset = trunk.pending.size() + TrunkFormat::kEntryHeaderSize;
+        TrunkFormat::append(entry, trunk.pending);
+        if(resumed) {
+            trunk.pending[offset + 1] = static_cast<char>(trunk.pending[offset + 1] | PacketHeader::kFlagResumed);
+        }
+        trunk.pendingEntries++;
+    }
+}
+
+void Bridge::sendTrunk(Trunk& trunk, Clock::time_point now)
+{
+    m_Transport.sendPacketTo(trunk.pending, trunk.endpoint);
+    Metrics::add(m_TrunkDatagramsMetric, 1);
+    Metrics::add(m_TrunkEntriesMetric, static_cast<int64_t>(trunk.pendingEntries));
+    trunk.lastSent = now;
+    trunk.sequence++;
+    resetPending(trunk);
+}
+
+void Bridge::resetPending(Trunk& trunk)
+{
+    PacketHeader header;
+    header.type = PacketType::Trunk;
+    header.sequence = trunk.sequence;
+    header.ssrc = m_NodeId;
+    trunk.pending.resize(PacketHeader::kSize);
+    header.write(reinterpret_cast<unsigned char*>(trunk.pending.data()));
+    trunk.pendingEntries = 0;
+}
+
+void Bridge::tick(Clock::time_point now)
+{
+    if(now < m_NextFlush) {
+        return;
+    }
+    m_NextFlush = now + m_FlushInterval;
+    if(m_Speakers) {
+        m_Speakers->update(now);
+    }
+
+    for(Trunk& trunk : m_Trunks) {
+        if(trunk.pendingEntries > 0 || now - trunk.lastSent >= kKeepaliveInterval) {
+            sendTrunk(trunk, now);
+        }
+    }
+
+    // Expiry, a scan per flush is nothing next to the sends
+    const auto silent = [this, now](Clock::time_point lastSeen) { return now - lastSeen >= m_Timeout; };
+    const size_t participants = m_Participants.size();
+    m_Participants.erase(std::remove_if(m_Participants.begin(), m_Participants.end(),
+        [&](const Participant& participant) { return silent(participant.lastSeen); }), m_Participants.end());
+    if(m_Participants.size() != participants) {
+        Metrics::set(m_ParticipantsMetric, static_cast<int64_t>(m_Participants.size()));
+    }
+    const size_t trunks = m_Trunks.size();
+    m_Trunks.erase(std::remove_if(m_Trunks.begin(), m_Trunks.end(),
+        [&](const Trunk& trunk) { return !trunk.configured && silent(trunk.lastHeard); }), m_Trunks.end());
+    if(m_Trunks.size() != trunks) {
+        Metrics::set(m_TrunksMetric, static_cast<int64_t>(m_Trunks.size()));
+    }
+    for(auto it = m_SeenStreams.begin(); it != m_SeenStreams.end();) {
+        it = silent(it->second.lastSeen) ? m_SeenStreams.erase(it) : std::next(it);
+    }
+}
+
+Bridge::Trunk* Bridge::findTrunk(const asio::ip::udp::endpoint& endpoint)
+{
+    for(Trunk& trunk : m_Trunks) {
+        if(trunk.endpoint == endpoint) {
+            return &trunk;
+        }
+    }
+    return nullptr;
+}
+
+void Bridge::touchParticipant(const asio::ip::udp::endpoint& endpoint, Clock::time_point now)
+{
+    for(Participant& participant : m_Participants) {
+        if(participant.endpoint == endpoint) {
+            participant.lastSeen = now;
+            return;
+        }
+    }
+    m_Participants.push_back({endpoint, now});
+    Metrics::set(m_ParticipantsMetric, static_cast<int64_t>(m_Participants.size()));
+    std::cout << "[Bridge] Participant " << endpoint << " joined (" << m_Participants.size() << " local)." << std::endl;
+}
+
+Bridge::SeenStream* Bridge::firstSighting(const StreamSource& source, uint32_t ssrc, uint16_t sequence,
+    Clock::time_point now)
+{
+    auto [it, inserted] = m_SeenStreams.try_emplace(ssrc);
+    SeenStream& stream = it->second;
+    if(inserted) {
+        stream.source = source;
+    } else if(!(stream.source == source)) {
+        // Two senders picked the same random SSRC: merged, each would lose the other's sequence
+        // numbers as duplicates and share its level and speaker slot
+        Metrics::add(m_CollisionsMetric, 1);
+        if(!stream.collisionLogged) {
+            stream.collisionLogged = true;
+            std::cerr << "[Bridge] SSRC 0x" << std::hex << ssrc;
+            if(source.participant.port() != 0) {
+                std::cerr << " of participant " << source.participant;
+            } else {
+                std::cerr << " from node 0x" << source.origin;
+            }
+            std::cerr << std::dec << " is already in use, dropping its datagrams while the first stream sends." << std::endl;
+        }
+        return nullptr;
+    }
+    stream.lastSeen = now;
+    if(stream.sequences.contains(sequence)) {
+        Metrics::add(m_DuplicatesMetric, 1);
+        return nullptr;
+    }
+    stream.sequences.mark(sequence);
+    return &stream;
+}
@@ -0,0 +1,117 @@
+#include "CallQuality.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr double kBaseR = 93.2;             // R0 - Is with the G.107 default values
+constexpr double kPlayoutSmoothing = 1.0 / 16.0;
+
+// Equipment impairment of Opus at a bitrate, a rough fit: ~26 at 8 kbps, ~10 at 16, ~1 at 32
+double codecImpairment(double kbps)
+{
+    return kbps < 0.0 ? 0.0 : 70.0 * std::exp(-kbps / 8.0);
+}
+
+// Cole-Rosenbluth approximation of Id for a mouth-to-ear delay
+double delayImpairment(double ms)
+{
+    return 0.024 * ms + (ms > 177.3 ? 0.11 * (ms - 177.3) : 0.0);
+}
+
+} // namespace
+
+void CallQuality::onReceived(uint32_t missing)
+{
+    if(missing > 0) {
+        m_Missing += missing;
+        m_LossEvents += 1.0;
+    }
+    m_Received += 1.0;
+    halveIfFull();
+}
+
+void CallQuality::onLate(bool recovered)
+{
+    m_Missing = std::max(0.0, m_Missing - 1.0);
+    if(recovered) {
+        m_Recovered = std::max(0.0, m_Recovered - 1.0);   // no longer missing, so not recovered either
+    }
+    m_Received += 1.0;
+}
+
+void CallQuality::onRecovered()
+{
+    m_Recovered += 1.0;
+}
+
+void CallQuality::onPayload(size_t bytes, int samples, int sampleRate)
+{
+    if(samples <= 0 || sampleRate <= 0) {
+        return;
+    }
+    const double kbps = bytes * 8.0 * sampleRate / samples / 1000.0;
+    m_BitrateKbps = m_BitrateKbps < 0.0 ? kbps : m_BitrateKbps + (kbps - m_BitrateKbps) / 16.0;
+}
+
+void CallQuality::setPlayoutDelayMs(double ms)
+{
+    m_PlayoutDelayMs = m_PlayoutDelayMs < 0.0 ? ms : m_PlayoutDelayMs + (ms - m_PlayoutDelayMs) * kPlayoutSmoothing;
+}
+
+double CallQuality::lossPercent() const
+{
+    const double expected = m_Received + m_Missing;
+    if(expected <= 0.0) {
+        return 0.0;
+    }
+    return 100.0 * std::max(0.0, m_Missing - m_Recovered) / expected;
+}
+
+double CallQuality::burstRatio() const
+{
+    if(m_LossEvents <= 0.0 || m_Received <= 0.0 || m_Missing <= 0.0) {
+        return 1.0;
+    }
+    // p: received -> missing, q: missing -> received; every gap is one of each
+    const double p = std::min(1.0, m_LossEvents / m_Received);
+    const double q = std::min(1.0, m_LossEvents / m_Missing);
+    return std::max(1.0, 1.0 / (p + q));
+}
+
+double CallQuality::mouthToEarMs() const
+{
+    return m_NetworkDelayMs + m_PacketTimeMs + std::max(0.0, m_PlayoutDelayMs);
+}
+
+double CallQuality::rFactor() const
+{
+    const double ie = codecImpairment(m_BitrateKbps);
+    const double ppl = lossPercent();
+    const double ieEffective = ie + (95.0 - ie) * ppl / (ppl / burstRatio() + kLossRobustness);
+    const double r = kBaseR - delayImpairment(mouthToEarMs()) - ieEffective;
+    return std::min(100.0, std::max(0.0, r));
+}
+
+double CallQuality::toMos(double r)
+{
+    if(r <= 0.0) {
+        return 1.0;
+    }
+    if(r >= 100.0) {
+        return 4.5;
+    }
+    return 1.0 + 0.035 * r + r * (r - 60.0) * (100.0 - r) * 7e-6;
+}
+
+void CallQuality::halveIfFull()
+{
+    if(m_Received < kWindowPackets) {
+        return;
+    }
+    m_Received /= 2.0;
+    m_Missing /= 2.0;
+    m_Recovered /= 2.0;
+    m_LossEvents /= 2.0;
+}
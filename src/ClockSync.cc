@@ -0,0 +1,221 @@
+#include "ClockSync.hpp"
+
+#include <algorithm>
+
+namespace {
+
+void writeU64(unsigned char* out, int64_t value)
+{
+    for(int i = 0; i < 8; i++) {
+        out[i] = static_cast<unsigned char>(static_cast<uint64_t>(value) >> (56 - 8 * i));
+    }
+}
+
+int64_t readU64(const unsigned char* in)
+{
+    uint64_t value = 0;
+    for(int i = 0; i < 8; i++) {
+        value = (value << 8) | in[i];
+    }
+    return static_cast<int64_t>(value);
+}
+
+} // namespace
+
+// --- ClockMessage ---
+
+size_t ClockMessage::write(unsigned char* out) const
+{
+    header.write(out);
+    unsigned char* body = out + PacketHeader::kSize;
+    writeU64(body, originNs);
+    if(header.type == PacketType::ClockPong) {
+        writeU64(body + 8, receiveNs);
+        writeU64(body + 16, transmitNs);
+        writeU64(body + 24, anchorNs);
+        return kPongSize;
+    }
+    writeU64(body + 8, anchorNs);
+    return kPingSize;
+}
+
+bool ClockMessage::read(const unsigned char* data, size_t len, ClockMessage& message)
+{
+    if(!PacketHeader::read(data, len, message.header)) {
+        return false;
+    }
+    const unsigned char* body = data + PacketHeader::kSize;
+    if(message.header.type == PacketType::ClockPing && len >= kPingSize) {
+        message.originNs = readU64(body);
+        message.receiveNs = 0;
+        message.transmitNs = 0;
+        message.anchorNs = readU64(body + 8);
+        return true;
+    }
+    if(message.header.type == PacketType::ClockPong && len >= kPongSize) {
+        message.originNs = readU64(body);
+        message.receiveNs = readU64(body + 8);
+        message.transmitNs = readU64(body + 16);
+        message.anchorNs = readU64(body + 24);
+        return true;
+    }
+    return false;
+}
+
+// --- ClockSync ---
+
+ClockSync::ClockSync()
+    : m_PeersMetric(Metrics::instance().get("net.clock.peers")),
+    m_PingsMetric(Metrics::instance().get("net.clock.pings_sent")),
+    m_PongsMetric(Metrics::instance().get("net.clock.pongs_received")),
+    m_UnmatchedMetric(Metrics::instance().get("net.clock.pongs_unmatched")),
+    m_RttMetric(Metrics::instance().get("net.clock.rtt_us")),
+    m_OffsetMetric(Metrics::instance().get("net.clock.offset_us"))
+{}
+
+ClockSync::PeerClock* ClockSync::find(const asio::ip::udp::endpoint& peer, int64_t nowNs)
+{
+    auto it = m_Peers.find(peer);
+    if(it == m_Peers.end()) {
+        if(m_Peers.size() >= kMaxPeers) {
+            return nullptr;
+        }
+        it = m_Peers.emplace(peer, PeerClock()).first;
+        it->second.lastHeardNs = nowNs;
+        Metrics::set(m_PeersMetric, static_cast<int64_t>(m_Peers.size()));
+    }
+    return &it->second;
+}
+
+void ClockSync::onPing(const asio::ip::udp::endpoint& peer, const ClockMessage& ping, int64_t receivedNs,
+    const MediaAnchor& localAnchor, ClockMessage& pong)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        PeerClock* clock = find(peer, receivedNs);
+        if(clock) {
+            clock->lastHeardNs = receivedNs;
+            if(ping.anchorNs != 0) {
+                clock->anchor = {ping.header.ssrc, ping.header.timestamp, ping.anchorNs};
+            }
+        }
+    }
+
+    pong.header.type = PacketType::ClockPong;
+    pong.header.sequence = ping.header.sequence;
+    pong.header.timestamp = localAnchor.timestamp;
+    pong.header.ssrc = localAnchor.ssrc;
+    pong.originNs = ping.originNs;
+    pong.receiveNs = receivedNs;
+    pong.transmitNs = 0;
+    pong.anchorNs = localAnchor.wallNs;
+}
+
+void ClockSync::onPong(const asio::ip::udp::endpoint& peer, const ClockMessage& pong, int64_t receivedNs)
+{
+    // t1 = originNs, t2 = receiveNs, t3 = transmitNs, t4 = receivedNs
+    const int64_t rttNs = (receivedNs - pong.originNs) - (pong.transmitNs - pong.receiveNs);
+    const int64_t offsetNs = ((pong.receiveNs - pong.originNs) + (pong.transmitNs - receivedNs)) / 2;
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    auto it = m_Peers.find(peer);
+    if(it == m_Peers.end() || it->second.pendingOriginNs == 0 || it->second.pendingOriginNs != pong.originNs
+        || it->second.pendingSequence != pong.header.sequence) {
+        Metrics::add(m_UnmatchedMetric, 1);
+        return;     // not an answer to our last ping: late, repeated or forged
+    }
+    PeerClock* clock = &it->second;
+    clock->pendingOriginNs = 0;
+    clock->lastHeardNs = receivedNs;
+    if(rttNs < 0) {
+        return;     // the clocks stepped during the exchange
+    }
+    if(pong.anchorNs != 0) {
+        clock->anchor = {pong.header.ssrc, pong.header.timestamp, pong.anchorNs};
+    }
+
+    clock->exchanges[clock->exchangeCount % kFilterSamples] = {offsetNs, rttNs};
+    clock->exchangeCount++;
+    const size_t filled = std::min(clock->exchangeCount, kFilterSamples);
+    const Exchange& best = *std::min_element(clock->exchanges.begin(), clock->exchanges.begin() + filled,
+        [](const Exchange& a, const Exchange& b) { return a.rttNs < b.rttNs; });
+    clock->estimate = {best.offsetNs, best.rttNs, filled};
+
+    Metrics::add(m_PongsMetric, 1);
+    Metrics::set(m_RttMetric, best.rttNs / 1000);
+    Metrics::set(m_OffsetMetric, best.offsetNs / 1000);
+}
+
+void ClockSync::onPingSent(const asio::ip::udp::endpoint& peer, const ClockMessage& ping)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    PeerClock* clock = find(peer, ping.originNs);
+    if(clock) {
+        clock->pendingOriginNs = ping.originNs;
+        clock->pendingSequence = ping.header.sequence;
+    }
+}
+
+void ClockSync::makePing(const MediaAnchor& localAnchor, ClockMessage& ping)
+{
+    ping.header.type = PacketType::ClockPing;
+    ping.header.sequence = m_NextSequence++;
+    ping.header.timestamp = localAnchor.timestamp;
+    ping.header.ssrc = localAnchor.ssrc;
+    ping.originNs = 0;
+    ping.receiveNs = 0;
+    ping.transmitNs = 0;
+    ping.anchorNs = localAnchor.wallNs;
+    Metrics::add(m_PingsMetric, 1);
+}
+
+std::vector<asio::ip::udp::endpoint> ClockSync::pingTargets(const asio::ip::udp::endpoint& always, int64_t nowNs)
+{
+    const int64_t cutoffNs = nowNs - std::chrono::duration_cast<std::chrono::nanoseconds>(kPeerTimeout).count();
+    std::vector<asio::ip::udp::endpoint> targets;
+    if(always.port() != 0) {
+        targets.push_back(always);
+    }
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    for(auto it = m_Peers.begin(); it != m_Peers.end();) {
+        if(it->second.lastHeardNs < cutoffNs && it->first != always) {
+            it = m_Peers.erase(it);
+            continue;
+        }
+        if(it->first != always) {
+            targets.push_back(it->first);
+        }
+        ++it;
+    }
+    Metrics::set(m_PeersMetric, static_cast<int64_t>(m_Peers.size()));
+    return targets;
+}
+
+bool ClockSync::estimate(const asio::ip::udp::endpoint& peer, ClockEstimate& estimate) const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    auto it = m_Peers.find(peer);
+    if(it == m_Peers.end() || it->second.estimate.samples == 0) {
+        return false;
+    }
+    estimate = it->second.estimate;
+    return true;
+}
+
+bool ClockSync::toLocalTime(const asio::ip::udp::endpoint& peer, uint32_t ssrc, uint32_t timestamp, int sampleRate,
+    int64_t& localNs) const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    auto it = m_Peers.find(peer);
+    if(it == m_Peers.end() || it->second.estimate.samples == 0 || it->second.anchor.wallNs == 0
+        || it->second.anchor.ssrc != ssrc) {
+        return false;
+    }
+    const PeerClock& clock = it->second;
+    // The media timestamp wraps at 32 bits, the distance to the anchor is small either way
+    const int64_t samples = static_cast<int32_t>(timestamp - clock.anchor.timestamp);
+    const int64_t peerNs = clock.anchor.wallNs + samples * 1000000000LL / sampleRate;
+    localNs = peerNs - clock.estimate.offsetNs;
+    return true;
+}
@@ -0,0 +1,87 @@
+#include "CodecStateArena.hpp"
+
+#include <algorithm>
+#include <new>
+
+CodecStateArena& CodecStateArena::instance()
+{
+    static CodecStateArena arena;
+    return arena;
+}
+
+CodecStateArena::CodecStateArena()
+    : m_BytesReservedMetric(Metrics::instance().get("codec.arena_bytes_reserved")),
+    m_BlocksInUseMetric(Metrics::instance().get("codec.arena_states_in_use"))
+{}
+
+CodecStateArena::~CodecStateArena()
+{
+    for(void* slab : m_Slabs) {
+        ::operator delete(slab, std::align_val_t(kAlignment));
+    }
+}
+
+void* CodecStateArena::allocate(size_t size)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    Pool& pool = poolFor(roundToAlignment(size));
+    if(pool.freeBlocks.empty()) {
+        addSlab(pool);
+    }
+    void* block = pool.freeBlocks.back();
+    pool.freeBlocks.pop_back();
+
+    m_BlocksInUse++;
+    Metrics::set(m_BlocksInUseMetric, static_cast<int64_t>(m_BlocksInUse));
+    return block;
+}
+
+void CodecStateArena::deallocate(void* block, size_t size)
+{
+    if(!block) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    poolFor(roundToAlignment(size)).freeBlocks.push_back(block);
+
+    m_BlocksInUse--;
+    Metrics::set(m_BlocksInUseMetric, static_cast<int64_t>(m_BlocksInUse));
+}
+
+size_t CodecStateArena::bytesReserved() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_BytesReserved;
+}
+
+size_t CodecStateArena::blocksInUse() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_BlocksInUse;
+}
+
+CodecStateArena::Pool& CodecStateArena::poolFor(size_t blockSize)
+{
+    for(Pool& pool : m_Pools) {
+        if(pool.blockSize == blockSize) {
+            return pool;
+        }
+    }
+    m_Pools.push_back(Pool{blockSize, kFirstSlabBlocks, {}});
+    return m_Pools.back();
+}
+
+void CodecStateArena::addSlab(Pool& pool)
+{
+    const size_t blocks = pool.nextSlabBlocks;
+    char* slab = static_cast<char*>(::operator new(blocks * pool.blockSize, std::align_val_t(kAlignment)));
+    m_Slabs.push_back(slab);
+    m_BytesReserved += blocks * pool.blockSize;
+    Metrics::set(m_BytesReservedMetric, static_cast<int64_t>(m_BytesReserved));
+
+    // Push in reverse so consecutive allocations walk the slab front to back
+    for(size_t i = blocks; i-- > 0;) {
+        pool.freeBlocks.push_back(slab + i * pool.blockSize);
+    }
+    pool.nextSlabBlocks = std::min(blocks * 2, kMaxSlabBlocks);
+}
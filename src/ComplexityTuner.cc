@@ -0,0 +1,52 @@
+#include "ComplexityTuner.hpp"
+
+#include <algorithm>
+
+ComplexityTuner::ComplexityTuner(int initialComplexity, double budgetShare)
+    : m_Complexity(std::clamp(initialComplexity, kMinComplexity, kMaxComplexity)),
+    m_BudgetShare(std::clamp(budgetShare, 0.01, 1.0))
+{}
+
+int ComplexityTuner::update(std::chrono::nanoseconds encodeTime, std::chrono::nanoseconds framePeriod)
+{
+    if(framePeriod.count() <= 0) {
+        return m_Complexity;
+    }
+
+    double frameLoad = static_cast<double>(encodeTime.count()) / static_cast<double>(framePeriod.count());
+    if(!b_LoadPrimed) {
+        m_Load = frameLoad;
+        b_LoadPrimed = true;
+    } else {
+        m_Load += kLoadSmoothing * (frameLoad - m_Load);
+    }
+
+    if(m_Cooldown > 0) {
+        m_Cooldown--;
+        return m_Complexity;
+    }
+
+    if(m_Load > m_BudgetShare) {
+        m_HeadroomFrames = 0;
+        if(++m_OverBudgetFrames >= kLowerStreak && m_Complexity > kMinComplexity) {
+            // Far over budget: take a bigger step so the queue stops growing quickly
+            int step = (m_Load > 2.0 * m_BudgetShare) ? 2 : 1;
+            m_Complexity = std::max(kMinComplexity, m_Complexity - step);
+            m_OverBudgetFrames = 0;
+            m_Cooldown = kCooldownFrames;
+        }
+    } else if(m_Load < m_BudgetShare * kRaiseThreshold) {
+        m_OverBudgetFrames = 0;
+        if(++m_HeadroomFrames >= kRaiseStreak && m_Complexity < kMaxComplexity) {
+            m_Complexity++;
+            m_HeadroomFrames = 0;
+            m_Cooldown = kCooldownFrames;
+        }
+    } else {
+        // Inside the dead band: hold the current setting
+        m_OverBudgetFrames = 0;
+        m_HeadroomFrames = 0;
+    }
+
+    return m_Complexity;
+}
@@ -0,0 +1,428 @@
+#include "DspChain.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ECHOLINK_X86_SIMD 1
+#endif
+
+namespace {
+
+constexpr float kScale = 1.0f / 32768.0f;
+
+constexpr float kDcTimeConstant = 1.0f;             // seconds
+constexpr float kGateFloor = 0.01f;                 // -40 dB while closed
+constexpr float kGateHysteresisDb = 6.0f;           // closes this far below the threshold...
+constexpr float kGateHoldSeconds = 0.15f;           // ...after staying there this long
+constexpr float kGateReleaseTimeConstant = 0.05f;
+constexpr float kAgcLevelTimeConstant = 0.3f;       // speech level estimate
+constexpr float kAgcRaiseDbPerSecond = 6.0f;        // slow up, so pauses don't pump noise
+constexpr float kAgcLowerDbPerSecond = 20.0f;
+constexpr float kLimiterReleaseTimeConstant = 0.05f;
+
+float dbToLinear(float db)
+{
+    return std::pow(10.0f, db / 20.0f);
+}
+
+// Converts `count` interleaved samples, subtracts the per-lane DC estimate and measures the
+// result. rawLaneSums (8 lanes) accumulates the input before DC removal, for the next estimate.
+using AnalyzeKernel = void (*)(const opus_int16* in, float* out, size_t count, const float* dcLanes,
+    float* rawLaneSums, float& squares, float& peak);
+// Multiplies by a gain ramping by gainStep per sample frame from gainStart, clamped to full scale
+using GainKernel = void (*)(float* samples, size_t count, int channels, float gainStart, float gainStep);
+
+void analyzeTail(const opus_int16* in, float* out, size_t begin, size_t count, const float* dcLanes,
+    float* rawLaneSums, float& squares, float& peak)
+{
+    for(size_t i = begin; i < count; i++) {
+        const float x = in[i] * kScale;
+        rawLaneSums[i % 8] += x;
+        out[i] = x - dcLanes[i % 8];
+        squares += out[i] * out[i];
+        peak = std::max(peak, std::abs(out[i]));
+    }
+}
+
+void gainTail(float* samples, size_t begin, size_t count, int channels, float gainStart, float gainStep)
+{
+    for(size_t i = begin; i < count; i++) {
+        const float gain = gainStart + gainStep * static_cast<float>(i / channels);
+        samples[i] = std::max(-1.0f, std::min(1.0f, samples[i] * gain));
+    }
+}
+
+#if !defined(ECHOLINK_X86_SIMD)
+void analyzeScalar(const opus_int16* in, float* out, size_t count, const float* dcLanes, float* rawLaneSums,
+    float& squares, float& peak)
+{
+    analyzeTail(in, out, 0, count, dcLanes, rawLaneSums, squares, peak);
+}
+
+void gainScalar(float* samples, size_t count, int channels, float gainStart, float gainStep)
+{
+    gainTail(samples, 0, count, channels, gainStart, gainStep);
+}
+#else
+float horizontalSum(__m128 v)
+{
+    const __m128 pairs = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    return _mm_cvtss_f32(_mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, 1)));
+}
+
+float horizontalMax(__m128 v)
+{
+    const __m128 pairs = _mm_max_ps(v, _mm_movehl_ps(v, v));
+    return _mm_cvtss_f32(_mm_max_ss(pairs, _mm_shuffle_ps(pairs, pairs, 1)));
+}
+
+void analyzeSse(const opus_int16* in, float* out, size_t count, const float* dcLanes, float* rawLaneSums,
+    float& squares, float& peak)
+{
+    const __m128 scale = _mm_set1_ps(kScale);
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    const __m128 dcLow = _mm_loadu_ps(dcLanes), dcHigh = _mm_loadu_ps(dcLanes + 4);
+    __m128 sumLow = _mm_setzero_ps(), sumHigh = _mm_setzero_ps();
+    __m128 sq = _mm_setzero_ps(), pk = _mm_setzero_ps();
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        // Sign extend by placing each sample in the upper half of a 32-bit lane and shifting down
+        const __m128i raw = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        const __m128 low = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(raw, raw), 16)), scale);
+        const __m128 high = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(raw, raw), 16)), scale);
+        sumLow = _mm_add_ps(sumLow, low);
+        sumHigh = _mm_add_ps(sumHigh, high);
+        const __m128 x0 = _mm_sub_ps(low, dcLow), x1 = _mm_sub_ps(high, dcHigh);
+        _mm_storeu_ps(out + i, x0);
+        _mm_storeu_ps(out + i + 4, x1);
+        sq = _mm_add_ps(sq, _mm_add_ps(_mm_mul_ps(x0, x0), _mm_mul_ps(x1, x1)));
+        pk = _mm_max_ps(pk, _mm_max_ps(_mm_andnot_ps(signMask, x0), _mm_andnot_ps(signMask, x1)));
+    }
+    _mm_storeu_ps(rawLaneSums, _mm_add_ps(_mm_loadu_ps(rawLaneSums), sumLow));
+    _mm_storeu_ps(rawLaneSums + 4, _mm_add_ps(_mm_loadu_ps(rawLaneSums + 4), sumHigh));
+    squares += horizontalSum(sq);
+    peak = std::max(peak, horizontalMax(pk));
+    analyzeTail(in, out, i, count, dcLanes, rawLaneSums, squares, peak);
+}
+
+void gainSse(float* samples, size_t count, int channels, float gainStart, float gainStep)
+{
+    size_t i = 0;
+    if(channels <= 4) {
+        // Lane l of a vector starting at sample i belongs to sample frame (i + l) / channels
+        float laneFrames[4];
+        for(int l = 0; l < 4; l++) {
+            laneFrames[l] = static_cast<float>(l / channels);
+        }
+        __m128 gain = _mm_add_ps(_mm_set1_ps(gainStart), _mm_mul_ps(_mm_loadu_ps(laneFrames), _mm_set1_ps(gainStep)));
+        const __m128 increment = _mm_set1_ps(gainStep * static_cast<float>(4 / channels));
+        const __m128 lower = _mm_set1_ps(-1.0f), upper = _mm_set1_ps(1.0f);
+        for(; i + 4 <= count; i += 4) {
+            const __m128 x = _mm_mul_ps(_mm_loadu_ps(samples + i), gain);
+            _mm_storeu_ps(samples + i, _mm_min_ps(upper, _mm_max_ps(lower, x)));
+            gain = _mm_add_ps(gain, increment);
+        }
+    }
+    gainTail(samples, i, count, channels, gainStart, gainStep);
+}
+
+// The AVX2 kernels reduce with their own VEX-encoded code, mixing in the SSE helpers above would
+// cost a state transition per call
+__attribute__((target("avx2,fma")))
+float horizontalSumAvx2(__m256 v)
+{
+    const __m128 half = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    const __m128 pairs = _mm_add_ps(half, _mm_movehl_ps(half, half));
+    return _mm_cvtss_f32(_mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, 1)));
+}
+
+__attribute__((target("avx2,fma")))
+float horizontalMaxAvx2(__m256 v)
+{
+    const __m128 half = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    const __m128 pairs = _mm_max_ps(half, _mm_movehl_ps(half, half));
+    return _mm_cvtss_f32(_mm_max_ss(pairs, _mm_shuffle_ps(pairs, pairs, 1)));
+}
+
+__attribute__((target("avx2,fma")))
+void analyzeAvx2(const opus_int16* in, float* out, size_t count, const float* dcLanes, float* rawLaneSums,
+    float& squares, float& peak)
+{
+    const __m256 scale = _mm256_set1_ps(kScale);
+    const __m256 signMask = _mm256_set1_ps(-0.0f);
+    const __m256 dc = _mm256_loadu_ps(dcLanes);
+    __m256 sum = _mm256_setzero_ps(), sq = _mm256_setzero_ps(), pk = _mm256_setzero_ps();
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        const __m128i raw = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        const __m256 x = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(raw)), scale);
+        sum = _mm256_add_ps(sum, x);
+        const __m256 y = _mm256_sub_ps(x, dc);
+        _mm256_storeu_ps(out + i, y);
+        sq = _mm256_fmadd_ps(y, y, sq);
+        pk = _mm256_max_ps(pk, _mm256_andnot_ps(signMask, y));
+    }
+    _mm256_storeu_ps(rawLaneSums, _mm256_add_ps(_mm256_loadu_ps(rawLaneSums), sum));
+    squares += horizontalSumAvx2(sq);
+    peak = std::max(peak, horizontalMaxAvx2(pk));
+    // GCC doesn't clear the upper halves before this call, and SSE code running with them dirty
+    // is several times slower on many Intel cores, up to the next vzeroupper
+    _mm256_zeroupper();
+    analyzeTail(in, out, i, count, dcLanes, rawLaneSums, squares, peak);
+}
+
+__attribute__((target("avx2,fma")))
+void gainAvx2(float* samples, size_t count, int channels, float gainStart, float gainStep)
+{
+    // Lane l of a vector starting at sample i belongs to sample frame (i + l) / channels
+    alignas(32) float laneFrames[8];
+    for(int l = 0; l < 8; l++) {
+        laneFrames[l] = static_cast<float>(l / channels);
+    }
+    const __m256 step = _mm256_set1_ps(gainStep);
+    __m256 gain = _mm256_fmadd_ps(_mm256_load_ps(laneFrames), step, _mm256_set1_ps(gainStart));
+    const __m256 increment = _mm256_set1_ps(gainStep * static_cast<float>(8 / channels));
+    const __m256 lower = _mm256_set1_ps(-1.0f), upper = _mm256_set1_ps(1.0f);
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        const __m256 x = _mm256_mul_ps(_mm256_loadu_ps(samples + i), gain);
+        _mm256_storeu_ps(samples + i, _mm256_min_ps(upper, _mm256_max_ps(lower, x)));
+        gain = _mm256_add_ps(gain, increment);
+    }
+    _mm256_zeroupper();
+    gainTail(samples, i, count, channels, gainStart, gainStep);
+}
+#endif
+
+struct Kernels
+{
+    AnalyzeKernel analyze;
+    GainKernel gain;
+    const char* name;
+};
+
+const Kernels& kernels()
+{
+    static const Kernels selected = []() -> Kernels {
+#if defined(ECHOLINK_X86_SIMD)
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+            return {analyzeAvx2, gainAvx2, "avx2"};
+        }
+        return {analyzeSse, gainSse, "sse"};
+#else
+        return {analyzeScalar, gainScalar, "scalar"};
+#endif
+    }();
+    return selected;
+}
+
+} // namespace
+
+// --- DspConfig ---
+
+bool DspConfig::parse(const std::string& spec, DspConfig& config)
+{
+    DspConfig parsed;
+    if(spec.empty() || spec == "off") {
+        config = parsed;
+        return true;
+    }
+
+    std::stringstream stream(spec);
+    std::string item;
+    while(std::getline(stream, item, ',')) {
+        const size_t equals = item.find('=');
+        const std::string name = item.substr(0, equals);
+        float value = 0.0f;
+        const bool hasValue = equals != std::string::npos;
+        if(hasValue) {
+            const std::string text = item.substr(equals + 1);
+            char* end = nullptr;
+            value = std::strtof(text.c_str(), &end);
+            if(text.empty() || *end != '\0' || value > 0.0f) {
+                return false;
+            }
+        }
+
+        if(name == "all" && !hasValue) {
+            parsed.dcFilter = parsed.noiseGate = parsed.agc = parsed.limiter = true;
+        } else if(name == "dc" && !hasValue) {
+            parsed.dcFilter = true;
+        } else if(name == "gate") {
+            parsed.noiseGate = true;
+            parsed.gateThresholdDb = hasValue ? value : parsed.gateThresholdDb;
+        } else if(name == "agc") {
+            parsed.agc = true;
+            parsed.agcTargetDb = hasValue ? value : parsed.agcTargetDb;
+        } else if(name == "limiter") {
+            parsed.limiter = true;
+            parsed.limiterCeilingDb = hasValue ? value : parsed.limiterCeilingDb;
+        } else {
+            return false;
+        }
+    }
+    config = parsed;
+    return true;
+}
+
+std::string DspConfig::describe() const
+{
+    if(!enabled()) {
+        return "off";
+    }
+    std::ostringstream out;
+    const char* separator = "";
+    if(dcFilter) {
+        out << separator << "dc";
+        separator = ", ";
+    }
+    if(noiseGate) {
+        out << separator << "gate " << gateThresholdDb << " dBFS";
+        separator = ", ";
+    }
+    if(agc) {
+        out << separator << "agc " << agcTargetDb << " dBFS (max +" << agcMaxGainDb << " dB)";
+        separator = ", ";
+    }
+    if(limiter) {
+        out << separator << "limiter " << limiterCeilingDb << " dBFS";
+    }
+    return out.str();
+}
+
+// --- DspChain ---
+
+DspChain::DspChain(int sampleRate, int channels, int frameSize, const DspConfig& config, const std::string& metricPrefix)
+    : m_Config(config),
+    m_Channels(channels),
+    m_FrameSize(frameSize),
+    m_FrameSeconds(static_cast<double>(frameSize) / sampleRate),
+    m_AgcLevelDb(config.agcTargetDb),
+    m_FrameNsMetric(Metrics::instance().get(metricPrefix + ".frame_ns")),
+    m_FrameNsMaxMetric(Metrics::instance().get(metricPrefix + ".frame_ns_max")),
+    m_GateOpenMetric(Metrics::instance().get(metricPrefix + ".gate_open")),
+    m_AgcGainMetric(Metrics::instance().get(metricPrefix + ".agc_gain_db")),
+    m_LimitedFramesMetric(Metrics::instance().get(metricPrefix + ".limited_frames")),
+    m_Perf(PerfCounters::site(metricPrefix))
+{
+    if(channels <= 0 || 8 % channels != 0 || frameSize <= 0 || sampleRate <= 0) {
+        throw std::invalid_argument("DSP chain needs 1, 2, 4 or 8 channels and a positive frame size and rate.");
+    }
+    std::cout << "[DspChain] " << m_Config.describe() << " (" << kernelName() << ")" << std::endl;
+}
+
+const char* DspChain::kernelName()
+{
+    return kernels().name;
+}
+
+void DspChain::process(const opus_int16* in, float* out)
+{
+    const auto begin = std::chrono::steady_clock::now();
+    {
+        PerfScope perf(m_Perf);
+        const Kernels& kernel = kernels();
+        const size_t count = static_cast<size_t>(m_FrameSize) * m_Channels;
+
+        float rawLaneSums[8] = {};
+        float squares = 0.0f;
+        float peak = 0.0f;
+        kernel.analyze(in, out, count, m_DcLanes, rawLaneSums, squares, peak);
+
+        if(m_Config.dcFilter) {
+            // Per channel mean of this frame, the lanes repeat every `channels`
+            float means[8] = {};
+            for(int l = 0; l < 8; l++) {
+                means[l % m_Channels] += rawLaneSums[l];
+            }
+            const float coefficient = b_DcInitialized
+                ? static_cast<float>(1.0 - std::exp(-m_FrameSeconds / kDcTimeConstant)) : 1.0f;
+            for(int l = 0; l < 8; l++) {
+                const float mean = means[l % m_Channels] / m_FrameSize;
+                m_DcLanes[l] += coefficient * (mean - m_DcLanes[l]);
+            }
+            b_DcInitialized = true;
+        }
+
+        if(m_Config.noiseGate || m_Config.agc || m_Config.limiter) {
+            float gainStart = 1.0f;
+            float gainEnd = 1.0f;
+            updateGains(std::sqrt(squares / count), peak, gainStart, gainEnd);
+            // Sample frame f gets gainStart + (f + 1) * step, the last one gainEnd
+            const float step = (gainEnd - gainStart) / m_FrameSize;
+            kernel.gain(out, count, m_Channels, gainStart + step, step);
+        }
+    }
+
+    m_LastFrameNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+    m_SmoothedFrameNs += 0.05 * (static_cast<double>(m_LastFrameNs) - m_SmoothedFrameNs);
+    Metrics::set(m_FrameNsMetric, static_cast<int64_t>(m_SmoothedFrameNs));
+    if(m_LastFrameNs > m_FrameNsMaxMetric.load(std::memory_order_relaxed)) {
+        Metrics::set(m_FrameNsMaxMetric, m_LastFrameNs);
+    }
+}
+
+void DspChain::updateGains(float rms, float peak, float& gainStart, float& gainEnd)
+{
+    const float rmsDb = 20.0f * std::log10(std::max(rms, 1e-9f));
+    const float frameSeconds = static_cast<float>(m_FrameSeconds);
+
+    // Noise gate: opens within one frame, closes after the hold time below the hysteresis band
+    if(m_Config.noiseGate) {
+        if(rmsDb >= m_Config.gateThresholdDb) {
+            b_GateOpen = true;
+            m_GateHoldFrames = static_cast<int>(std::ceil(kGateHoldSeconds / frameSeconds));
+        } else if(b_GateOpen && rmsDb < m_Config.gateThresholdDb - kGateHysteresisDb && --m_GateHoldFrames <= 0) {
+            b_GateOpen = false;
+        }
+        const float target = b_GateOpen ? 1.0f : kGateFloor;
+        gainStart *= m_GateGain;
+        if(target >= m_GateGain) {
+            m_GateGain = target;
+        } else {
+            m_GateGain = target + (m_GateGain - target) * std::exp(-frameSeconds / kGateReleaseTimeConstant);
+        }
+        gainEnd *= m_GateGain;
+        Metrics::set(m_GateOpenMetric, b_GateOpen ? 1 : 0);
+    }
+
+    // AGC: follows the level of frames that look like speech (above the gate threshold, gate
+    // open), moves its gain slowly towards the target and holds it in pauses
+    if(m_Config.agc) {
+        gainStart *= dbToLinear(m_AgcGainDb);
+        const bool speech = rmsDb >= m_Config.gateThresholdDb && (!m_Config.noiseGate || b_GateOpen);
+        if(speech) {
+            m_AgcLevelDb += (1.0f - std::exp(-frameSeconds / kAgcLevelTimeConstant)) * (rmsDb - m_AgcLevelDb);
+            const float desired = std::max(-m_Config.agcMaxGainDb,
+                std::min(m_Config.agcMaxGainDb, m_Config.agcTargetDb - m_AgcLevelDb));
+            m_AgcGainDb += std::max(-kAgcLowerDbPerSecond * frameSeconds,
+                std::min(kAgcRaiseDbPerSecond * frameSeconds, desired - m_AgcGainDb));
+            Metrics::set(m_AgcGainMetric, static_cast<int64_t>(std::lround(m_AgcGainDb)));
+        }
+        gainEnd *= dbToLinear(m_AgcGainDb);
+    }
+
+    // Limiter: no lookahead, the whole frame is scaled so the ramp never takes its peak over the
+    // ceiling (a lower gain applies from the first sample), then recovers over a few frames
+    if(m_Config.limiter) {
+        const float ceiling = dbToLinear(m_Config.limiterCeilingDb);
+        const float loudest = peak * std::max(gainStart, gainEnd);
+        const float bound = (loudest > ceiling) ? ceiling / loudest : 1.0f;
+        const float released = 1.0f - (1.0f - m_LimiterGain) * std::exp(-frameSeconds / kLimiterReleaseTimeConstant);
+        const float limiterStart = std::min(m_LimiterGain, bound);
+        m_LimiterGain = std::min(released, bound);
+        if(bound < released) {
+            Metrics::add(m_LimitedFramesMetric, 1);
+        }
+        gainStart *= limiterStart;
+        gainEnd *= m_LimiterGain;
+    }
+}
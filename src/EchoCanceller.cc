@@ -0,0 +1,277 @@
+#include "EchoCanceller.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+constexpr float kStepSize = 0.5f;               // NLMS step, normalized per bin
+constexpr float kPowerSmoothing = 0.05f;        // weight of the newest block in the far-end power
+constexpr float kActiveFarPower = 1e-6f;        // -60 dBFS: below this the filter doesn't adapt
+constexpr float kRegularization = 1e-6f;        // noise floor added to the normalization
+constexpr size_t kConstrainedPerBlock = 2;      // partitions forced back to kBlockSize taps per block
+constexpr double kDivergenceRatio = 4.0;        // output this much louder than the input: start over
+constexpr float kSampleScale = 1.0f / 32768.0f;
+
+// acc += a * b over n bins (n a multiple of 4)
+void multiplyAccumulate(float* accRe, float* accIm, const float* aRe, const float* aIm,
+    const float* bRe, const float* bIm, size_t n)
+{
+#if defined(__SSE2__)
+    for(size_t k = 0; k < n; k += 4) {
+        const __m128 ar = _mm_loadu_ps(aRe + k), ai = _mm_loadu_ps(aIm + k);
+        const __m128 br = _mm_loadu_ps(bRe + k), bi = _mm_loadu_ps(bIm + k);
+        const __m128 re = _mm_sub_ps(_mm_mul_ps(ar, br), _mm_mul_ps(ai, bi));
+        const __m128 im = _mm_add_ps(_mm_mul_ps(ar, bi), _mm_mul_ps(ai, br));
+        _mm_storeu_ps(accRe + k, _mm_add_ps(_mm_loadu_ps(accRe + k), re));
+        _mm_storeu_ps(accIm + k, _mm_add_ps(_mm_loadu_ps(accIm + k), im));
+    }
+#else
+    for(size_t k = 0; k < n; k++) {
+        accRe[k] += aRe[k] * bRe[k] - aIm[k] * bIm[k];
+        accIm[k] += aRe[k] * bIm[k] + aIm[k] * bRe[k];
+    }
+#endif
+}
+
+// acc += a * conj(b) over n bins (n a multiple of 4)
+void multiplyConjugateAccumulate(float* accRe, float* accIm, const float* aRe, const float* aIm,
+    const float* bRe, const float* bIm, size_t n)
+{
+#if defined(__SSE2__)
+    for(size_t k = 0; k < n; k += 4) {
+        const __m128 ar = _mm_loadu_ps(aRe + k), ai = _mm_loadu_ps(aIm + k);
+        const __m128 br = _mm_loadu_ps(bRe + k), bi = _mm_loadu_ps(bIm + k);
+        const __m128 re = _mm_add_ps(_mm_mul_ps(ar, br), _mm_mul_ps(ai, bi));
+        const __m128 im = _mm_sub_ps(_mm_mul_ps(ai, br), _mm_mul_ps(ar, bi));
+        _mm_storeu_ps(accRe + k, _mm_add_ps(_mm_loadu_ps(accRe + k), re));
+        _mm_storeu_ps(accIm + k, _mm_add_ps(_mm_loadu_ps(accIm + k), im));
+    }
+#else
+    for(size_t k = 0; k < n; k++) {
+        accRe[k] += aRe[k] * bRe[k] + aIm[k] * bIm[k];
+        accIm[k] += aIm[k] * bRe[k] - aRe[k] * bIm[k];
+    }
+#endif
+}
+
+opus_int16 toSample(float value)
+{
+    const float scaled = std::round(value * 32768.0f);
+    return static_cast<opus_int16>(std::max(-32768.0f, std::min(32767.0f, scaled)));
+}
+
+} // namespace
+
+EchoCanceller::EchoCanceller(int sampleRate, int channels, int tailMs)
+    : m_SampleRate(sampleRate),
+    m_Channels(channels),
+    m_Partitions(0),
+    m_Fft(kFftSize),
+    m_ReferenceCapacity(static_cast<size_t>(sampleRate) / 2),
+    m_FarTime(kFftSize, 0.0f),
+    m_FarPower(kBinStride, 0.0f),
+    m_Output(kBlockSize * channels, 0),
+    m_TimeBuffer(kFftSize),
+    m_SpecRe(kBinStride),
+    m_SpecIm(kBinStride),
+    m_StepRe(kBinStride),
+    m_StepIm(kBinStride),
+    m_BlocksMetric(Metrics::instance().get("aec.blocks")),
+    m_ErleMetric(Metrics::instance().get("aec.erle_db")),
+    m_UnderrunMetric(Metrics::instance().get("aec.reference_underruns")),
+    m_OverrunMetric(Metrics::instance().get("aec.reference_overruns")),
+    m_ResetMetric(Metrics::instance().get("aec.filter_resets"))
+{
+    if(tailMs <= 0 || tailMs > kMaxTailMs) {
+        throw std::invalid_argument("Echo tail must be 1-" + std::to_string(kMaxTailMs) + " ms, got "
+            + std::to_string(tailMs));
+    }
+    const size_t tailSamples = static_cast<size_t>(sampleRate) * tailMs / 1000;
+    m_Partitions = std::max<size_t>(1, (tailSamples + kBlockSize - 1) / kBlockSize);
+
+    m_Reference.assign(m_ReferenceCapacity, 0.0f);
+    m_FarRe.assign(m_Partitions * kBinStride, 0.0f);
+    m_FarIm.assign(m_Partitions * kBinStride, 0.0f);
+    m_State.resize(channels);
+    for(ChannelState& channel : m_State) {
+        channel.weightsRe.assign(m_Partitions * kBinStride, 0.0f);
+        channel.weightsIm.assign(m_Partitions * kBinStride, 0.0f);
+        channel.nearBlock.assign(kBlockSize, 0.0f);
+    }
+
+    std::cout << "[EchoCanceller] " << tailMs << " ms tail: " << m_Partitions << " partitions of " << kBlockSize
+        << " samples, " << channels << " channel(s), " << kBlockSize * 1000.0 / sampleRate << " ms added latency."
+        << std::endl;
+}
+
+void EchoCanceller::addReference(const opus_int16* pcm, size_t frames)
+{
+    std::lock_guard<std::mutex> lock(m_ReferenceMutex);
+    b_ReferenceStarted = true;
+    for(size_t i = 0; i < frames; i++) {
+        float mono = 0.0f;
+        for(int c = 0; c < m_Channels; c++) {
+            mono += pcm[i * m_Channels + c];
+        }
+        if(m_ReferenceCount == m_ReferenceCapacity) {
+            // Capture stalled or stopped: keep the newest audio
+            m_ReferenceRead = (m_ReferenceRead + 1) % m_ReferenceCapacity;
+            m_ReferenceCount--;
+            Metrics::add(m_OverrunMetric, 1);
+        }
+        m_Reference[(m_ReferenceRead + m_ReferenceCount) % m_ReferenceCapacity] = mono * kSampleScale / m_Channels;
+        m_ReferenceCount++;
+    }
+}
+
+void EchoCanceller::takeReference()
+{
+    float* block = m_FarTime.data() + kBlockSize;
+    std::lock_guard<std::mutex> lock(m_ReferenceMutex);
+    const size_t available = std::min(m_ReferenceCount, kBlockSize);
+    for(size_t n = 0; n < available; n++) {
+        block[n] = m_Reference[m_ReferenceRead];
+        m_ReferenceRead = (m_ReferenceRead + 1) % m_ReferenceCapacity;
+    }
+    m_ReferenceCount -= available;
+    std::fill(block + available, block + kBlockSize, 0.0f);
+    if(available < kBlockSize && b_ReferenceStarted) {
+        Metrics::add(m_UnderrunMetric, 1);
+    }
+}
+
+void EchoCanceller::process(opus_int16* pcm, size_t frames)
+{
+    for(size_t i = 0; i < frames; i++) {
+        opus_int16* frame = pcm + i * m_Channels;
+        opus_int16* delayed = m_Output.data() + m_Fill * m_Channels;
+        for(int c = 0; c < m_Channels; c++) {
+            m_State[c].nearBlock[m_Fill] = frame[c] * kSampleScale;
+            frame[c] = delayed[c];
+        }
+        if(++m_Fill == kBlockSize) {
+            m_Fill = 0;
+            processBlock();
+        }
+    }
+}
+
+void EchoCanceller::processBlock()
+{
+    takeReference();
+
+    // Newest far-end spectrum replaces the oldest; partition p uses the spectrum p blocks back
+    m_Newest = (m_Newest + m_Partitions - 1) % m_Partitions;
+    float* farRe = m_FarRe.data() + m_Newest * kBinStride;
+    float* farIm = m_FarIm.data() + m_Newest * kBinStride;
+    m_Fft.forward(m_FarTime.data(), farRe, farIm);
+
+    float farEnergy = 0.0f;
+    for(size_t n = kBlockSize; n < kFftSize; n++) {
+        farEnergy += m_FarTime[n] * m_FarTime[n];
+    }
+    b_FarActive = farEnergy > kActiveFarPower * kBlockSize;
+    for(size_t k = 0; k < kBins; k++) {
+        const float power = farRe[k] * farRe[k] + farIm[k] * farIm[k];
+        m_FarPower[k] += kPowerSmoothing * (power - m_FarPower[k]);
+    }
+
+    for(ChannelState& channel : m_State) {
+        filterAndAdapt(channel);
+    }
+    for(size_t i = 0; i < kConstrainedPerBlock && i < m_Partitions; i++) {
+        for(ChannelState& channel : m_State) {
+            constrain(channel, m_NextConstrained);
+        }
+        m_NextConstrained = (m_NextConstrained + 1) % m_Partitions;
+    }
+
+    // Overlap-save: this block is the first half of the next window
+    std::copy(m_FarTime.begin() + kBlockSize, m_FarTime.end(), m_FarTime.begin());
+    Metrics::add(m_BlocksMetric, 1);
+}
+
+void EchoCanceller::filterAndAdapt(ChannelState& channel)
+{
+    const size_t channelIndex = static_cast<size_t>(&channel - m_State.data());
+
+    // Echo estimate: Y = sum over partitions of W_p X_p, its last kBlockSize samples are valid
+    std::fill(m_SpecRe.begin(), m_SpecRe.end(), 0.0f);
+    std::fill(m_SpecIm.begin(), m_SpecIm.end(), 0.0f);
+    for(size_t p = 0; p < m_Partitions; p++) {
+        const size_t far = ((m_Newest + p) % m_Partitions) * kBinStride;
+        multiplyAccumulate(m_SpecRe.data(), m_SpecIm.data(),
+            channel.weightsRe.data() + p * kBinStride, channel.weightsIm.data() + p * kBinStride,
+            m_FarRe.data() + far, m_FarIm.data() + far, kBinStride);
+    }
+    m_Fft.inverse(m_SpecRe.data(), m_SpecIm.data(), m_TimeBuffer.data());
+
+    // Error = what is left of the microphone signal, also the output
+    float* error = m_TimeBuffer.data() + kBlockSize;
+    double nearEnergy = 0.0;
+    double errorEnergy = 0.0;
+    for(size_t n = 0; n < kBlockSize; n++) {
+        const float nearSample = channel.nearBlock[n];
+        error[n] = nearSample - error[n];
+        nearEnergy += nearSample * nearSample;
+        errorEnergy += error[n] * error[n];
+    }
+
+    if(errorEnergy > kDivergenceRatio * nearEnergy + kActiveFarPower * kBlockSize) {
+        // The filter adds more than it removes (e.g. the echo path changed during double talk)
+        std::fill(channel.weightsRe.begin(), channel.weightsRe.end(), 0.0f);
+        std::fill(channel.weightsIm.begin(), channel.weightsIm.end(), 0.0f);
+        std::copy(channel.nearBlock.begin(), channel.nearBlock.end(), error);
+        errorEnergy = nearEnergy;
+        Metrics::add(m_ResetMetric, 1);
+    }
+
+    for(size_t n = 0; n < kBlockSize; n++) {
+        m_Output[n * m_Channels + channelIndex] = toSample(error[n]);
+    }
+    if(!b_FarActive) {
+        return;
+    }
+
+    // ERLE over about a second of far-end activity
+    const double smoothing = static_cast<double>(kBlockSize) / m_SampleRate;
+    channel.nearEnergy += smoothing * (nearEnergy - channel.nearEnergy);
+    channel.errorEnergy += smoothing * (errorEnergy - channel.errorEnergy);
+    if(channelIndex == 0 && channel.errorEnergy > 0.0) {
+        m_ErleDb = 10.0 * std::log10(channel.nearEnergy / channel.errorEnergy);
+        Metrics::set(m_ErleMetric, static_cast<int64_t>(std::lround(m_ErleDb)));
+    }
+
+    // Gradient: E = FFT([0, e]), step per bin mu E / (partitions * Pxx + floor)
+    std::fill(m_TimeBuffer.begin(), m_TimeBuffer.begin() + kBlockSize, 0.0f);
+    m_Fft.forward(m_TimeBuffer.data(), m_SpecRe.data(), m_SpecIm.data());
+    const float partitions = static_cast<float>(m_Partitions);
+    const float floor = partitions * kRegularization * kFftSize;
+    for(size_t k = 0; k < kBins; k++) {
+        const float scale = kStepSize / (partitions * m_FarPower[k] + floor);
+        m_StepRe[k] = m_SpecRe[k] * scale;
+        m_StepIm[k] = m_SpecIm[k] * scale;
+    }
+    for(size_t p = 0; p < m_Partitions; p++) {
+        const size_t far = ((m_Newest + p) % m_Partitions) * kBinStride;
+        multiplyConjugateAccumulate(channel.weightsRe.data() + p * kBinStride, channel.weightsIm.data() + p * kBinStride,
+            m_StepRe.data(), m_StepIm.data(), m_FarRe.data() + far, m_FarIm.data() + far, kBinStride);
+    }
+}
+
+void EchoCanceller::constrain(ChannelState& channel, size_t partition)
+{
+    float* weightsRe = channel.weightsRe.data() + partition * kBinStride;
+    float* weightsIm = channel.weightsIm.data() + partition * kBinStride;
+    m_Fft.inverse(weightsRe, weightsIm, m_TimeBuffer.data());
+    std::fill(m_TimeBuffer.begin() + kBlockSize, m_TimeBuffer.end(), 0.0f);
+    m_Fft.forward(m_TimeBuffer.data(), weightsRe, weightsIm);
+}
@@ -79,6 +79,7 @@ void FakeAudioSource::readLoop()
 
     m_AudioFile.clear();
     m_AudioFile.seekg(0, std::ios::beg);
+    int64_t frames = 0;     // frame trace tag
 
     while(a_IsRunning.load())
     {
@@ -105,6 +106,7 @@ void FakeAudioSource::readLoop()
             break; // Exit the loop if the destination queue is no longer accepting data
         }
 
+        currentFrame.traceId = frames++;
         m_OutputQueue->push(currentFrame); // Push the read audio frame to the queue
         // std::cout << "[FakeAudioSource] Pushed frame. Queue size: " << _outputQueue->size() << std::endl; // For debugging
 
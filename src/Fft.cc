@@ -0,0 +1,173 @@
+#include "Fft.hpp"
+
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+
+#if !defined(__SSE2__)
+// One radix-2 Stockham stage over `half` butterflies: with stride s, butterfly j = p * s + q
+// combines x[j] and x[j + half] and writes y[j + p * s] (sum) and y[j + p * s + s]
+// (difference times the twiddle w[j])
+void stageScalar(const float* xr, const float* xi, float* yr, float* yi, const float* wr, const float* wi,
+    size_t half, size_t stride)
+{
+    for(size_t j = 0; j < half; j++) {
+        const size_t out = j + (j / stride) * stride;
+        const float ar = xr[j], ai = xi[j];
+        const float br = xr[j + half], bi = xi[j + half];
+        const float dr = ar - br, di = ai - bi;
+        yr[out] = ar + br;
+        yi[out] = ai + bi;
+        yr[out + stride] = dr * wr[j] - di * wi[j];
+        yi[out + stride] = dr * wi[j] + di * wr[j];
+    }
+}
+#else
+// One radix-2 Stockham stage over `half` butterflies, four at a time: with stride s, butterfly
+// j = p * s + q combines x[j] and x[j + half] and writes y[j + p * s] (sum) and y[j + p * s + s]
+// (difference times the twiddle w[j]). Strides of 4 and up write contiguous runs, strides 1 and
+// 2 interleave the sums and differences of neighbouring butterflies.
+void stageSse(const float* xr, const float* xi, float* yr, float* yi, const float* wr, const float* wi,
+    size_t half, size_t stride)
+{
+    for(size_t j = 0; j < half; j += 4) {
+        const __m128 ar = _mm_loadu_ps(xr + j), ai = _mm_loadu_ps(xi + j);
+        const __m128 br = _mm_loadu_ps(xr + j + half), bi = _mm_loadu_ps(xi + j + half);
+        const __m128 twr = _mm_loadu_ps(wr + j), twi = _mm_loadu_ps(wi + j);
+        const __m128 sr = _mm_add_ps(ar, br), si = _mm_add_ps(ai, bi);
+        const __m128 dr = _mm_sub_ps(ar, br), di = _mm_sub_ps(ai, bi);
+        const __m128 tr = _mm_sub_ps(_mm_mul_ps(dr, twr), _mm_mul_ps(di, twi));
+        const __m128 ti = _mm_add_ps(_mm_mul_ps(dr, twi), _mm_mul_ps(di, twr));
+
+        if(stride >= 4) {
+            const size_t out = j + (j / stride) * stride;
+            _mm_storeu_ps(yr + out, sr);
+            _mm_storeu_ps(yi + out, si);
+            _mm_storeu_ps(yr + out + stride, tr);
+            _mm_storeu_ps(yi + out + stride, ti);
+        } else if(stride == 2) {
+            _mm_storeu_ps(yr + 2 * j, _mm_movelh_ps(sr, tr));
+            _mm_storeu_ps(yr + 2 * j + 4, _mm_movehl_ps(tr, sr));
+            _mm_storeu_ps(yi + 2 * j, _mm_movelh_ps(si, ti));
+            _mm_storeu_ps(yi + 2 * j + 4, _mm_movehl_ps(ti, si));
+        } else {
+            _mm_storeu_ps(yr + 2 * j, _mm_unpacklo_ps(sr, tr));
+            _mm_storeu_ps(yr + 2 * j + 4, _mm_unpackhi_ps(sr, tr));
+            _mm_storeu_ps(yi + 2 * j, _mm_unpacklo_ps(si, ti));
+            _mm_storeu_ps(yi + 2 * j + 4, _mm_unpackhi_ps(si, ti));
+        }
+    }
+}
+#endif
+
+} // namespace
+
+RealFft::RealFft(size_t size)
+    : m_Size(size), m_Half(size / 2), m_Stages(0),
+    m_WorkRe(size / 2), m_WorkIm(size / 2), m_ScratchRe(size / 2), m_ScratchIm(size / 2)
+{
+    if(size < 16 || (size & (size - 1)) != 0) {
+        throw std::invalid_argument("FFT size must be a power of two >= 16, got " + std::to_string(size));
+    }
+
+    const size_t butterflies = m_Half / 2;
+    for(size_t stride = 1; stride < m_Half; stride *= 2) {
+        m_Stages++;
+        for(size_t j = 0; j < butterflies; j++) {
+            const double angle = -2.0 * kPi * static_cast<double>((j / stride) * stride) / static_cast<double>(m_Half);
+            m_StageRe.push_back(static_cast<float>(std::cos(angle)));
+            m_StageIm.push_back(static_cast<float>(std::sin(angle)));
+        }
+    }
+    for(size_t k = 0; k < m_Half; k++) {
+        const double angle = -2.0 * kPi * static_cast<double>(k) / static_cast<double>(m_Size);
+        m_SplitRe.push_back(static_cast<float>(std::cos(angle)));
+        m_SplitIm.push_back(static_cast<float>(std::sin(angle)));
+    }
+}
+
+void RealFft::transform(float*& re, float*& im)
+{
+    float* xr = m_WorkRe.data();
+    float* xi = m_WorkIm.data();
+    float* yr = m_ScratchRe.data();
+    float* yi = m_ScratchIm.data();
+    const size_t butterflies = m_Half / 2;
+
+    size_t stride = 1;
+    for(size_t stage = 0; stage < m_Stages; stage++, stride *= 2) {
+        const float* wr = m_StageRe.data() + stage * butterflies;
+        const float* wi = m_StageIm.data() + stage * butterflies;
+#if defined(__SSE2__)
+        stageSse(xr, xi, yr, yi, wr, wi, butterflies, stride);
+#else
+        stageScalar(xr, xi, yr, yi, wr, wi, butterflies, stride);
+#endif
+        std::swap(xr, yr);
+        std::swap(xi, yi);
+    }
+    re = xr;
+    im = xi;
+}
+
+void RealFft::forward(const float* in, float* re, float* im)
+{
+    // Even samples as the real, odd samples as the imaginary part of an N/2 point signal
+    for(size_t n = 0; n < m_Half; n++) {
+        m_WorkRe[n] = in[2 * n];
+        m_WorkIm[n] = in[2 * n + 1];
+    }
+    float* zr;
+    float* zi;
+    transform(zr, zi);
+
+    // Split step: the spectra of the even (Fe) and odd (Fo) samples are the conjugate-symmetric
+    // and -antisymmetric parts of Z, and X[k] = Fe[k] + exp(-2 pi i k / N) Fo[k]
+    re[0] = zr[0] + zi[0];
+    im[0] = 0.0f;
+    re[m_Half] = zr[0] - zi[0];
+    im[m_Half] = 0.0f;
+    for(size_t k = 1; k < m_Half; k++) {
+        const float ar = zr[k], ai = zi[k];
+        const float br = zr[m_Half - k], bi = -zi[m_Half - k];     // conj(Z[N/2 - k])
+        const float er = 0.5f * (ar + br), ei = 0.5f * (ai + bi);
+        const float or_ = 0.5f * (ai - bi), oi = -0.5f * (ar - br);
+        re[k] = er + or_ * m_SplitRe[k] - oi * m_SplitIm[k];
+        im[k] = ei + or_ * m_SplitIm[k] + oi * m_SplitRe[k];
+    }
+}
+
+void RealFft::inverse(const float* re, const float* im, float* out)
+{
+    // Undo the split step: Z[k] = Fe[k] + i Fo[k]. The inverse FFT is the forward one with real
+    // and imaginary parts swapped on the way in and out, so Z is stored swapped.
+    for(size_t k = 0; k < m_Half; k++) {
+        const float ar = re[k], ai = (k == 0) ? 0.0f : im[k];
+        const float br = re[m_Half - k], bi = (k == 0) ? 0.0f : -im[m_Half - k];   // conj(X[N/2 - k])
+        const float er = 0.5f * (ar + br), ei = 0.5f * (ai + bi);
+        const float dr = 0.5f * (ar - br), di = 0.5f * (ai - bi);
+        // Fo = (X[k] - conj(X[N/2 - k])) / 2 * exp(+2 pi i k / N)
+        const float or_ = dr * m_SplitRe[k] + di * m_SplitIm[k];
+        const float oi = di * m_SplitRe[k] - dr * m_SplitIm[k];
+        m_WorkRe[k] = ei + or_;     // Im Z
+        m_WorkIm[k] = er - oi;      // Re Z
+    }
+    float* zi;
+    float* zr;
+    transform(zi, zr);
+
+    const float scale = 1.0f / static_cast<float>(m_Half);
+    for(size_t n = 0; n < m_Half; n++) {
+        out[2 * n] = zr[n] * scale;
+        out[2 * n + 1] = zi[n] * scale;
+    }
+}
@@ -0,0 +1,191 @@
+#include "FrameTracer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// The spans of one thread. Only the owning thread writes; `count` is published with a release
+// store so write() sees complete events.
+struct TraceBuffer
+{
+    std::unique_ptr<TraceEvent[]> events{new TraceEvent[FrameTracer::kEventsPerThread]};
+    std::atomic<uint64_t> count{0};     // spans ever recorded, the ring keeps the last kEventsPerThread
+    std::string name;
+    int tid = 0;
+};
+
+namespace {
+
+std::mutex& buffersMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+// Kept for the lifetime of the process, threads that exited still show up in the trace
+std::vector<std::unique_ptr<TraceBuffer>>& buffers()
+{
+    static std::vector<std::unique_ptr<TraceBuffer>> registry;
+    return registry;
+}
+
+thread_local TraceBuffer* t_Buffer = nullptr;
+
+TraceBuffer* registerBuffer(const char* name)
+{
+    auto buffer = std::make_unique<TraceBuffer>();
+    if(name) {
+        buffer->name = name;
+    }
+    std::lock_guard<std::mutex> lock(buffersMutex());
+    buffer->tid = static_cast<int>(buffers().size()) + 1;
+    buffers().push_back(std::move(buffer));
+    return buffers().back().get();
+}
+
+TraceBuffer& threadBuffer()
+{
+    if(!t_Buffer) {
+        t_Buffer = registerBuffer(nullptr);
+    }
+    return *t_Buffer;
+}
+
+void writeString(std::ostream& out, const std::string& text)
+{
+    out << '"';
+    for(char c : text) {
+        if(c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if(static_cast<unsigned char>(c) < 0x20) {
+            out << ' ';
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+// Chrome trace timestamps are microseconds, keep the nanoseconds as decimals
+void writeMicros(std::ostream& out, int64_t ns)
+{
+    char text[32];
+    std::snprintf(text, sizeof(text), "%lld.%03lld", static_cast<long long>(ns / 1000),
+        static_cast<long long>(ns % 1000));
+    out << text;
+}
+
+} // namespace
+
+std::atomic_bool FrameTracer::s_Enabled{false};
+
+void FrameTracer::enable()
+{
+    s_Enabled.store(true);
+    std::cout << "[FrameTracer] Recording per-frame spans of the audio callbacks, stages, codec and network." << std::endl;
+}
+
+int64_t FrameTracer::nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void FrameTracer::record(const TraceEvent& event)
+{
+    TraceBuffer& buffer = threadBuffer();
+    const uint64_t count = buffer.count.load(std::memory_order_relaxed);
+    buffer.events[count % kEventsPerThread] = event;
+    buffer.count.store(count + 1, std::memory_order_release);
+}
+
+void FrameTracer::nameThread(const char* name)
+{
+    if(!enabled()) {
+        return;
+    }
+    TraceBuffer& buffer = threadBuffer();
+    if(buffer.name.empty()) {
+        std::lock_guard<std::mutex> lock(buffersMutex());
+        buffer.name = name;
+    }
+}
+
+TraceBuffer* FrameTracer::reserveThread(const char* name)
+{
+    return enabled() ? registerBuffer(name) : nullptr;
+}
+
+void FrameTracer::adoptThread(TraceBuffer* buffer)
+{
+    if(!t_Buffer) {
+        t_Buffer = buffer;
+    }
+}
+
+bool FrameTracer::write(const std::string& path)
+{
+    std::ofstream out(path, std::ios::trunc);
+    if(!out) {
+        std::cerr << "[FrameTracer] Error: Cannot open " << path << " for writing." << std::endl;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(buffersMutex());
+
+    // Timestamps relative to the first span kept, so the timeline starts at 0
+    int64_t originNs = INT64_MAX;
+    for(const auto& buffer : buffers()) {
+        const uint64_t count = buffer->count.load(std::memory_order_acquire);
+        for(uint64_t i = count - std::min<uint64_t>(count, kEventsPerThread); i < count; i++) {
+            originNs = std::min(originNs, buffer->events[i % kEventsPerThread].beginNs);
+        }
+    }
+
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    size_t written = 0;
+    uint64_t overwritten = 0;
+    for(const auto& buffer : buffers()) {
+        out << (first ? "\n" : ",\n") << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << buffer->tid
+            << ",\"args\":{\"name\":";
+        writeString(out, buffer->name.empty() ? "thread " + std::to_string(buffer->tid) : buffer->name);
+        out << "}}";
+        first = false;
+
+        const uint64_t count = buffer->count.load(std::memory_order_acquire);
+        const uint64_t kept = std::min<uint64_t>(count, kEventsPerThread);
+        overwritten += count - kept;
+        for(uint64_t i = count - kept; i < count; i++) {
+            const TraceEvent& event = buffer->events[i % kEventsPerThread];
+            out << ",\n{\"ph\":\"X\",\"cat\":\"" << event.category << "\",\"name\":\"" << event.name
+                << "\",\"pid\":1,\"tid\":" << buffer->tid << ",\"ts\":";
+            writeMicros(out, event.beginNs - originNs);
+            out << ",\"dur\":";
+            writeMicros(out, event.endNs - event.beginNs);
+            if(event.argName) {
+                out << ",\"args\":{\"" << event.argName << "\":" << event.arg << "}";
+            }
+            out << "}";
+            written++;
+        }
+    }
+    out << "\n]}\n";
+    out.close();
+    if(!out) {
+        std::cerr << "[FrameTracer] Error: Writing " << path << " failed." << std::endl;
+        return false;
+    }
+
+    std::cout << "[FrameTracer] Wrote " << written << " spans of " << buffers().size() << " threads to " << path;
+    if(overwritten > 0) {
+        std::cout << " (" << overwritten << " older spans overwritten)";
+    }
+    std::cout << std::endl;
+    return true;
+}
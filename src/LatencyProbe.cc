@@ -0,0 +1,368 @@
+#include "LatencyProbe.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+constexpr double kBurstSeconds = 0.04;
+constexpr double kGateRelative = 0.01;     // -20 dB
+
+// Feedback taps (right-shifting Fibonacci LFSR) of primitive polynomials, by order
+struct MlsPolynomial
+{
+    int order;
+    uint32_t taps;
+};
+constexpr MlsPolynomial kMlsPolynomials[] = {
+    {9, 0x011},     // x^9 + x^5 + 1
+    {10, 0x009},    // x^10 + x^7 + 1
+    {11, 0x005},    // x^11 + x^9 + 1
+    {12, 0x053},    // x^12 + x^11 + x^8 + x^6 + 1
+    {13, 0x01B},    // x^13 + x^12 + x^10 + x^9 + 1
+};
+
+std::vector<float> makeChirp(int sampleRate)
+{
+    const size_t length = static_cast<size_t>(std::lround(sampleRate * kBurstSeconds));
+    const double f0 = 300.0;
+    const double f1 = std::min(6000.0, sampleRate * 0.4);
+    const double duration = static_cast<double>(length) / sampleRate;
+
+    std::vector<float> burst(length);
+    for(size_t n = 0; n < length; n++) {
+        const double t = static_cast<double>(n) / sampleRate;
+        const double phase = 2.0 * kPi * (f0 * t + (f1 - f0) * t * t / (2.0 * duration));
+        const double window = 0.5 * (1.0 - std::cos(2.0 * kPi * n / (length - 1)));
+        burst[n] = static_cast<float>(window * std::sin(phase));
+    }
+    return burst;
+}
+
+std::vector<float> makeMls(int sampleRate)
+{
+    const double minimum = sampleRate * kBurstSeconds;
+    const MlsPolynomial* polynomial = &kMlsPolynomials[0];
+    for(const auto& candidate : kMlsPolynomials) {
+        polynomial = &candidate;
+        if(static_cast<double>((1u << candidate.order) - 1) >= minimum) {
+            break;
+        }
+    }
+
+    const size_t length = (1u << polynomial->order) - 1;
+    std::vector<float> burst(length);
+    uint32_t state = 1;
+    for(size_t n = 0; n < length; n++) {
+        burst[n] = (state & 1) ? 1.0f : -1.0f;
+        uint32_t feedback = state & polynomial->taps;
+        feedback ^= feedback >> 16;
+        feedback ^= feedback >> 8;
+        feedback ^= feedback >> 4;
+        feedback ^= feedback >> 2;
+        feedback ^= feedback >> 1;
+        state = (state >> 1) | ((feedback & 1) << (polynomial->order - 1));
+    }
+    return burst;
+}
+
+double sumOfSquares(const std::vector<float>& samples)
+{
+    double sum = 0.0;
+    for(float sample : samples) {
+        sum += static_cast<double>(sample) * sample;
+    }
+    return sum;
+}
+
+std::chrono::nanoseconds samplesToDuration(int64_t samples, int sampleRate)
+{
+    return std::chrono::nanoseconds(samples * 1000000000LL / sampleRate);
+}
+
+} // namespace
+
+// --- LatencyProbe ---
+
+LatencyProbe& LatencyProbe::instance()
+{
+    static LatencyProbe probe;
+    return probe;
+}
+
+LatencyProbe::LatencyProbe()
+    : m_SentMetric(Metrics::instance().get("latency.probe.sent")),
+    m_DetectedMetric(Metrics::instance().get("latency.probe.detected")),
+    m_MissedMetric(Metrics::instance().get("latency.probe.missed")),
+    m_LastMetric(Metrics::instance().get("latency.probe.last_us")),
+    m_MeanMetric(Metrics::instance().get("latency.probe.mean_us")),
+    m_StddevMetric(Metrics::instance().get("latency.probe.stddev_us")),
+    m_P95Metric(Metrics::instance().get("latency.probe.p95_us")),
+    m_MaxMetric(Metrics::instance().get("latency.probe.max_us"))
+{}
+
+bool LatencyProbe::parseSignal(const std::string& name, ProbeSignal& signal)
+{
+    if(name.empty() || name == "chirp") {
+        signal = ProbeSignal::Chirp;
+        return true;
+    }
+    if(name == "mls") {
+        signal = ProbeSignal::Mls;
+        return true;
+    }
+    return false;
+}
+
+const char* LatencyProbe::signalName(ProbeSignal signal)
+{
+    return signal == ProbeSignal::Mls ? "mls" : "chirp";
+}
+
+std::vector<float> LatencyProbe::makeReference(ProbeSignal signal, int sampleRate)
+{
+    return signal == ProbeSignal::Mls ? makeMls(sampleRate) : makeChirp(sampleRate);
+}
+
+void LatencyProbe::burstEmitted(Clock::time_point at)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Emissions.push_back({at, false});
+    if(m_Emissions.size() > kMaxPendingBursts) {
+        if(!m_Emissions.front().matched) {
+            m_Missed++;
+            Metrics::set(m_MissedMetric, static_cast<int64_t>(m_Missed));
+        }
+        m_Emissions.pop_front();
+    }
+    Metrics::add(m_SentMetric, 1);
+}
+
+std::chrono::microseconds LatencyProbe::burstArrived(Clock::time_point at)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    auto it = std::find_if(m_Emissions.rbegin(), m_Emissions.rend(),
+        [at](const Emission& emission) { return emission.at <= at; });
+    if(it == m_Emissions.rend() || it->matched) {
+        return std::chrono::microseconds(-1);
+    }
+    it->matched = true;
+    const Clock::time_point emittedAt = it->at;
+    const auto latency = std::chrono::duration_cast<std::chrono::microseconds>(at - emittedAt);
+
+    // Everything emitted before the matched burst has had its chance
+    while(m_Emissions.front().at < emittedAt) {
+        if(!m_Emissions.front().matched) {
+            m_Missed++;
+        }
+        m_Emissions.pop_front();
+    }
+
+    const int64_t latencyUs = latency.count();
+    m_LatenciesUs.push_back(latencyUs);
+    const double delta = latencyUs - m_MeanUs;
+    m_MeanUs += delta / static_cast<double>(m_LatenciesUs.size());
+    m_M2 += delta * (latencyUs - m_MeanUs);
+    const double stddev = m_LatenciesUs.size() > 1 ? std::sqrt(m_M2 / (m_LatenciesUs.size() - 1)) : 0.0;
+
+    Metrics::add(m_DetectedMetric, 1);
+    Metrics::set(m_MissedMetric, static_cast<int64_t>(m_Missed));
+    Metrics::set(m_LastMetric, latencyUs);
+    Metrics::set(m_MeanMetric, std::llround(m_MeanUs));
+    Metrics::set(m_StddevMetric, std::llround(stddev));
+    return latency;
+}
+
+void LatencyProbe::reset()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Emissions.clear();
+    m_LatenciesUs.clear();
+    m_MeanUs = 0.0;
+    m_M2 = 0.0;
+    m_Missed = 0;
+}
+
+LatencySummary LatencyProbe::summary()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    LatencySummary summary;
+    summary.missed = m_Missed;
+    if(m_LatenciesUs.empty()) {
+        return summary;
+    }
+
+    std::vector<int64_t> sorted = m_LatenciesUs;
+    std::sort(sorted.begin(), sorted.end());
+    auto percentile = [&sorted](double p) {
+        return sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()))];
+    };
+    summary.bursts = sorted.size();
+    summary.meanUs = m_MeanUs;
+    summary.stddevUs = sorted.size() > 1 ? std::sqrt(m_M2 / (sorted.size() - 1)) : 0.0;
+    summary.minUs = sorted.front();
+    summary.p50Us = percentile(0.5);
+    summary.p95Us = percentile(0.95);
+    summary.maxUs = sorted.back();
+
+    Metrics::set(m_P95Metric, summary.p95Us);
+    Metrics::set(m_MaxMetric, summary.maxUs);
+    return summary;
+}
+
+void LatencyProbe::report(std::ostream& out, ProbeSignal signal)
+{
+    const LatencySummary stats = summary();
+    if(stats.bursts == 0) {
+        out << "[LatencyProbe] " << signalName(signal) << ": no bursts detected ("
+            << m_SentMetric.load() << " sent)" << std::endl;
+        return;
+    }
+
+    const auto ms = [](double us) { return us / 1000.0; };
+    out << std::fixed << std::setprecision(2)
+        << "[LatencyProbe] " << signalName(signal) << ": " << stats.bursts << " bursts, " << stats.missed
+        << " missed, latency mean " << ms(stats.meanUs) << " ms, stddev " << ms(stats.stddevUs)
+        << " ms (min " << ms(stats.minUs) << ", p50 " << ms(stats.p50Us) << ", p95 "
+        << ms(stats.p95Us) << ", max " << ms(stats.maxUs) << ")" << std::endl;
+    out.unsetf(std::ios::floatfield);
+}
+
+// --- ProbeAudioSource ---
+
+ProbeAudioSource::ProbeAudioSource(ProbeSignal signal, int sampleRate, int channels, int frameSize)
+    : NullAudioSource(sampleRate, channels, frameSize),
+    m_PeriodSamples(static_cast<int64_t>(sampleRate) * LatencyProbe::kBurstPeriod.count() / 1000)
+{
+    m_LogName = "ProbeAudioSource";
+    for(float sample : LatencyProbe::makeReference(signal, sampleRate)) {
+        m_Burst.push_back(static_cast<opus_int16>(std::lround(sample * kAmplitude * 32767.0)));
+    }
+    std::cout << "[ProbeAudioSource] " << LatencyProbe::signalName(signal) << " burst of " << m_Burst.size()
+        << " samples every " << LatencyProbe::kBurstPeriod.count() << " ms" << std::endl;
+}
+
+ProbeAudioSource::~ProbeAudioSource()
+{
+    // The clock thread calls fillFrame()
+    stop();
+}
+
+void ProbeAudioSource::fillFrame(AudioFrame& frame)
+{
+    const auto handedOut = LatencyProbe::Clock::now();
+    const int channels = getChannels();
+    const int64_t frames = static_cast<int64_t>(frame.size()) / channels;
+    const int64_t burstLength = static_cast<int64_t>(m_Burst.size());
+
+    for(int64_t i = 0; i < frames; i++) {
+        const int64_t sample = m_SamplesCaptured + i;
+        if(sample < m_PeriodSamples) {
+            continue;
+        }
+        const int64_t phase = sample % m_PeriodSamples;
+        if(phase >= burstLength) {
+            continue;
+        }
+        if(phase == 0) {
+            LatencyProbe::instance().burstEmitted(handedOut - samplesToDuration(frames - i, getSampleRate()));
+        }
+        std::fill_n(frame.begin() + i * channels, channels, m_Burst[phase]);
+    }
+    m_SamplesCaptured += frames;
+}
+
+// --- ProbeAudioPlayback ---
+
+ProbeAudioPlayback::ProbeAudioPlayback(ProbeSignal signal, int sampleRate, int channels, int frameSize)
+    : NullAudioPlayback(sampleRate, channels, frameSize), m_Signal(signal),
+    m_Reference(LatencyProbe::makeReference(signal, sampleRate))
+{
+    m_LogName = "ProbeAudioPlayback";
+    const double referenceEnergy = sumOfSquares(m_Reference);
+    const double amplitude = ProbeAudioSource::kAmplitude * 32767.0;
+    m_ReferenceNorm = std::sqrt(referenceEnergy);
+    m_GateEnergy = referenceEnergy * amplitude * amplitude * kGateRelative;
+}
+
+ProbeAudioPlayback::~ProbeAudioPlayback()
+{
+    // The clock thread calls renderFrame()
+    stop();
+}
+
+bool ProbeAudioPlayback::start()
+{
+    // The sink owns the measurement, every start begins a new one
+    LatencyProbe::instance().reset();
+    m_History.assign(m_Reference.size(), 0.0f);
+    m_WindowEnergy = 0.0;
+    m_SamplesPlayed = 0;
+    b_Tracking = false;
+    m_HoldUntil = 0;
+    b_Started = NullAudioPlayback::start();
+    return b_Started;
+}
+
+void ProbeAudioPlayback::stop()
+{
+    NullAudioPlayback::stop();
+    if(b_Started) {
+        b_Started = false;
+        LatencyProbe::instance().report(std::cout, m_Signal);
+    }
+}
+
+void ProbeAudioPlayback::renderFrame(const AudioFrame& frame)
+{
+    const auto playedAt = LatencyProbe::Clock::now();
+    const int channels = getChannels();
+    const size_t frames = frame.size() / channels;
+    const size_t length = m_Reference.size();
+
+    m_History.resize(length + frames);
+    for(size_t i = 0; i < frames; i++) {
+        m_History[length + i] = frame[i * channels];
+    }
+
+    // The samples are integers, so the running sum of squares stays exact in a double
+    for(size_t i = 0; i < frames; i++) {
+        const double entering = m_History[length + i];
+        const double leaving = m_History[i];
+        m_WindowEnergy += entering * entering - leaving * leaving;
+
+        const int64_t burstStart = m_SamplesPlayed + static_cast<int64_t>(i) - static_cast<int64_t>(length) + 1;
+        if(m_WindowEnergy >= m_GateEnergy && burstStart >= m_HoldUntil) {
+            const float* window = m_History.data() + i + 1;
+            float dot = 0.0f;
+            for(size_t k = 0; k < length; k++) {
+                dot += m_Reference[k] * window[k];
+            }
+            const double score = dot / (m_ReferenceNorm * std::sqrt(m_WindowEnergy));
+            if(score >= kDetectionThreshold && (!b_Tracking || score > m_BestScore)) {
+                b_Tracking = true;
+                m_BestScore = score;
+                m_BestStart = burstStart;
+            }
+        }
+
+        // Half a burst past the best peak without a better one: that was the burst
+        if(b_Tracking && burstStart - m_BestStart >= static_cast<int64_t>(length / 2)) {
+            b_Tracking = false;
+            m_HoldUntil = m_BestStart + static_cast<int64_t>(length);
+            const auto arrival = playedAt + samplesToDuration(m_BestStart - m_SamplesPlayed, getSampleRate());
+            const auto latency = LatencyProbe::instance().burstArrived(arrival);
+            if(latency.count() >= 0) {
+                std::cout << "[LatencyProbe] Burst arrived after " << latency.count() / 1000.0
+                    << " ms (correlation " << m_BestScore << ")" << std::endl;
+            }
+        }
+    }
+
+    std::copy(m_History.end() - static_cast<std::ptrdiff_t>(length), m_History.end(), m_History.begin());
+    m_SamplesPlayed += static_cast<int64_t>(frames);
+}
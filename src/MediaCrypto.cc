@@ -0,0 +1,491 @@
+#include "MediaCrypto.hpp"
+#include "PacketHeader.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#ifdef ECHOLINK_HAVE_OPENSSL
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/kdf.h>
+#include <openssl/rand.h>
+#endif
+
+namespace {
+
+// Fixed PBKDF2 salt: both ends derive the master from nothing but the secret, sessions differ
+const char kDerivationSalt[] = "echo-link media key v1";
+const char kSessionInfo[] = "echo-link media session v1";
+const char kClockInfo[] = "echo-link clock v1";
+
+constexpr size_t kAadSize = PacketHeader::kSize + MediaCrypto::kSessionSize + MediaCrypto::kRolloverSize;
+constexpr size_t kRolloverOffset = PacketHeader::kSize + MediaCrypto::kSessionSize;
+
+// session salt XOR (00 00 | SSRC | rollover | sequence), RFC 7714 section 8.1
+void makeNonce(const MediaKey& key, const unsigned char* packet, unsigned char* nonce)
+{
+    nonce[0] = 0;
+    nonce[1] = 0;
+    std::memcpy(nonce + 2, packet + 8, 4);                              // SSRC
+    std::memcpy(nonce + 6, packet + kRolloverOffset, 4);                // rollover counter
+    std::memcpy(nonce + 10, packet + 2, 2);                             // sequence
+    for(size_t i = 0; i < MediaKey::kSaltSize; i++) {
+        nonce[i] ^= key.salt[i];
+    }
+}
+
+// Drops the least recently used quarter of `table`, and frees what `release` is given
+template <typename Table, typename Release>
+void evictOldest(Table& table, Release release)
+{
+    std::vector<uint64_t> uses;
+    uses.reserve(table.size());
+    for(const auto& entry : table) {
+        uses.push_back(entry.second.lastUsed);
+    }
+    const size_t count = std::max<size_t>(1, uses.size() / 4);
+    std::nth_element(uses.begin(), uses.begin() + (count - 1), uses.end());
+    const uint64_t cutoff = uses[count - 1];
+    for(auto it = table.begin(); it != table.end();) {
+        if(it->second.lastUsed <= cutoff) {
+            release(it->second);
+            it = table.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void writeSession(unsigned char* data, uint64_t session)
+{
+    for(size_t i = 0; i < MediaCrypto::kSessionSize; i++) {
+        data[i] = static_cast<unsigned char>(session >> (8 * (MediaCrypto::kSessionSize - 1 - i)));
+    }
+}
+
+uint64_t readSession(const unsigned char* data)
+{
+    uint64_t session = 0;
+    for(size_t i = 0; i < MediaCrypto::kSessionSize; i++) {
+        session = (session << 8) | data[i];
+    }
+    return session;
+}
+
+#ifdef ECHOLINK_HAVE_OPENSSL
+// HKDF-SHA256 over the master key and salt, `size` bytes of output
+bool expandMaster(const MediaKey& master, const unsigned char* salt, size_t saltSize, const char* info,
+    unsigned char* out, size_t size)
+{
+    unsigned char secret[MediaKey::kKeySize + MediaKey::kSaltSize];
+    std::memcpy(secret, master.key.data(), MediaKey::kKeySize);
+    std::memcpy(secret + MediaKey::kKeySize, master.salt.data(), MediaKey::kSaltSize);
+    size_t length = size;
+
+    EVP_PKEY_CTX* context = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, nullptr);
+    const bool derived = context
+        && EVP_PKEY_derive_init(context) == 1
+        && EVP_PKEY_CTX_set_hkdf_md(context, EVP_sha256()) == 1
+        && (saltSize == 0 || EVP_PKEY_CTX_set1_hkdf_salt(context, salt, static_cast<int>(saltSize)) == 1)
+        && EVP_PKEY_CTX_set1_hkdf_key(context, secret, sizeof(secret)) == 1
+        && EVP_PKEY_CTX_add1_hkdf_info(context, reinterpret_cast<const unsigned char*>(info),
+            static_cast<int>(std::strlen(info))) == 1
+        && EVP_PKEY_derive(context, out, &length) == 1
+        && length == size;
+    EVP_PKEY_CTX_free(context);
+    std::memset(secret, 0, sizeof(secret));
+    return derived;
+}
+#endif
+
+bool isAudio(const unsigned char* packet)
+{
+    return (packet[0] >> 6) == PacketHeader::kVersion
+        && (packet[0] & 0x3F) == static_cast<uint8_t>(PacketType::Audio);
+}
+
+} // namespace
+
+bool MediaKey::available()
+{
+#ifdef ECHOLINK_HAVE_OPENSSL
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool MediaKey::derive(const std::string& secret, MediaKey& out)
+{
+#ifdef ECHOLINK_HAVE_OPENSSL
+    if(secret.empty()) {
+        return false;
+    }
+    unsigned char material[kKeySize + kSaltSize];
+    if(PKCS5_PBKDF2_HMAC(secret.data(), static_cast<int>(secret.size()),
+        reinterpret_cast<const unsigned char*>(kDerivationSalt), sizeof(kDerivationSalt) - 1,
+        kDerivationRounds, EVP_sha256(), sizeof(material), material) != 1) {
+        return false;
+    }
+    std::memcpy(out.key.data(), material, kKeySize);
+    std::memcpy(out.salt.data(), material + kKeySize, kSaltSize);
+    std::memset(material, 0, sizeof(material));
+    return true;
+#else
+    (void)secret;
+    (void)out;
+    return false;
+#endif
+}
+
+bool MediaKey::deriveSession(const MediaKey& master, uint64_t session, MediaKey& out)
+{
+#ifdef ECHOLINK_HAVE_OPENSSL
+    unsigned char salt[MediaCrypto::kSessionSize];
+    writeSession(salt, session);
+    unsigned char material[kKeySize + kSaltSize];
+    const bool derived = expandMaster(master, salt, sizeof(salt), kSessionInfo, material, sizeof(material));
+    if(derived) {
+        std::memcpy(out.key.data(), material, kKeySize);
+        std::memcpy(out.salt.data(), material + kKeySize, kSaltSize);
+    }
+    std::memset(material, 0, sizeof(material));
+    return derived;
+#else
+    (void)master;
+    (void)session;
+    (void)out;
+    return false;
+#endif
+}
+
+// --- MediaSealer ---
+
+MediaSealer::MediaSealer(const MediaKey& master)
+    : m_Cipher(nullptr),
+    m_SealedMetric(Metrics::instance().get("crypto.sealed"))
+{
+#ifdef ECHOLINK_HAVE_OPENSSL
+    // A fresh session, then the key schedule is expanded here once, every packet only sets its nonce
+    unsigned char session[MediaCrypto::kSessionSize];
+    if(RAND_bytes(session, sizeof(session)) == 1) {
+        m_Session = readSession(session);
+        if(MediaKey::deriveSession(master, m_Session, m_Key)) {
+            m_Cipher = EVP_CIPHER_CTX_new();
+        }
+    }
+    if(m_Cipher && EVP_EncryptInit_ex(m_Cipher, EVP_aes_128_gcm(), nullptr, m_Key.key.data(), nullptr) != 1) {
+        EVP_CIPHER_CTX_free(m_Cipher);
+        m_Cipher = nullptr;
+    }
+#else
+    (void)master;
+#endif
+    if(!m_Cipher) {
+        std::cerr << "[MediaSealer] AES-GCM is not available, datagrams will not be sent." << std::endl;
+    }
+}
+
+MediaSealer::~MediaSealer()
+{
+#ifdef ECHOLINK_HAVE_OPENSSL
+    EVP_CIPHER_CTX_free(m_Cipher);
+#endif
+}
+
+bool MediaSealer::seal(Datagram& datagram)
+{
+#ifdef ECHOLINK_HAVE_OPENSSL
+    NetworkPacket& packet = datagram.payload;
+    if(!m_Cipher || packet.size() < PacketHeader::kSize) {
+        return false;
+    }
+    auto* data = reinterpret_cast<unsigned char*>(packet.data());
+    if(!isAudio(data) || (data[1] & PacketHeader::kFlagEncrypted) != 0) {
+        return false;
+    }
+
+    // Make room for the session id and rollover counter in front of the payload and the tag behind it
+    const size_t plainSize = packet.size() - PacketHeader::kSize;
+    packet.resize(packet.size() + MediaCrypto::kOverhead);
+    data = reinterpret_cast<unsigned char*>(packet.data());
+    unsigned char* body = data + kAadSize;
+    std::memmove(body, data + PacketHeader::kSize, plainSize);
+    data[1] |= PacketHeader::kFlagEncrypted;
+    writeSession(data + PacketHeader::kSize, m_Session);
+    data[kRolloverOffset] = static_cast<unsigned char>(datagram.rollover >> 24);
+    data[kRolloverOffset + 1] = static_cast<unsigned char>(datagram.rollover >> 16);
+    data[kRolloverOffset + 2] = static_cast<unsigned char>(datagram.rollover >> 8);
+    data[kRolloverOffset + 3] = static_cast<unsigned char>(datagram.rollover);
+
+    unsigned char nonce[MediaKey::kSaltSize];
+    makeNonce(m_Key, data, nonce);
+    int length = 0;
+    if(EVP_EncryptInit_ex(m_Cipher, nullptr, nullptr, nullptr, nonce) != 1
+        || EVP_EncryptUpdate(m_Cipher, nullptr, &length, data, kAadSize) != 1
+        || EVP_EncryptUpdate(m_Cipher, body, &length, body, static_cast<int>(plainSize)) != 1
+        || EVP_EncryptFinal_ex(m_Cipher, body + length, &length) != 1
+        || EVP_CIPHER_CTX_ctrl(m_Cipher, EVP_CTRL_GCM_GET_TAG, MediaCrypto::kTagSize, body + plainSize) != 1) {
+        packet.clear();     // never let a half sealed datagram out
+        return false;
+    }
+    Metrics::add(m_SealedMetric, 1);
+    return true;
+#else
+    (void)datagram;
+    return false;
+#endif
+}
+
+// --- MediaResealer ---
+
+MediaResealer::MediaResealer(const MediaKey& master)
+    : m_Master(master),
+    m_SessionsMetric(Metrics::instance().get("crypto.reseal_sessions"))
+{}
+
+bool MediaResealer::seal(Datagram& datagram)
+{
+    if(datagram.session == 0) {
+        return false;       // not opened, nothing keeps its nonce apart from other senders'
+    }
+    auto it = m_Sealers.find(datagram.session);
+    if(it == m_Sealers.end()) {
+        if(m_Sealers.size() >= kMaxSessions) {
+            // A sender session that comes back later gets a new relay session, never an old one
+            evictOldest(m_Sealers, [](Entry&) {});
+        }
+        it = m_Sealers.emplace(datagram.session, Entry{std::make_unique<MediaSealer>(m_Master), 0}).first;
+        Metrics::set(m_SessionsMetric, static_cast<int64_t>(m_Sealers.size()));
+    }
+    it->second.lastUsed = ++m_Uses;
+    return it->second.sealer->seal(datagram);
+}
+
+// --- MediaOpener ---
+
+MediaOpener::MediaOpener(const MediaKey& master)
+    : m_Master(master),
+    m_OpenedMetric(Metrics::instance().get("crypto.opened")),
+    m_AuthFailuresMetric(Metrics::instance().get("crypto.auth_failures")),
+    m_ReplaysMetric(Metrics::instance().get("crypto.replays")),
+    m_UnencryptedMetric(Metrics::instance().get("crypto.unencrypted_dropped")),
+    m_SessionsMetric(Metrics::instance().get("crypto.sessions")),
+    m_ThrottledMetric(Metrics::instance().get("crypto.sessions_throttled"))
+{
+    if(!MediaKey::available()) {
+        std::cerr << "[MediaOpener] AES-GCM is not available, received datagrams will be dropped." << std::endl;
+    }
+}
+
+MediaOpener::~MediaOpener()
+{
+#ifdef ECHOLINK_HAVE_OPENSSL
+    for(auto& entry : m_Sessions) {
+        EVP_CIPHER_CTX_free(entry.second.cipher);
+    }
+    EVP_CIPHER_CTX_free(m_Candidate.cipher);
+#endif
+}
+
+MediaOpener::Session* MediaOpener::findSession(uint64_t id)
+{
+    auto it = m_Sessions.find(id);
+    if(it != m_Sessions.end()) {
+        return &it->second;
+    }
+#ifdef ECHOLINK_HAVE_OPENSSL
+    // Unknown session: derive its key into the candidate, kept only if the datagram authenticates.
+    // Every forged session id costs a derivation, so their number per second is capped.
+    const Clock::time_point now = Clock::now();
+    if(now - m_DerivationWindowStart >= std::chrono::seconds(1)) {
+        m_DerivationWindowStart = now;
+        m_DerivationsInWindow = 0;
+    }
+    if(m_DerivationsInWindow >= kMaxNewSessionsPerSecond) {
+        Metrics::add(m_ThrottledMetric, 1);
+        return nullptr;
+    }
+    m_DerivationsInWindow++;
+
+    if(!m_Candidate.cipher) {
+        m_Candidate.cipher = EVP_CIPHER_CTX_new();
+    }
+    if(!m_Candidate.cipher || !MediaKey::deriveSession(m_Master, id, m_Candidate.key)
+        || EVP_DecryptInit_ex(m_Candidate.cipher, EVP_aes_128_gcm(), nullptr, m_Candidate.key.key.data(), nullptr) != 1) {
+        Metrics::add(m_AuthFailuresMetric, 1);
+        return nullptr;
+    }
+    return &m_Candidate;
+#else
+    return nullptr;
+#endif
+}
+
+bool MediaOpener::open(Datagram& datagram)
+{
+#ifdef ECHOLINK_HAVE_OPENSSL
+    NetworkPacket& packet = datagram.payload;
+    auto* data = reinterpret_cast<unsigned char*>(packet.data());
+    if(packet.size() < PacketHeader::kSize || !isAudio(data) || (data[1] & PacketHeader::kFlagEncrypted) == 0) {
+        Metrics::add(m_UnencryptedMetric, 1);
+        return false;
+    }
+    if(packet.size() < kAadSize + MediaCrypto::kTagSize) {
+        Metrics::add(m_AuthFailuresMetric, 1);
+        return false;
+    }
+    const uint64_t id = readSession(data + PacketHeader::kSize);
+    Session* session = findSession(id);
+    if(!session) {
+        return false;
+    }
+
+    const size_t cipherSize = packet.size() - kAadSize - MediaCrypto::kTagSize;
+    unsigned char* body = data + kAadSize;
+    unsigned char tag[MediaCrypto::kTagSize];
+    std::memcpy(tag, body + cipherSize, sizeof(tag));
+    unsigned char nonce[MediaKey::kSaltSize];
+    makeNonce(session->key, data, nonce);
+
+    // Decrypted in place before the tag is checked; a forged datagram is dropped whole anyway
+    int length = 0;
+    if(EVP_DecryptInit_ex(session->cipher, nullptr, nullptr, nullptr, nonce) != 1
+        || EVP_DecryptUpdate(session->cipher, nullptr, &length, data, kAadSize) != 1
+        || EVP_DecryptUpdate(session->cipher, body, &length, body, static_cast<int>(cipherSize)) != 1
+        || EVP_CIPHER_CTX_ctrl(session->cipher, EVP_CTRL_GCM_SET_TAG, sizeof(tag), tag) != 1
+        || EVP_DecryptFinal_ex(session->cipher, body + length, &length) != 1) {
+        Metrics::add(m_AuthFailuresMetric, 1);
+        return false;
+    }
+
+    if(session == &m_Candidate) {
+        // Authenticated: the session is real, keep its context
+        if(m_Sessions.size() >= kMaxSessions) {
+            evictOldest(m_Sessions, [](Session& old) { EVP_CIPHER_CTX_free(old.cipher); });
+        }
+        session = &m_Sessions[id];
+        *session = m_Candidate;
+        m_Candidate.cipher = nullptr;
+        Metrics::set(m_SessionsMetric, static_cast<int64_t>(m_Sessions.size()));
+    }
+    session->lastUsed = ++m_Uses;
+
+    datagram.session = id;
+    datagram.rollover = (static_cast<uint32_t>(data[kRolloverOffset]) << 24)
+        | (static_cast<uint32_t>(data[kRolloverOffset + 1]) << 16)
+        | (static_cast<uint32_t>(data[kRolloverOffset + 2]) << 8) | data[kRolloverOffset + 3];
+    data[1] &= static_cast<unsigned char>(~PacketHeader::kFlagEncrypted);
+    std::memmove(data + PacketHeader::kSize, body, cipherSize);
+    packet.resize(PacketHeader::kSize + cipherSize);    // keeps the capacity for sealing it again
+    Metrics::add(m_OpenedMetric, 1);
+    return true;
+#else
+    (void)datagram;
+    Metrics::add(m_UnencryptedMetric, 1);
+    return false;
+#endif
+}
+
+bool MediaOpener::accept(const Datagram& datagram)
+{
+    if(datagram.payload.size() < PacketHeader::kSize) {
+        return false;
+    }
+    const auto* data = reinterpret_cast<const unsigned char*>(datagram.payload.data());
+    const uint16_t sequence = static_cast<uint16_t>((data[2] << 8) | data[3]);
+    const uint32_t ssrc = (static_cast<uint32_t>(data[8]) << 24) | (static_cast<uint32_t>(data[9]) << 16)
+        | (static_cast<uint32_t>(data[10]) << 8) | data[11];
+    const uint64_t index = (static_cast<uint64_t>(datagram.rollover) << 16) | sequence;
+
+    const WindowKey key{datagram.session, ssrc};
+    auto it = m_Windows.find(key);
+    if(it == m_Windows.end()) {
+        if(m_Windows.size() >= kMaxReplayWindows) {
+            evictOldest(m_Windows, [](ReplayWindow&) {});
+        }
+        m_Windows.emplace(key, ReplayWindow{index, 1, ++m_Uses});
+        return true;
+    }
+    ReplayWindow& window = it->second;
+    window.lastUsed = ++m_Uses;
+
+    if(index > window.highest) {
+        const uint64_t shift = index - window.highest;
+        window.mask = (shift >= kReplayWindow) ? 1 : ((window.mask << shift) | 1);
+        window.highest = index;
+        return true;
+    }
+    const uint64_t age = window.highest - index;
+    if(age >= kReplayWindow || (window.mask & (uint64_t(1) << age)) != 0) {
+        Metrics::add(m_ReplaysMetric, 1);
+        return false;
+    }
+    window.mask |= uint64_t(1) << age;
+    return true;
+}
+
+// --- ClockAuthenticator ---
+
+ClockAuthenticator::ClockAuthenticator(const MediaKey& master)
+    : m_RejectedMetric(Metrics::instance().get("net.clock.rejected"))
+{
+#ifdef ECHOLINK_HAVE_OPENSSL
+    b_Ready = expandMaster(master, nullptr, 0, kClockInfo, m_Key.data(), m_Key.size());
+#else
+    (void)master;
+#endif
+    if(!b_Ready) {
+        std::cerr << "[ClockAuthenticator] HMAC-SHA256 is not available, clock messages will be dropped." << std::endl;
+    }
+}
+
+ClockAuthenticator::~ClockAuthenticator()
+{
+    std::fill(m_Key.begin(), m_Key.end(), 0);
+}
+
+bool ClockAuthenticator::computeTag(const unsigned char* data, size_t size, unsigned char* tag) const
+{
+#ifdef ECHOLINK_HAVE_OPENSSL
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int length = 0;
+    if(!b_Ready || !HMAC(EVP_sha256(), m_Key.data(), static_cast<int>(m_Key.size()), data, size, digest, &length)
+        || length < ClockMessage::kTagSize) {
+        return false;
+    }
+    std::memcpy(tag, digest, ClockMessage::kTagSize);
+    return true;
+#else
+    (void)data;
+    (void)size;
+    (void)tag;
+    return false;
+#endif
+}
+
+size_t ClockAuthenticator::sign(unsigned char* data, size_t size) const
+{
+    return computeTag(data, size, data + size) ? size + ClockMessage::kTagSize : 0;
+}
+
+size_t ClockAuthenticator::verify(const unsigned char* data, size_t size) const
+{
+#ifdef ECHOLINK_HAVE_OPENSSL
+    unsigned char tag[ClockMessage::kTagSize];
+    if(size > ClockMessage::kTagSize) {
+        const size_t messageSize = size - ClockMessage::kTagSize;
+        if(computeTag(data, messageSize, tag) && CRYPTO_memcmp(tag, data + messageSize, sizeof(tag)) == 0) {
+            return messageSize;
+        }
+    }
+#else
+    (void)data;
+    (void)size;
+#endif
+    Metrics::add(m_RejectedMetric, 1);
+    return 0;
+}
@@ -0,0 +1,36 @@
+#include "Metrics.hpp"
+
+Metrics& Metrics::instance()
+{
+    static Metrics metrics;
+    return metrics;
+}
+
+MetricValue& Metrics::get(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    std::unique_ptr<MetricValue>& metric = m_Metrics[name];
+    if(!metric) {
+        metric = std::make_unique<MetricValue>(0);
+    }
+    return *metric;
+}
+
+std::vector<std::pair<std::string, int64_t>> Metrics::snapshot() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    std::vector<std::pair<std::string, int64_t>> values;
+    values.reserve(m_Metrics.size());
+    for(const auto& [name, metric] : m_Metrics) {
+        values.emplace_back(name, metric->load(std::memory_order_relaxed));
+    }
+    return values;
+}
+
+void Metrics::dump(std::ostream& out) const
+{
+    for(const auto& [name, value] : snapshot()) {
+        out << name << " " << value << "\n";
+    }
+    out.flush();
+}
@@ -1,9 +1,75 @@
 #include "NetworkManager.hpp"
+#include "MediaCrypto.hpp"
+#include "PacketHeader.hpp"
+#include "PacketTrace.hpp"
 #include <asio/system_error.hpp>
 #include <iostream>
 
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <sys/socket.h>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+
+namespace {
+
+int64_t realtimeNs()
+{
+    timespec ts{};
+    ::clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+int getIntOption(int fd, int level, int name)
+{
+    int value = 0;
+    socklen_t length = sizeof(value);
+    ::getsockopt(fd, level, name, &value, &length);
+    return value;
+}
+
+bool setIntOption(int fd, int level, int name, int value)
+{
+    return ::setsockopt(fd, level, name, &value, sizeof(value)) == 0;
+}
+
+// Sizes a socket buffer. Above net.core.[rw]mem_max the plain option is silently capped, the
+// *FORCE variant (CAP_NET_ADMIN) is tried then. Returns the effective size (the kernel reports
+// twice the requested value, half of it is bookkeeping).
+int setBufferSize(int fd, int option, int forceOption, int bytes, const char* what)
+{
+    setIntOption(fd, SOL_SOCKET, option, bytes);
+    if(getIntOption(fd, SOL_SOCKET, option) / 2 < bytes) {
+        setIntOption(fd, SOL_SOCKET, forceOption, bytes);
+    }
+    const int effective = getIntOption(fd, SOL_SOCKET, option) / 2;
+    if(effective < bytes) {
+        std::cerr << "[NetworkManager] Warning: " << what << " buffer capped at " << effective << " of " << bytes
+            << " bytes, raise net.core." << (option == SO_RCVBUF ? "rmem_max" : "wmem_max") << std::endl;
+    }
+    return effective;
+}
+
+} // namespace
+
 NetworkManager::NetworkManager(asio::io_context& context)
-    : m_Context(context), m_Socket(context), a_IsRunning(false)
+    : m_Context(context), m_Socket(context), m_Streams(kMaxStreams), m_StreamSweepTimer(context), m_ClockSyncTimer(context),
+    a_IsRunning(false),
+    m_PacketsSentMetric(Metrics::instance().get("net.packets_sent")),
+    m_BytesSentMetric(Metrics::instance().get("net.bytes_sent")),
+    m_SendErrorsMetric(Metrics::instance().get("net.send_errors")),
+    m_PacketsReceivedMetric(Metrics::instance().get("net.packets_received")),
+    m_BytesReceivedMetric(Metrics::instance().get("net.bytes_received")),
+    m_ReceiveErrorsMetric(Metrics::instance().get("net.receive_errors")),
+    m_RxQueueDropsMetric(Metrics::instance().get("net.rx_queue_drops")),
+    m_TruncatedMetric(Metrics::instance().get("net.truncated")),
+    m_StreamsMetric(Metrics::instance().get("net.streams")),
+    m_StreamsRejectedMetric(Metrics::instance().get("net.streams_rejected")),
+    m_StreamsExpiredMetric(Metrics::instance().get("net.streams_expired")),
+    m_ClockIgnoredMetric(Metrics::instance().get("net.clock.pings_ignored")),
+    m_ReceivePerf(PerfCounters::site("net.receive")),
+    m_SendPerf(PerfCounters::site("net.send"))
 {}
 
 NetworkManager::~NetworkManager()
@@ -11,11 +77,12 @@ NetworkManager::~NetworkManager()
     stop(); // Close socket and release resources
 }
 
-bool NetworkManager::init(unsigned short localPort)
+bool NetworkManager::init(unsigned short localPort, const SocketOptions& options)
 {
     try
     {
         m_Socket.open(asio::ip::udp::v4());
+        applySocketOptions(options);
         m_Socket.bind(asio::ip::udp::endpoint(asio::ip::udp::v4(), localPort));
         a_IsRunning.store(true);
         std::cout << "[NetworkManager] UDP socket bound to port " << localPort << std::endl;
@@ -41,7 +108,7 @@ void NetworkManager::setRemoteEndpoint(const std::string& ipAddress, unsigned sh
     }
 }
 
-void NetworkManager::setIncomingQueue(std::shared_ptr<ThreadSafeQueue<NetworkPacket>> queue)
+void NetworkManager::setIncomingQueue(std::shared_ptr<ThreadSafeQueue<Datagram>> queue)
 {
     m_IncomingQueue = queue;
     if (!m_IncomingQueue) {
@@ -49,7 +116,66 @@ void NetworkManager::setIncomingQueue(std::shared_ptr<ThreadSafeQueue<NetworkPac
     }
 }
 
+void NetworkManager::setStreamTimeout(std::chrono::milliseconds timeout)
+{
+    m_StreamTimeout = timeout;
+}
+
+void NetworkManager::applySocketOptions(const SocketOptions& options)
+{
+    const int fd = m_Socket.native_handle();
+    if(options.receiveBufferBytes > 0) {
+        const int bytes = setBufferSize(fd, SO_RCVBUF, SO_RCVBUFFORCE, options.receiveBufferBytes, "Receive");
+        Metrics::set(Metrics::instance().get("net.receive_buffer_bytes"), bytes);
+    }
+    if(options.sendBufferBytes > 0) {
+        const int bytes = setBufferSize(fd, SO_SNDBUF, SO_SNDBUFFORCE, options.sendBufferBytes, "Send");
+        Metrics::set(Metrics::instance().get("net.send_buffer_bytes"), bytes);
+    }
+    if(options.dscp >= 0 && !setIntOption(fd, IPPROTO_IP, IP_TOS, (options.dscp & 0x3F) << 2)) {
+        std::cerr << "[NetworkManager] Warning: Failed to set DSCP " << options.dscp << ": " << std::strerror(errno) << std::endl;
+    }
+    if(options.busyPollUs > 0 && !setIntOption(fd, SOL_SOCKET, SO_BUSY_POLL, options.busyPollUs)) {
+        std::cerr << "[NetworkManager] Warning: Failed to enable busy polling (" << std::strerror(errno)
+            << "), above net.core.busy_read it needs CAP_NET_ADMIN" << std::endl;
+    }
+    if(options.kernelTimestamps && !setIntOption(fd, SOL_SOCKET, SO_TIMESTAMPNS, 1)) {
+        std::cerr << "[NetworkManager] Warning: Kernel receive timestamps unavailable: " << std::strerror(errno) << std::endl;
+    }
+    if(!setIntOption(fd, SOL_SOCKET, SO_RXQ_OVFL, 1)) {
+        std::cerr << "[NetworkManager] Warning: Receive queue drop counter unavailable, net.rx_queue_drops stays 0: "
+            << std::strerror(errno) << std::endl;
+    }
+}
+
+bool NetworkManager::startTrace(const std::string& path)
+{
+    auto trace = std::make_unique<PacketTraceWriter>();
+    if(!trace->open(path)) {
+        return false;
+    }
+    m_Trace = std::move(trace);
+    return true;
+}
+
+void NetworkManager::enableEncryption(const MediaKey& key)
+{
+    m_Opener = std::make_unique<MediaOpener>(key);
+    m_ClockAuth = std::make_unique<ClockAuthenticator>(key);
+    m_SealedBatch.reserve(kMaxDatagramsPerWakeup);
+}
+
 void NetworkManager::sendPacket(const NetworkPacket& packet)
+{
+    queueSend(packet, m_Remote, true);
+}
+
+void NetworkManager::sendPacketTo(const NetworkPacket& packet, const asio::ip::udp::endpoint& peer)
+{
+    queueSend(packet, peer, false);
+}
+
+void NetworkManager::queueSend(const NetworkPacket& packet, const asio::ip::udp::endpoint& peer, bool ownStream)
 {
     if(!a_IsRunning.load() || !m_Socket.is_open()) {
         std::cerr << "[NetworkManager] Error sending packet: Manager not running or Socket not open." << std::endl;
@@ -61,15 +187,27 @@ void NetworkManager::sendPacket(const NetworkPacket& packet)
     // Asio's async functions typically require the buffer to be stable.
     std::shared_ptr<NetworkPacket> packet_ptr = std::make_shared<NetworkPacket>(packet);
 
-    m_Context.post([this, packet_ptr](){
+    m_Context.post([this, packet_ptr, peer, ownStream](){
         if(!m_Socket.is_open()) {
             return;
         }
+        PerfScope perf(m_SendPerf);
+        PacketHeader header;
+        const bool audio = (ownStream || FrameTracer::enabled())
+            && PacketHeader::read(reinterpret_cast<const unsigned char*>(packet_ptr->data()), packet_ptr->size(), header)
+            && header.type == PacketType::Audio;
+        TraceScope span("net", "send", audio ? "seq" : nullptr, header.sequence);
+
+        // The last audio packet of our own stream anchors its media clock for the peers'
+        // one-way delay (reflected packets belong to someone else's)
+        if(ownStream && audio) {
+            m_LocalAnchor = {header.ssrc, header.timestamp, realtimeNs()};
+        }
 
         m_Socket.async_send_to(asio::buffer(*packet_ptr),
-            m_Remote,
+            peer,
             std::bind(&NetworkManager::handleSend, this,
-                std::placeholders::_1, std::placeholders::_2, packet_ptr));
+                std::placeholders::_1, std::placeholders::_2, packet_ptr, peer));
     });
 
 }
@@ -88,54 +226,267 @@ void NetworkManager::startReceive() {
         return;
     }
 
-    // Start an asynchronous receive operation. The callback `handleReceive` will be called
-    // when data arrives or an error occurs.
-    m_Socket.async_receive_from(
-        asio::buffer(m_RecvBuffer), // Buffer to store incoming data
-        m_SenderEndpoint,           // To store the sender's endpoint
-        std::bind(&NetworkManager::handleReceive, this,
-                  std::placeholders::_1, std::placeholders::_2));
+    receiveNext();
+    scheduleStreamSweep();
+    scheduleClockSync();
     std::cout << "[NetworkManager] Waiting for incoming UDP packets..." << std::endl;
 }
 
+void NetworkManager::receiveNext()
+{
+    // Wait for readability instead of posting a receive, so handleReceive can read with recvmsg
+    // (kernel timestamp, overflow counter) and drain everything that queued up in one go
+    m_Socket.async_wait(asio::ip::udp::socket::wait_read,
+        std::bind(&NetworkManager::handleReceive, this, std::placeholders::_1));
+}
+
+std::ptrdiff_t NetworkManager::receiveOne()
+{
+    iovec buffer{m_RecvBuffer.data(), m_RecvBuffer.size()};
+    msghdr message{};
+    ssize_t bytes = -1;
+    do {
+        message.msg_name = m_SenderEndpoint.data();
+        message.msg_namelen = static_cast<socklen_t>(m_SenderEndpoint.capacity());
+        message.msg_iov = &buffer;
+        message.msg_iovlen = 1;
+        message.msg_control = m_ControlBuffer.data();
+        message.msg_controllen = m_ControlBuffer.size();
+        message.msg_flags = 0;
+
+        bytes = ::recvmsg(m_Socket.native_handle(), &message, MSG_DONTWAIT);
+        if(bytes < 0) {
+            if(errno != EAGAIN && errno != EWOULDBLOCK) {
+                // e.g. ECONNREFUSED from an ICMP error for an earlier send
+                Metrics::add(m_ReceiveErrorsMetric, 1);
+            }
+            return -1;
+        }
+        if(message.msg_flags & MSG_TRUNC) {
+            // Larger than m_RecvBuffer, the tail is gone: no sender of ours makes those
+            Metrics::add(m_TruncatedMetric, 1);
+        }
+    } while(message.msg_flags & MSG_TRUNC);
+    m_SenderEndpoint.resize(message.msg_namelen);
+
+    m_ReceivedNs = 0;
+    for(cmsghdr* control = CMSG_FIRSTHDR(&message); control != nullptr; control = CMSG_NXTHDR(&message, control)) {
+        if(control->cmsg_level != SOL_SOCKET) {
+            continue;
+        }
+        if(control->cmsg_type == SCM_TIMESTAMPNS) {
+            timespec ts;
+            std::memcpy(&ts, CMSG_DATA(control), sizeof(ts));
+            m_ReceivedNs = static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+        } else if(control->cmsg_type == SO_RXQ_OVFL) {
+            uint32_t drops;
+            std::memcpy(&drops, CMSG_DATA(control), sizeof(drops));
+            if(drops != m_RxQueueDrops) {
+                m_RxQueueDrops = drops;
+                Metrics::set(m_RxQueueDropsMetric, drops);
+            }
+        }
+    }
+    if(m_ReceivedNs == 0) {
+        m_ReceivedNs = realtimeNs();    // timestamping disabled
+    }
+    return bytes;
+}
+
+void NetworkManager::resolveStream(Datagram& datagram)
+{
+    PacketHeader header;
+    if(!PacketHeader::read(reinterpret_cast<const unsigned char*>(datagram.payload.data()), datagram.payload.size(), header)) {
+        return;
+    }
+    const size_t streamsBefore = m_Streams.size();
+    datagram.stream = m_Streams.resolve(PeerKey::from(datagram.peer, header.ssrc), StreamDirectory::Clock::now());
+    if(datagram.stream == kNoStreamId) {
+        Metrics::add(m_StreamsRejectedMetric, 1);
+    } else if(m_Streams.size() != streamsBefore) {
+        Metrics::set(m_StreamsMetric, static_cast<int64_t>(m_Streams.size()));
+    }
+}
+
+void NetworkManager::openSealedBatch()
+{
+    // One pass over the wakeup's datagrams keeps the cipher context and its key schedule hot
+    for(Datagram& datagram : m_SealedBatch) {
+        if(!m_Opener->open(datagram) || !m_Opener->accept(datagram)) {
+            continue;
+        }
+        resolveStream(datagram);
+        if(datagram.stream == kNoStreamId) {
+            continue;   // no stream for the pipeline to track (stream table full)
+        }
+        m_IncomingQueue->push(std::move(datagram));
+    }
+    m_SealedBatch.clear();
+}
+
+void NetworkManager::scheduleStreamSweep()
+{
+    m_StreamSweepTimer.expires_after(kStreamSweepInterval);
+    m_StreamSweepTimer.async_wait([this](const asio::error_code& error) {
+        if(error || !a_IsRunning.load()) {
+            return;
+        }
+        const size_t expired = m_Streams.expire(StreamDirectory::Clock::now() - m_StreamTimeout);
+        if(expired > 0) {
+            Metrics::add(m_StreamsExpiredMetric, static_cast<int64_t>(expired));
+            Metrics::set(m_StreamsMetric, static_cast<int64_t>(m_Streams.size()));
+        }
+        scheduleStreamSweep();
+    });
+}
+
+void NetworkManager::scheduleClockSync()
+{
+    m_ClockSyncTimer.expires_after(ClockSync::kPingInterval);
+    m_ClockSyncTimer.async_wait([this](const asio::error_code& error) {
+        if(error || !a_IsRunning.load()) {
+            return;
+        }
+        for(const asio::ip::udp::endpoint& peer : m_ClockSync.pingTargets(m_Remote, realtimeNs())) {
+            ClockMessage ping;
+            m_ClockSync.makePing(m_LocalAnchor, ping);
+            sendClockMessage(ping, peer);
+        }
+        scheduleClockSync();
+    });
+}
+
+bool NetworkManager::handleClockMessage(size_t size)
+{
+    const auto* data = reinterpret_cast<const unsigned char*>(m_RecvBuffer.data());
+    if(size < PacketHeader::kSize || (data[0] & 0x3F) == static_cast<uint8_t>(PacketType::Audio)) {
+        return false;   // the common case, decided without parsing
+    }
+    if(m_ClockAuth) {
+        size = m_ClockAuth->verify(data, size);
+        if(size == 0) {
+            return true;    // forged or unsigned, dropped (counted by the authenticator)
+        }
+    }
+    ClockMessage message;
+    if(!ClockMessage::read(data, size, message)) {
+        return false;
+    }
+    if(message.header.type == PacketType::ClockPing) {
+        if(!admitsClockPeer(m_SenderEndpoint, message.header.ssrc)) {
+            Metrics::add(m_ClockIgnoredMetric, 1);
+            return true;
+        }
+        ClockMessage pong;
+        m_ClockSync.onPing(m_SenderEndpoint, message, m_ReceivedNs, m_LocalAnchor, pong);
+        sendClockMessage(pong, m_SenderEndpoint);
+    } else {
+        m_ClockSync.onPong(m_SenderEndpoint, message, m_ReceivedNs);
+    }
+    return true;
+}
+
+bool NetworkManager::admitsClockPeer(const asio::ip::udp::endpoint& peer, uint32_t ssrc) const
+{
+    // With a key, streams only get an entry once a datagram of theirs authenticated
+    return peer == m_Remote || (ssrc != 0 && m_Streams.contains(PeerKey::from(peer, ssrc)));
+}
+
+void NetworkManager::sendClockMessage(ClockMessage& message, const asio::ip::udp::endpoint& peer)
+{
+    // Sent synchronously (a few dozen bytes, UDP doesn't block) so the timestamp is taken as
+    // late as possible, not before a trip through the io_context queue
+    if(message.header.type == PacketType::ClockPong) {
+        message.transmitNs = realtimeNs();
+    } else {
+        message.originNs = realtimeNs();
+    }
+    size_t size = message.write(m_ClockBuffer.data());
+    if(m_ClockAuth) {
+        size = m_ClockAuth->sign(m_ClockBuffer.data(), size);
+        if(size == 0) {
+            return;
+        }
+    }
+    if(message.header.type == PacketType::ClockPing) {
+        m_ClockSync.onPingSent(peer, message);
+    }
+    asio::error_code error;
+    m_Socket.send_to(asio::buffer(m_ClockBuffer.data(), size), peer, 0, error);
+    if(error) {
+        Metrics::add(m_SendErrorsMetric, 1);
+    }
+}
 
 // CALLBACKS TO HANDLE RECEIVE AND SEND OPERATIONS
 
-void NetworkManager::handleReceive(const asio::error_code& error, std::size_t bytesRecieved)
+void NetworkManager::handleReceive(const asio::error_code& error)
 {
     if(!error) {
-        if(m_IncomingQueue) {
-            m_IncomingQueue->push(NetworkPacket(m_RecvBuffer.data(), m_RecvBuffer.data() + bytesRecieved));
+        PerfScope perf(m_ReceivePerf);
+        for(int i = 0; i < kMaxDatagramsPerWakeup; i++) {
+            const std::ptrdiff_t bytesRecieved = receiveOne();
+            if(bytesRecieved < 0) {
+                break;
+            }
+            PacketHeader header;
+            const bool audio = FrameTracer::enabled()
+                && PacketHeader::read(reinterpret_cast<const unsigned char*>(m_RecvBuffer.data()), static_cast<size_t>(bytesRecieved), header)
+                && header.type == PacketType::Audio;
+            TraceScope span("net", "receive", audio ? "seq" : nullptr, header.sequence);
+            Metrics::add(m_PacketsReceivedMetric, 1);
+            Metrics::add(m_BytesReceivedMetric, static_cast<int64_t>(bytesRecieved));
+            if(m_Trace) {
+                m_Trace->record(m_ReceivedNs, m_SenderEndpoint, m_RecvBuffer.data(), static_cast<size_t>(bytesRecieved));
+            }
+            if(handleClockMessage(static_cast<size_t>(bytesRecieved))) {
+                continue;
+            }
+            if(m_IncomingQueue) {
+                Datagram datagram{NetworkPacket(m_RecvBuffer.data(), m_RecvBuffer.data() + bytesRecieved), m_SenderEndpoint};
+                datagram.receivedNs = m_ReceivedNs;
+                if(m_Opener) {
+                    m_SealedBatch.push_back(std::move(datagram));
+                    continue;
+                }
+                resolveStream(datagram);
+                m_IncomingQueue->push(std::move(datagram));
+            }
+        }
+        if(!m_SealedBatch.empty()) {
+            openSealedBatch();
         }
 
-        // Immediately start another receive operation to keep listening for more data.
-        // This forms a continuous receive loop.
-        if (a_IsRunning.load()) { // Only continue if not shutting down
-            startReceive();
+        // Wait for the next datagrams. This forms a continuous receive loop.
+        if (a_IsRunning.load() && m_Socket.is_open()) { // Only continue if not shutting down
+            receiveNext();
         }
     } else if(error == asio::error::operation_aborted) {
         std::cout << "[NetworkManager] Receive operation aborted." << std::endl;
     } else {
         std::cerr << "[NetworkManager] Error receiving data: " << error.message() << std::endl;
 
-        if (a_IsRunning.load()) { // If not shutting down, try to restart receive
-            startReceive();
+        if (a_IsRunning.load() && m_Socket.is_open()) { // If not shutting down, try to restart receive
+            receiveNext();
         }
     }
 }
 
-void NetworkManager::handleSend(const asio::error_code& error, std::size_t bytesTransferred, std::shared_ptr<NetworkPacket> packet_ptr) {
+void NetworkManager::handleSend(const asio::error_code& error, std::size_t bytesTransferred, std::shared_ptr<NetworkPacket> packet_ptr,
+    const asio::ip::udp::endpoint& destination) {
     // The `packet_ptr` shared_ptr ensures the `NetworkPacket` data remains valid
     // until this handler is executed, then it will be automatically released.
     if (!error) {
         // Packet sent successfully!
-        std::cout << "[NetworkManager] Sent " << bytesTransferred << " bytes to "<< m_Remote << std::endl;
+        Metrics::add(m_PacketsSentMetric, 1);
+        Metrics::add(m_BytesSentMetric, static_cast<int64_t>(bytesTransferred));
     } else if (error == asio::error::operation_aborted) {
         // Send operation cancelled, e.g., socket closed during shutdown.
         std::cout << "[NetworkManager] Send operation aborted (socket closed)." << std::endl;
     } else {
         // Other send errors
-        std::cerr << "[NetworkManager] Error on send: " << error.message() << std::endl;
+        Metrics::add(m_SendErrorsMetric, 1);
+        std::cerr << "[NetworkManager] Error on send to " << destination << ": " << error.message() << std::endl;
     }
 }
 
@@ -143,6 +494,8 @@ void NetworkManager::stop() {
     if (a_IsRunning.load())
     {
         a_IsRunning.store(false); // Set flag to indicate shutdown
+        m_StreamSweepTimer.cancel();
+        m_ClockSyncTimer.cancel();
         if (m_Socket.is_open())
         {
             asio::error_code ec;
@@ -155,4 +508,7 @@ void NetworkManager::stop() {
             }
         }
     }
+    if(m_Trace) {
+        m_Trace->close();
+    }
 }
@@ -0,0 +1,181 @@
+#include "NullAudioDevice.hpp"
+#include "FrameTracer.hpp"
+
+#include <iostream>
+
+namespace {
+
+std::chrono::steady_clock::duration framePeriod(int frameSize, int sampleRate)
+{
+    return std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::nanoseconds(static_cast<int64_t>(frameSize) * 1000000000LL / sampleRate));
+}
+
+} // namespace
+
+// --- NullAudioSource ---
+
+NullAudioSource::NullAudioSource(int sampleRate, int channels, int frameSize)
+    : m_SampleRate(sampleRate), m_Channels(channels), m_FrameSize(frameSize)
+{}
+
+NullAudioSource::~NullAudioSource()
+{
+    stop();
+}
+
+bool NullAudioSource::start()
+{
+    if(m_OutputQueue == nullptr) {
+        std::cerr << "[" << m_LogName << "] Error: m_OutputQueue is NULL\n";
+        return false;
+    }
+    if(a_IsRunning.load()) {
+        std::cout << "[" << m_LogName << "] Already running\n";
+        return true;
+    }
+
+    a_IsRunning.store(true);
+    m_ClockThread = std::thread(&NullAudioSource::clockLoop, this);
+    std::cout << "[" << m_LogName << "] Started (SR: " << m_SampleRate << ", CH: " << m_Channels
+        << ", Frame: " << m_FrameSize << ")" << std::endl;
+    return true;
+}
+
+void NullAudioSource::stop()
+{
+    if(a_IsRunning.load()) {
+        a_IsRunning.store(false);
+        if(m_ClockThread.joinable()) {
+            m_ClockThread.join();
+        }
+        std::cout << "[" << m_LogName << "] Stopped" << std::endl;
+    }
+}
+
+void NullAudioSource::clockLoop()
+{
+    const auto period = framePeriod(m_FrameSize, m_SampleRate);
+    auto nextFrame = std::chrono::steady_clock::now();
+    FrameTracer::nameThread("audio.capture");
+    int64_t frames = 0;
+
+    while(a_IsRunning.load()) {
+        nextFrame += period;
+        std::this_thread::sleep_until(nextFrame);
+
+        if(m_OutputQueue->is_shutting_down()) {
+            break;
+        }
+        TraceScope span("audio", "capture", "frame", frames);
+        AudioFrame frame(m_FrameSize * m_Channels, 0);
+        frame.traceId = frames++;
+        fillFrame(frame);
+        m_OutputQueue->push(std::move(frame));
+    }
+}
+
+// --- NullAudioPlayback ---
+
+NullAudioPlayback::NullAudioPlayback(int sampleRate, int channels, int frameSize)
+    : m_SampleRate(sampleRate), m_Channels(channels), m_FrameSize(frameSize)
+{}
+
+NullAudioPlayback::~NullAudioPlayback()
+{
+    stop();
+}
+
+bool NullAudioPlayback::start()
+{
+    if(m_InputQueue == nullptr) {
+        std::cerr << "[" << m_LogName << "] Error: Input queue is not initialized." << std::endl;
+        return false;
+    }
+    if(a_IsRunning.load()) {
+        std::cerr << "[" << m_LogName << "] Error: Already running." << std::endl;
+        return false;
+    }
+
+    a_IsRunning.store(true);
+    m_ClockThread = std::thread(&NullAudioPlayback::clockLoop, this);
+    std::cout << "[" << m_LogName << "] Started playback (SR: " << m_SampleRate << ", CH: " << m_Channels
+        << ", Frame: " << m_FrameSize << ")" << std::endl;
+    return true;
+}
+
+void NullAudioPlayback::stop()
+{
+    if(a_IsRunning.load()) {
+        a_IsRunning.store(false);
+        if(m_ClockThread.joinable()) {
+            m_ClockThread.join();
+        }
+        std::cout << "[" << m_LogName << "] Stopped playback (" << m_FramesPlayed << " frames, "
+            << m_Underruns << " underruns)" << std::endl;
+    }
+}
+
+void NullAudioPlayback::clockLoop()
+{
+    const auto period = framePeriod(m_FrameSize, m_SampleRate);
+    const AudioFrame silence(m_FrameSize * m_Channels, 0);
+    auto nextFrame = std::chrono::steady_clock::now();
+    AudioFrame frame;
+    FrameTracer::nameThread("audio.playback");
+
+    while(a_IsRunning.load()) {
+        nextFrame += period;
+        std::this_thread::sleep_until(nextFrame);
+
+        TraceScope span("audio", "playback");
+        if(m_InputQueue->try_pop(frame)) {
+            if(frame.traceId >= 0) {
+                span.tag("frame", frame.traceId);
+            }
+            renderFrame(frame);
+        } else {
+            if(m_InputQueue->is_shutting_down()) {
+                break;
+            }
+            m_Underruns++;
+            renderFrame(silence);
+        }
+        m_FramesPlayed++;
+    }
+}
+
+// --- FileAudioPlayback ---
+
+FileAudioPlayback::FileAudioPlayback(const std::string& filePath, int sampleRate, int channels, int frameSize)
+    : NullAudioPlayback(sampleRate, channels, frameSize), m_FilePath(filePath)
+{
+    m_LogName = "FileAudioPlayback";
+}
+
+FileAudioPlayback::~FileAudioPlayback()
+{
+    // Stop the clock thread before the file goes away, it calls renderFrame()
+    stop();
+    if(m_AudioFile.is_open()) {
+        m_AudioFile.close();
+    }
+}
+
+bool FileAudioPlayback::start()
+{
+    if(!m_AudioFile.is_open()) {
+        m_AudioFile.open(m_FilePath, std::ios::binary | std::ios::trunc);
+        if(!m_AudioFile.is_open()) {
+            std::cerr << "[FileAudioPlayback] Failed to open output file: " << m_FilePath << std::endl;
+            return false;
+        }
+        std::cout << "[FileAudioPlayback] Writing playback to " << m_FilePath << std::endl;
+    }
+    return NullAudioPlayback::start();
+}
+
+void FileAudioPlayback::renderFrame(const AudioFrame& frame)
+{
+    m_AudioFile.write(reinterpret_cast<const char*>(frame.data()), frame.size() * sizeof(opus_int16));
+}
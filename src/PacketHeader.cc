@@ -0,0 +1,71 @@
+#include "PacketHeader.hpp"
+
+#include <random>
+
+namespace {
+
+void writeU16(unsigned char* out, uint16_t value)
+{
+    out[0] = static_cast<unsigned char>(value >> 8);
+    out[1] = static_cast<unsigned char>(value);
+}
+
+void writeU32(unsigned char* out, uint32_t value)
+{
+    out[0] = static_cast<unsigned char>(value >> 24);
+    out[1] = static_cast<unsigned char>(value >> 16);
+    out[2] = static_cast<unsigned char>(value >> 8);
+    out[3] = static_cast<unsigned char>(value);
+}
+
+uint16_t readU16(const unsigned char* in)
+{
+    return static_cast<uint16_t>((in[0] << 8) | in[1]);
+}
+
+uint32_t readU32(const unsigned char* in)
+{
+    return (static_cast<uint32_t>(in[0]) << 24) | (static_cast<uint32_t>(in[1]) << 16)
+        | (static_cast<uint32_t>(in[2]) << 8) | static_cast<uint32_t>(in[3]);
+}
+
+} // namespace
+
+void PacketHeader::write(unsigned char* out) const
+{
+    out[0] = static_cast<unsigned char>((kVersion << 6) | (static_cast<uint8_t>(type) & 0x3F));
+    out[1] = flags;
+    writeU16(out + 2, sequence);
+    writeU32(out + 4, timestamp);
+    writeU32(out + 8, ssrc);
+    if(hasAudioLevel()) {
+        out[kSize] = audioLevel & 0x7F;
+    }
+}
+
+bool PacketHeader::read(const unsigned char* data, size_t len, PacketHeader& header)
+{
+    if(len < kSize || (data[0] >> 6) != kVersion) {
+        return false;
+    }
+    header.type = static_cast<PacketType>(data[0] & 0x3F);
+    header.flags = data[1];
+    header.sequence = readU16(data + 2);
+    header.timestamp = readU32(data + 4);
+    header.ssrc = readU32(data + 8);
+    header.audioLevel = kSilentLevel;
+    if(header.hasAudioLevel() && (header.flags & kFlagEncrypted) == 0) {
+        if(len < kSize + 1) {
+            return false;
+        }
+        header.audioLevel = data[kSize] & 0x7F;
+    }
+    return true;
+}
+
+uint32_t PacketHeader::randomSsrc()
+{
+    static thread_local std::mt19937 generator{std::random_device{}()};
+    std::uniform_int_distribution<uint32_t> distribution(1, 0xFFFFFFFFu);
+    return distribution(generator);
+}
@@ -0,0 +1,195 @@
+#include "PacketTrace.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+const char kMagic[4] = {'E', 'L', 'T', 'R'};
+
+void putBigEndian(std::vector<char>& out, uint64_t value, int bytes)
+{
+    for(int shift = (bytes - 1) * 8; shift >= 0; shift -= 8) {
+        out.push_back(static_cast<char>((value >> shift) & 0xFF));
+    }
+}
+
+uint64_t getBigEndian(const unsigned char* in, int bytes)
+{
+    uint64_t value = 0;
+    for(int i = 0; i < bytes; i++) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+} // namespace
+
+// --- PacketTraceWriter ---
+
+PacketTraceWriter::PacketTraceWriter()
+    : m_RecordsMetric(Metrics::instance().get("trace.records")),
+    m_BytesMetric(Metrics::instance().get("trace.bytes")),
+    m_DroppedMetric(Metrics::instance().get("trace.dropped"))
+{}
+
+PacketTraceWriter::~PacketTraceWriter()
+{
+    close();
+}
+
+bool PacketTraceWriter::open(const std::string& path)
+{
+    m_File.open(path, std::ios::binary | std::ios::trunc);
+    if(!m_File.is_open()) {
+        std::cerr << "[PacketTrace] Failed to open trace file: " << path << std::endl;
+        return false;
+    }
+    m_Path = path;
+
+    std::vector<char> header(kMagic, kMagic + sizeof(kMagic));
+    putBigEndian(header, kVersion, 2);
+    putBigEndian(header, 0, 2);
+    m_File.write(header.data(), static_cast<std::streamsize>(header.size()));
+
+    m_Pending.reserve(kWakeBytes * 2);
+    m_Writing.reserve(kWakeBytes * 2);
+    b_Closing = false;
+    m_Thread = std::thread(&PacketTraceWriter::writerLoop, this);
+    std::cout << "[PacketTrace] Recording received datagrams to " << path << std::endl;
+    return true;
+}
+
+void PacketTraceWriter::record(int64_t timestampNs, const asio::ip::udp::endpoint& sender, const char* data, size_t size)
+{
+    const asio::ip::address address = sender.address();
+    const size_t length = std::min<size_t>(size, 0xFFFF);
+    const size_t recordBytes = 8 + 1 + (address.is_v6() ? 16 : 4) + 2 + 2 + length;
+
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    if(b_Closing || m_Pending.size() + recordBytes > kMaxBufferedBytes) {
+        lock.unlock();
+        Metrics::add(m_DroppedMetric, 1);
+        return;
+    }
+
+    putBigEndian(m_Pending, static_cast<uint64_t>(timestampNs), 8);
+    if(address.is_v6()) {
+        m_Pending.push_back(6);
+        const auto bytes = address.to_v6().to_bytes();
+        m_Pending.insert(m_Pending.end(), bytes.begin(), bytes.end());
+    } else {
+        m_Pending.push_back(4);
+        const auto bytes = address.to_v4().to_bytes();
+        m_Pending.insert(m_Pending.end(), bytes.begin(), bytes.end());
+    }
+    putBigEndian(m_Pending, sender.port(), 2);
+    putBigEndian(m_Pending, length, 2);
+    m_Pending.insert(m_Pending.end(), data, data + length);
+
+    const bool wake = m_Pending.size() >= kWakeBytes;
+    lock.unlock();
+    if(wake) {
+        m_Wake.notify_one();
+    }
+    Metrics::add(m_RecordsMetric, 1);
+    Metrics::add(m_BytesMetric, static_cast<int64_t>(recordBytes));
+}
+
+void PacketTraceWriter::close()
+{
+    if(!m_Thread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        b_Closing = true;
+    }
+    m_Wake.notify_one();
+    m_Thread.join();
+    m_File.close();
+    std::cout << "[PacketTrace] Trace closed: " << m_Path << std::endl;
+}
+
+void PacketTraceWriter::writerLoop()
+{
+    bool closing = false;
+    while(!closing) {
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_Wake.wait_for(lock, kFlushInterval, [this]() { return b_Closing || m_Pending.size() >= kWakeBytes; });
+            closing = b_Closing;
+            m_Writing.swap(m_Pending);   // m_Writing was emptied by the last pass
+        }
+        if(!m_Writing.empty()) {
+            m_File.write(m_Writing.data(), static_cast<std::streamsize>(m_Writing.size()));
+            m_File.flush();
+            if(!m_File) {
+                std::cerr << "[PacketTrace] Error writing trace file: " << m_Path << std::endl;
+            }
+            m_Writing.clear();
+        }
+    }
+}
+
+// --- PacketTraceReader ---
+
+bool PacketTraceReader::open(const std::string& path)
+{
+    m_File.open(path, std::ios::binary);
+    if(!m_File.is_open()) {
+        std::cerr << "[PacketTrace] Failed to open trace file: " << path << std::endl;
+        return false;
+    }
+    m_Path = path;
+
+    unsigned char header[8];
+    if(!m_File.read(reinterpret_cast<char*>(header), sizeof(header)) || std::memcmp(header, kMagic, sizeof(kMagic)) != 0) {
+        std::cerr << "[PacketTrace] Not a packet trace: " << path << std::endl;
+        return false;
+    }
+    const uint64_t version = getBigEndian(header + 4, 2);
+    if(version != PacketTraceWriter::kVersion) {
+        std::cerr << "[PacketTrace] Unsupported trace version " << version << ": " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool PacketTraceReader::next(TraceRecord& record)
+{
+    unsigned char fixed[9];
+    if(!m_File.read(reinterpret_cast<char*>(fixed), sizeof(fixed))) {
+        return false;
+    }
+    record.timestampNs = static_cast<int64_t>(getBigEndian(fixed, 8));
+
+    const unsigned char family = fixed[8];
+    if(family != 4 && family != 6) {
+        std::cerr << "[PacketTrace] Corrupt record (address family " << static_cast<int>(family) << ") in " << m_Path << std::endl;
+        return false;
+    }
+    unsigned char rest[16 + 2 + 2];
+    const size_t addressBytes = (family == 6) ? 16 : 4;
+    if(!m_File.read(reinterpret_cast<char*>(rest), static_cast<std::streamsize>(addressBytes + 4))) {
+        return false;
+    }
+
+    asio::ip::address address;
+    if(family == 6) {
+        asio::ip::address_v6::bytes_type bytes;
+        std::memcpy(bytes.data(), rest, bytes.size());
+        address = asio::ip::address_v6(bytes);
+    } else {
+        asio::ip::address_v4::bytes_type bytes;
+        std::memcpy(bytes.data(), rest, bytes.size());
+        address = asio::ip::address_v4(bytes);
+    }
+    const auto port = static_cast<unsigned short>(getBigEndian(rest + addressBytes, 2));
+    record.sender = asio::ip::udp::endpoint(address, port);
+
+    const size_t length = static_cast<size_t>(getBigEndian(rest + addressBytes + 2, 2));
+    record.payload.resize(length);
+    return static_cast<bool>(m_File.read(record.payload.data(), static_cast<std::streamsize>(length)));
+}
@@ -0,0 +1,310 @@
+#include "PeerManager.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+std::string describe(const Peer& peer)
+{
+    std::ostringstream out;
+    out << "0x" << std::hex << std::setw(8) << std::setfill('0') << peer.ssrc << std::dec << " (" << peer.endpoint << ")";
+    return out.str();
+}
+
+} // namespace
+
+PeerManager::PeerManager(const PeerManagerConfig& config)
+    : m_Config(config),
+    m_Timers(kTimerTick, kTimerSlots),
+    m_LocalStreams(config.maxPeers),
+    m_ActiveMetric(Metrics::instance().get("peers.active")),
+    m_IdleMetric(Metrics::instance().get("peers.idle")),
+    m_PooledMetric(Metrics::instance().get("peers.pooled")),
+    m_JoinedMetric(Metrics::instance().get("peers.joined")),
+    m_ReusedMetric(Metrics::instance().get("peers.reused")),
+    m_ExpiredMetric(Metrics::instance().get("peers.expired")),
+    m_RejectedMetric(Metrics::instance().get("peers.rejected")),
+    m_OneWayDelayMetric(Metrics::instance().get("peers.one_way_delay_us")),
+    m_MosMinMetric(Metrics::instance().get("quality.mos_min_x100")),
+    m_MosMeanMetric(Metrics::instance().get("quality.mos_mean_x100")),
+    m_RMinMetric(Metrics::instance().get("quality.r_min")),
+    m_PoorMetric(Metrics::instance().get("quality.streams_poor"))
+{
+    if(m_Config.expiryTimeout < m_Config.idleTimeout) {
+        m_Config.expiryTimeout = m_Config.idleTimeout;
+    }
+}
+
+PeerManager::~PeerManager()
+{
+    // The calls still going end with the stage
+    for(const std::unique_ptr<Peer>& peer : m_Slots) {
+        if(peer) {
+            report(*peer, "ended");
+        }
+    }
+}
+
+Peer* PeerManager::onPacket(const Datagram& datagram, const PacketHeader& header, Clock::time_point now)
+{
+    const uint32_t ssrc = header.ssrc;
+    const asio::ip::udp::endpoint& endpoint = datagram.peer;
+    const uint16_t sequence = header.sequence;
+    StreamId stream = datagram.stream;
+    bool localStream = false;
+    if(stream == kNoStreamId) {
+        stream = m_LocalStreams.resolve(PeerKey::from(endpoint, ssrc), now);
+        if(stream == kNoStreamId) {
+            Metrics::add(m_RejectedMetric, 1);
+            return nullptr;
+        }
+        localStream = true;
+    }
+
+    const Slot slot = StreamDirectory::indexOf(stream);
+    if(slot >= m_Slots.size()) {
+        m_Slots.resize(static_cast<size_t>(slot) + 1);
+    }
+    Peer* peer = m_Slots[slot].get();
+    if(peer && peer->stream != stream) {
+        // The id was recycled for another stream while this peer was still waiting to expire
+        m_Timers.cancel(slot);
+        evict(slot);
+        peer = nullptr;
+    }
+
+    if(peer) {
+        if(peer->idle) {
+            peer->idle = false;
+            m_IdleCount--;
+            updateGauges();
+            std::cout << "[PeerManager] Peer " << describe(*peer) << " is back." << std::endl;
+        }
+    } else {
+        peer = admit(stream, localStream, ssrc, endpoint, now);
+        if(!peer) {
+            if(localStream) {
+                m_LocalStreams.release(stream);
+            }
+            return nullptr;
+        }
+    }
+    peer->lastSeen = now;
+
+    PeerStats& stats = peer->stats;
+    stats.packets++;
+    stats.bytes += datagram.payload.size();
+
+    // Transit time in media clock units; its variation is the jitter (RFC 3550 6.4.1)
+    const int64_t arrivalNs = (datagram.receivedNs != 0) ? datagram.receivedNs
+        : std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count();
+    const int64_t arrivalSamples = (arrivalNs / 1000000000) * m_Config.sampleRate
+        + (arrivalNs % 1000000000) * m_Config.sampleRate / 1000000000;
+    const int64_t transit = arrivalSamples - static_cast<int64_t>(header.timestamp);
+
+    if(!peer->haveSequence) {
+        peer->highestSequence = sequence;
+        peer->haveSequence = true;
+        peer->quality.onReceived(0);
+    } else {
+        // The media timestamp wraps at 32 bits, so only the low 32 bits of the difference count
+        const int32_t transitDelta = static_cast<int32_t>(static_cast<uint32_t>(transit - peer->lastTransit));
+        stats.jitterSamples += (std::abs(static_cast<double>(transitDelta)) - stats.jitterSamples) / 16.0;
+
+        const int16_t delta = static_cast<int16_t>(sequence - peer->highestSequence);
+        if(delta > 1 && header.isResumed()) {
+            // A bridge held the stream back, the datagrams in the gap were never sent on
+            peer->quality.onReceived(0);
+            peer->highestSequence = sequence;
+        } else if(delta > 0) {
+            stats.lost += static_cast<uint64_t>(delta - 1);
+            peer->quality.onReceived(static_cast<uint32_t>(delta - 1));
+            peer->highestSequence = sequence;
+            if(delta > 1 && m_Config.redundancy) {
+                m_Config.redundancy->onLossBurst(delta - 1, now);
+            }
+        } else if(delta < 0) {
+            // Counted as lost when the gap opened, it made it after all
+            stats.reordered++;
+            if(stats.lost > 0) {
+                stats.lost--;
+            }
+            peer->quality.onLate(peer->decoded.contains(sequence));
+        } else {
+            stats.duplicates++;
+        }
+    }
+    peer->lastTransit = transit;
+    if(m_Config.redundancy) {
+        m_Config.redundancy->onPeerRequest(header.requestedRedundancy(), now);
+    }
+
+    // One-way delay needs the sender's clock: its media timestamp mapped to our wall clock
+    int64_t sentNs = 0;
+    if(m_Config.clockSync && datagram.receivedNs != 0
+        && m_Config.clockSync->toLocalTime(endpoint, ssrc, header.timestamp, m_Config.sampleRate, sentNs)) {
+        stats.oneWayDelayNs = datagram.receivedNs - sentNs;
+        Metrics::set(m_OneWayDelayMetric, stats.oneWayDelayNs / 1000);
+        peer->quality.setNetworkDelayMs(std::max<int64_t>(0, stats.oneWayDelayNs) / 1000000.0);
+    }
+    return peer;
+}
+
+void PeerManager::expire(Clock::time_point now)
+{
+    m_Timers.advance(now, [this, now](Slot slot) { onTimer(slot, now); });
+    if(m_Config.redundancy) {
+        m_Config.redundancy->tick(now);
+    }
+    if(now >= m_NextQualityUpdate) {
+        m_NextQualityUpdate = now + kQualityInterval;
+        updateQualityGauges();
+    }
+}
+
+Peer* PeerManager::admit(StreamId stream, bool localStream, uint32_t ssrc, const asio::ip::udp::endpoint& endpoint,
+    Clock::time_point now)
+{
+    if(m_PeerCount >= m_Config.maxPeers) {
+        Metrics::add(m_RejectedMetric, 1);
+        return nullptr;
+    }
+
+    std::unique_ptr<Peer> peer;
+    if(!m_Pool.empty()) {
+        // Reuse an evicted peer: resetting the decoder is much cheaper than allocating one
+        peer = std::move(m_Pool.back());
+        m_Pool.pop_back();
+        peer->decoder.resetDecoder();
+        peer->stats = PeerStats{};
+        peer->quality.reset();
+        peer->haveSequence = false;
+        peer->decoded.reset();
+        peer->idle = false;
+        Metrics::add(m_ReusedMetric, 1);
+    } else {
+        peer = std::make_unique<Peer>();
+        if(!peer->decoder.initDecoder(m_Config.sampleRate, m_Config.channels)) {
+            std::cerr << "[PeerManager] Failed to create a decoder for a new peer." << std::endl;
+            Metrics::add(m_RejectedMetric, 1);
+            return nullptr;
+        }
+    }
+    peer->stream = stream;
+    peer->localStream = localStream;
+    peer->ssrc = ssrc;
+    peer->endpoint = endpoint;
+    peer->lastSeen = now;
+
+    const Slot slot = StreamDirectory::indexOf(stream);
+    m_Slots[slot] = std::move(peer);
+    m_PeerCount++;
+    m_Timers.schedule(slot, now, m_Config.idleTimeout);
+
+    Metrics::add(m_JoinedMetric, 1);
+    updateGauges();
+    std::cout << "[PeerManager] Peer " << describe(*m_Slots[slot]) << " joined (" << m_PeerCount
+        << " peers)." << std::endl;
+    return m_Slots[slot].get();
+}
+
+void PeerManager::onTimer(Slot slot, Clock::time_point now)
+{
+    Peer& peer = *m_Slots[slot];
+    const auto silent = std::chrono::duration_cast<std::chrono::milliseconds>(now - peer.lastSeen);
+
+    if(!peer.idle) {
+        if(silent < m_Config.idleTimeout) {
+            // Heard from since the timer was armed
+            m_Timers.schedule(slot, now, m_Config.idleTimeout - silent);
+            return;
+        }
+        peer.idle = true;
+        peer.haveSequence = false;      // the stream may restart with a new sequence
+        peer.decoded.reset();
+        peer.decoder.resetDecoder();
+        m_IdleCount++;
+        updateGauges();
+        std::cout << "[PeerManager] Peer " << describe(peer) << " idle for " << silent.count() << " ms." << std::endl;
+    }
+
+    if(silent >= m_Config.expiryTimeout) {
+        evict(slot);
+        return;
+    }
+    m_Timers.schedule(slot, now, m_Config.expiryTimeout - silent);
+}
+
+void PeerManager::evict(Slot slot)
+{
+    std::unique_ptr<Peer> peer = std::move(m_Slots[slot]);
+    report(*peer, "expired");
+
+    if(peer->localStream) {
+        m_LocalStreams.release(peer->stream);
+    }
+    m_PeerCount--;
+    if(peer->idle) {
+        m_IdleCount--;
+    }
+    if(m_Pool.size() < m_Config.maxPooledPeers) {
+        m_Pool.push_back(std::move(peer));
+    }
+    // else: the decoder state goes back to the codec arena with the peer
+
+    Metrics::add(m_ExpiredMetric, 1);
+    updateGauges();
+}
+
+void PeerManager::report(const Peer& peer, const char* event) const
+{
+    std::cout << "[PeerManager] Peer " << describe(peer) << " " << event << " after " << peer.stats.packets
+        << " packets (" << peer.stats.lost << " lost, " << peer.stats.reordered << " reordered, jitter "
+        << peer.stats.jitterSamples * 1000.0 / m_Config.sampleRate << " ms";
+    if(peer.stats.oneWayDelayNs >= 0) {
+        std::cout << ", one-way delay " << peer.stats.oneWayDelayNs / 1000000.0 << " ms";
+    }
+    const CallQuality& quality = peer.quality;
+    std::cout << "), MOS " << std::fixed << std::setprecision(2) << quality.mos() << std::setprecision(1)
+        << " (R " << quality.rFactor() << ", " << quality.lossPercent() << "% concealed, burst ratio "
+        << quality.burstRatio() << ", " << std::max(0.0, quality.bitrateKbps()) << " kbps, "
+        << quality.mouthToEarMs() << " ms mouth-to-ear)." << std::defaultfloat << std::endl;
+}
+
+void PeerManager::updateQualityGauges()
+{
+    double mosMin = 0.0;
+    double mosSum = 0.0;
+    double rMin = 0.0;
+    size_t rated = 0;
+    size_t poor = 0;
+    for(const std::unique_ptr<Peer>& peer : m_Slots) {
+        if(!peer || peer->idle || peer->stats.packets == 0) {
+            continue;
+        }
+        const double r = peer->quality.rFactor();
+        const double mos = CallQuality::toMos(r);
+        mosMin = (rated == 0) ? mos : std::min(mosMin, mos);
+        rMin = (rated == 0) ? r : std::min(rMin, r);
+        mosSum += mos;
+        rated++;
+        if(mos < CallQuality::kPoorMos) {
+            poor++;
+        }
+    }
+    Metrics::set(m_MosMinMetric, std::lround(mosMin * 100.0));
+    Metrics::set(m_MosMeanMetric, rated > 0 ? std::lround(mosSum * 100.0 / rated) : 0);
+    Metrics::set(m_RMinMetric, std::lround(rMin));
+    Metrics::set(m_PoorMetric, static_cast<int64_t>(poor));
+}
+
+void PeerManager::updateGauges()
+{
+    Metrics::set(m_ActiveMetric, static_cast<int64_t>(m_PeerCount - m_IdleCount));
+    Metrics::set(m_IdleMetric, static_cast<int64_t>(m_IdleCount));
+    Metrics::set(m_PooledMetric, static_cast<int64_t>(m_Pool.size()));
+}
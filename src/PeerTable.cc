@@ -0,0 +1,111 @@
+#include "PeerTable.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+PeerKey PeerKey::from(const asio::ip::udp::endpoint& endpoint, uint32_t ssrc)
+{
+    PeerKey key;
+    const asio::ip::address address = endpoint.address();
+    if(address.is_v6()) {
+        const auto bytes = address.to_v6().to_bytes();
+        std::copy(bytes.begin(), bytes.end(), key.address.begin());
+    } else {
+        const auto bytes = address.to_v4().to_bytes();
+        key.address[10] = 0xFF;
+        key.address[11] = 0xFF;
+        std::copy(bytes.begin(), bytes.end(), key.address.begin() + 12);
+    }
+    key.port = endpoint.port();
+    key.ssrc = ssrc;
+    return key;
+}
+
+PeerTable::PeerTable(size_t maxEntries)
+    : m_MaxEntries(std::max<size_t>(maxEntries, 1))
+{
+    // Load factor <= 0.5 keeps linear probes within a cache line or two
+    size_t buckets = 2;
+    while(buckets < m_MaxEntries * 2) {
+        buckets <<= 1;
+    }
+    m_Buckets.resize(buckets);
+    m_Mask = buckets - 1;
+}
+
+uint64_t PeerTable::hash(const PeerKey& key)
+{
+    uint64_t high, low;
+    std::memcpy(&high, key.address.data(), sizeof(high));
+    std::memcpy(&low, key.address.data() + 8, sizeof(low));
+    uint64_t h = high ^ (low * 0x9E3779B97F4A7C15ull) ^ (static_cast<uint64_t>(key.port) << 32 | key.ssrc);
+
+    // MurmurHash3 finalizer
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+uint32_t PeerTable::find(const PeerKey& key) const
+{
+    for(size_t i = home(key);; i = (i + 1) & m_Mask) {
+        const Bucket& bucket = m_Buckets[i];
+        if(bucket.value == kNotFound) {
+            return kNotFound;
+        }
+        if(bucket.key == key) {
+            return bucket.value;
+        }
+    }
+}
+
+bool PeerTable::insert(const PeerKey& key, uint32_t value)
+{
+    if(value == kNotFound || m_Size >= m_MaxEntries) {
+        return false;
+    }
+    for(size_t i = home(key);; i = (i + 1) & m_Mask) {
+        Bucket& bucket = m_Buckets[i];
+        if(bucket.value == kNotFound) {
+            bucket.key = key;
+            bucket.value = value;
+            m_Size++;
+            return true;
+        }
+        if(bucket.key == key) {
+            return false;
+        }
+    }
+}
+
+bool PeerTable::erase(const PeerKey& key)
+{
+    size_t hole = home(key);
+    while(true) {
+        if(m_Buckets[hole].value == kNotFound) {
+            return false;
+        }
+        if(m_Buckets[hole].key == key) {
+            break;
+        }
+        hole = (hole + 1) & m_Mask;
+    }
+
+    // Backward shift: pull later entries of the cluster into the hole when their home
+    // bucket doesn't lie strictly between the hole and their current position
+    for(size_t i = (hole + 1) & m_Mask; m_Buckets[i].value != kNotFound; i = (i + 1) & m_Mask) {
+        const size_t entryHome = home(m_Buckets[i].key);
+        const size_t distanceToEntry = (i - entryHome) & m_Mask;
+        const size_t distanceToHole = (i - hole) & m_Mask;
+        if(distanceToEntry >= distanceToHole) {
+            m_Buckets[hole] = m_Buckets[i];
+            hole = i;
+        }
+    }
+    m_Buckets[hole].value = kNotFound;
+    m_Size--;
+    return true;
+}
@@ -0,0 +1,221 @@
+#include "PerfCounters.hpp"
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace {
+
+struct EventSpec
+{
+    uint32_t type;
+    uint64_t config;
+    const char* metric;
+};
+
+// Indexed by PerfSample::Event
+const EventSpec kEvents[PerfSample::kEventCount] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles"},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instructions"},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, "cache_misses"},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, "context_switches"},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, "task_clock_ns"},
+};
+
+std::atomic_bool s_WarnedUnavailable{false};
+std::atomic_bool s_WarnedUserOnly{false};
+std::atomic_bool s_WarnedMissing{false};
+
+int openEvent(const EventSpec& spec, int groupFd, bool excludeKernel)
+{
+    perf_event_attr attr{};
+    attr.size = sizeof(attr);
+    attr.type = spec.type;
+    attr.config = spec.config;
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.exclude_kernel = excludeKernel ? 1 : 0;
+    attr.exclude_hv = 1;
+    return static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, PERF_FLAG_FD_CLOEXEC));
+}
+
+// The calling thread's counter group
+struct ThreadCounters
+{
+    bool opened = false;
+    int leaderFd = -1;
+    std::array<int, PerfSample::kEventCount> fds;
+    std::array<int, PerfSample::kEventCount> slots;     // position in the group read, -1 if not counted
+    int count = 0;
+
+    ThreadCounters()
+    {
+        fds.fill(-1);
+        slots.fill(-1);
+    }
+
+    ~ThreadCounters()
+    {
+        for(int fd : fds) {
+            if(fd >= 0) {
+                ::close(fd);
+            }
+        }
+    }
+
+    void open()
+    {
+        opened = true;
+        // Counting kernel time needs perf_event_paranoid <= 1; in user space only, cycles and
+        // instructions still work, context switches (which happen in the kernel) read 0
+        bool excludeKernel = false;
+        int firstError = 0;
+        std::string missing;
+        for(int event = 0; event < PerfSample::kEventCount; event++) {
+            int fd = openEvent(kEvents[event], leaderFd, excludeKernel);
+            if(fd < 0 && (errno == EACCES || errno == EPERM) && !excludeKernel) {
+                excludeKernel = true;
+                fd = openEvent(kEvents[event], leaderFd, excludeKernel);
+            }
+            if(fd < 0) {
+                firstError = firstError ? firstError : errno;
+                missing += std::string(missing.empty() ? "" : ", ") + kEvents[event].metric;
+                continue;
+            }
+            if(leaderFd < 0) {
+                leaderFd = fd;
+            }
+            fds[event] = fd;
+            slots[event] = count++;
+        }
+
+        if(leaderFd < 0) {
+            if(!s_WarnedUnavailable.exchange(true)) {
+                std::cerr << "[PerfCounters] perf_event_open unavailable (" << std::strerror(firstError)
+                    << "), check kernel.perf_event_paranoid. Not measuring." << std::endl;
+            }
+            return;
+        }
+        if(!missing.empty() && !s_WarnedMissing.exchange(true)) {
+            // Typically hardware events inside a VM without a virtual PMU
+            std::cerr << "[PerfCounters] Not available on this host: " << missing << " (" << std::strerror(firstError)
+                << "), counted as 0." << std::endl;
+        }
+        if(excludeKernel && !s_WarnedUserOnly.exchange(true)) {
+            std::cerr << "[PerfCounters] Counting user space only (kernel.perf_event_paranoid > 1),"
+                " context switches are not counted." << std::endl;
+        }
+    }
+};
+
+thread_local ThreadCounters t_Counters;
+
+std::mutex& sitesMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+std::map<std::string, std::unique_ptr<PerfSite>>& sites()
+{
+    static std::map<std::string, std::unique_ptr<PerfSite>> registry;
+    return registry;
+}
+
+} // namespace
+
+// --- PerfSite ---
+
+PerfSite::PerfSite(const std::string& name)
+    : m_Name(name),
+    m_Calls(Metrics::instance().get("perf." + name + ".calls"))
+{
+    for(int event = 0; event < PerfSample::kEventCount; event++) {
+        m_Totals[event] = &Metrics::instance().get("perf." + name + "." + kEvents[event].metric);
+    }
+}
+
+void PerfSite::add(const PerfSample& begin, const PerfSample& end)
+{
+    Metrics::add(m_Calls, 1);
+    for(int event = 0; event < PerfSample::kEventCount; event++) {
+        Metrics::add(*m_Totals[event], static_cast<int64_t>(end.values[event] - begin.values[event]));
+    }
+}
+
+void PerfSite::report(std::ostream& out) const
+{
+    const int64_t calls = m_Calls.load();
+    if(calls == 0) {
+        return;
+    }
+    auto total = [this](PerfSample::Event event) { return static_cast<double>(m_Totals[event]->load()); };
+    const double cycles = total(PerfSample::Cycles);
+    const double taskClockNs = total(PerfSample::TaskClockNs);
+
+    out << std::fixed << std::setprecision(2)
+        << "[PerfCounters] " << m_Name << ": " << calls << " calls, "
+        << std::setprecision(0) << cycles / calls << " cycles/call, " << std::setprecision(2)
+        << "IPC " << (cycles > 0 ? total(PerfSample::Instructions) / cycles : 0.0) << ", "
+        << (taskClockNs > 0 ? cycles / taskClockNs : 0.0) << " GHz, "
+        << total(PerfSample::CacheMisses) / calls << " cache misses/call, "
+        << total(PerfSample::ContextSwitches) / calls << " context switches/call" << std::endl;
+    out.unsetf(std::ios::floatfield);
+}
+
+// --- PerfCounters ---
+
+std::atomic_bool PerfCounters::s_Enabled{false};
+
+void PerfCounters::enable()
+{
+    s_Enabled.store(true);
+    std::cout << "[PerfCounters] Measuring codec, network and audio callbacks with perf_event_open." << std::endl;
+}
+
+PerfSite& PerfCounters::site(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(sitesMutex());
+    std::unique_ptr<PerfSite>& site = sites()[name];
+    if(!site) {
+        site = std::make_unique<PerfSite>(name);
+    }
+    return *site;
+}
+
+bool PerfCounters::read(PerfSample& sample)
+{
+    ThreadCounters& counters = t_Counters;
+    if(!counters.opened) {
+        counters.open();
+    }
+    if(counters.leaderFd < 0) {
+        return false;
+    }
+
+    uint64_t buffer[1 + PerfSample::kEventCount];
+    if(::read(counters.leaderFd, buffer, sizeof(buffer)) < static_cast<ssize_t>(sizeof(uint64_t))) {
+        return false;
+    }
+    const uint64_t read = buffer[0];
+    for(int event = 0; event < PerfSample::kEventCount; event++) {
+        const int slot = counters.slots[event];
+        sample.values[event] = (slot >= 0 && static_cast<uint64_t>(slot) < read) ? buffer[1 + slot] : 0;
+    }
+    return true;
+}
+
+void PerfCounters::report(std::ostream& out)
+{
+    std::lock_guard<std::mutex> lock(sitesMutex());
+    for(const auto& entry : sites()) {
+        entry.second->report(out);
+    }
+}
@@ -0,0 +1,197 @@
+#include "Pipeline.hpp"
+#include "PipelineStages.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+// Built-in topologies, selectable by name instead of a full description
+const std::map<std::string, std::string> kBuiltinTopologies = {
+    {"loopback", "capture > encode > decode > playback"},
+    {"p2p",      "capture > encode > send; receive > decode > playback"},
+    {"p2p-aec",  "capture > aec > encode > send; receive > decode > echoref > playback"},
+    {"record",   "capture > encode > record"},
+    {"server",   "receive > reflect"},
+    {"relay",    "receive > send"},
+    {"bridge",   "receive > bridge"},
+    {"replay",   "replay > decode > playback"},
+};
+
+std::string trim(const std::string& text)
+{
+    auto begin = std::find_if_not(text.begin(), text.end(), [](unsigned char c) { return std::isspace(c); });
+    auto end = std::find_if_not(text.rbegin(), text.rend(), [](unsigned char c) { return std::isspace(c); }).base();
+    return (begin < end) ? std::string(begin, end) : std::string();
+}
+
+std::vector<std::string> split(const std::string& text, char separator)
+{
+    std::vector<std::string> parts;
+    std::stringstream stream(text);
+    std::string part;
+    while(std::getline(stream, part, separator)) {
+        parts.push_back(trim(part));
+    }
+    return parts;
+}
+
+} // namespace
+
+const char* toString(PortType type)
+{
+    switch(type) {
+        case PortType::None: return "nothing";
+        case PortType::Pcm: return "PCM frames";
+        case PortType::Encoded: return "encoded packets";
+    }
+    return "unknown";
+}
+
+PortHandle PortHandle::create(PortType type)
+{
+    switch(type) {
+        case PortType::Pcm: return createTyped<AudioFrame>();
+        case PortType::Encoded: return createTyped<Datagram>();
+        case PortType::None: break;
+    }
+    return PortHandle();
+}
+
+std::string PipelineGraph::resolveTopology(const std::string& nameOrDescription)
+{
+    auto it = kBuiltinTopologies.find(trim(nameOrDescription));
+    return (it != kBuiltinTopologies.end()) ? it->second : nameOrDescription;
+}
+
+PipelineGraph::Description PipelineGraph::parse(const std::string& description)
+{
+    Description chains;
+    for(const std::string& chainText : split(description, ';')) {
+        if(chainText.empty()) {
+            continue;
+        }
+        std::vector<std::string> chain = split(chainText, '>');
+        for(const std::string& stageName : chain) {
+            if(stageName.empty()) {
+                throw std::runtime_error("Pipeline description has an empty stage in '" + chainText + "'");
+            }
+        }
+        chains.push_back(std::move(chain));
+    }
+    if(chains.empty()) {
+        throw std::runtime_error("Pipeline description is empty.");
+    }
+    return chains;
+}
+
+bool PipelineGraph::uses(const Description& description, const std::string& stageName)
+{
+    for(const auto& chain : description) {
+        if(std::find(chain.begin(), chain.end(), stageName) != chain.end()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+PipelineGraph::PipelineGraph(const Description& description, PipelineContext& context)
+{
+    std::map<std::string, int> instances;
+
+    for(const auto& chainNames : description) {
+        // Resolve and type-check the whole chain before creating anything
+        std::vector<const StageDescriptor*> descriptors;
+        for(size_t i = 0; i < chainNames.size(); i++) {
+            const StageDescriptor* descriptor = findStageDescriptor(chainNames[i]);
+            if(!descriptor) {
+                throw std::runtime_error("Unknown pipeline stage '" + chainNames[i] + "' (available: " + stageNames() + ")");
+            }
+            if(descriptor->singleInstance && ++instances[descriptor->name] > 1) {
+                throw std::runtime_error(std::string("Pipeline stage '") + descriptor->name + "' can only be used once.");
+            }
+            if(i == 0 && descriptor->input != PortType::None) {
+                throw std::runtime_error(std::string("Pipeline chain must start with a source, '") + descriptor->name
+                    + "' consumes " + toString(descriptor->input));
+            }
+            if(i > 0) {
+                const StageDescriptor* upstream = descriptors.back();
+                if(upstream->output != descriptor->input) {
+                    throw std::runtime_error(std::string("Cannot connect '") + upstream->name + "' (produces "
+                        + toString(upstream->output) + ") to '" + descriptor->name + "' (consumes "
+                        + toString(descriptor->input) + ")");
+                }
+            }
+            descriptors.push_back(descriptor);
+        }
+
+        Chain chain;
+        for(size_t i = 0; i + 1 < descriptors.size(); i++) {
+            chain.ports.push_back(PortHandle::create(descriptors[i]->output));
+        }
+        for(size_t i = 0; i < descriptors.size(); i++) {
+            PortHandle input = (i > 0) ? chain.ports[i - 1] : PortHandle();
+            PortHandle output = (i + 1 < descriptors.size()) ? chain.ports[i] : PortHandle();
+            chain.stages.push_back(descriptors[i]->create(input, output, context));
+        }
+        m_Chains.push_back(std::move(chain));
+    }
+
+    std::cout << "[Pipeline] Built " << m_Chains.size() << " chain(s):" << std::endl;
+    for(const Chain& chain : m_Chains) {
+        std::cout << "[Pipeline]  ";
+        for(size_t i = 0; i < chain.stages.size(); i++) {
+            const IStage& stage = *chain.stages[i];
+            std::cout << (i ? " > " : " ") << stage.name()
+                << (stage.threading() == ThreadingPolicy::Dedicated ? "[thread]" : "[callback]");
+        }
+        std::cout << std::endl;
+    }
+}
+
+PipelineGraph::~PipelineGraph()
+{
+    stop();
+}
+
+bool PipelineGraph::start()
+{
+    if(b_Started) {
+        return true;
+    }
+    b_Started = true;
+
+    for(Chain& chain : m_Chains) {
+        for(auto it = chain.stages.rbegin(); it != chain.stages.rend(); ++it) {
+            if(!(*it)->start()) {
+                std::cerr << "[Pipeline] Failed to start stage '" << (*it)->name() << "'." << std::endl;
+                stop();
+                return false;
+            }
+        }
+    }
+    std::cout << "[Pipeline] Started." << std::endl;
+    return true;
+}
+
+void PipelineGraph::stop()
+{
+    if(!b_Started) {
+        return;
+    }
+    b_Started = false;
+
+    for(Chain& chain : m_Chains) {
+        for(size_t i = 0; i < chain.stages.size(); i++) {
+            if(i > 0) {
+                chain.ports[i - 1].shutdown();
+            }
+            chain.stages[i]->stop();
+        }
+    }
+    std::cout << "[Pipeline] Stopped." << std::endl;
+}
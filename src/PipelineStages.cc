@@ -0,0 +1,832 @@
+#include "PipelineStages.hpp"
+#include "Metrics.hpp"
+#include "opus_defines.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+template <typename T>
+T& require(T* resource, const char* stageName, const char* resourceName)
+{
+    if(!resource) {
+        throw std::runtime_error(std::string("Pipeline stage '") + stageName + "' needs " + resourceName
+            + ", which is not available in this configuration.");
+    }
+    return *resource;
+}
+
+const std::vector<StageDescriptor>& stageDescriptors()
+{
+    static const std::vector<StageDescriptor> descriptors = {
+        {"capture", PortType::None, PortType::Pcm, true,
+            [](const PortHandle&, const PortHandle& out, PipelineContext& ctx) -> std::unique_ptr<IStage> {
+                return std::make_unique<CaptureStage>(require(ctx.audioSource, "capture", "an audio source"),
+                    ctx.audioSourceName, out.get<AudioFrame>());
+            }},
+        {"receive", PortType::None, PortType::Encoded, true,
+            [](const PortHandle&, const PortHandle& out, PipelineContext& ctx) -> std::unique_ptr<IStage> {
+                return std::make_unique<ReceiveStage>(require(ctx.transport, "receive", "the network"),
+                    out.get<Datagram>());
+            }},
+        {"replay", PortType::None, PortType::Encoded, false,
+            [](const PortHandle&, const PortHandle& out, PipelineContext& ctx) -> std::unique_ptr<IStage> {
+                if(ctx.replayPath.empty()) {
+                    throw std::runtime_error("Pipeline stage 'replay' needs a packet trace to replay.");
+                }
+                return std::make_unique<ReplayStage>(ctx.replayPath, ctx.replayRealtime, ctx.mediaKey, out.get<Datagram>());
+            }},
+        // One instance: the codec (encoder state, complexity tuner) and redundancy history are shared
+        {"encode", PortType::Pcm, PortType::Encoded, true,
+            [](const PortHandle& in, const PortHandle& out, PipelineContext& ctx) -> std::unique_ptr<IStage> {
+                return std::make_unique<EncodeStage>(require(ctx.codec, "encode", "a codec"), ctx.sampleRate,
+                    ctx.frameSize, ctx.channels, ctx.framesPerPacket, ctx.dsp, ctx.redundancy, in.get<AudioFrame>(),
+                    out.get<Datagram>());
+            }},
+        {"decode", PortType::Encoded, PortType::Pcm, false,
+            [](const PortHandle& in, const PortHandle& out, PipelineContext& ctx) -> std::unique_ptr<IStage> {
+                PeerManagerConfig peerConfig;
+                peerConfig.sampleRate = ctx.sampleRate;
+                peerConfig.channels = ctx.channels;
+                peerConfig.idleTimeout = std::chrono::milliseconds(ctx.peerIdleTimeoutMs);
+                peerConfig.expiryTimeout = std::chrono::milliseconds(ctx.peerExpiryTimeoutMs);
+                peerConfig.clockSync = ctx.network ? &ctx.network->clockSync() : nullptr;
+                peerConfig.redundancy = ctx.redundancy;
+                return std::make_unique<DecodeStage>(peerConfig, ctx.frameSize, ctx.channels,
+                    in.get<Datagram>(), out.get<AudioFrame>());
+            }},
+        {"resample-in", PortType::Pcm, PortType::Pcm, false,
+            [](const PortHandle& in, const PortHandle& out, PipelineContext& ctx) -> std::unique_ptr<IStage> {
+                return std::make_unique<ResampleStage>(ctx.deviceSampleRate, ctx.sampleRate, ctx.channels,
+                    ctx.resampleQuality, "resample.in", in.get<AudioFrame>(), out.get<AudioFrame>());
+            }},
+        {"resample-out", PortType::Pcm, PortType::Pcm, false,
+            [](const PortHandle& in, const PortHandle& out, PipelineContext& ctx) -> std::unique_ptr<IStage> {
+                return std::make_unique<ResampleStage>(ctx.sampleRate, ctx.deviceSampleRate, ctx.channels,
+                    ctx.resampleQuality, "resample.out", in.get<AudioFrame>(), out.get<AudioFrame>());
+            }},
+        {"stretch", PortType::Pcm, PortType::Pcm, false,
+            [](const PortHandle& in, const PortHandle& out, PipelineContext& ctx) -> std::unique_ptr<IStage> {
+                // Right before playback, so at the device rate
+                const int frameSize = static_cast<int>(static_cast<int64_t>(ctx.frameSize) * ctx.deviceSampleRate / ctx.sampleRate);
+                return std::make_unique<StretchStage>(ctx.deviceSampleRate, ctx.channels, frameSize,
+                    ctx.stretchTargetMs, in.get<AudioFrame>(), out.get<AudioFrame>());
+            }},
+        {"aec", PortType::Pcm, PortType::Pcm, true,
+            [](const PortHandle& in, const PortHandle& out, PipelineContext& ctx) -> std::unique_ptr<IStage> {
+                return std::make_unique<EchoCancelStage>(require(ctx.echoCanceller, "aec", "an echo canceller"),
+                    ctx.channels, in.get<AudioFrame>(), out.get<AudioFrame>());
+            }},
+        {"echoref", PortType::Pcm, PortType::Pcm, true,
+            [](const PortHandle& in, const PortHandle& out, PipelineContext& ctx) -> std::unique_ptr<IStage> {
+                return std::make_unique<EchoReferenceStage>(require(ctx.echoCanceller, "echoref", "an echo canceller"),
+                    ctx.channels, in.get<AudioFrame>(), out.get<AudioFrame>());
+            }},
+        {"record", PortType::Encoded, PortType::Encoded, false,
+            [](const PortHandle& in, const PortHandle& out, PipelineContext& ctx) -> std::unique_ptr<IStage> {
+                if(ctx.recordPath.empty()) {
+                    throw std::runtime_error("Pipeline stage 'record' needs a recording path.");
+                }
+                return std::make_unique<RecordStage>(ctx.recordPath, in.get<Datagram>(), out.get<Datagram>());
+            }},
+        {"send", PortType::Encoded, PortType::None, false,
+            [](const PortHandle& in, const PortHandle&, PipelineContext& ctx) -> std::unique_ptr<IStage> {
+                return std::make_unique<SendStage>(require(ctx.transport, "send", "the network"), ctx.mediaKey,
+                    in.get<Datagram>());
+            }},
+        {"reflect", PortType::Encoded, PortType::None, false,
+            [](const PortHandle& in, const PortHandle&, PipelineContext& ctx) -> std::unique_ptr<IStage> {
+                return std::make_unique<ReflectStage>(require(ctx.transport, "reflect", "the network"), ctx.mediaKey,
+                    in.get<Datagram>());
+            }},
+        {"bridge", PortType::Encoded, PortType::None, true,
+            [](const PortHandle& in, const PortHandle&, PipelineContext& ctx) -> std::unique_ptr<IStage> {
+                return std::make_unique<BridgeStage>(require(ctx.bridge, "bridge", "a bridge configuration"),
+                    require(ctx.transport, "bridge", "the network"), ctx.mediaKey,
+                    std::chrono::milliseconds(ctx.peerExpiryTimeoutMs), in.get<Datagram>());
+            }},
+        {"playback", PortType::Pcm, PortType::None, true,
+            [](const PortHandle& in, const PortHandle&, PipelineContext& ctx) -> std::unique_ptr<IStage> {
+                return std::make_unique<PlaybackStage>(require(ctx.audioPlayback, "playback", "an audio playback device"),
+                    ctx.audioPlaybackName, in.get<AudioFrame>());
+            }},
+    };
+    return descriptors;
+}
+
+// Starts an audio backend and records how long it took (audio.<kind>.<backend>.start_us)
+template <typename Device>
+bool timedStart(Device& device, const char* kind, const std::string& backendName)
+{
+    auto begin = std::chrono::steady_clock::now();
+    bool started = device.start();
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin);
+    if(started) {
+        const std::string label = backendName.empty() ? std::string("unknown") : backendName;
+        Metrics::set(Metrics::instance().get(std::string("audio.") + kind + "." + label + ".start_us"), elapsed.count());
+        std::cout << "[Pipeline] Audio " << kind << " '" << label << "' started in " << elapsed.count() << " us" << std::endl;
+    }
+    return started;
+}
+
+// Sums of squares relative to full scale, for the audio level
+double sumOfSquares(const opus_int16* pcm, size_t samples)
+{
+    int64_t sum = 0;
+    for (size_t i = 0; i < samples; i++) {
+        sum += static_cast<int32_t>(pcm[i]) * pcm[i];
+    }
+    return static_cast<double>(sum) / (32768.0 * 32768.0);
+}
+
+double sumOfSquares(const float* samples, size_t count)
+{
+    float sum = 0.0f;
+    for (size_t i = 0; i < count; i++) {
+        sum += samples[i] * samples[i];
+    }
+    return sum;
+}
+
+// RMS level as -dBov (0 = full scale square wave, PacketHeader::kSilentLevel at -127 dBov and below)
+uint8_t audioLevel(double sumOfSquares, size_t samples)
+{
+    if (samples == 0 || sumOfSquares <= 0.0) {
+        return PacketHeader::kSilentLevel;
+    }
+    const double dBov = 10.0 * std::log10(sumOfSquares / samples);
+    return static_cast<uint8_t>(std::lround(std::min<double>(PacketHeader::kSilentLevel, std::max(0.0, -dBov))));
+}
+
+} // namespace
+
+const StageDescriptor* findStageDescriptor(const std::string& name)
+{
+    for(const StageDescriptor& descriptor : stageDescriptors()) {
+        if(name == descriptor.name) {
+            return &descriptor;
+        }
+    }
+    return nullptr;
+}
+
+std::string stageNames()
+{
+    std::string names;
+    for(const StageDescriptor& descriptor : stageDescriptors()) {
+        names += (names.empty() ? "" : " ") + std::string(descriptor.name);
+    }
+    return names;
+}
+
+// --- CaptureStage ---
+
+CaptureStage::CaptureStage(IAudioSource& source, const std::string& backendName, Port<AudioFrame> output)
+    : SourceStage<AudioFrame>(std::move(output)), m_Source(source), m_BackendName(backendName)
+{
+    m_Source.setOutputQueue(m_Output);
+}
+
+bool CaptureStage::start()
+{
+    return timedStart(m_Source, "source", m_BackendName);
+}
+
+void CaptureStage::stop()
+{
+    m_Source.stop();
+}
+
+// --- ReceiveStage ---
+
+ReceiveStage::ReceiveStage(ITransport& transport, Port<Datagram> output)
+    : SourceStage<Datagram>(std::move(output)), m_Transport(transport)
+{
+    m_Transport.setIncomingQueue(m_Output);
+}
+
+bool ReceiveStage::start()
+{
+    m_Transport.startReceive();
+    return true;
+}
+
+void ReceiveStage::stop()
+{
+    // The socket is shared with the send stages and closed by its owner once the whole graph
+    // has stopped. Datagrams arriving until then are dropped by the shut-down output port.
+}
+
+// --- ReplayStage ---
+
+ReplayStage::ReplayStage(const std::string& path, bool realtime, const MediaKey* key, Port<Datagram> output)
+    : SourceStage<Datagram>(std::move(output)), m_Path(path), b_Realtime(realtime),
+    m_Opener(key ? std::make_unique<MediaOpener>(*key) : nullptr)
+{}
+
+ReplayStage::~ReplayStage()
+{
+    stop();
+}
+
+bool ReplayStage::start()
+{
+    if (m_Thread.joinable()) {
+        return true;
+    }
+    if (!m_Reader.open(m_Path)) {
+        return false;
+    }
+    b_Stopping = false;
+    m_Thread = std::thread(&ReplayStage::replayLoop, this);
+    return true;
+}
+
+void ReplayStage::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        b_Stopping = true;
+    }
+    m_Wake.notify_all();
+    if (m_Thread.joinable()) {
+        m_Thread.join();
+    }
+}
+
+void ReplayStage::replayLoop()
+{
+    std::cout << "[Replay Stage] Replaying " << m_Path << (b_Realtime ? " at original timing" : " as fast as possible")
+        << std::endl;
+    MetricValue& packetsMetric = Metrics::instance().get("replay.packets");
+    const auto begin = std::chrono::steady_clock::now();
+    int64_t firstTimestampNs = 0;
+    int64_t lastTimestampNs = 0;
+    uint64_t packets = 0;
+
+    TraceRecord record;
+    while (m_Reader.next(record)) {
+        if (packets == 0) {
+            firstTimestampNs = record.timestampNs;
+        }
+        lastTimestampNs = record.timestampNs;
+        if (b_Realtime) {
+            // Spacing relative to the first packet, so waiting never accumulates drift
+            const auto due = begin + std::chrono::nanoseconds(record.timestampNs - firstTimestampNs);
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            if (m_Wake.wait_until(lock, due, [this]() { return b_Stopping; })) {
+                break;
+            }
+        } else {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            if (b_Stopping) {
+                break;
+            }
+        }
+        Datagram datagram{std::move(record.payload), record.sender};
+        datagram.receivedNs = record.timestampNs;   // jitter is measured against the recorded arrival
+        // Traces hold what the socket saw: sealed audio, clock messages in the clear
+        PacketHeader header;
+        if (m_Opener && PacketHeader::read(reinterpret_cast<const unsigned char*>(datagram.payload.data()),
+                datagram.payload.size(), header)
+            && header.type == PacketType::Audio && !m_Opener->open(datagram)) {
+            continue;
+        }
+        m_Output->push(std::move(datagram));
+        Metrics::add(packetsMetric, 1);
+        packets++;
+    }
+
+    const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin);
+    std::cout << "[Replay Stage] Replayed " << packets << " packets (" << (lastTimestampNs - firstTimestampNs) / 1000000
+        << " ms of traffic) in " << elapsed.count() << " ms." << std::endl;
+}
+
+// --- EncodeStage ---
+
+EncodeStage::EncodeStage(AudioCodec& codec, int sampleRate, int frameSize, int channels, int framesPerPacket,
+    const DspConfig& dsp, RedundancyController* redundancy, Port<AudioFrame> input, Port<Datagram> output)
+    : TransformStage<AudioFrame, Datagram>(std::move(input), std::move(output)),
+    m_Codec(codec), m_FrameSize(frameSize), m_Channels(channels),
+    m_Dsp(dsp.enabled() ? std::make_unique<DspChain>(sampleRate, channels, frameSize, dsp) : nullptr),
+    m_ProcessedFrame(m_Dsp ? static_cast<size_t>(frameSize) * channels : 0),
+    m_Assembler(frameSize, channels),
+    m_Packetizer(framesPerPacket),
+    m_OpusPacket(kMaxOpusPacketSize),
+    m_BundledPacket(kMaxBundledPacketSize),
+    m_Redundancy(redundancy),
+    m_RecentPayloads(redundancy ? static_cast<size_t>(redundancy->config().depth) : 0),
+    m_RedundantBytesMetric(Metrics::instance().get("redundancy.bytes_sent"))
+{
+    m_Header.ssrc = PacketHeader::randomSsrc();
+    if (m_Redundancy) {
+        std::cout << "[Encode Stage] Redundancy: " << m_Redundancy->config().describe() << "." << std::endl;
+    }
+}
+
+void EncodeStage::consume(AudioFrame& rawFrame)
+{
+    // Sources normally deliver exact frames already, encode those in place
+    if (m_Assembler.pendingFrames() == 0 && rawFrame.size() == static_cast<size_t>(m_FrameSize * m_Channels)) {
+        encodeFrame(rawFrame.data());
+        return;
+    }
+    m_Assembler.push(rawFrame.data(), rawFrame.size() / m_Channels,
+        [this](AudioFrame& frame) { encodeFrame(frame.data()); });
+}
+
+void EncodeStage::encodeFrame(const opus_int16* pcm)
+{
+    const uint32_t frameTimestamp = m_NextTimestamp;
+    m_NextTimestamp += static_cast<uint32_t>(m_FrameSize);
+
+    int encodedBytes;
+    if (m_Dsp) {
+        m_Dsp->process(pcm, m_ProcessedFrame.data());
+        TraceScope span("codec", "encode", "seq", m_Header.sequence);
+        encodedBytes = m_Codec.encodeFloat(m_ProcessedFrame.data(), m_FrameSize, m_OpusPacket.data(), kMaxOpusPacketSize);
+    } else {
+        TraceScope span("codec", "encode", "seq", m_Header.sequence);
+        encodedBytes = m_Codec.encode(pcm, m_FrameSize, m_OpusPacket.data(), kMaxOpusPacketSize);
+    }
+    if (encodedBytes < 0) {
+        std::cerr << "[Encode Stage] Opus encoding error: " << encodedBytes << std::endl;
+        return;
+    }
+    // Level of what was encoded, the DSP chain's output when there is one
+    const size_t samples = static_cast<size_t>(m_FrameSize) * m_Channels;
+    m_LevelEnergy += m_Dsp ? sumOfSquares(m_ProcessedFrame.data(), samples) : sumOfSquares(pcm, samples);
+    m_LevelSamples += samples;
+
+    if (m_Packetizer.framesPerPacket() == 1) {
+        m_Header.timestamp = frameTimestamp;
+        emitPacket(m_OpusPacket.data(), encodedBytes);
+        return;
+    }
+
+    if (m_Packetizer.pendingFrames() == 0) {
+        m_Header.timestamp = frameTimestamp;
+    }
+
+    // Packet time mode: bundle frames until the datagram is full
+    int result = m_Packetizer.append(m_OpusPacket.data(), encodedBytes);
+    if (result == OPUS_INVALID_PACKET && m_Packetizer.pendingFrames() > 0) {
+        // The encoder switched mode/bandwidth, frames with different TOCs can't share a packet.
+        // Send what we have and start a new bundle with this frame.
+        emitBundle();
+        m_Header.timestamp = frameTimestamp;
+        result = m_Packetizer.append(m_OpusPacket.data(), encodedBytes);
+    }
+    if (result != OPUS_OK) {
+        std::cerr << "[Encode Stage] Repacketizer error: " << opus_strerror(result) << ". Dropping frame." << std::endl;
+        return;
+    }
+
+    if (m_Packetizer.isFull()) {
+        emitBundle();
+    }
+}
+
+void EncodeStage::emitBundle()
+{
+    int bundledBytes = m_Packetizer.flush(m_BundledPacket.data(), kMaxBundledPacketSize);
+    if (bundledBytes > 0) {
+        emitPacket(m_BundledPacket.data(), bundledBytes);
+    }
+}
+
+void EncodeStage::emitPacket(const unsigned char* payload, int payloadSize)
+{
+    const unsigned char* body = payload;
+    size_t bodySize = static_cast<size_t>(payloadSize);
+    m_Header.flags = 0;
+    m_Header.setAudioLevel(audioLevel(m_LevelEnergy, m_LevelSamples));
+    m_LevelEnergy = 0.0;
+    m_LevelSamples = 0;
+
+    if (m_Redundancy) {
+        m_Header.setRequestedRedundancy(m_Redundancy->requestedDepth());
+
+        // Repeat the last payloads, oldest first, right in front of this one. The newest copies
+        // matter most, older ones are left out once the datagram would outgrow the size budget.
+        const size_t wanted = std::min(static_cast<size_t>(m_Redundancy->sendDepth()), m_RecentCount);
+        const size_t ringSize = m_RecentPayloads.size();
+        size_t depth = 0;
+        size_t datagramSize = m_Header.size() + 1 + bodySize;
+        while (depth < wanted) {
+            const size_t copySize = m_RecentPayloads[(m_RecentNewest + ringSize - depth) % ringSize].size();
+            datagramSize += copySize + (copySize < 0x80 ? 1 : 2);
+            if (datagramSize > kMaxRedundantDatagramSize) {
+                break;
+            }
+            depth++;
+        }
+        if (depth > 0) {
+            m_Repeated.clear();
+            for (size_t i = depth; i > 0; i--) {
+                m_Repeated.push_back(&m_RecentPayloads[(m_RecentNewest + ringSize - (i - 1)) % ringSize]);
+            }
+            m_FramedPayload.clear();
+            RedundancyFormat::write(m_Repeated, payload, bodySize, m_FramedPayload);
+            body = m_FramedPayload.data();
+            Metrics::add(m_RedundantBytesMetric, static_cast<int64_t>(m_FramedPayload.size() - bodySize));
+            bodySize = m_FramedPayload.size();
+            m_Header.flags |= PacketHeader::kFlagRedundancy;
+        }
+
+        // Remember this payload for the next datagrams; the copies have to stay consecutive,
+        // so one that can't be framed starts the history over
+        if (!m_RecentPayloads.empty()) {
+            if (static_cast<size_t>(payloadSize) <= RedundancyFormat::kMaxBlockSize) {
+                m_RecentNewest = (m_RecentNewest + 1) % m_RecentPayloads.size();
+                m_RecentPayloads[m_RecentNewest].assign(payload, payload + payloadSize);
+                m_RecentCount = std::min(m_RecentCount + 1, m_RecentPayloads.size());
+            } else {
+                m_RecentCount = 0;
+            }
+        }
+    }
+
+    // Room for the send stage to seal the datagram in place
+    NetworkPacket packet;
+    const size_t headerSize = m_Header.size();
+    packet.reserve(headerSize + bodySize + MediaCrypto::kOverhead);
+    packet.resize(headerSize + bodySize);
+    m_Header.write(reinterpret_cast<unsigned char*>(packet.data()));
+    std::copy(body, body + bodySize, packet.begin() + headerSize);
+    Datagram datagram{std::move(packet), {}};
+    datagram.rollover = m_Rollover;
+    if (++m_Header.sequence == 0) {
+        m_Rollover++;
+    }
+    emit(std::move(datagram));
+}
+
+// --- DecodeStage ---
+
+DecodeStage::DecodeStage(const PeerManagerConfig& peerConfig, int frameSize, int channels,
+    Port<Datagram> input, Port<AudioFrame> output)
+    : TransformStage<Datagram, AudioFrame>(std::move(input), std::move(output)),
+    m_Peers(peerConfig), m_SampleRate(peerConfig.sampleRate), m_FrameSize(frameSize), m_Channels(channels),
+    m_DecodedPcm(frameSize * channels),
+    m_RecoveredMetric(Metrics::instance().get("redundancy.recovered")),
+    m_DuplicatesMetric(Metrics::instance().get("redundancy.duplicates_skipped")),
+    m_EncryptedMetric(Metrics::instance().get("crypto.undecryptable_dropped"))
+{}
+
+void DecodeStage::consume(Datagram& datagram)
+{
+    NetworkPacket& encodedPacket = datagram.payload;
+    PacketHeader header;
+    const bool validHeader = PacketHeader::read(reinterpret_cast<const unsigned char*>(encodedPacket.data()),
+        encodedPacket.size(), header);
+    if (validHeader && (header.type == PacketType::ClockPing || header.type == PacketType::ClockPong)) {
+        return;     // clock messages in a replayed trace, the NetworkManager answers them live
+    }
+    if (!validHeader || header.type != PacketType::Audio) {
+        std::cerr << "[Decode Stage] Dropping datagram without a valid audio header (" << encodedPacket.size()
+            << " bytes)" << std::endl;
+        return;
+    }
+
+    if (header.flags & PacketHeader::kFlagEncrypted) {
+        Metrics::add(m_EncryptedMetric, 1);
+        return;     // sealed by a sender with a key we were not given
+    }
+
+    Peer* peer = m_Peers.onPacket(datagram, header, std::chrono::steady_clock::now());
+    if (!peer) {
+        return;     // stream not admitted
+    }
+
+    const unsigned char* payload = reinterpret_cast<const unsigned char*>(encodedPacket.data()) + header.size();
+    size_t payloadSize = encodedPacket.size() - header.size();
+    if (header.hasRedundancy()) {
+        RedundancyFormat::Block own;
+        if (!RedundancyFormat::read(payload, payloadSize, m_RepeatedBlocks, own)) {
+            std::cerr << "[Decode Stage] Dropping datagram with malformed redundancy (" << encodedPacket.size()
+                << " bytes)" << std::endl;
+            return;
+        }
+        // Copies of datagrams newer than anything decoded went missing so far: decode them first,
+        // oldest first. Older holes are left alone, their audio would play out of order, and so
+        // are the copies in a resumed datagram (audio a bridge left out on purpose).
+        if (peer->decoded.started() && !header.isResumed()) {
+            const size_t count = m_RepeatedBlocks.size();
+            for (size_t i = 0; i < count; i++) {
+                const uint16_t sequence = static_cast<uint16_t>(header.sequence - (count - i));
+                if (static_cast<int16_t>(sequence - peer->decoded.highest()) > 0) {
+                    peer->decoded.mark(sequence);
+                    decodePayload(*peer, m_RepeatedBlocks[i].data, static_cast<int>(m_RepeatedBlocks[i].size), sequence);
+                    Metrics::add(m_RecoveredMetric, 1);
+                    peer->quality.onRecovered();
+                }
+            }
+        }
+        payload = own.data;
+        payloadSize = own.size;
+    }
+
+    // Already played from a redundant copy, or a duplicate
+    if (peer->decoded.contains(header.sequence)) {
+        Metrics::add(m_DuplicatesMetric, 1);
+        return;
+    }
+    peer->decoded.mark(header.sequence);
+
+    // Codec bitrate and packet time from the datagram's own payload, playout delay from the
+    // decoded audio still queued ahead of playback, in the mixer and after it
+    const int samples = opus_packet_get_nb_samples(payload, static_cast<opus_int32>(payloadSize), m_SampleRate);
+    if (samples > 0) {
+        peer->quality.onPayload(payloadSize, samples, m_SampleRate);
+        peer->quality.setPacketTimeMs(samples * 1000.0 / m_SampleRate);
+    }
+    const size_t queued = outputDepth() + m_Mixer.queuedFrames(peer->stream);
+    peer->quality.setPlayoutDelayMs(static_cast<double>(queued) * m_FrameSize * 1000.0 / m_SampleRate);
+
+    decodePayload(*peer, payload, static_cast<int>(payloadSize), header.sequence);
+}
+
+void DecodeStage::decodePayload(Peer& peer, const unsigned char* payload, int payloadSize, uint16_t sequence)
+{
+    int frameCount = opus_packet_get_nb_frames(payload, payloadSize);
+    if (frameCount < 0) {
+        std::cerr << "[Decode Stage] Invalid Opus packet: " << opus_strerror(frameCount) << std::endl;
+        return;
+    }
+
+    // Bundled packet: split it back into capture-sized frames so playback sees the usual frame size
+    if (frameCount > 1) {
+        int result = m_Depacketizer.split(payload, payloadSize, m_SplitFrames);
+        if (result < 0) {
+            std::cerr << "[Decode Stage] Failed to split packet: " << opus_strerror(result) << std::endl;
+            return;
+        }
+    } else {
+        m_SplitFrames.clear();
+        m_SplitFrames.emplace_back(reinterpret_cast<const char*>(payload), reinterpret_cast<const char*>(payload) + payloadSize);
+    }
+
+    for (const NetworkPacket& frame : m_SplitFrames) {
+        TraceScope span("codec", "decode", "seq", sequence);
+        int decodedSamples = peer.decoder.decode(
+            reinterpret_cast<const unsigned char*>(frame.data()),
+            frame.size(),
+            m_DecodedPcm.data(),
+            m_FrameSize
+        );
+
+        if (decodedSamples < 0) {
+            std::cerr << "[Decode Stage] Opus decoding error: " << decodedSamples << std::endl;
+            continue;
+        }
+
+        AudioFrame decoded(m_DecodedPcm.begin(), m_DecodedPcm.begin() + (decodedSamples * m_Channels));
+        decoded.traceId = sequence;
+        m_Mixer.push(peer.stream, std::move(decoded), [this](AudioFrame&& mixed) { emit(std::move(mixed)); });
+    }
+}
+
+void DecodeStage::housekeeping()
+{
+    m_Peers.expire(std::chrono::steady_clock::now());
+}
+
+// --- ResampleStage ---
+
+ResampleStage::ResampleStage(int inputRate, int outputRate, int channels, ResamplerQuality quality,
+    const char* perfSite, Port<AudioFrame> input, Port<AudioFrame> output)
+    : TransformStage<AudioFrame, AudioFrame>(std::move(input), std::move(output)),
+    m_Resampler(inputRate, outputRate, channels, quality),
+    m_Channels(channels),
+    m_Perf(PerfCounters::site(perfSite))
+{
+    std::cout << "[Resample Stage] " << inputRate << " Hz > " << outputRate << " Hz, " << Resampler::qualityName(quality)
+        << " quality (" << Resampler::kernelName() << "), "
+        << m_Resampler.latencyFrames() * 1000.0 / inputRate << " ms delay." << std::endl;
+}
+
+void ResampleStage::consume(AudioFrame& frame)
+{
+    AudioFrame converted;
+    {
+        PerfScope perf(m_Perf);
+        m_Resampler.process(frame.data(), frame.size() / m_Channels, converted);
+    }
+    if(!converted.empty()) {
+        converted.traceId = frame.traceId;
+        emit(std::move(converted));
+    }
+}
+
+// --- StretchStage ---
+
+StretchStage::StretchStage(int sampleRate, int channels, int frameSize, int targetMs, Port<AudioFrame> input,
+    Port<AudioFrame> output)
+    : TransformStage<AudioFrame, AudioFrame>(std::move(input), std::move(output)),
+    m_Stretcher(sampleRate, channels),
+    m_Channels(channels),
+    m_FrameSize(std::max(1, frameSize)),
+    m_SampleRate(sampleRate),
+    m_TargetFrames(static_cast<size_t>(sampleRate) * std::max(0, targetMs) / 1000),
+    m_WindowFrames(static_cast<size_t>(sampleRate) / 2),
+    m_BacklogMetric(Metrics::instance().get("stretch.backlog_min_ms")),
+    m_InsertedMetric(Metrics::instance().get("stretch.inserted_ms")),
+    m_RemovedMetric(Metrics::instance().get("stretch.removed_ms")),
+    m_InsertedCount(Metrics::instance().get("stretch.insertions")),
+    m_RemovedCount(Metrics::instance().get("stretch.removals")),
+    m_Perf(PerfCounters::site("stretch"))
+{
+    startWindow();
+    std::cout << "[Stretch Stage] Keeping " << targetMs << " ms queued for playback." << std::endl;
+}
+
+void StretchStage::startWindow()
+{
+    m_WindowSeen = 0;
+    m_WindowMin = SIZE_MAX;
+}
+
+void StretchStage::consume(AudioFrame& frame)
+{
+    // Frames in the playback queue; they all carry about a frame size
+    const size_t backlog = outputDepth() * static_cast<size_t>(m_FrameSize);
+    m_WindowMin = std::min(m_WindowMin, backlog);
+    m_WindowSeen += frame.size() / m_Channels;
+    if(m_WindowSeen >= m_WindowFrames) {
+        Metrics::set(m_BacklogMetric, static_cast<int64_t>(m_WindowMin * 1000 / m_SampleRate));
+        if(m_WindowMin < m_TargetFrames) {
+            m_Mode = TimeStretcher::Mode::Expand;
+        } else if(m_WindowMin >= m_TargetFrames + m_Stretcher.maxHoldbackFrames() + m_FrameSize) {
+            m_Mode = TimeStretcher::Mode::Compress;
+        } else {
+            m_Mode = TimeStretcher::Mode::Normal;
+        }
+        startWindow();
+    }
+
+    AudioFrame out;
+    long change;
+    {
+        PerfScope perf(m_Perf);
+        change = m_Stretcher.process(frame.data(), frame.size() / m_Channels, m_Mode, out);
+    }
+    if(change != 0) {
+        // One period per window, then look at the backlog again
+        if(change > 0) {
+            m_InsertedFrames += change;
+            Metrics::add(m_InsertedCount, 1);
+            Metrics::set(m_InsertedMetric, m_InsertedFrames * 1000 / m_SampleRate);
+        } else {
+            m_RemovedFrames -= change;
+            Metrics::add(m_RemovedCount, 1);
+            Metrics::set(m_RemovedMetric, m_RemovedFrames * 1000 / m_SampleRate);
+        }
+        m_Mode = TimeStretcher::Mode::Normal;
+        startWindow();
+    }
+    if(!out.empty()) {
+        out.traceId = frame.traceId;
+        emit(std::move(out));
+    }
+}
+
+// --- EchoCancelStage ---
+
+EchoCancelStage::EchoCancelStage(EchoCanceller& canceller, int channels, Port<AudioFrame> input,
+    Port<AudioFrame> output)
+    : TransformStage<AudioFrame, AudioFrame>(std::move(input), std::move(output)),
+    m_Canceller(canceller), m_Channels(channels), m_Perf(PerfCounters::site("aec"))
+{}
+
+void EchoCancelStage::consume(AudioFrame& frame)
+{
+    {
+        PerfScope perf(m_Perf);
+        m_Canceller.process(frame.data(), frame.size() / m_Channels);
+    }
+    emit(std::move(frame));
+}
+
+// --- EchoReferenceStage ---
+
+EchoReferenceStage::EchoReferenceStage(EchoCanceller& canceller, int channels, Port<AudioFrame> input,
+    Port<AudioFrame> output)
+    : TransformStage<AudioFrame, AudioFrame>(std::move(input), std::move(output)),
+    m_Canceller(canceller), m_Channels(channels)
+{}
+
+void EchoReferenceStage::consume(AudioFrame& frame)
+{
+    m_Canceller.addReference(frame.data(), frame.size() / m_Channels);
+    emit(std::move(frame));
+}
+
+// --- RecordStage ---
+
+RecordStage::RecordStage(const std::string& path, Port<Datagram> input, Port<Datagram> output)
+    : TransformStage<Datagram, Datagram>(std::move(input), std::move(output)), m_Path(path)
+{}
+
+RecordStage::~RecordStage()
+{
+    if (m_File.is_open()) {
+        m_File.close();
+        std::cout << "[Record Stage] Recording closed: " << m_Path << std::endl;
+    }
+}
+
+bool RecordStage::start()
+{
+    if (!m_File.is_open()) {
+        m_File.open(m_Path, std::ios::binary | std::ios::trunc);
+        if (!m_File.is_open()) {
+            std::cerr << "[Record Stage] Failed to open recording file: " << m_Path << std::endl;
+            return false;
+        }
+        std::cout << "[Record Stage] Recording to " << m_Path << std::endl;
+    }
+    return TransformStage<Datagram, Datagram>::start();
+}
+
+void RecordStage::consume(Datagram& datagram)
+{
+    const size_t size = std::min<size_t>(datagram.payload.size(), 0xFFFF);
+    const char header[2] = { static_cast<char>((size >> 8) & 0xFF), static_cast<char>(size & 0xFF) };
+    m_File.write(header, sizeof(header));
+    m_File.write(datagram.payload.data(), size);
+    emit(std::move(datagram));
+}
+
+// --- SendStage ---
+
+SendStage::SendStage(ITransport& transport, const MediaKey* key, Port<Datagram> input)
+    : ConsumerStage<Datagram>(std::move(input)), m_Transport(transport),
+    m_Sealer(key ? std::make_unique<MediaSealer>(*key) : nullptr)
+{}
+
+void SendStage::consume(Datagram& datagram)
+{
+    if (m_Sealer && !m_Sealer->seal(datagram)) {
+        return;
+    }
+    m_Transport.sendPacket(datagram.payload);
+}
+
+// --- ReflectStage ---
+
+ReflectStage::ReflectStage(ITransport& transport, const MediaKey* key, Port<Datagram> input)
+    : ConsumerStage<Datagram>(std::move(input)), m_Transport(transport),
+    m_Sealer(key ? std::make_unique<MediaResealer>(*key) : nullptr)
+{}
+
+void ReflectStage::consume(Datagram& datagram)
+{
+    // The receive path opened it. Two senders may use the same SSRC and packet index, so it is
+    // resealed under a session kept for its sender's session only.
+    if (m_Sealer && !m_Sealer->seal(datagram)) {
+        return;
+    }
+    m_Transport.sendPacketTo(datagram.payload, datagram.peer);
+}
+
+// --- BridgeStage ---
+
+BridgeStage::BridgeStage(const BridgeConfig& config, ITransport& transport, const MediaKey* key,
+    std::chrono::milliseconds timeout, Port<Datagram> input)
+    : ConsumerStage<Datagram>(std::move(input)), m_Bridge(config, transport, key, timeout),
+    m_FlushInterval(std::max(1, config.flushMs))
+{}
+
+void BridgeStage::consume(Datagram& datagram)
+{
+    m_Bridge.onDatagram(datagram, Bridge::Clock::now());
+}
+
+void BridgeStage::housekeeping()
+{
+    m_Bridge.tick(Bridge::Clock::now());
+}
+
+// --- PlaybackStage ---
+
+PlaybackStage::PlaybackStage(IAudioPlayback& playback, const std::string& backendName, Port<AudioFrame> input)
+    : m_Playback(playback), m_BackendName(backendName)
+{
+    m_Playback.setInputQueue(std::move(input));
+}
+
+bool PlaybackStage::start()
+{
+    return timedStart(m_Playback, "playback", m_BackendName);
+}
+
+void PlaybackStage::stop()
+{
+    m_Playback.stop();
+}
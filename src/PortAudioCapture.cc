@@ -1,18 +1,23 @@
 #include "PortAudioCapture.hpp"
+#include "PortAudioGlobal.hpp"
 #include <iostream>
 #include <portaudio.h>
 
 PortAudioCapture::PortAudioCapture(int sampleRate, int channels, int frameSize)
-    : m_SampleRate(sampleRate), m_Channels(channels), m_FrameSize(frameSize)
+    : m_SampleRate(sampleRate), m_Channels(channels), m_FrameSize(frameSize),
+    m_Assembler(frameSize, channels),
+    m_CallbackPerf(PerfCounters::site("audio.capture"))
 {
     a_IsRunning.store(false);
-    // Initialize PortAudio in the global scope, to avoid multiple initializations
+    // PortAudio is initialized globally and ref-counted, to avoid multiple initializations
+    InitPortAudio();
 }
 
 PortAudioCapture::~PortAudioCapture()
 {
     // Cleanup PortAudio resources
     stop();
+    TerminatePortAudio();
 }
 
 void PortAudioCapture::setOutputQueue(std::shared_ptr<ThreadSafeQueue<AudioFrame>> queue)
@@ -47,7 +52,7 @@ bool PortAudioCapture::start()
         &inputParameters,    // Input stream parameters
         NULL,                // No output stream
         m_SampleRate,         // Sample rate
-        m_FrameSize,          // Frames per buffer (size of chunks for callback)
+        paFramesPerBufferUnspecified, // Host buffer size, m_Assembler cuts it into frames
         paNoFlag,            // No special flags
         paInputCallback,     // The static callback function
         this                 // User data to pass to the callback (pointer to this instance)
@@ -58,6 +63,10 @@ bool PortAudioCapture::start()
         return false;
     }
 
+    // The callback must not allocate its trace buffer itself
+    if(!m_TraceBuffer) {
+        m_TraceBuffer = FrameTracer::reserveThread("audio.capture");
+    }
     err = Pa_StartStream(m_InputStream);
     if(err != paNoError) {
         std::cerr << "[PortAudioCapture] Failed to start input stream: " << Pa_GetErrorText(err) << "\n";
@@ -87,6 +96,8 @@ void PortAudioCapture::stop() {
             }
             m_InputStream = nullptr; // Clear stream handle
         }
+        // The callback has returned for good, hand out the last partial frame
+        m_Assembler.flush([this](AudioFrame& frame) { m_OutputQueue->push(std::move(frame)); });
         std::cout << "[PortAudioCapture] Audio capture stopped." << std::endl;
     }
 }
@@ -100,6 +111,9 @@ int PortAudioCapture::paInputCallback(const void *inputBuffer,
 {
     // Cast userData back to our PortAudioCapture instance
     PortAudioCapture* self = static_cast<PortAudioCapture*>(userData);
+    PerfScope perf(self->m_CallbackPerf);
+    FrameTracer::adoptThread(self->m_TraceBuffer);
+    TraceScope span("audio", "capture", "frame", self->m_Assembler.nextTraceId());
 
     // If inputBuffer is NULL or stream is stopping, return accordingly
     if(inputBuffer == NULL || !self->a_IsRunning.load()) {
@@ -108,18 +122,15 @@ int PortAudioCapture::paInputCallback(const void *inputBuffer,
     }
 
     const opus_int16* pcmData = static_cast<const opus_int16*>(inputBuffer);
-    AudioFrame capturedFrame(framesPerBuffer * self->m_Channels); // Create a new AudioFrame
-
-    // Copy captured PCM data from the input buffer into our AudioFrame vector
-    std::copy(pcmData, pcmData + capturedFrame.size(), capturedFrame.begin());
 
-    // Push the captured frame to the output queue
+    // The host picks the buffer size: copy it into codec-sized frames and push each one complete
     if(self->m_OutputQueue) {
         if(self->m_OutputQueue->is_shutting_down()) {
                 std::cout << "[PortAudioCapture] Callback: Output queue shutting down. Returning paComplete." << std::endl;
                 return paComplete;
         }
-        self->m_OutputQueue->push(capturedFrame);
+        self->m_Assembler.push(pcmData, framesPerBuffer,
+            [self](AudioFrame& frame) { self->m_OutputQueue->push(std::move(frame)); });
     } else {
         std::cerr << "[PortAudioCapture] Callback: Output queue is nullptr! Captured data dropped." << std::endl;
     }
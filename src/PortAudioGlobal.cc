@@ -0,0 +1,46 @@
+#include "PortAudioGlobal.hpp"
+
+#include <iostream>
+#include <mutex>
+#include <portaudio.h>
+#include <stdexcept>
+#include <string>
+
+// Port Audio status flags
+static bool g_Pa_Initialized = false;
+static int g_Pa_RefCount = 0;
+std::mutex g_Pa_Mutex;
+
+void InitPortAudio()
+{
+    std::lock_guard<std::mutex> lock(g_Pa_Mutex);
+    if(!g_Pa_Initialized)
+    {
+        PaError err = Pa_Initialize();
+        if(err != paNoError)
+        {
+            throw std::runtime_error("Failed to initialize PortAudio: " + std::string(Pa_GetErrorText(err)));
+        }
+        g_Pa_Initialized = true;
+        std::cout << "[PortAudio Global] initialized successfully." << std::endl;
+    }
+    g_Pa_RefCount++;
+}
+
+void TerminatePortAudio()
+{
+    std::lock_guard<std::mutex> lock(g_Pa_Mutex);
+    g_Pa_RefCount--;
+    if(g_Pa_RefCount == 0 && g_Pa_Initialized)
+    {
+        // Called from the device destructors, so a failure is logged rather than thrown
+        PaError err = Pa_Terminate();
+        g_Pa_Initialized = false;
+        if(err != paNoError)
+        {
+            std::cerr << "[PortAudio Global] Error: Failed to terminate PortAudio: " << Pa_GetErrorText(err) << std::endl;
+            return;
+        }
+        std::cout << "[PortAudio Global] terminated successfully." << std::endl;
+    }
+}
@@ -1,4 +1,5 @@
 #include "PortAudioPlayback.hpp"
+#include "PortAudioGlobal.hpp"
 #include "interfaces/IAudioPlayback.hpp"
 
 #include "opus_types.h"
@@ -6,15 +7,20 @@
 #include <portaudio.h>
 
 PortAudioPlayback::PortAudioPlayback(int sampleRate, int channels, int frameSize)
-    : m_SampleRate(sampleRate), m_Channels(channels), m_FrameSize(frameSize)
+    : m_SampleRate(sampleRate), m_Channels(channels), m_FrameSize(frameSize),
+    m_Splitter(channels),
+    m_UnderrunMetric(Metrics::instance().get("audio.playback.underrun_frames")),
+    m_CallbackPerf(PerfCounters::site("audio.playback"))
 {
-    // Initialize PortAudio in the global scope, to avoid multiple initializations
+    // PortAudio is initialized globally and ref-counted, to avoid multiple initializations
+    InitPortAudio();
 }
 
 PortAudioPlayback::~PortAudioPlayback()
 {
     // Terminate PortAudio
     stop();
+    TerminatePortAudio();
 }
 
 bool PortAudioPlayback::start()
@@ -45,7 +51,7 @@ bool PortAudioPlayback::start()
         NULL,
         &outputParameters,
         m_SampleRate,
-        m_FrameSize,
+        paFramesPerBufferUnspecified,   // host buffer size, m_Splitter spreads frames over it
         paNoFlag,
         paOutputCallback,
         this
@@ -56,6 +62,10 @@ bool PortAudioPlayback::start()
         return false;
     }
 
+    // The callback must not allocate its trace buffer itself
+    if(!m_TraceBuffer) {
+        m_TraceBuffer = FrameTracer::reserveThread("audio.playback");
+    }
     err = Pa_StartStream(m_OutputStream);
     if(err != paNoError) {
         std::cerr << "[PortAudioPlayback] Error: Failed to start PortAudio stream: " << Pa_GetErrorText(err) << std::endl;
@@ -100,35 +110,25 @@ int PortAudioPlayback::paOutputCallback(
 )
 {
     PortAudioPlayback* self = static_cast<PortAudioPlayback*>(userData);
+    PerfScope perf(self->m_CallbackPerf);
+    FrameTracer::adoptThread(self->m_TraceBuffer);
+    TraceScope span("audio", "playback");
     opus_int16* out = static_cast<opus_int16*>(outputBuffer);
-    unsigned long framesToFill = framesPerBuffer;
-    int samplesToFill = framesToFill * self->m_Channels;
 
-    AudioFrame decodedFrame;
-    // Decode audio from input Queue
-    if(!self->m_InputQueue->try_pop(decodedFrame)) {
-        std::fill(out, out + samplesToFill, 0);
+    // Decoded frames rarely match the host buffer: play the rest of a frame in the next callback,
+    // silence only where the queue ran dry (jitter buffer placeholder)
+    size_t silentFrames = self->m_Splitter.pull(out, framesPerBuffer,
+        [self](AudioFrame& frame) { return self->m_InputQueue->try_pop(frame); });
+    if(self->m_Splitter.firstTraceId() >= 0) {
+        span.tag("frame", self->m_Splitter.firstTraceId());
+    }
+    if(silentFrames > 0) {
         if(self->m_InputQueue->is_shutting_down() && self->m_InputQueue->empty()) {
             return paComplete;
         }
-        // Can maybe add jitter buffer
-        return paContinue;
-    }
-
-    // Copy decoded samples to output buffer
-    size_t samplesInFrame = decodedFrame.size();
-    size_t samplesToCopy = std::min(samplesInFrame, (size_t)samplesToFill);
-    std::copy(decodedFrame.begin(), decodedFrame.begin() + samplesToCopy, out);
-
-    // If the decoded frame was smaller than requested, fill the rest with silence
-    if (samplesToCopy < (size_t)samplesToFill) {
-        std::fill(out + samplesToCopy, out + samplesToFill, 0);
-        // std::cout << "[PortAudioPlayback] Jitter: Decoded frame too small, padding with silence." << std::endl;
+        Metrics::add(self->m_UnderrunMetric, static_cast<int64_t>(silentFrames));
     }
 
-    // Jitter buffer placeholder: If decodedFrame was larger than needed,
-    // you'd typically push the remainder back to a JitterBuffer, not to the main inputQueue.
-
     // If the playback module is stopping, signal PortAudio to stop the stream
     if (!self->a_IsRunning.load()) {
         std::cout << "[PortAudioPlayback] Stopping callback signal." << std::endl;
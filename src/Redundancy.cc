@@ -0,0 +1,203 @@
+#include "Redundancy.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+// --- RedundancyConfig ---
+
+bool RedundancyConfig::parse(const std::string& spec, RedundancyConfig& config)
+{
+    RedundancyConfig parsed;
+    if(spec.empty() || spec == "off") {
+        config = parsed;
+        return true;
+    }
+
+    std::string text = spec;
+    if(spec.compare(0, 4, "auto") == 0) {
+        parsed.adaptive = true;
+        parsed.depth = 3;
+        if(spec.size() == 4) {
+            parsed.enabled = true;
+            config = parsed;
+            return true;
+        }
+        if(spec[4] != '=') {
+            return false;
+        }
+        text = spec.substr(5);
+    }
+
+    char* end = nullptr;
+    const long depth = std::strtol(text.c_str(), &end, 10);
+    if(text.empty() || *end != '\0' || depth < 0 || depth > kMaxDepth) {
+        return false;
+    }
+    parsed.depth = static_cast<int>(depth);
+    parsed.enabled = parsed.adaptive || depth > 0;
+    config = parsed;
+    return true;
+}
+
+std::string RedundancyConfig::describe() const
+{
+    if(!enabled) {
+        return "off";
+    }
+    if(adaptive) {
+        return "adaptive, up to " + std::to_string(depth) + " earlier payload(s) per datagram";
+    }
+    return std::to_string(depth) + " earlier payload(s) per datagram";
+}
+
+// --- RedundancyFormat ---
+
+void RedundancyFormat::write(const std::vector<const std::vector<unsigned char>*>& previous,
+    const unsigned char* payload, size_t payloadSize, std::vector<unsigned char>& out)
+{
+    out.push_back(static_cast<unsigned char>(previous.size()));
+    for(const std::vector<unsigned char>* block : previous) {
+        const size_t size = block->size();
+        if(size < 0x80) {
+            out.push_back(static_cast<unsigned char>(size));
+        } else {
+            out.push_back(static_cast<unsigned char>(0x80 | (size >> 8)));
+            out.push_back(static_cast<unsigned char>(size));
+        }
+    }
+    for(const std::vector<unsigned char>* block : previous) {
+        out.insert(out.end(), block->begin(), block->end());
+    }
+    out.insert(out.end(), payload, payload + payloadSize);
+}
+
+bool RedundancyFormat::read(const unsigned char* data, size_t size, std::vector<Block>& previous, Block& payload)
+{
+    previous.clear();
+    if(size < 1) {
+        return false;
+    }
+    const size_t count = data[0];
+    size_t offset = 1;
+    for(size_t i = 0; i < count; i++) {
+        if(offset >= size) {
+            return false;
+        }
+        size_t length = data[offset++];
+        if(length & 0x80) {
+            if(offset >= size) {
+                return false;
+            }
+            length = ((length & 0x7F) << 8) | data[offset++];
+        }
+        previous.push_back(Block{nullptr, length});
+    }
+    for(Block& block : previous) {
+        if(block.size > size - offset) {
+            return false;
+        }
+        block.data = data + offset;
+        offset += block.size;
+    }
+    payload.data = data + offset;
+    payload.size = size - offset;
+    return payload.size > 0;
+}
+
+// --- DecodeHistory ---
+
+bool DecodeHistory::contains(uint16_t sequence) const
+{
+    if(!b_Started) {
+        return false;
+    }
+    const int16_t behind = static_cast<int16_t>(m_Highest - sequence);
+    if(behind < 0 || behind >= 64) {
+        return false;
+    }
+    return (m_Mask >> behind) & 1;
+}
+
+void DecodeHistory::mark(uint16_t sequence)
+{
+    if(!b_Started) {
+        b_Started = true;
+        m_Highest = sequence;
+        m_Mask = 1;
+        return;
+    }
+    const int16_t ahead = static_cast<int16_t>(sequence - m_Highest);
+    if(ahead > 0) {
+        m_Mask = (ahead >= 64) ? 0 : (m_Mask << ahead);
+        m_Mask |= 1;
+        m_Highest = sequence;
+    } else if(ahead > -64) {
+        m_Mask |= uint64_t{1} << -ahead;
+    }
+}
+
+// --- RedundancyController ---
+
+void RedundancyController::WindowedMax::advance(Clock::time_point now, Clock::duration window)
+{
+    if(windowStart == Clock::time_point{}) {
+        windowStart = now;
+        return;
+    }
+    const Clock::duration elapsed = now - windowStart;
+    if(elapsed >= 2 * window) {
+        current = previous = 0;
+        windowStart = now;
+    } else if(elapsed >= window) {
+        previous = current;
+        current = 0;
+        windowStart += window;
+    }
+}
+
+void RedundancyController::WindowedMax::add(int value, Clock::time_point now, Clock::duration window)
+{
+    advance(now, window);
+    current = std::max(current, value);
+}
+
+RedundancyController::RedundancyController(const RedundancyConfig& config)
+    : m_Config(config),
+    m_SendDepthMetric(Metrics::instance().get("redundancy.send_depth")),
+    m_RequestedDepthMetric(Metrics::instance().get("redundancy.requested_depth")),
+    m_BurstsMetric(Metrics::instance().get("redundancy.loss_bursts")),
+    m_LongestBurstMetric(Metrics::instance().get("redundancy.longest_burst"))
+{
+    publish();
+}
+
+void RedundancyController::onLossBurst(int length, Clock::time_point now)
+{
+    Metrics::add(m_BurstsMetric, 1);
+    m_Bursts.add(length, now, kBurstWindow);
+    publish();
+}
+
+void RedundancyController::onPeerRequest(int depth, Clock::time_point now)
+{
+    m_Requests.add(depth, now, kRequestWindow);
+    publish();
+}
+
+void RedundancyController::tick(Clock::time_point now)
+{
+    m_Bursts.advance(now, kBurstWindow);
+    m_Requests.advance(now, kRequestWindow);
+    publish();
+}
+
+void RedundancyController::publish()
+{
+    const int requested = std::min(m_Bursts.value(), RedundancyConfig::kMaxDepth);
+    const int send = m_Config.adaptive ? std::min(m_Requests.value(), m_Config.depth) : m_Config.depth;
+    a_RequestedDepth.store(requested, std::memory_order_relaxed);
+    a_SendDepth.store(send, std::memory_order_relaxed);
+    Metrics::set(m_RequestedDepthMetric, requested);
+    Metrics::set(m_SendDepthMetric, send);
+    Metrics::set(m_LongestBurstMetric, m_Bursts.value());
+}
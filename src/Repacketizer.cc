@@ -0,0 +1,106 @@
+#include "Repacketizer.hpp"
+#include "opus_defines.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+Repacketizer::Repacketizer(int framesPerPacket)
+    : m_FramesPerPacket(std::clamp(framesPerPacket, kMinFramesPerPacket, kMaxFramesPerPacket)),
+    m_FrameStorage(static_cast<size_t>(kMaxFramesPerPacket) * kMaxFrameBytes)
+{
+    if(framesPerPacket != m_FramesPerPacket) {
+        std::cerr << "[Repacketizer] Frames per packet " << framesPerPacket << " out of range, using "
+            << m_FramesPerPacket << std::endl;
+    }
+
+    m_State = opus_repacketizer_create();
+    if(!m_State) {
+        throw std::runtime_error("Failed to create Opus repacketizer.");
+    }
+}
+
+Repacketizer::~Repacketizer()
+{
+    if(m_State) {
+        opus_repacketizer_destroy(m_State);
+        m_State = nullptr;
+    }
+}
+
+int Repacketizer::append(const unsigned char* data, int len)
+{
+    if(!data || len <= 0 || len > kMaxFrameBytes) {
+        return OPUS_BAD_ARG;
+    }
+    if(m_Pending >= kMaxFramesPerPacket) {
+        return OPUS_BUFFER_TOO_SMALL;
+    }
+
+    unsigned char* slot = m_FrameStorage.data() + static_cast<size_t>(m_Pending) * kMaxFrameBytes;
+    std::memcpy(slot, data, len);
+
+    int result = opus_repacketizer_cat(m_State, slot, len);
+    if(result != OPUS_OK) {
+        return result;
+    }
+    m_Pending++;
+    return OPUS_OK;
+}
+
+int Repacketizer::flush(unsigned char* out, int maxLen)
+{
+    if(m_Pending == 0) {
+        return 0;
+    }
+
+    int result = opus_repacketizer_out(m_State, out, maxLen);
+    opus_repacketizer_init(m_State);
+    m_Pending = 0;
+
+    if(result < 0) {
+        std::cerr << "[Repacketizer] Failed to build packet: " << opus_strerror(result) << std::endl;
+    }
+    return result;
+}
+
+int Repacketizer::split(const unsigned char* packet, int len, std::vector<std::vector<char>>& frames)
+{
+    frames.clear();
+    if(m_Pending != 0) {
+        // split() reuses the state, never mix it with a half-built bundle
+        return OPUS_INVALID_STATE;
+    }
+
+    opus_repacketizer_init(m_State);
+    int result = opus_repacketizer_cat(m_State, packet, len);
+    if(result != OPUS_OK) {
+        opus_repacketizer_init(m_State);
+        return result;
+    }
+
+    int frameCount = opus_repacketizer_get_nb_frames(m_State);
+    unsigned char frame[kMaxFrameBytes + 1]; // +1 for the rewritten TOC byte
+    for(int i = 0; i < frameCount; i++) {
+        int frameBytes = opus_repacketizer_out_range(m_State, i, i + 1, frame, sizeof(frame));
+        if(frameBytes < 0) {
+            opus_repacketizer_init(m_State);
+            frames.clear();
+            return frameBytes;
+        }
+        frames.emplace_back(reinterpret_cast<char*>(frame), reinterpret_cast<char*>(frame) + frameBytes);
+    }
+
+    opus_repacketizer_init(m_State);
+    return frameCount;
+}
+
+bool Repacketizer::isValidPacketTime(int framesPerPacket, int frameSize, int sampleRate)
+{
+    if(framesPerPacket < kMinFramesPerPacket || framesPerPacket > kMaxFramesPerPacket || sampleRate <= 0) {
+        return false;
+    }
+    return static_cast<long long>(framesPerPacket) * frameSize * 1000 <=
+        static_cast<long long>(kMaxPacketDurationMs) * sampleRate;
+}
@@ -0,0 +1,235 @@
+#include "Resampler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ECHOLINK_X86_SIMD 1
+#endif
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+
+struct QualityParams
+{
+    int taps;
+    double passband;    // cutoff as a share of the lower Nyquist frequency
+    double kaiserBeta;
+};
+
+QualityParams qualityParams(ResamplerQuality quality)
+{
+    switch(quality) {
+        case ResamplerQuality::Fast: return {16, 0.85, 6.0};
+        case ResamplerQuality::Balanced: return {32, 0.91, 8.0};
+        case ResamplerQuality::High: return {64, 0.95, 10.0};
+    }
+    return {32, 0.91, 8.0};
+}
+
+// Zeroth order modified Bessel function of the first kind, for the Kaiser window
+double besselI0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    for(int k = 1; k < 32; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if(term < sum * 1e-12) {
+            break;
+        }
+    }
+    return sum;
+}
+
+using DotProduct = float (*)(const float* a, const float* b, int n);
+
+// n is a multiple of 16 for all of these
+#if !defined(ECHOLINK_X86_SIMD)
+float dotScalar(const float* a, const float* b, int n)
+{
+    float sum = 0.0f;
+    for(int i = 0; i < n; i++) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+#else
+float dotSse(const float* a, const float* b, int n)
+{
+    __m128 sum0 = _mm_setzero_ps();
+    __m128 sum1 = _mm_setzero_ps();
+    for(int i = 0; i < n; i += 8) {
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    const __m128 sum = _mm_add_ps(sum0, sum1);
+    const __m128 pairs = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    return _mm_cvtss_f32(_mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, 1)));
+}
+
+__attribute__((target("avx2,fma")))
+float dotAvx2(const float* a, const float* b, int n)
+{
+    __m256 sum0 = _mm256_setzero_ps();
+    __m256 sum1 = _mm256_setzero_ps();
+    for(int i = 0; i < n; i += 16) {
+        sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum0);
+        sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), sum1);
+    }
+    const __m256 sum = _mm256_add_ps(sum0, sum1);
+    const __m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+    const __m128 pairs = _mm_add_ps(half, _mm_movehl_ps(half, half));
+    return _mm_cvtss_f32(_mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, 1)));
+}
+#endif
+
+struct Kernel
+{
+    DotProduct dot;
+    const char* name;
+};
+
+const Kernel& kernel()
+{
+    static const Kernel selected = []() -> Kernel {
+#if defined(ECHOLINK_X86_SIMD)
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+            return {dotAvx2, "avx2"};
+        }
+        return {dotSse, "sse"};
+#else
+        return {dotScalar, "scalar"};
+#endif
+    }();
+    return selected;
+}
+
+} // namespace
+
+Resampler::Resampler(int inputRate, int outputRate, int channels, ResamplerQuality quality)
+    : m_InputRate(inputRate), m_OutputRate(outputRate), m_Channels(channels)
+{
+    if(inputRate <= 0 || outputRate <= 0 || channels <= 0) {
+        throw std::invalid_argument("Resampler needs positive rates and channel count.");
+    }
+    const int divisor = std::gcd(inputRate, outputRate);
+    m_Interpolation = outputRate / divisor;
+    m_Decimation = inputRate / divisor;
+    if(m_Interpolation > kMaxPhases) {
+        throw std::invalid_argument("Can't resample " + std::to_string(inputRate) + " Hz to "
+            + std::to_string(outputRate) + " Hz: ratio " + std::to_string(m_Interpolation) + "/"
+            + std::to_string(m_Decimation) + " needs more than " + std::to_string(kMaxPhases) + " filter phases.");
+    }
+
+    // Phase p computes the output at fractional input position p / L between two input samples.
+    // Tap j multiplies input sample (floor(t) - taps / 2 + 1 + j), at distance d from t.
+    const QualityParams params = qualityParams(quality);
+    m_Taps = params.taps;
+    const double cutoff = params.passband * std::min(1.0, static_cast<double>(outputRate) / inputRate);
+    const double half = m_Taps / 2.0;
+    m_Filters.resize(static_cast<size_t>(m_Interpolation) * m_Taps);
+    for(int phase = 0; phase < m_Interpolation; phase++) {
+        float* filter = m_Filters.data() + static_cast<size_t>(phase) * m_Taps;
+        const double fraction = static_cast<double>(phase) / m_Interpolation;
+        double sum = 0.0;
+        for(int j = 0; j < m_Taps; j++) {
+            const double distance = j - half + 1.0 - fraction;
+            const double x = kPi * cutoff * distance;
+            const double sinc = (std::abs(x) < 1e-9) ? 1.0 : std::sin(x) / x;
+            const double position = distance / half;
+            const double window = (std::abs(position) >= 1.0) ? 0.0
+                : besselI0(params.kaiserBeta * std::sqrt(1.0 - position * position)) / besselI0(params.kaiserBeta);
+            filter[j] = static_cast<float>(cutoff * sinc * window);
+            sum += filter[j];
+        }
+        // Unity gain at DC for every phase, or the phases beat against each other
+        for(int j = 0; j < m_Taps; j++) {
+            filter[j] = static_cast<float>(filter[j] / sum);
+        }
+    }
+
+    // Start with a full window of silence, so every input sample yields its outputs right away
+    // (a 10 ms chunk converts to exactly 10 ms) and the signal is delayed by half the filter
+    m_History.assign(channels, std::vector<float>(m_Taps - 1, 0.0f));
+}
+
+bool Resampler::parseQuality(const std::string& name, ResamplerQuality& quality)
+{
+    if(name == "fast") {
+        quality = ResamplerQuality::Fast;
+    } else if(name.empty() || name == "balanced") {
+        quality = ResamplerQuality::Balanced;
+    } else if(name == "high") {
+        quality = ResamplerQuality::High;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* Resampler::qualityName(ResamplerQuality quality)
+{
+    switch(quality) {
+        case ResamplerQuality::Fast: return "fast";
+        case ResamplerQuality::Balanced: return "balanced";
+        case ResamplerQuality::High: return "high";
+    }
+    return "unknown";
+}
+
+const char* Resampler::kernelName()
+{
+    return kernel().name;
+}
+
+size_t Resampler::process(const opus_int16* in, size_t frames, AudioFrame& out)
+{
+    constexpr float kScale = 1.0f / 32768.0f;
+    for(int c = 0; c < m_Channels; c++) {
+        std::vector<float>& history = m_History[c];
+        const size_t begin = history.size();
+        history.resize(begin + frames);
+        for(size_t i = 0; i < frames; i++) {
+            history[begin + i] = in[i * m_Channels + c] * kScale;
+        }
+    }
+
+    const DotProduct dot = kernel().dot;
+    const size_t available = m_History[0].size();
+    const size_t firstOut = out.size();
+    // At most one output per L/M input samples, plus one for the phase
+    const size_t maxOutputs = (available - std::min(available, m_Position)) * m_Interpolation / m_Decimation + 1;
+    out.resize(firstOut + maxOutputs * m_Channels);
+    opus_int16* frame = out.data() + firstOut;
+    size_t produced = 0;
+    while(m_Position + m_Taps <= available) {
+        const float* filter = m_Filters.data() + static_cast<size_t>(m_Phase) * m_Taps;
+        for(int c = 0; c < m_Channels; c++) {
+            const float value = dot(filter, m_History[c].data() + m_Position, m_Taps) * 32768.0f;
+            frame[c] = static_cast<opus_int16>(std::lrint(std::max(-32768.0f, std::min(32767.0f, value))));
+        }
+        frame += m_Channels;
+        produced++;
+
+        m_Phase += m_Decimation;
+        m_Position += static_cast<size_t>(m_Phase / m_Interpolation);
+        m_Phase %= m_Interpolation;
+    }
+
+    out.resize(firstOut + produced * m_Channels);
+
+    // Keep the window start and everything after it for the next call
+    const size_t consumed = std::min(m_Position, available);
+    for(std::vector<float>& history : m_History) {
+        history.erase(history.begin(), history.begin() + consumed);
+    }
+    m_Position -= consumed;
+    return produced;
+}
@@ -0,0 +1,324 @@
+#include "ShmRing.hpp"
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <iostream>
+#include <new>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Lives at the start of the segment, shared by both processes
+struct ShmRing::Header
+{
+    static constexpr uint32_t kMagic = 0x524c4545;  // "EELR"
+    static constexpr uint32_t kVersion = 1;
+
+    std::atomic<uint32_t> magic;        // stored last by the reader once the rest is set up
+    uint32_t version;
+    uint64_t capacity;
+    std::atomic<int32_t> readerPid;
+    std::atomic<int32_t> writerPid;     // 0 = no writer attached
+    std::atomic<uint32_t> closed;       // the reader is gone, writers detach
+
+    alignas(64) std::atomic<uint64_t> head;     // written by the producer
+    alignas(64) std::atomic<uint64_t> tail;     // written by the consumer
+    alignas(64) std::atomic<uint32_t> wakeSequence;     // futex word, bumped on every wake-up
+    std::atomic<uint32_t> readerSleeping;
+};
+
+namespace {
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free,
+    "shared-memory atomics have to be lock free");
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex word has to be a plain u32");
+
+constexpr uint32_t kSkipMarker = 0xFFFFFFFFu;   // the rest of the buffer is unused, go to offset 0
+constexpr size_t kLengthSize = sizeof(uint32_t);
+
+constexpr uint64_t recordSize(size_t size)
+{
+    return (kLengthSize + size + 7) & ~uint64_t(7);
+}
+
+long futex(std::atomic<uint32_t>& word, int op, uint32_t value, const timespec* timeout)
+{
+    // Not FUTEX_PRIVATE: the word is shared with the other process
+    return ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), op, value, timeout, nullptr, 0);
+}
+
+bool processAlive(int32_t pid)
+{
+    return pid > 0 && (::kill(pid, 0) == 0 || errno == EPERM);
+}
+
+} // namespace
+
+ShmRing::~ShmRing()
+{
+    close();
+}
+
+bool ShmRing::map(int fd, size_t size)
+{
+    void* memory = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(memory == MAP_FAILED) {
+        return false;
+    }
+    m_Header = static_cast<Header*>(memory);
+    m_Data = static_cast<unsigned char*>(memory) + sizeof(Header);
+    m_MappedSize = size;
+    return true;
+}
+
+bool ShmRing::create(const std::string& name, size_t capacity)
+{
+    close();
+    size_t rounded = 4096;
+    while(rounded < capacity) {
+        rounded <<= 1;
+    }
+    const std::string segment = segmentName(name);
+    const size_t size = sizeof(Header) + rounded;
+
+    int fd = ::shm_open(segment.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if(fd < 0 && errno == EEXIST) {
+        // Replace what a reader that died left behind, never a live one's inbox
+        const int existing = ::shm_open(segment.c_str(), O_RDWR, 0);
+        struct stat info{};
+        if(existing >= 0 && ::fstat(existing, &info) == 0 && static_cast<size_t>(info.st_size) >= sizeof(Header)
+            && map(existing, sizeof(Header))) {
+            const bool inUse = m_Header->magic.load(std::memory_order_acquire) == Header::kMagic
+                && m_Header->closed.load() == 0 && processAlive(m_Header->readerPid.load());
+            ::munmap(m_Header, m_MappedSize);
+            m_Header = nullptr;
+            if(inUse) {
+                ::close(existing);
+                std::cerr << "[ShmRing] " << segment << " is the inbox of a running process." << std::endl;
+                return false;
+            }
+        }
+        if(existing >= 0) {
+            ::close(existing);
+        }
+        ::shm_unlink(segment.c_str());
+        fd = ::shm_open(segment.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    }
+    if(fd < 0) {
+        std::cerr << "[ShmRing] Failed to create " << segment << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    if(::ftruncate(fd, static_cast<off_t>(size)) != 0 || !map(fd, size)) {
+        std::cerr << "[ShmRing] Failed to size " << segment << ": " << std::strerror(errno) << std::endl;
+        ::close(fd);
+        ::shm_unlink(segment.c_str());
+        return false;
+    }
+    ::close(fd);
+
+    new (m_Header) Header();
+    m_Header->version = Header::kVersion;
+    m_Header->capacity = rounded;
+    m_Header->readerPid.store(static_cast<int32_t>(::getpid()));
+    m_Header->writerPid.store(0);
+    m_Header->closed.store(0);
+    m_Header->head.store(0);
+    m_Header->tail.store(0);
+    m_Header->wakeSequence.store(0);
+    m_Header->readerSleeping.store(0);
+    m_Header->magic.store(Header::kMagic, std::memory_order_release);
+
+    m_Mask = rounded - 1;
+    m_Position = 0;
+    b_Reader = true;
+    m_Name = segment;
+    return true;
+}
+
+bool ShmRing::attach(const std::string& name)
+{
+    close();
+    const std::string segment = segmentName(name);
+    const int fd = ::shm_open(segment.c_str(), O_RDWR, 0);
+    if(fd < 0) {
+        return false;
+    }
+    struct stat info{};
+    const bool mapped = ::fstat(fd, &info) == 0 && static_cast<size_t>(info.st_size) > sizeof(Header)
+        && map(fd, static_cast<size_t>(info.st_size));
+    ::close(fd);
+    if(!mapped) {
+        return false;
+    }
+
+    const uint64_t capacity = m_Header->capacity;
+    if(m_Header->magic.load(std::memory_order_acquire) != Header::kMagic || m_Header->version != Header::kVersion
+        || capacity == 0 || (capacity & (capacity - 1)) != 0 || sizeof(Header) + capacity != m_MappedSize
+        || !readerAlive()) {
+        close();
+        return false;
+    }
+
+    // One producer per ring: take the slot if it is free or its holder died
+    const int32_t self = static_cast<int32_t>(::getpid());
+    int32_t holder = 0;
+    while(!m_Header->writerPid.compare_exchange_strong(holder, self)) {
+        if(holder == self || processAlive(holder)) {
+            std::cerr << "[ShmRing] " << segment << " already has a writer (pid " << holder << ")." << std::endl;
+            close();
+            return false;
+        }
+    }
+
+    m_Mask = capacity - 1;
+    m_Position = m_Header->head.load(std::memory_order_acquire);
+    b_Reader = false;
+    m_Name = segment;
+    return true;
+}
+
+void ShmRing::close()
+{
+    if(!m_Header) {
+        return;
+    }
+    if(b_Reader) {
+        m_Header->closed.store(1);
+        ::shm_unlink(m_Name.c_str());
+    } else {
+        int32_t self = static_cast<int32_t>(::getpid());
+        m_Header->writerPid.compare_exchange_strong(self, 0);
+    }
+    ::munmap(m_Header, m_MappedSize);
+    m_Header = nullptr;
+    m_Data = nullptr;
+    m_MappedSize = 0;
+}
+
+unsigned char* ShmRing::reserve(size_t size)
+{
+    if(!m_Header || b_Reader || size > kMaxRecordSize) {
+        return nullptr;
+    }
+    const uint64_t capacity = m_Mask + 1;
+    const uint64_t record = recordSize(size);
+    const uint64_t tail = m_Header->tail.load(std::memory_order_acquire);
+    uint64_t offset = m_Position & m_Mask;
+    const uint64_t skip = (capacity - offset < record) ? capacity - offset : 0;
+    if(record > capacity / 2 || m_Position + skip + record - tail > capacity) {
+        return nullptr;
+    }
+    if(skip > 0) {
+        // Offsets are 8-byte aligned, so there is always room for the marker
+        std::memcpy(m_Data + offset, &kSkipMarker, kLengthSize);
+        m_Position += skip;
+        offset = 0;
+    }
+    const uint32_t length = static_cast<uint32_t>(size);
+    std::memcpy(m_Data + offset, &length, kLengthSize);
+    m_RecordEnd = m_Position + record;
+    return m_Data + offset + kLengthSize;
+}
+
+void ShmRing::commit()
+{
+    m_Header->head.store(m_RecordEnd, std::memory_order_release);
+    m_Position = m_RecordEnd;
+    wakeReader();
+}
+
+bool ShmRing::write(const void* data, size_t size)
+{
+    unsigned char* record = reserve(size);
+    if(!record) {
+        return false;
+    }
+    std::memcpy(record, data, size);
+    commit();
+    return true;
+}
+
+bool ShmRing::readerAlive() const
+{
+    return m_Header && m_Header->closed.load() == 0 && processAlive(m_Header->readerPid.load());
+}
+
+void ShmRing::wakeReader()
+{
+    // Pairs with the fence in wait(): either the reader sees the new head before it sleeps,
+    // or we see it sleeping and wake it
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(m_Header->readerSleeping.load(std::memory_order_relaxed) != 0) {
+        m_Header->wakeSequence.fetch_add(1, std::memory_order_release);
+        futex(m_Header->wakeSequence, FUTEX_WAKE, 1, nullptr);
+    }
+}
+
+const unsigned char* ShmRing::peek(size_t& size)
+{
+    if(!m_Header || !b_Reader) {
+        return nullptr;
+    }
+    const uint64_t head = m_Header->head.load(std::memory_order_acquire);
+    if(m_Position == head) {
+        return nullptr;
+    }
+    const uint64_t capacity = m_Mask + 1;
+    uint64_t offset = m_Position & m_Mask;
+    uint32_t length;
+    std::memcpy(&length, m_Data + offset, kLengthSize);
+    if(length == kSkipMarker) {
+        m_Position += capacity - offset;
+        offset = 0;
+        std::memcpy(&length, m_Data, kLengthSize);
+    }
+    const uint64_t record = recordSize(length);
+    if(length > kMaxRecordSize || offset + record > capacity || m_Position + record > head) {
+        // Only a broken writer gets here: drop everything it wrote
+        std::cerr << "[ShmRing] Corrupt record in " << m_Name << ", skipping the backlog." << std::endl;
+        m_Position = head;
+        m_Header->tail.store(head, std::memory_order_release);
+        return nullptr;
+    }
+    size = length;
+    m_RecordEnd = m_Position + record;
+    return m_Data + offset + kLengthSize;
+}
+
+void ShmRing::release()
+{
+    m_Position = m_RecordEnd;
+    m_Header->tail.store(m_Position, std::memory_order_release);
+}
+
+void ShmRing::wait(std::chrono::milliseconds timeout)
+{
+    if(!m_Header) {
+        return;
+    }
+    const uint32_t sequence = m_Header->wakeSequence.load(std::memory_order_acquire);
+    m_Header->readerSleeping.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(m_Header->head.load(std::memory_order_relaxed) == m_Position) {
+        timespec ts{};
+        ts.tv_sec = static_cast<time_t>(timeout.count() / 1000);
+        ts.tv_nsec = static_cast<long>((timeout.count() % 1000) * 1000000);
+        futex(m_Header->wakeSequence, FUTEX_WAIT, sequence, &ts);
+    }
+    m_Header->readerSleeping.store(0, std::memory_order_relaxed);
+}
+
+void ShmRing::wake()
+{
+    if(!m_Header) {
+        return;
+    }
+    m_Header->wakeSequence.fetch_add(1, std::memory_order_release);
+    futex(m_Header->wakeSequence, FUTEX_WAKE, INT_MAX, nullptr);
+}
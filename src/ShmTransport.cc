@@ -0,0 +1,145 @@
+#include "ShmTransport.hpp"
+
+#include <ctime>
+#include <iostream>
+
+namespace {
+
+int64_t realtimeNs()
+{
+    timespec ts{};
+    ::clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+} // namespace
+
+ShmTransport::ShmTransport()
+    : m_PacketsSentMetric(Metrics::instance().get("shm.packets_sent")),
+    m_BytesSentMetric(Metrics::instance().get("shm.bytes_sent")),
+    m_SendDropsMetric(Metrics::instance().get("shm.send_drops")),
+    m_PacketsReceivedMetric(Metrics::instance().get("shm.packets_received")),
+    m_BytesReceivedMetric(Metrics::instance().get("shm.bytes_received")),
+    m_WakeupsMetric(Metrics::instance().get("shm.wakeups"))
+{}
+
+ShmTransport::~ShmTransport()
+{
+    stop();
+}
+
+bool ShmTransport::init(const std::string& localName, const std::string& remoteName, size_t capacity)
+{
+    if(!m_Inbox.create(localName, capacity)) {
+        return false;
+    }
+    m_LocalName = localName;
+    m_RemoteName = remoteName;
+    a_IsRunning.store(true);
+    std::cout << "[ShmTransport] Inbox " << ShmRing::segmentName(localName) << " ready";
+    if(!remoteName.empty()) {
+        std::cout << ", sending to " << ShmRing::segmentName(remoteName);
+    }
+    std::cout << "." << std::endl;
+    return true;
+}
+
+void ShmTransport::setIncomingQueue(std::shared_ptr<ThreadSafeQueue<Datagram>> queue)
+{
+    m_IncomingQueue = std::move(queue);
+}
+
+void ShmTransport::startReceive()
+{
+    if(!a_IsRunning.load() || m_ReceiveThread.joinable()) {
+        return;
+    }
+    m_ReceiveThread = std::thread(&ShmTransport::receiveLoop, this);
+}
+
+bool ShmTransport::ensureAttached(std::chrono::steady_clock::time_point now)
+{
+    if(now < m_NextAttach) {
+        return m_Outbox.isOpen();
+    }
+    m_NextAttach = now + kAttachRetryInterval;
+    if(m_Outbox.isOpen()) {
+        if(m_Outbox.readerAlive()) {
+            return true;
+        }
+        std::cout << "[ShmTransport] " << ShmRing::segmentName(m_RemoteName) << " was closed by its reader." << std::endl;
+        m_Outbox.close();
+    }
+    if(!m_Outbox.attach(m_RemoteName)) {
+        return false;
+    }
+    std::cout << "[ShmTransport] Attached to " << ShmRing::segmentName(m_RemoteName) << "." << std::endl;
+    return true;
+}
+
+void ShmTransport::sendPacket(const NetworkPacket& packet)
+{
+    if(!a_IsRunning.load() || m_RemoteName.empty()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_SendMutex);
+    if(!ensureAttached(std::chrono::steady_clock::now()) || !m_Outbox.write(packet.data(), packet.size())) {
+        Metrics::add(m_SendDropsMetric, 1);
+        return;
+    }
+    Metrics::add(m_PacketsSentMetric, 1);
+    Metrics::add(m_BytesSentMetric, static_cast<int64_t>(packet.size()));
+}
+
+void ShmTransport::sendPacketTo(const NetworkPacket& packet, const asio::ip::udp::endpoint&)
+{
+    sendPacket(packet);
+}
+
+void ShmTransport::receiveLoop()
+{
+    std::cout << "[ShmTransport] Receive thread started." << std::endl;
+    while(a_IsRunning.load()) {
+        // Drain what is there, then sleep on the futex until the writer publishes more
+        int records = 0;
+        size_t size = 0;
+        while(records < kMaxRecordsPerWakeup) {
+            const unsigned char* record = m_Inbox.peek(size);
+            if(!record) {
+                break;
+            }
+            if(m_IncomingQueue) {
+                const char* bytes = reinterpret_cast<const char*>(record);
+                Datagram datagram{NetworkPacket(bytes, bytes + size), {}};
+                datagram.receivedNs = realtimeNs();
+                m_IncomingQueue->push(std::move(datagram));
+            }
+            m_Inbox.release();
+            Metrics::add(m_PacketsReceivedMetric, 1);
+            Metrics::add(m_BytesReceivedMetric, static_cast<int64_t>(size));
+            records++;
+        }
+        if(records > 0) {
+            Metrics::add(m_WakeupsMetric, 1);
+        }
+        if(records < kMaxRecordsPerWakeup) {
+            m_Inbox.wait(kWaitTimeout);
+        }
+    }
+    std::cout << "[ShmTransport] Receive thread stopped." << std::endl;
+}
+
+void ShmTransport::stop()
+{
+    if(!a_IsRunning.exchange(false)) {
+        return;
+    }
+    m_Inbox.wake();
+    if(m_ReceiveThread.joinable()) {
+        m_ReceiveThread.join();
+    }
+    m_Inbox.close();
+    std::lock_guard<std::mutex> lock(m_SendMutex);
+    m_Outbox.close();
+    std::cout << "[ShmTransport] Stopped." << std::endl;
+}
@@ -0,0 +1,97 @@
+#include "SpeakerSelector.hpp"
+
+#include <algorithm>
+
+SpeakerSelector::SpeakerSelector(size_t maxSpeakers, std::chrono::milliseconds timeout)
+    : m_MaxSpeakers(maxSpeakers),
+    m_Timeout(timeout),
+    m_StreamsMetric(Metrics::instance().get("speakers.streams")),
+    m_SelectedMetric(Metrics::instance().get("speakers.selected")),
+    m_SwitchesMetric(Metrics::instance().get("speakers.switches")),
+    m_FilteredMetric(Metrics::instance().get("speakers.filtered"))
+{}
+
+bool SpeakerSelector::onLevel(uint32_t ssrc, uint8_t level, Clock::time_point now)
+{
+    const double levelDb = -static_cast<double>(level);
+    auto [it, inserted] = m_Speakers.try_emplace(ssrc);
+    Speaker& speaker = it->second;
+    if(inserted) {
+        speaker.ssrc = ssrc;
+        speaker.levelDb = levelDb;
+        Metrics::set(m_StreamsMetric, static_cast<int64_t>(m_Speakers.size()));
+    } else {
+        speaker.levelDb += (levelDb > speaker.levelDb ? kAttack : kRelease) * (levelDb - speaker.levelDb);
+    }
+    speaker.lastSeen = now;
+
+    if(!speaker.selected && m_SelectedCount < m_MaxSpeakers) {
+        select(speaker, now);
+        Metrics::set(m_SelectedMetric, static_cast<int64_t>(m_SelectedCount));
+    }
+    if(!speaker.selected) {
+        Metrics::add(m_FilteredMetric, 1);
+    }
+    return speaker.selected;
+}
+
+void SpeakerSelector::update(Clock::time_point now)
+{
+    if(now < m_NextReselect) {
+        return;
+    }
+    m_NextReselect = now + kReselectInterval;
+
+    m_Candidates.clear();
+    m_Holders.clear();
+    for(auto it = m_Speakers.begin(); it != m_Speakers.end();) {
+        Speaker& speaker = it->second;
+        if(now - speaker.lastSeen >= m_Timeout) {
+            if(speaker.selected) {
+                deselect(speaker);
+            }
+            it = m_Speakers.erase(it);
+            continue;
+        }
+        if(!speaker.selected) {
+            m_Candidates.push_back(&speaker);
+        } else if(now - speaker.selectedSince >= kMinHold) {
+            m_Holders.push_back(&speaker);
+        }
+        ++it;
+    }
+
+    // Loudest candidates first: into the free slots, then against the quietest holders
+    std::sort(m_Candidates.begin(), m_Candidates.end(),
+        [](const Speaker* a, const Speaker* b) { return a->levelDb > b->levelDb; });
+    size_t next = 0;
+    while(m_SelectedCount < m_MaxSpeakers && next < m_Candidates.size()) {
+        select(*m_Candidates[next++], now);
+    }
+    std::sort(m_Holders.begin(), m_Holders.end(),
+        [](const Speaker* a, const Speaker* b) { return a->levelDb < b->levelDb; });
+    for(Speaker* holder : m_Holders) {
+        if(next == m_Candidates.size() || m_Candidates[next]->levelDb < holder->levelDb + kHysteresisDb) {
+            break;
+        }
+        deselect(*holder);
+        select(*m_Candidates[next++], now);
+        Metrics::add(m_SwitchesMetric, 1);
+    }
+
+    Metrics::set(m_StreamsMetric, static_cast<int64_t>(m_Speakers.size()));
+    Metrics::set(m_SelectedMetric, static_cast<int64_t>(m_SelectedCount));
+}
+
+void SpeakerSelector::select(Speaker& speaker, Clock::time_point now)
+{
+    speaker.selected = true;
+    speaker.selectedSince = now;
+    m_SelectedCount++;
+}
+
+void SpeakerSelector::deselect(Speaker& speaker)
+{
+    speaker.selected = false;
+    m_SelectedCount--;
+}
@@ -0,0 +1,61 @@
+#include "StreamDirectory.hpp"
+
+#include <algorithm>
+
+StreamDirectory::StreamDirectory(size_t maxStreams)
+    : m_Table(std::min(std::max<size_t>(maxStreams, 1), kMaxStreams)),
+    m_Slots(m_Table.maxEntries())
+{
+    // Hand out low indices first, so per-stream arrays indexed by id stay small
+    m_FreeSlots.reserve(m_Slots.size());
+    for(size_t i = m_Slots.size(); i > 0; i--) {
+        m_FreeSlots.push_back(static_cast<uint32_t>(i - 1));
+    }
+}
+
+StreamId StreamDirectory::resolve(const PeerKey& key, Clock::time_point now)
+{
+    StreamId id = m_Table.find(key);
+    if(id != PeerTable::kNotFound) {
+        m_Slots[indexOf(id)].lastSeen = now;
+        return id;
+    }
+    if(m_FreeSlots.empty()) {
+        return kNoStreamId;
+    }
+
+    const uint32_t index = m_FreeSlots.back();
+    m_FreeSlots.pop_back();
+    Slot& slot = m_Slots[index];
+    slot.generation = (slot.generation + 1) & (0xFFFFFFFFu >> kIndexBits);
+    slot.id = (slot.generation << kIndexBits) | index;
+    slot.key = key;
+    slot.lastSeen = now;
+    m_Table.insert(key, slot.id);
+    return slot.id;
+}
+
+bool StreamDirectory::release(StreamId id)
+{
+    const uint32_t index = indexOf(id);
+    if(id == kNoStreamId || index >= m_Slots.size() || m_Slots[index].id != id) {
+        return false;
+    }
+    Slot& slot = m_Slots[index];
+    m_Table.erase(slot.key);
+    slot.id = kNoStreamId;
+    m_FreeSlots.push_back(index);
+    return true;
+}
+
+size_t StreamDirectory::expire(Clock::time_point cutoff)
+{
+    size_t released = 0;
+    for(Slot& slot : m_Slots) {
+        if(slot.id != kNoStreamId && slot.lastSeen < cutoff) {
+            release(slot.id);
+            released++;
+        }
+    }
+    return released;
+}
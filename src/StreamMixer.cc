@@ -0,0 +1,95 @@
+#include "StreamMixer.hpp"
+
+#include <algorithm>
+#include <limits>
+
+StreamMixer::StreamMixer()
+    : m_StreamsMetric(Metrics::instance().get("mix.streams"))
+{}
+
+void StreamMixer::queue(StreamId stream, AudioFrame&& frame)
+{
+    auto it = std::find_if(m_Streams.begin(), m_Streams.end(), [stream](const Stream& s) { return s.id == stream; });
+    if(it == m_Streams.end()) {
+        m_Streams.emplace_back();
+        it = m_Streams.end() - 1;
+        it->id = stream;
+        Metrics::set(m_StreamsMetric, static_cast<int64_t>(m_Streams.size()));
+    }
+    it->frames.push_back(std::move(frame));
+}
+
+size_t StreamMixer::queuedFrames(StreamId stream) const
+{
+    for(const Stream& s : m_Streams) {
+        if(s.id == stream) {
+            return s.frames.size();
+        }
+    }
+    return 0;
+}
+
+bool StreamMixer::due() const
+{
+    bool everyStream = !m_Streams.empty();
+    for(const Stream& stream : m_Streams) {
+        if(stream.frames.size() > kJitterFrames) {
+            return true;
+        }
+        everyStream = everyStream && !stream.frames.empty();
+    }
+    return everyStream;
+}
+
+void StreamMixer::mix(AudioFrame& out)
+{
+    size_t contributions = 0;
+    size_t length = 0;
+    for(const Stream& stream : m_Streams) {
+        if(!stream.frames.empty()) {
+            contributions++;
+            length = std::max(length, stream.frames.front().size());
+        }
+    }
+    if(contributions > 1) {
+        m_Sum.assign(length, 0);
+    }
+
+    out.traceId = -1;
+    const size_t streams = m_Streams.size();
+    for(auto it = m_Streams.begin(); it != m_Streams.end();) {
+        if(it->frames.empty()) {
+            if(++it->missed >= kMaxMissedMixes) {
+                it = m_Streams.erase(it);
+                continue;
+            }
+            ++it;
+            continue;
+        }
+        it->missed = 0;
+        AudioFrame& frame = it->frames.front();
+        if(contributions == 1) {
+            out = std::move(frame);     // nothing to add, keeps its traceId
+        } else {
+            for(size_t i = 0; i < frame.size(); i++) {
+                m_Sum[i] += frame[i];
+            }
+            if(out.traceId < 0) {
+                out.traceId = frame.traceId;
+            }
+        }
+        it->frames.pop_front();
+        ++it;
+    }
+    if(m_Streams.size() != streams) {
+        Metrics::set(m_StreamsMetric, static_cast<int64_t>(m_Streams.size()));
+    }
+
+    if(contributions > 1) {
+        out.resize(length);
+        for(size_t i = 0; i < length; i++) {
+            out[i] = static_cast<opus_int16>(std::min<int32_t>(std::numeric_limits<opus_int16>::max(),
+                std::max<int32_t>(std::numeric_limits<opus_int16>::min(), m_Sum[i])));
+        }
+    }
+}
@@ -0,0 +1,209 @@
+#include "TimeStretcher.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+
+constexpr int kMinPeriodUs = 2500;          // 400 Hz
+constexpr int kMaxPeriodUs = 10000;         // 100 Hz
+constexpr int kCoarseRate = 8000;
+constexpr float kMinCorrelation = 0.8f;     // below this the splice would be audible
+constexpr float kQuietRms = 0.0018f;        // -55 dBFS, anything splices cleanly
+
+// Normalized cross-correlation of a[0, n) and b[0, n)
+float correlation(const float* a, const float* b, int n)
+{
+    float ab = 0.0f, aa = 0.0f, bb = 0.0f;
+    for(int i = 0; i < n; i++) {
+        ab += a[i] * b[i];
+        aa += a[i] * a[i];
+        bb += b[i] * b[i];
+    }
+    return ab / std::sqrt(aa * bb + 1e-12f);
+}
+
+} // namespace
+
+TimeStretcher::TimeStretcher(int sampleRate, int channels)
+    : m_Channels(channels),
+    m_MinPeriod(static_cast<int>(static_cast<long>(sampleRate) * kMinPeriodUs / 1000000)),
+    m_MaxPeriod(static_cast<int>(static_cast<long>(sampleRate) * kMaxPeriodUs / 1000000)),
+    m_Decimation(std::max(1, sampleRate / kCoarseRate))
+{
+}
+
+long TimeStretcher::process(const opus_int16* in, size_t frames, Mode mode, AudioFrame& out)
+{
+    m_Pending.insert(m_Pending.end(), in, in + frames * m_Channels);
+    const int pending = static_cast<int>(pendingFrames());
+
+    if(mode == Mode::Compress) {
+        // Hold back until a full pitch range fits, then splice at the start of the pending audio
+        if(pending < 2 * m_MaxPeriod) {
+            return 0;
+        }
+        m_Mono.resize(2 * m_MaxPeriod);
+        for(int n = 0; n < 2 * m_MaxPeriod; n++) {
+            float sum = 0.0f;
+            for(int c = 0; c < m_Channels; c++) {
+                sum += m_Pending[n * m_Channels + c];
+            }
+            m_Mono[n] = sum / (32768.0f * m_Channels);
+        }
+        const int period = findPeriod(m_Mono, m_MaxPeriod, false);
+        if(period == 0) {
+            flush(out);
+            return 0;
+        }
+
+        // x[0, 2T) becomes one period fading from the first into the second, x[2T, ...) follows
+        AudioFrame spliced;
+        spliced.reserve(m_Pending.size() - period * m_Channels);
+        appendCrossFade(m_Pending.data(), m_Pending.data() + period * m_Channels, period, spliced);
+        spliced.insert(spliced.end(), m_Pending.begin() + 2 * period * m_Channels, m_Pending.end());
+        m_Pending.clear();
+        emit(spliced.data(), spliced.size() / m_Channels, out);
+        return -period;
+    }
+
+    if(mode == Mode::Expand) {
+        // The newest period has to be pending (it is handed out again after the inserted one),
+        // the one before it may already have been played
+        const int history = static_cast<int>(m_History.size() / m_Channels);
+        const int maxPeriod = std::min(m_MaxPeriod, std::min(pending, (history + pending) / 2));
+        if(maxPeriod >= m_MinPeriod) {
+            const int length = 2 * maxPeriod;
+            m_Mono.resize(length);
+            for(int n = 0; n < length; n++) {
+                // Index into history + pending, counted from the end
+                const int index = history + pending - length + n;
+                const opus_int16* frame = (index < history) ? &m_History[index * m_Channels]
+                    : &m_Pending[(index - history) * m_Channels];
+                float sum = 0.0f;
+                for(int c = 0; c < m_Channels; c++) {
+                    sum += frame[c];
+                }
+                m_Mono[n] = sum / (32768.0f * m_Channels);
+            }
+            const int period = findPeriod(m_Mono, maxPeriod, true);
+            if(period > 0) {
+                // x[.., L - T), then the newest period fading into the one before it, then the
+                // newest period again: playback continues from where it would have anyway
+                AudioFrame context(2 * period * m_Channels);
+                for(int n = 0; n < 2 * period; n++) {
+                    const int index = history + pending - 2 * period + n;
+                    const opus_int16* frame = (index < history) ? &m_History[index * m_Channels]
+                        : &m_Pending[(index - history) * m_Channels];
+                    std::copy(frame, frame + m_Channels, context.begin() + n * m_Channels);
+                }
+                AudioFrame stretched(m_Pending.begin(), m_Pending.end() - period * m_Channels);
+                appendCrossFade(context.data() + period * m_Channels, context.data(), period, stretched);
+                stretched.insert(stretched.end(), m_Pending.end() - period * m_Channels, m_Pending.end());
+                m_Pending.clear();
+                emit(stretched.data(), stretched.size() / m_Channels, out);
+                return period;
+            }
+        }
+    }
+
+    flush(out);
+    return 0;
+}
+
+void TimeStretcher::flush(AudioFrame& out)
+{
+    if(m_Pending.empty()) {
+        return;
+    }
+    AudioFrame pending;
+    pending.swap(m_Pending);
+    emit(pending.data(), pending.size() / m_Channels, out);
+}
+
+int TimeStretcher::findPeriod(const std::vector<float>& mono, int maxPeriod, bool endAligned)
+{
+    const int length = static_cast<int>(mono.size());
+    float energy = 0.0f;
+    for(float sample : mono) {
+        energy += sample * sample;
+    }
+    if(std::sqrt(energy / length) < kQuietRms) {
+        return maxPeriod;
+    }
+
+    // Coarse search on a box-filtered, decimated copy
+    const int coarseLength = length / m_Decimation;
+    m_Coarse.resize(coarseLength);
+    for(int n = 0; n < coarseLength; n++) {
+        float sum = 0.0f;
+        for(int k = 0; k < m_Decimation; k++) {
+            sum += mono[n * m_Decimation + k];
+        }
+        m_Coarse[n] = sum;
+    }
+    const int coarseMin = std::max(1, (m_MinPeriod + m_Decimation - 1) / m_Decimation);
+    const int coarseMax = maxPeriod / m_Decimation;
+    int coarseBest = 0;
+    float coarseScore = -1.0f;
+    for(int lag = coarseMin; lag <= coarseMax; lag++) {
+        const float* first = m_Coarse.data() + (endAligned ? coarseLength - 2 * lag : 0);
+        const float score = correlation(first, first + lag, lag);
+        if(score > coarseScore) {
+            coarseScore = score;
+            coarseBest = lag;
+        }
+    }
+    if(coarseBest == 0) {
+        return 0;
+    }
+
+    // Refine around it at full rate
+    int best = 0;
+    float bestScore = -1.0f;
+    const int from = std::max(m_MinPeriod, (coarseBest - 1) * m_Decimation);
+    const int to = std::min(maxPeriod, (coarseBest + 1) * m_Decimation);
+    for(int period = from; period <= to; period++) {
+        const float* first = mono.data() + (endAligned ? length - 2 * period : 0);
+        const float score = correlation(first, first + period, period);
+        if(score > bestScore) {
+            bestScore = score;
+            best = period;
+        }
+    }
+    return (bestScore >= kMinCorrelation) ? best : 0;
+}
+
+void TimeStretcher::appendCrossFade(const opus_int16* fadeOut, const opus_int16* fadeIn, int period,
+    AudioFrame& out) const
+{
+    const size_t begin = out.size();
+    out.resize(begin + static_cast<size_t>(period) * m_Channels);
+    for(int n = 0; n < period; n++) {
+        // Raised cosine, the two gains sum to 1
+        const float in = static_cast<float>(0.5 - 0.5 * std::cos(kPi * (n + 0.5) / period));
+        for(int c = 0; c < m_Channels; c++) {
+            const size_t i = static_cast<size_t>(n) * m_Channels + c;
+            out[begin + i] = static_cast<opus_int16>(std::lrint((1.0f - in) * fadeOut[i] + in * fadeIn[i]));
+        }
+    }
+}
+
+void TimeStretcher::emit(const opus_int16* data, size_t frames, AudioFrame& out)
+{
+    out.insert(out.end(), data, data + frames * m_Channels);
+
+    // Keep the newest m_MaxPeriod sample frames for the next expansion
+    const size_t keep = static_cast<size_t>(m_MaxPeriod) * m_Channels;
+    const size_t count = frames * m_Channels;
+    if(count >= keep) {
+        m_History.assign(data + count - keep, data + count);
+    } else {
+        m_History.insert(m_History.end(), data, data + count);
+        if(m_History.size() > keep) {
+            m_History.erase(m_History.begin(), m_History.end() - keep);
+        }
+    }
+}
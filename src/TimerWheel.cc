@@ -0,0 +1,79 @@
+#include "TimerWheel.hpp"
+
+#include <algorithm>
+
+TimerWheel::TimerWheel(std::chrono::milliseconds tick, size_t slots, Clock::time_point origin)
+    : m_Tick(std::max(tick, std::chrono::milliseconds(1))), m_Origin(origin)
+{
+    size_t size = 1;
+    while(size < std::max<size_t>(slots, 2)) {
+        size <<= 1;
+    }
+    m_SlotMask = size - 1;
+    m_Slots.assign(size, kNone);
+}
+
+void TimerWheel::schedule(TimerId id, Clock::time_point now, std::chrono::milliseconds delay)
+{
+    if(id >= m_Nodes.size()) {
+        m_Nodes.resize(static_cast<size_t>(id) + 1);
+    }
+    if(m_Nodes[id].armed) {
+        unlink(id);
+    }
+
+    // Round up so a timer never fires early, and never into a tick that was already processed
+    const uint64_t delayTicks = static_cast<uint64_t>((delay.count() + m_Tick.count() - 1) / m_Tick.count());
+    m_Nodes[id].expiryTick = std::max(tickAt(now) + std::max<uint64_t>(delayTicks, 1), m_CurrentTick + 1);
+    link(id);
+}
+
+void TimerWheel::cancel(TimerId id)
+{
+    if(id < m_Nodes.size() && m_Nodes[id].armed) {
+        unlink(id);
+    }
+}
+
+bool TimerWheel::isScheduled(TimerId id) const
+{
+    return id < m_Nodes.size() && m_Nodes[id].armed;
+}
+
+uint64_t TimerWheel::tickAt(Clock::time_point time) const
+{
+    if(time <= m_Origin) {
+        return 0;
+    }
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(time - m_Origin) / m_Tick);
+}
+
+void TimerWheel::link(TimerId id)
+{
+    Node& node = m_Nodes[id];
+    size_t slot = slotOf(node.expiryTick);
+    node.prev = kNone;
+    node.next = m_Slots[slot];
+    if(node.next != kNone) {
+        m_Nodes[node.next].prev = id;
+    }
+    m_Slots[slot] = id;
+    node.armed = true;
+    m_Pending++;
+}
+
+void TimerWheel::unlink(TimerId id)
+{
+    Node& node = m_Nodes[id];
+    if(node.prev != kNone) {
+        m_Nodes[node.prev].next = node.next;
+    } else {
+        m_Slots[slotOf(node.expiryTick)] = node.next;
+    }
+    if(node.next != kNone) {
+        m_Nodes[node.next].prev = node.prev;
+    }
+    node.prev = node.next = kNone;
+    node.armed = false;
+    m_Pending--;
+}
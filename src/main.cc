@@ -1,60 +1,327 @@
 #include "Application.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
 #include <string>
 
 int main(int argc, char* argv[]) {
-    // Usage: ./ech-link <mode> <frame_size_samples> [local_port] [remote_ip] [remote_port]
-    // Mode options: --loopback (local mic test), --network (P2P network chat)
+    // Usage: ./ech-link <mode> <mode arguments...> [options]
+    // Mode options: --loopback (local mic test), --network (P2P network chat),
+    //               --server (headless echo server), --bridge (conference bridge),
+    //               --record (mic to file),
+    //               --replay (packet trace to speaker)
+
+    ApplicationConfig config;
+    config.encodeBudgetShare = 0.5;
+    std::string pipelineOverride;
+    bool echoCancellation = false;
+
+    // Named options can appear anywhere after the mode; strip them so the positional parsing below stays simple
+    int positionalArgs = 0;
+    for (int i = 0; i < argc; i++) {
+        if (std::strcmp(argv[i], "--encode-budget") == 0 && i + 1 < argc) {
+            config.encodeBudgetShare = std::atof(argv[++i]);
+            continue;
+        }
+        if (std::strcmp(argv[i], "--pipeline") == 0 && i + 1 < argc) {
+            pipelineOverride = argv[++i];
+            continue;
+        }
+        if (std::strcmp(argv[i], "--peer-idle-ms") == 0 && i + 1 < argc) {
+            config.peerIdleTimeoutMs = std::atoi(argv[++i]);
+            continue;
+        }
+        if (std::strcmp(argv[i], "--peer-expiry-ms") == 0 && i + 1 < argc) {
+            config.peerExpiryTimeoutMs = std::atoi(argv[++i]);
+            continue;
+        }
+        if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            config.tracePath = argv[++i];
+            continue;
+        }
+        if (std::strcmp(argv[i], "--rcvbuf") == 0 && i + 1 < argc) {
+            config.socketOptions.receiveBufferBytes = std::atoi(argv[++i]);
+            continue;
+        }
+        if (std::strcmp(argv[i], "--sndbuf") == 0 && i + 1 < argc) {
+            config.socketOptions.sendBufferBytes = std::atoi(argv[++i]);
+            continue;
+        }
+        if (std::strcmp(argv[i], "--dscp") == 0 && i + 1 < argc) {
+            config.socketOptions.dscp = std::atoi(argv[++i]);
+            continue;
+        }
+        if (std::strcmp(argv[i], "--busy-poll-us") == 0 && i + 1 < argc) {
+            config.socketOptions.busyPollUs = std::atoi(argv[++i]);
+            continue;
+        }
+        if (std::strcmp(argv[i], "--no-kernel-timestamps") == 0) {
+            config.socketOptions.kernelTimestamps = false;
+            continue;
+        }
+        if (std::strcmp(argv[i], "--replay-fast") == 0) {
+            config.replayRealtime = false;
+            continue;
+        }
+        if (std::strcmp(argv[i], "--frame-trace") == 0 && i + 1 < argc) {
+            config.frameTracePath = argv[++i];
+            continue;
+        }
+        if (std::strcmp(argv[i], "--perf-counters") == 0) {
+            config.perfCounters = true;
+            continue;
+        }
+        if (std::strcmp(argv[i], "--aec") == 0) {
+            echoCancellation = true;
+            continue;
+        }
+        if (std::strcmp(argv[i], "--aec-tail-ms") == 0 && i + 1 < argc) {
+            config.echoTailMs = std::atoi(argv[++i]);
+            continue;
+        }
+        if (std::strcmp(argv[i], "--stretch") == 0) {
+            config.timeStretch = true;
+            continue;
+        }
+        if (std::strcmp(argv[i], "--stretch-target-ms") == 0 && i + 1 < argc) {
+            config.timeStretch = true;
+            config.stretchTargetMs = std::atoi(argv[++i]);
+            continue;
+        }
+        if (std::strcmp(argv[i], "--dsp") == 0 && i + 1 < argc) {
+            if (!DspConfig::parse(argv[++i], config.dsp)) {
+                std::cerr << "Error: invalid --dsp '" << argv[i] << "' (e.g. all, or dc,gate=-50,agc=-20,limiter=-1)." << std::endl;
+                return 1;
+            }
+            continue;
+        }
+        if (std::strcmp(argv[i], "--redundancy") == 0 && i + 1 < argc) {
+            if (!RedundancyConfig::parse(argv[++i], config.redundancy)) {
+                std::cerr << "Error: invalid --redundancy '" << argv[i] << "' (off, 1-" << RedundancyConfig::kMaxDepth
+                    << ", auto or auto=<max>)." << std::endl;
+                return 1;
+            }
+            continue;
+        }
+        if (std::strcmp(argv[i], "--shm") == 0 && i + 2 < argc) {
+            config.shmLocal = argv[++i];
+            config.shmRemote = argv[++i];
+            if (config.shmRemote == "-") {
+                config.shmRemote.clear();
+            }
+            continue;
+        }
+        if (std::strcmp(argv[i], "--trunk") == 0 && i + 1 < argc) {
+            asio::ip::udp::endpoint endpoint;
+            if (!BridgeConfig::parseTrunk(argv[++i], endpoint)) {
+                std::cerr << "Error: invalid --trunk '" << argv[i] << "' (ip:port)." << std::endl;
+                return 1;
+            }
+            config.bridge.trunks.push_back(argv[i]);
+            continue;
+        }
+        if (std::strcmp(argv[i], "--trunk-mesh") == 0) {
+            config.bridge.mesh = true;
+            continue;
+        }
+        if (std::strcmp(argv[i], "--trunk-flush-ms") == 0 && i + 1 < argc) {
+            config.bridge.flushMs = std::atoi(argv[++i]);
+            continue;
+        }
+        if (std::strcmp(argv[i], "--speakers") == 0 && i + 1 < argc) {
+            config.bridge.maxSpeakers = static_cast<size_t>(std::max(0, std::atoi(argv[++i])));
+            continue;
+        }
+        if (std::strcmp(argv[i], "--psk") == 0 && i + 1 < argc) {
+            config.mediaSecret = argv[++i];
+            continue;
+        }
+        if (std::strcmp(argv[i], "--psk-file") == 0 && i + 1 < argc) {
+            // First line of the file, so the secret stays out of the process list
+            std::ifstream file(argv[++i]);
+            if (!file || !std::getline(file, config.mediaSecret) || config.mediaSecret.empty()) {
+                std::cerr << "Error: could not read a secret from --psk-file '" << argv[i] << "'." << std::endl;
+                return 1;
+            }
+            continue;
+        }
+        if (std::strcmp(argv[i], "--device-rate") == 0 && i + 1 < argc) {
+            config.deviceSampleRate = std::atoi(argv[++i]);
+            continue;
+        }
+        if (std::strcmp(argv[i], "--resample-quality") == 0 && i + 1 < argc) {
+            if (!Resampler::parseQuality(argv[++i], config.resampleQuality)) {
+                std::cerr << "Error: unknown resample quality '" << argv[i] << "' (fast, balanced, high)." << std::endl;
+                return 1;
+            }
+            continue;
+        }
+        if (std::strcmp(argv[i], "--duration") == 0 && i + 1 < argc) {
+            config.durationSeconds = std::stoi(argv[++i]);
+            continue;
+        }
+        if (std::strcmp(argv[i], "--source") == 0 && i + 1 < argc) {
+            config.audioSource = argv[++i];
+            continue;
+        }
+        if (std::strcmp(argv[i], "--sink") == 0 && i + 1 < argc) {
+            config.audioSink = argv[++i];
+            continue;
+        }
+        argv[positionalArgs++] = argv[i];
+    }
+    argc = positionalArgs;
 
     if (argc < 3) {
-        std::cerr << "Usage for Live Mic Loopback: " << argv[0] << " --loopback <frame_size_samples>" << std::endl;
-        std::cerr << "Usage for Network Chat: " << argv[0] << " --network <local_port> <remote_ip> <remote_port> <frame_size_samples>" << std::endl;
+        std::cerr << "Usage for Live Mic Loopback: " << argv[0] << " --loopback <frame_size_samples> [frames_per_packet]" << std::endl;
+        std::cerr << "Usage for Network Chat: " << argv[0] << " --network <local_port> <remote_ip> <remote_port> <frame_size_samples> [frames_per_packet]" << std::endl;
         std::cerr << "       (For network, microphone is always used. Specify 'self' for remote_ip to test self-connection)" << std::endl;
+        std::cerr << "Usage for Echo Server: " << argv[0] << " --server <local_port>" << std::endl;
+        std::cerr << "Usage for Conference Bridge: " << argv[0] << " --bridge <local_port>" << std::endl;
+        std::cerr << "Usage for Recording: " << argv[0] << " --record <output_file> <frame_size_samples> [frames_per_packet]" << std::endl;
+        std::cerr << "Usage for Trace Replay: " << argv[0] << " --replay <trace_file> <frame_size_samples>" << std::endl;
+        std::cerr << "       frames_per_packet (1-6, default 1) bundles several encoded frames into one datagram" << std::endl;
+        std::cerr << "Options:" << std::endl;
+        std::cerr << "  --encode-budget <share>  Max share of the frame period spent encoding, complexity adapts to it (default 0.5, 0 = fixed)" << std::endl;
+        std::cerr << "  --pipeline <topology>    Replace the mode's stage graph: a built-in name (loopback, p2p, p2p-aec, record, server, relay, bridge, replay)" << std::endl;
+        std::cerr << "                           or a description like \"capture > encode > record > send; receive > decode > playback\"" << std::endl;
+        std::cerr << "  --source <backend>       Audio input: portaudio (default), null, file:<raw_pcm_path>, alsa[:<device>], probe[:chirp|mls]" << std::endl;
+        std::cerr << "  --sink <backend>         Audio output: portaudio (default), null, file:<raw_pcm_path>, alsa[:<device>], probe[:chirp|mls]" << std::endl;
+        std::cerr << "  --aec                    Cancel the far end's echo from the microphone (network mode, topology p2p-aec)" << std::endl;
+        std::cerr << "  --aec-tail-ms <ms>       Longest echo delay the canceller models, playback buffering included (default 200)" << std::endl;
+        std::cerr << "  --stretch                Speed up/slow down playout a few percent to keep the playback queue near its target" << std::endl;
+        std::cerr << "  --stretch-target-ms <ms> Audio to keep queued for playback with --stretch (default 20)" << std::endl;
+        std::cerr << "  --dsp <processors>       Process the captured stream before encoding: all, or any of dc, gate[=dBFS], agc[=dBFS], limiter[=dBFS]" << std::endl;
+        std::cerr << "  --redundancy <depth>     Repeat the last 1-7 payloads in every datagram, or auto[=max]: as many as the receiver's loss bursts need (default max 3)" << std::endl;
+        std::cerr << "  --shm <local> <remote>   Talk to a process on this host through shared memory instead of UDP: read inbox <local>," << std::endl;
+        std::cerr << "                           write to inbox <remote> ('-' = receive only); ports and addresses are ignored" << std::endl;
+        std::cerr << "  --trunk <ip:port>        Bridge mode: link up with the bridge at this address, repeatable" << std::endl;
+        std::cerr << "  --trunk-mesh             Bridge mode: every bridge trunks to every other, don't pass streams between trunks" << std::endl;
+        std::cerr << "  --trunk-flush-ms <ms>    Bridge mode: longest a stream waits to share a trunk datagram with others (default 5)" << std::endl;
+        std::cerr << "  --speakers <n>           Bridge mode: forward only the n loudest streams, by the level senders put in every header" << std::endl;
+        std::cerr << "  --psk <secret>           Encrypt and authenticate the audio (AES-128-GCM) with a key derived from this secret" << std::endl;
+        std::cerr << "  --psk-file <path>        Same, secret read from the first line of a file" << std::endl;
+        std::cerr << "  --device-rate <hz>       Run the audio devices at this rate and resample to/from the 48 kHz codec (e.g. 44100)" << std::endl;
+        std::cerr << "  --resample-quality <q>   fast, balanced (default) or high: longer filters, less aliasing, more delay" << std::endl;
+        std::cerr << "  --peer-idle-ms <ms>      Received stream silent this long is marked idle, decoder reset (default 2000)" << std::endl;
+        std::cerr << "  --peer-expiry-ms <ms>    Received stream silent this long is evicted, its state pooled (default 30000)" << std::endl;
+        std::cerr << "  --rcvbuf <bytes>         Socket receive buffer (default 4 MiB, 0 = system default)" << std::endl;
+        std::cerr << "  --sndbuf <bytes>         Socket send buffer (default 1 MiB, 0 = system default)" << std::endl;
+        std::cerr << "  --dscp <0-63>            Mark sent packets with this DSCP code point (46 = EF for voice)" << std::endl;
+        std::cerr << "  --busy-poll-us <us>      Busy-poll the socket this long before sleeping (SO_BUSY_POLL)" << std::endl;
+        std::cerr << "  --no-kernel-timestamps   Timestamp received packets in user space instead of the kernel" << std::endl;
+        std::cerr << "  --trace <file>           Record every received datagram with its kernel timestamp and sender to a packet trace" << std::endl;
+        std::cerr << "  --replay-fast            Replay a packet trace as fast as possible instead of at its recorded timing" << std::endl;
+        std::cerr << "  --duration <seconds>     Stop after this long instead of waiting for 'exit'" << std::endl;
+        std::cerr << "  --perf-counters          Count cycles, instructions, cache misses and context switches per stage (perf_event_open)" << std::endl;
+        std::cerr << "  --frame-trace <file>     Write a per-frame timeline of callbacks, queues, codec and network (Chrome trace JSON)" << std::endl;
         std::cerr << "Examples:" << std::endl;
         std::cerr << "  Live mic loopback:   " << argv[0] << " --loopback 480" << std::endl;
         std::cerr << "  Network client 1:    " << argv[0] << " --network 12345 127.0.0.1 54321 480" << std::endl;
         std::cerr << "  Network client 2:    " << argv[0] << " --network 54321 127.0.0.1 12345 480" << std::endl;
+        std::cerr << "  40 ms packets:       " << argv[0] << " --network 12345 127.0.0.1 54321 480 4" << std::endl;
+        std::cerr << "  With speakers:       " << argv[0] << " --network 12345 127.0.0.1 54321 480 --aec" << std::endl;
+        std::cerr << "  Bursty links:        " << argv[0] << " --network 12345 127.0.0.1 54321 480 --redundancy auto" << std::endl;
+        std::cerr << "  Levelled mic:        " << argv[0] << " --network 12345 127.0.0.1 54321 480 --dsp all" << std::endl;
+        std::cerr << "  44.1 kHz devices:    " << argv[0] << " --loopback 480 --device-rate 44100" << std::endl;
+        std::cerr << "  Echo server:         " << argv[0] << " --server 12345" << std::endl;
+        std::cerr << "  Bridge node 1:       " << argv[0] << " --bridge 40001" << std::endl;
+        std::cerr << "  Bridge node 2:       " << argv[0] << " --bridge 40002 --trunk 127.0.0.1:40001" << std::endl;
+        std::cerr << "  Large room:          " << argv[0] << " --bridge 40001 --speakers 3" << std::endl;
+        std::cerr << "  Same-host client:    " << argv[0] << " --network 0 127.0.0.1 0 480 --shm client server" << std::endl;
+        std::cerr << "  Same-host server:    " << argv[0] << " --server 0 --shm server client" << std::endl;
+        std::cerr << "  Encrypted server:    " << argv[0] << " --server 12345 --psk-file echo-link.psk" << std::endl;
+        std::cerr << "  Headless loopback:   " << argv[0] << " --loopback 480 --source file:speech.raw --sink null" << std::endl;
+        std::cerr << "  Measure latency:     " << argv[0] << " --loopback 480 --source probe --sink probe --duration 20" << std::endl;
+        std::cerr << "  Traced server:       " << argv[0] << " --server 12345 --trace server.eltr" << std::endl;
+        std::cerr << "  Replay a trace:      " << argv[0] << " --replay server.eltr 480 --sink file:out.raw" << std::endl;
         return 1;
     }
 
     std::string mode = argv[1];
-    bool enableNetworking = false;
-    int frameSize = 0;
-    unsigned short localPort = 0;
-    std::string remoteIp = "";
-    unsigned short remotePort = 0;
-
-    // Common audio parameters (Opus preferred)
-    const int sampleRate = 48000;
-    const int channels = 2; // Stereo
 
     try {
         if (mode == "--loopback") {
-            if (argc != 3) { // Expecting mode and frame_size
+            if (argc != 3 && argc != 4) { // Expecting mode, frame_size and optional frames_per_packet
                 std::cerr << "Error: Incorrect arguments for loopback mode." << std::endl;
                 return 1;
             }
-            frameSize = std::stoi(argv[2]);
-            enableNetworking = false; // No networking in loopback mode
+            config.topology = "loopback"; // No networking in loopback mode
+            config.frameSize = std::stoi(argv[2]);
+            if (argc == 4) {
+                config.framesPerPacket = std::stoi(argv[3]);
+            }
             std::cout << "Running in LOCAL MIC LOOPBACK mode." << std::endl;
         } else if (mode == "--network") {
-            if (argc != 6) { // Expecting mode, local_port, remote_ip, remote_port, frame_size
+            if (argc != 6 && argc != 7) { // Expecting mode, local_port, remote_ip, remote_port, frame_size, [frames_per_packet]
                 std::cerr << "Error: Incorrect arguments for network mode." << std::endl;
                 return 1;
             }
-            enableNetworking = true;
-            localPort = std::stoi(argv[2]);
-            remoteIp = argv[3];
-            remotePort = std::stoi(argv[4]);
-            frameSize = std::stoi(argv[5]);
+            config.topology = "p2p";
+            config.localPort = std::stoi(argv[2]);
+            config.remoteIp = argv[3];
+            config.remotePort = std::stoi(argv[4]);
+            config.frameSize = std::stoi(argv[5]);
+            if (argc == 7) {
+                config.framesPerPacket = std::stoi(argv[6]);
+            }
             std::cout << "Running in NETWORK CHAT mode." << std::endl;
+        } else if (mode == "--server") {
+            if (argc != 3) { // Expecting mode and local_port
+                std::cerr << "Error: Incorrect arguments for server mode." << std::endl;
+                return 1;
+            }
+            config.topology = "server";
+            config.localPort = std::stoi(argv[2]);
+            std::cout << "Running in ECHO SERVER mode." << std::endl;
+        } else if (mode == "--bridge") {
+            if (argc != 3) { // Expecting mode and local_port
+                std::cerr << "Error: Incorrect arguments for bridge mode." << std::endl;
+                return 1;
+            }
+            config.topology = "bridge";
+            config.localPort = std::stoi(argv[2]);
+            std::cout << "Running in CONFERENCE BRIDGE mode." << std::endl;
+        } else if (mode == "--record") {
+            if (argc != 4 && argc != 5) { // Expecting mode, output_file, frame_size and optional frames_per_packet
+                std::cerr << "Error: Incorrect arguments for record mode." << std::endl;
+                return 1;
+            }
+            config.topology = "record";
+            config.recordPath = argv[2];
+            config.frameSize = std::stoi(argv[3]);
+            if (argc == 5) {
+                config.framesPerPacket = std::stoi(argv[4]);
+            }
+            std::cout << "Running in RECORD mode." << std::endl;
+        } else if (mode == "--replay") {
+            if (argc != 4) { // Expecting mode, trace_file and frame_size
+                std::cerr << "Error: Incorrect arguments for replay mode." << std::endl;
+                return 1;
+            }
+            config.topology = "replay";
+            config.replayPath = argv[2];
+            config.frameSize = std::stoi(argv[3]);
+            std::cout << "Running in TRACE REPLAY mode." << std::endl;
         } else {
             std::cerr << "Invalid mode: " << mode << std::endl;
             return 1;
         }
 
-        Application app(sampleRate, channels, frameSize,
-            enableNetworking, localPort, remoteIp, remotePort);
+        if (echoCancellation) {
+            if (config.topology != "p2p") {
+                std::cerr << "Error: --aec needs network mode (or a --pipeline with the aec and echoref stages)." << std::endl;
+                return 1;
+            }
+            config.topology = "p2p-aec";
+        }
+        if (!pipelineOverride.empty()) {
+            config.topology = pipelineOverride;
+        }
+
+        Application app(config);
         app.run();
     } catch (const std::exception& e) {
         std::cerr << "Application error: " << e.what() << std::endl;
@@ -0,0 +1,34 @@
+#ifndef TEST_CHECK_HPP
+#define TEST_CHECK_HPP
+
+#include <iostream>
+
+// Minimal checks for the unit tests in tests/: a failing CHECK prints where it failed and the
+// test goes on, main() returns testResult() so ctest sees the failure.
+
+inline int& testFailures()
+{
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(condition)                                                                    \
+    do {                                                                                    \
+        if(!(condition)) {                                                                  \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed"   \
+                << std::endl;                                                               \
+            testFailures()++;                                                               \
+        }                                                                                   \
+    } while(0)
+
+inline int testResult(const char* name)
+{
+    if(testFailures() > 0) {
+        std::cerr << "[" << name << "] " << testFailures() << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "[" << name << "] All checks passed" << std::endl;
+    return 0;
+}
+
+#endif // TEST_CHECK_HPP
@@ -0,0 +1,158 @@
+// Bridge: the first datagrams of a stream that was left out carry kFlagResumed and keep the
+// sender's sequence numbers; two sources using one SSRC are kept apart, not merged
+
+#include "Bridge.hpp"
+#include "Metrics.hpp"
+#include "PacketHeader.hpp"
+#include "TestCheck.hpp"
+
+#include <vector>
+
+namespace {
+
+using Clock = Bridge::Clock;
+
+constexpr std::chrono::milliseconds kStep{20};     // one datagram per stream and step
+
+struct SentDatagram
+{
+    NetworkPacket payload;
+    asio::ip::udp::endpoint peer;
+};
+
+struct RecordingTransport : ITransport
+{
+    std::vector<SentDatagram> sent;
+
+    void setIncomingQueue(std::shared_ptr<ThreadSafeQueue<Datagram>>) override {}
+    void startReceive() override {}
+    void sendPacket(const NetworkPacket&) override {}
+    void sendPacketTo(const NetworkPacket& data, const asio::ip::udp::endpoint& peer) override
+    {
+        sent.push_back({data, peer});
+    }
+    void stop() override {}
+};
+
+Datagram audioDatagram(uint32_t ssrc, uint16_t sequence, uint8_t level, const asio::ip::udp::endpoint& peer,
+    char fill = 0x5A)
+{
+    PacketHeader header;
+    header.type = PacketType::Audio;
+    header.sequence = sequence;
+    header.ssrc = ssrc;
+    header.setAudioLevel(level);
+    Datagram datagram;
+    datagram.payload.assign(PacketHeader::kSize + 10, fill);
+    header.write(reinterpret_cast<unsigned char*>(datagram.payload.data()));
+    datagram.peer = peer;
+    return datagram;
+}
+
+void testBridgeMarksResumedStream()
+{
+    BridgeConfig config;
+    config.maxSpeakers = 1;
+    RecordingTransport transport;
+    Bridge bridge(config, transport, nullptr, std::chrono::seconds(5));
+
+    const auto address = asio::ip::make_address("127.0.0.1");
+    const asio::ip::udp::endpoint quiet(address, 1001), loud(address, 1002), listener(address, 1003);
+    Clock::time_point now = Clock::now();     // the bridge schedules its first flush from the real clock
+    std::vector<uint16_t> loudSent;
+    for(uint16_t sequence = 100; sequence < 200; sequence++) {  // 2 s
+        bridge.onDatagram(audioDatagram(1, sequence, 40, quiet), now);
+        bridge.onDatagram(audioDatagram(2, static_cast<uint16_t>(sequence + 1000), 20, loud), now);
+        loudSent.push_back(static_cast<uint16_t>(sequence + 1000));
+        bridge.onDatagram(audioDatagram(3, sequence, 127, listener), now);
+        bridge.tick(now);
+        now += kStep;
+    }
+
+    // What the listener got of the loud stream once it took over the slot
+    std::vector<PacketHeader> heard;
+    for(const SentDatagram& datagram : transport.sent) {
+        PacketHeader header;
+        CHECK(PacketHeader::read(reinterpret_cast<const unsigned char*>(datagram.payload.data()),
+            datagram.payload.size(), header));
+        if(datagram.peer == listener && header.ssrc == 2) {
+            heard.push_back(header);
+        }
+    }
+    CHECK(heard.size() > Bridge::kResumeMarks + 1);
+    if(heard.size() <= Bridge::kResumeMarks + 1) {
+        return;
+    }
+    CHECK(heard.size() < loudSent.size());      // left out while the quiet stream held the slot
+    for(size_t i = 0; i < heard.size(); i++) {
+        CHECK(heard[i].isResumed() == (i < Bridge::kResumeMarks));
+        CHECK(heard[i].hasAudioLevel());
+        // The sender's sequence numbers, consecutive from where forwarding resumed
+        CHECK(heard[i].sequence == static_cast<uint16_t>(heard[0].sequence + i));
+    }
+    CHECK(heard.back().sequence == loudSent.back());
+}
+
+void testSsrcCollision()
+{
+    RecordingTransport transport;
+    Bridge bridge(BridgeConfig(), transport, nullptr, std::chrono::milliseconds(200));
+    MetricValue& collisions = Metrics::instance().get("bridge.ssrc_collisions");
+    MetricValue& duplicates = Metrics::instance().get("bridge.duplicates_dropped");
+    const int64_t collisionsBefore = collisions.load();
+    const int64_t duplicatesBefore = duplicates.load();
+
+    // Two participants picked SSRC 5 and send the same sequence numbers
+    const auto address = asio::ip::make_address("127.0.0.1");
+    const asio::ip::udp::endpoint first(address, 1001), second(address, 1002), listener(address, 1003);
+    Clock::time_point now = Clock::now();
+    const auto round = [&](uint16_t sequence, bool firstSends) {
+        bridge.onDatagram(audioDatagram(9, sequence, 127, listener), now);
+        if(firstSends) {
+            bridge.onDatagram(audioDatagram(5, sequence, 30, first, 0x11), now);
+        }
+        bridge.onDatagram(audioDatagram(5, sequence, 30, second, 0x22), now);
+        bridge.tick(now);
+        now += kStep;
+    };
+    for(uint16_t sequence = 0; sequence < 20; sequence++) {
+        round(sequence, true);
+    }
+
+    // The listener gets the first one's stream, complete and unmixed
+    const auto heardFrom = [&](char fill) {
+        size_t count = 0;
+        for(const SentDatagram& datagram : transport.sent) {
+            count += (datagram.peer == listener && datagram.payload.back() == fill) ? 1 : 0;
+        }
+        return count;
+    };
+    CHECK(heardFrom(0x11) == 20);
+    CHECK(heardFrom(0x22) == 0);
+    CHECK(collisions.load() == collisionsBefore + 20);
+    CHECK(duplicates.load() == duplicatesBefore);
+
+    // The second one still hears the first, from its own first datagram on
+    size_t toSecond = 0;
+    for(const SentDatagram& datagram : transport.sent) {
+        toSecond += (datagram.peer == second && datagram.payload.back() == 0x11) ? 1 : 0;
+    }
+    CHECK(toSecond == 19);
+
+    // Once the first one is silent for the timeout, the SSRC is free again
+    transport.sent.clear();
+    for(uint16_t sequence = 20; sequence < 40; sequence++) {
+        round(sequence, false);
+    }
+    CHECK(heardFrom(0x22) > 0);
+    CHECK(heardFrom(0x22) < 20);
+}
+
+} // namespace
+
+int main()
+{
+    testBridgeMarksResumedStream();
+    testSsrcCollision();
+    return testResult("bridge_test");
+}
@@ -0,0 +1,128 @@
+// CallQuality: R factor and MOS for known loss, burstiness and delay (G.107 formulas), counter
+// halving, and payloads recovered from redundancy whose original arrived late
+
+#include "CallQuality.hpp"
+#include "TestCheck.hpp"
+
+#include <cmath>
+
+namespace {
+
+bool near(double value, double expected, double tolerance = 0.01)
+{
+    return std::abs(value - expected) <= tolerance;
+}
+
+// `received` packets with a gap of `burst` missing ones before every `spacing`th
+void receive(CallQuality& quality, int received, int spacing, uint32_t burst)
+{
+    for(int i = 1; i <= received; i++) {
+        quality.onReceived(i % spacing == 0 ? burst : 0);
+    }
+}
+
+void testMosMapping()
+{
+    // G.107 Annex B: R 93.2 (all defaults) is MOS 4.41
+    CHECK(near(CallQuality::toMos(93.2), 4.41));
+    CHECK(near(CallQuality::toMos(80.0), 4.02));
+    CHECK(near(CallQuality::toMos(70.0), 3.60));
+    CHECK(near(CallQuality::toMos(50.0), 2.58));
+    CHECK(CallQuality::toMos(-5.0) == 1.0);
+    CHECK(CallQuality::toMos(120.0) == 4.5);
+
+    CallQuality clean;
+    receive(clean, 500, 1000, 0);
+    CHECK(near(clean.rFactor(), 93.2));
+    CHECK(near(clean.mos(), 4.41));
+}
+
+void testRandomLoss()
+{
+    // 10 single losses in 500 packets: Ppl 2 %, BurstR 1, Ie,eff = 95 * 2 / (2 + 25)
+    CallQuality quality;
+    receive(quality, 490, 49, 1);
+    CHECK(near(quality.lossPercent(), 2.0));
+    CHECK(near(quality.burstRatio(), 1.0));
+    CHECK(near(quality.rFactor(), 93.2 - 95.0 * 2.0 / 27.0));
+    CHECK(near(quality.rFactor(), 86.16));
+}
+
+void testBurstLoss()
+{
+    // 5 gaps of 4 in 500 packets: Ppl 4 %, p = 5 / 480, q = 5 / 20, BurstR = 1 / (p + q) = 3.84
+    CallQuality quality;
+    receive(quality, 480, 96, 4);
+    CHECK(near(quality.lossPercent(), 4.0));
+    CHECK(near(quality.burstRatio(), 3.84));
+    CHECK(near(quality.rFactor(), 78.61));
+
+    // The same loss spread out rates better
+    CallQuality random;
+    receive(random, 480, 24, 1);
+    CHECK(near(random.lossPercent(), 4.0));
+    CHECK(near(random.burstRatio(), 1.0));
+    CHECK(near(random.rFactor(), 93.2 - 95.0 * 4.0 / 29.0));
+    CHECK(quality.rFactor() < random.rFactor());
+}
+
+void testDelay()
+{
+    // 300 ms mouth to ear: Id = 0.024 * 300 + 0.11 * (300 - 177.3)
+    CallQuality quality;
+    receive(quality, 100, 1000, 0);
+    quality.setNetworkDelayMs(250.0);
+    quality.setPacketTimeMs(20.0);
+    quality.setPlayoutDelayMs(30.0);
+    CHECK(near(quality.mouthToEarMs(), 300.0));
+    CHECK(near(quality.rFactor(), 72.50));
+
+    // Below 177.3 ms only the linear term applies
+    quality.setNetworkDelayMs(100.0);
+    CHECK(near(quality.rFactor(), 93.2 - 0.024 * 150.0));
+}
+
+void testWindowHalving()
+{
+    // Many windows of 2 % random loss rate the same as one, then a clean stretch wins back
+    CallQuality quality;
+    receive(quality, 4900, 49, 1);
+    CHECK(near(quality.lossPercent(), 2.0, 0.1));
+    CHECK(near(quality.burstRatio(), 1.0));
+    receive(quality, 3 * static_cast<int>(CallQuality::kWindowPackets), 1 << 30, 0);
+    CHECK(quality.lossPercent() < 0.5);
+}
+
+void testRecoveredThenLate()
+{
+    // 10 losses, 4 decoded from redundant copies: 6 concealed
+    CallQuality quality;
+    receive(quality, 490, 49, 1);
+    for(int i = 0; i < 4; i++) {
+        quality.onRecovered();
+    }
+    CHECK(near(quality.lossPercent(), 6.0 * 100.0 / 500.0));
+
+    // The recovered originals arrive late after all: still 6 concealed out of 500
+    for(int i = 0; i < 4; i++) {
+        quality.onLate(true);
+    }
+    CHECK(near(quality.lossPercent(), 6.0 * 100.0 / 500.0));
+
+    // A concealed one arriving late no longer counts as lost
+    quality.onLate(false);
+    CHECK(near(quality.lossPercent(), 5.0 * 100.0 / 500.0));
+}
+
+} // namespace
+
+int main()
+{
+    testMosMapping();
+    testRandomLoss();
+    testBurstLoss();
+    testDelay();
+    testWindowHalving();
+    testRecoveredThenLate();
+    return testResult("call_quality_test");
+}
@@ -0,0 +1,166 @@
+// ClockSync: offset and RTT of a known asymmetric exchange, stale or forged pongs dropped, the
+// minimum-RTT filter, and media timestamps mapped to local time across a 32-bit wrap
+
+#include "ClockSync.hpp"
+#include "Metrics.hpp"
+#include "TestCheck.hpp"
+
+namespace {
+
+constexpr int64_t kMs = 1000000;
+constexpr int kSampleRate = 48000;
+
+const asio::ip::udp::endpoint kLocal(asio::ip::make_address("10.0.0.1"), 4000);
+const asio::ip::udp::endpoint kPeer(asio::ip::make_address("10.0.0.2"), 5000);
+
+int64_t unmatchedPongs()
+{
+    return Metrics::instance().get("net.clock.pongs_unmatched").load();
+}
+
+// Pings the peer at t1 (local clock); the peer receives it at t2 and answers at t3 (its clock)
+ClockMessage pingAndAnswer(ClockSync& sync, ClockSync& peer, int64_t t1, int64_t t2, int64_t t3,
+    const MediaAnchor& peerAnchor = {})
+{
+    ClockMessage ping;
+    sync.makePing({}, ping);
+    ping.originNs = t1;
+    sync.onPingSent(kPeer, ping);
+
+    ClockMessage pong;
+    peer.onPing(kLocal, ping, t2, peerAnchor, pong);
+    pong.transmitNs = t3;
+    return pong;
+}
+
+// One full exchange; the pong comes back at t4
+void exchange(ClockSync& sync, ClockSync& peer, int64_t t1, int64_t t2, int64_t t3, int64_t t4,
+    const MediaAnchor& peerAnchor = {})
+{
+    sync.onPong(kPeer, pingAndAnswer(sync, peer, t1, t2, t3, peerAnchor), t4);
+}
+
+void testAsymmetricExchange()
+{
+    // The peer's clock is 5 ms ahead; 10 ms out, 1 ms turnaround, 30 ms back
+    ClockSync sync, peer;
+    const int64_t t1 = 1000 * kMs;
+    exchange(sync, peer, t1, t1 + 15 * kMs, t1 + 16 * kMs, t1 + 41 * kMs);
+
+    ClockEstimate estimate;
+    CHECK(sync.estimate(kPeer, estimate));
+    CHECK(estimate.rttNs == 40 * kMs);
+    // NTP assumes a symmetric path: off by half the asymmetry, (10 - 30) / 2
+    CHECK(estimate.offsetNs == 5 * kMs - 10 * kMs);
+    CHECK(estimate.samples == 1);
+
+    // Symmetric, the offset comes out exact
+    ClockSync symmetric, other;
+    exchange(symmetric, other, t1, t1 + 25 * kMs, t1 + 26 * kMs, t1 + 41 * kMs);
+    CHECK(symmetric.estimate(kPeer, estimate));
+    CHECK(estimate.rttNs == 40 * kMs);
+    CHECK(estimate.offsetNs == 5 * kMs);
+}
+
+void testUnmatchedPongsDropped()
+{
+    ClockSync sync, peer;
+    ClockEstimate estimate;
+    const int64_t t1 = 1000 * kMs;
+
+    // Wrong sequence
+    ClockMessage pong = pingAndAnswer(sync, peer, t1, t1 + 10 * kMs, t1 + 11 * kMs);
+    int64_t before = unmatchedPongs();
+    ClockMessage forged = pong;
+    forged.header.sequence++;
+    sync.onPong(kPeer, forged, t1 + 20 * kMs);
+    CHECK(unmatchedPongs() == before + 1);
+    CHECK(!sync.estimate(kPeer, estimate));
+
+    // Wrong origin time
+    forged = pong;
+    forged.originNs -= kMs;
+    sync.onPong(kPeer, forged, t1 + 20 * kMs);
+    CHECK(unmatchedPongs() == before + 2);
+    CHECK(!sync.estimate(kPeer, estimate));
+
+    // The genuine one counts, once
+    sync.onPong(kPeer, pong, t1 + 20 * kMs);
+    CHECK(sync.estimate(kPeer, estimate));
+    CHECK(estimate.samples == 1);
+    sync.onPong(kPeer, pong, t1 + 21 * kMs);
+    CHECK(unmatchedPongs() == before + 3);
+    CHECK(sync.estimate(kPeer, estimate) && estimate.samples == 1);
+
+    // An answer to an older ping, after a newer one went out
+    const int64_t t1b = 2000 * kMs;
+    ClockMessage stale = pingAndAnswer(sync, peer, t1b, t1b + 10 * kMs, t1b + 11 * kMs);
+    pingAndAnswer(sync, peer, t1b + 1000 * kMs, 0, 0);
+    sync.onPong(kPeer, stale, t1b + 20 * kMs);
+    CHECK(unmatchedPongs() == before + 4);
+
+    // A pong from a peer that was never pinged
+    const asio::ip::udp::endpoint stranger(asio::ip::make_address("10.0.0.9"), 5000);
+    sync.onPong(stranger, pong, t1 + 20 * kMs);
+    CHECK(unmatchedPongs() == before + 5);
+    CHECK(!sync.estimate(stranger, estimate));
+}
+
+void testQueuedExchangeFiltered()
+{
+    ClockSync sync, peer;
+    ClockEstimate estimate;
+    int64_t t1 = 1000 * kMs;
+
+    // Clean exchange: 20 ms RTT, offset 0
+    exchange(sync, peer, t1, t1 + 10 * kMs, t1 + 10 * kMs, t1 + 20 * kMs);
+    // Queued on the way out: 120 ms RTT and an offset skewed by 50 ms
+    t1 += 1000 * kMs;
+    exchange(sync, peer, t1, t1 + 110 * kMs, t1 + 110 * kMs, t1 + 120 * kMs);
+    CHECK(sync.estimate(kPeer, estimate));
+    CHECK(estimate.samples == 2);
+    CHECK(estimate.rttNs == 20 * kMs);
+    CHECK(estimate.offsetNs == 0);
+
+    // Once kFilterSamples newer exchanges came in, the clean one has aged out
+    for(size_t i = 0; i < ClockSync::kFilterSamples; i++) {
+        t1 += 1000 * kMs;
+        exchange(sync, peer, t1, t1 + 20 * kMs, t1 + 20 * kMs, t1 + 30 * kMs);
+    }
+    CHECK(sync.estimate(kPeer, estimate));
+    CHECK(estimate.samples == ClockSync::kFilterSamples);
+    CHECK(estimate.rttNs == 30 * kMs);
+    CHECK(estimate.offsetNs == 5 * kMs);
+}
+
+void testAnchorAcrossWrap()
+{
+    ClockSync sync, peer;
+    const int64_t t1 = 1000 * kMs;
+    // The peer's clock is 5 ms ahead; it sent media timestamp 0xFFFFFF00 of stream 7 at 900 ms
+    const MediaAnchor anchor{7, 0xFFFFFF00u, 900 * kMs};
+    exchange(sync, peer, t1, t1 + 15 * kMs, t1 + 15 * kMs, t1 + 20 * kMs, anchor);
+
+    // 512 samples later, past the wrap: 900 ms + 10.667 ms on the peer's clock
+    int64_t localNs = 0;
+    CHECK(sync.toLocalTime(kPeer, 7, 0x00000100u, kSampleRate, localNs));
+    CHECK(localNs == 900 * kMs + 512LL * 1000000000 / kSampleRate - 5 * kMs);
+
+    // 256 samples before the anchor
+    CHECK(sync.toLocalTime(kPeer, 7, 0xFFFFFE00u, kSampleRate, localNs));
+    CHECK(localNs == 900 * kMs - 256LL * 1000000000 / kSampleRate - 5 * kMs);
+
+    // Another stream of the peer has no anchor
+    CHECK(!sync.toLocalTime(kPeer, 8, 0x00000100u, kSampleRate, localNs));
+}
+
+} // namespace
+
+int main()
+{
+    testAsymmetricExchange();
+    testUnmatchedPongsDropped();
+    testQueuedExchangeFiltered();
+    testAnchorAcrossWrap();
+    return testResult("clock_sync_test");
+}
@@ -0,0 +1,168 @@
+// MediaSealer/MediaOpener: tampering, and the replay window per (session, SSRC) across sequence
+// wraps, reordering and recycled stream ids; MediaResealer: one relay session per sender session
+
+#include "MediaCrypto.hpp"
+#include "PacketHeader.hpp"
+#include "TestCheck.hpp"
+
+#include <vector>
+
+namespace {
+
+Datagram audioDatagram(uint32_t ssrc, uint16_t sequence, uint32_t rollover)
+{
+    PacketHeader header;
+    header.type = PacketType::Audio;
+    header.sequence = sequence;
+    header.timestamp = sequence * 480u;
+    header.ssrc = ssrc;
+    std::vector<unsigned char> packet(PacketHeader::kSize + 20, static_cast<unsigned char>(sequence));
+    header.write(packet.data());
+
+    Datagram datagram;
+    datagram.payload.assign(packet.begin(), packet.end());
+    datagram.peer = asio::ip::udp::endpoint(asio::ip::make_address("127.0.0.1"), 40000);
+    datagram.rollover = rollover;
+    return datagram;
+}
+
+Datagram sealed(MediaSealer& sealer, uint32_t ssrc, uint16_t sequence, uint32_t rollover = 0)
+{
+    Datagram datagram = audioDatagram(ssrc, sequence, rollover);
+    CHECK(sealer.seal(datagram));
+    return datagram;
+}
+
+// What the receive path does: open, then the replay check
+bool receive(MediaOpener& opener, Datagram datagram, StreamId stream = 1)
+{
+    datagram.rollover = 0;
+    datagram.stream = stream;
+    return opener.open(datagram) && opener.accept(datagram);
+}
+
+void testOpenAndTamper(const MediaKey& master)
+{
+    MediaSealer sealer(master);
+    MediaOpener opener(master);
+
+    Datagram datagram = sealed(sealer, 0x1234, 7);
+    Datagram opened = datagram;
+    CHECK(opener.open(opened));
+    CHECK(opened.session == sealer.session());
+    CHECK(opened.payload == audioDatagram(0x1234, 7, 0).payload);
+
+    for(size_t i : {size_t{2}, PacketHeader::kSize + 3, datagram.payload.size() - 1}) {
+        Datagram tampered = datagram;
+        tampered.payload[i] ^= 0x01;
+        CHECK(!opener.open(tampered));
+    }
+    Datagram clear = audioDatagram(0x1234, 8, 0);
+    CHECK(!opener.open(clear));
+}
+
+void testReplayWindow(const MediaKey& master)
+{
+    MediaSealer sealer(master);
+    MediaOpener opener(master);
+    const uint32_t ssrc = 0xCAFE;
+
+    std::vector<Datagram> sent;
+    for(uint16_t sequence = 100; sequence < 200; sequence++) {
+        sent.push_back(sealed(sealer, ssrc, sequence));
+    }
+    // Arrives out of order: 180 first, then the rest
+    const size_t first = 80;
+    CHECK(receive(opener, sent[first]));
+    for(size_t i = 0; i < sent.size(); i++) {
+        const bool accepted = receive(opener, sent[i]);
+        if(i == first) {
+            CHECK(!accepted);       // already accepted
+        } else if(i + MediaOpener::kReplayWindow <= first) {
+            CHECK(!accepted);       // too old to tell once 180 was the newest
+        } else {
+            CHECK(accepted);
+        }
+    }
+    // Every copy is rejected, also under another (recycled) stream id
+    for(const Datagram& datagram : sent) {
+        CHECK(!receive(opener, datagram, 2));
+    }
+}
+
+void testRolloverAndSessions(const MediaKey& master)
+{
+    MediaOpener opener(master);
+    const uint32_t ssrc = 0xBEEF;
+    {
+        MediaSealer sealer(master);
+        const Datagram last = sealed(sealer, ssrc, 65535, 0);
+        const Datagram wrapped = sealed(sealer, ssrc, 0, 1);
+        CHECK(receive(opener, last));
+        CHECK(receive(opener, wrapped));
+        CHECK(!receive(opener, wrapped));
+        CHECK(!receive(opener, last));
+    }
+    // A restarted sender starts over at sequence 0 in a new session, with a fresh window
+    MediaSealer restarted(master);
+    const Datagram first = sealed(restarted, ssrc, 0, 0);
+    CHECK(receive(opener, first));
+    CHECK(!receive(opener, first));
+}
+
+void testResealPerSenderSession(const MediaKey& master)
+{
+    // Two senders in different sessions with the same SSRC and packet index, different audio
+    MediaSealer first(master), second(master);
+    MediaOpener relayOpener(master), listener(master);
+    MediaResealer resealer(master);
+
+    Datagram fromFirst = sealed(first, 0x42, 5);
+    Datagram fromSecond = audioDatagram(0x42, 5, 0);
+    fromSecond.payload.back() ^= 0x55;
+    const NetworkPacket secondClear = fromSecond.payload;
+    CHECK(second.seal(fromSecond));
+
+    CHECK(relayOpener.open(fromFirst) && relayOpener.accept(fromFirst));
+    CHECK(relayOpener.open(fromSecond) && relayOpener.accept(fromSecond));
+    CHECK(resealer.seal(fromFirst));
+    CHECK(resealer.seal(fromSecond));
+
+    // Same nonce fields, so they have to be under different relay sessions
+    Datagram heardFirst = fromFirst, heardSecond = fromSecond;
+    CHECK(listener.open(heardFirst));
+    CHECK(listener.open(heardSecond));
+    CHECK(heardFirst.session != heardSecond.session);
+    CHECK(heardFirst.session != first.session() && heardSecond.session != second.session());
+    CHECK(heardFirst.payload == audioDatagram(0x42, 5, 0).payload);
+    CHECK(heardSecond.payload == secondClear);
+
+    // The first sender's next packet goes out under the same relay session as before
+    Datagram next = sealed(first, 0x42, 6);
+    CHECK(relayOpener.open(next) && relayOpener.accept(next));
+    CHECK(resealer.seal(next));
+    CHECK(listener.open(next));
+    CHECK(next.session == heardFirst.session);
+
+    // Without a sender session there is nothing to keep the nonce apart
+    Datagram unopened = audioDatagram(0x42, 7, 0);
+    CHECK(!resealer.seal(unopened));
+    CHECK(unopened.payload == audioDatagram(0x42, 7, 0).payload);
+}
+
+} // namespace
+
+int main()
+{
+    if(!MediaKey::available()) {
+        std::cout << "[media_opener_test] Built without libcrypto, nothing to test" << std::endl;
+        return 0;
+    }
+    MediaKey master;
+    CHECK(MediaKey::derive("correct horse battery staple", master));
+    testOpenAndTamper(master);
+    testReplayWindow(master);
+    testRolloverAndSessions(master);
+    testResealPerSenderSession(master);
+    return testResult("media_opener_test");
+}
@@ -0,0 +1,129 @@
+// PeerTable: lookups after backward-shift deletes, in clusters that wrap around the bucket array
+
+#include "PeerTable.hpp"
+#include "TestCheck.hpp"
+
+#include <map>
+#include <random>
+#include <vector>
+
+namespace {
+
+PeerKey keyFor(uint32_t ssrc)
+{
+    return PeerKey::from(asio::ip::udp::endpoint(asio::ip::make_address("10.0.0.1"), 5000), ssrc);
+}
+
+size_t homeOf(const PeerTable& table, const PeerKey& key)
+{
+    return static_cast<size_t>(PeerTable::hash(key)) & (table.bucketCount() - 1);
+}
+
+// `count` keys whose home bucket is `bucket`
+std::vector<PeerKey> keysWithHome(const PeerTable& table, size_t bucket, size_t count, uint32_t& nextSsrc)
+{
+    std::vector<PeerKey> keys;
+    while(keys.size() < count) {
+        const PeerKey key = keyFor(nextSsrc++);
+        if(homeOf(table, key) == bucket) {
+            keys.push_back(key);
+        }
+    }
+    return keys;
+}
+
+void testClusterDelete()
+{
+    PeerTable table(8);     // 16 buckets
+    CHECK(table.bucketCount() == 16);
+    uint32_t ssrc = 1;
+
+    // One cluster spanning buckets 3..7: three keys homed at 3, two homed at 4
+    std::vector<PeerKey> at3 = keysWithHome(table, 3, 3, ssrc);
+    std::vector<PeerKey> at4 = keysWithHome(table, 4, 2, ssrc);
+    for(size_t i = 0; i < at3.size(); i++) {
+        CHECK(table.insert(at3[i], static_cast<uint32_t>(i)));
+    }
+    for(size_t i = 0; i < at4.size(); i++) {
+        CHECK(table.insert(at4[i], static_cast<uint32_t>(10 + i)));
+    }
+    CHECK(table.size() == 5);
+    CHECK(!table.insert(at3[0], 99));   // duplicate
+
+    // Deleting the head of the cluster must shift both chains back, not cut them off
+    CHECK(table.erase(at3[0]));
+    CHECK(table.find(at3[0]) == PeerTable::kNotFound);
+    CHECK(table.find(at3[1]) == 1);
+    CHECK(table.find(at3[2]) == 2);
+    CHECK(table.find(at4[0]) == 10);
+    CHECK(table.find(at4[1]) == 11);
+
+    // And from the middle
+    CHECK(table.erase(at4[0]));
+    CHECK(table.find(at3[1]) == 1);
+    CHECK(table.find(at3[2]) == 2);
+    CHECK(table.find(at4[1]) == 11);
+    CHECK(!table.erase(at4[0]));
+    CHECK(table.size() == 3);
+}
+
+void testWrappingClusterDelete()
+{
+    PeerTable table(8);
+    uint32_t ssrc = 1000;
+
+    // Homed at the last bucket, the cluster continues at bucket 0; a key homed at 0 follows
+    std::vector<PeerKey> atEnd = keysWithHome(table, 15, 3, ssrc);
+    std::vector<PeerKey> atZero = keysWithHome(table, 0, 1, ssrc);
+    for(size_t i = 0; i < atEnd.size(); i++) {
+        CHECK(table.insert(atEnd[i], static_cast<uint32_t>(i)));
+    }
+    CHECK(table.insert(atZero[0], 20));
+
+    CHECK(table.erase(atEnd[1]));
+    CHECK(table.find(atEnd[0]) == 0);
+    CHECK(table.find(atEnd[2]) == 2);
+    CHECK(table.find(atZero[0]) == 20);
+
+    CHECK(table.erase(atEnd[0]));
+    CHECK(table.find(atEnd[2]) == 2);
+    CHECK(table.find(atZero[0]) == 20);
+    CHECK(table.size() == 2);
+}
+
+void testChurnAgainstMap()
+{
+    PeerTable table(64);
+    std::map<uint32_t, uint32_t> reference;
+    std::mt19937 random(7);
+
+    for(int step = 0; step < 20000; step++) {
+        const uint32_t ssrc = random() % 200;
+        const PeerKey key = keyFor(ssrc);
+        if(random() % 2 == 0) {
+            const bool inserted = table.insert(key, ssrc + 1);
+            const bool expected = reference.size() < table.maxEntries() && reference.count(ssrc) == 0;
+            CHECK(inserted == expected);
+            if(inserted) {
+                reference[ssrc] = ssrc + 1;
+            }
+        } else {
+            CHECK(table.erase(key) == (reference.erase(ssrc) == 1));
+        }
+        CHECK(table.size() == reference.size());
+    }
+    for(uint32_t ssrc = 0; ssrc < 200; ssrc++) {
+        auto it = reference.find(ssrc);
+        CHECK(table.find(keyFor(ssrc)) == (it == reference.end() ? PeerTable::kNotFound : it->second));
+    }
+}
+
+} // namespace
+
+int main()
+{
+    testClusterDelete();
+    testWrappingClusterDelete();
+    testChurnAgainstMap();
+    return testResult("peer_table_test");
+}
@@ -0,0 +1,107 @@
+// RedundancyFormat round trips and truncated input, DecodeHistory across the sequence wrap
+
+#include "Redundancy.hpp"
+#include "TestCheck.hpp"
+
+#include <vector>
+
+namespace {
+
+std::vector<unsigned char> bytes(size_t size, unsigned char fill)
+{
+    return std::vector<unsigned char>(size, fill);
+}
+
+void testRoundTrip()
+{
+    const std::vector<unsigned char> older = bytes(40, 0x11);
+    const std::vector<unsigned char> longer = bytes(300, 0x22);   // two-byte length
+    const std::vector<unsigned char> own = bytes(50, 0x33);
+    std::vector<unsigned char> framed;
+    RedundancyFormat::write({&older, &longer}, own.data(), own.size(), framed);
+    CHECK(framed.size() == 1 + 1 + 2 + older.size() + longer.size() + own.size());
+
+    std::vector<RedundancyFormat::Block> previous;
+    RedundancyFormat::Block payload;
+    CHECK(RedundancyFormat::read(framed.data(), framed.size(), previous, payload));
+    CHECK(previous.size() == 2);
+    if(previous.size() == 2) {
+        CHECK(previous[0].size == older.size() && previous[0].data[0] == 0x11);
+        CHECK(previous[1].size == longer.size() && previous[1].data[longer.size() - 1] == 0x22);
+    }
+    CHECK(payload.size == own.size() && payload.data[0] == 0x33);
+}
+
+void testTruncated()
+{
+    const std::vector<unsigned char> older = bytes(40, 0x11);
+    const std::vector<unsigned char> longer = bytes(300, 0x22);
+    const std::vector<unsigned char> own = bytes(50, 0x33);
+    std::vector<unsigned char> framed;
+    RedundancyFormat::write({&older, &longer}, own.data(), own.size(), framed);
+
+    // Every prefix that cuts into the lengths or the blocks, or leaves no own payload, is rejected
+    std::vector<RedundancyFormat::Block> previous;
+    RedundancyFormat::Block payload;
+    const size_t blocksEnd = framed.size() - own.size();
+    for(size_t size = 0; size <= blocksEnd; size++) {
+        CHECK(!RedundancyFormat::read(framed.data(), size, previous, payload));
+    }
+    CHECK(RedundancyFormat::read(framed.data(), blocksEnd + 1, previous, payload));
+    CHECK(payload.size == 1);
+
+    // Lengths claiming more than the datagram holds
+    const unsigned char bogus[] = {1, 0xFF, 0xFF, 0xAA, 0xBB};
+    CHECK(!RedundancyFormat::read(bogus, sizeof(bogus), previous, payload));
+    const unsigned char tooMany[] = {200, 1, 0xAA};
+    CHECK(!RedundancyFormat::read(tooMany, sizeof(tooMany), previous, payload));
+}
+
+void testHistoryWrap()
+{
+    DecodeHistory history;
+    CHECK(!history.started());
+    CHECK(!history.contains(0));
+
+    history.mark(65530);
+    for(uint16_t sequence = 65531; sequence != 5; sequence++) {
+        if(sequence != 65534 && sequence != 1) {
+            history.mark(sequence);
+        }
+    }
+    CHECK(history.highest() == 4);
+    CHECK(history.contains(65530));
+    CHECK(history.contains(65535));
+    CHECK(history.contains(0));
+    CHECK(!history.contains(65534));     // the gaps, on both sides of the wrap
+    CHECK(!history.contains(1));
+    CHECK(!history.contains(5));         // ahead of the highest
+
+    // A late datagram across the wrap fills its gap
+    history.mark(65534);
+    CHECK(history.contains(65534));
+    CHECK(history.highest() == 4);
+
+    // 64 behind is out of the window, a jump of 64 or more forgets everything
+    history.mark(4 + 63);
+    CHECK(history.contains(4));
+    history.mark(4 + 64);
+    CHECK(!history.contains(4));
+    history.mark(4 + 64 + 100);
+    CHECK(!history.contains(4 + 64));
+    CHECK(history.contains(4 + 64 + 100));
+
+    history.reset();
+    CHECK(!history.started());
+    CHECK(!history.contains(4 + 64 + 100));
+}
+
+} // namespace
+
+int main()
+{
+    testRoundTrip();
+    testTruncated();
+    testHistoryWrap();
+    return testResult("redundancy_test");
+}
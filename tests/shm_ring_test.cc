@@ -0,0 +1,133 @@
+// ShmRing: records that wrap behind a skip marker, a record that ends exactly at the end of
+// the buffer, a full ring, and random sizes against the order they were written in
+
+#include "ShmRing.hpp"
+#include "TestCheck.hpp"
+
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+namespace {
+
+std::vector<unsigned char> record(uint32_t number, size_t size)
+{
+    std::vector<unsigned char> bytes(size);
+    for(size_t i = 0; i < size; i++) {
+        bytes[i] = static_cast<unsigned char>(number * 31 + i);
+    }
+    return bytes;
+}
+
+// Reads the next record and checks it is `expected`
+bool readExpected(ShmRing& reader, const std::vector<unsigned char>& expected)
+{
+    size_t size = 0;
+    const unsigned char* data = reader.peek(size);
+    if(!data || size != expected.size() || std::memcmp(data, expected.data(), size) != 0) {
+        return false;
+    }
+    reader.release();
+    return true;
+}
+
+struct Pair
+{
+    ShmRing reader;
+    ShmRing writer;
+
+    explicit Pair(const std::string& name)
+    {
+        const std::string unique = name + "." + std::to_string(::getpid());
+        CHECK(reader.create(unique, 4096));
+        CHECK(writer.attach(unique));
+    }
+};
+
+void testSkipMarkerWrap()
+{
+    Pair ring("test-wrap");
+    // Records take 8-byte aligned slots of a 4-byte length plus the bytes
+    for(uint32_t i = 0; i < 3; i++) {
+        CHECK(ring.writer.write(record(i, 1000).data(), 1000));     // 1008 bytes each, up to 3024
+        CHECK(readExpected(ring.reader, record(i, 1000)));
+    }
+    // 1512 bytes don't fit in the 1072 left before the end: skip marker, record at offset 0
+    CHECK(ring.writer.write(record(3, 1500).data(), 1500));
+    CHECK(ring.writer.write(record(4, 100).data(), 100));
+    CHECK(readExpected(ring.reader, record(3, 1500)));
+    CHECK(readExpected(ring.reader, record(4, 100)));
+    size_t size = 0;
+    CHECK(ring.reader.peek(size) == nullptr);
+}
+
+void testExactFitAndFull()
+{
+    Pair ring("test-fit");
+    // 4096 = 2 * 2048: two records of 2044 bytes fill the buffer to its last byte
+    CHECK(ring.writer.write(record(0, 2044).data(), 2044));
+    CHECK(ring.writer.write(record(1, 2044).data(), 2044));
+    CHECK(!ring.writer.write(record(2, 1).data(), 1));          // full
+    CHECK(readExpected(ring.reader, record(0, 2044)));
+    CHECK(ring.writer.write(record(2, 1).data(), 1));           // at offset 0, no marker needed
+    CHECK(readExpected(ring.reader, record(1, 2044)));
+    CHECK(readExpected(ring.reader, record(2, 1)));
+
+    // A wrap needs room for the skipped tail too (the writer is at offset 8 now)
+    CHECK(ring.writer.write(record(3, 2000).data(), 2000));         // 2008 bytes, up to 2016
+    CHECK(ring.writer.write(record(4, 1800).data(), 1800));         // 1808 bytes, up to 3824
+    // 272 bytes left before the end, 1008 wanted: skipping 272 + 1008 is more than the 280 free
+    CHECK(!ring.writer.write(record(5, 1000).data(), 1000));
+    CHECK(readExpected(ring.reader, record(3, 2000)));
+    CHECK(ring.writer.write(record(5, 1000).data(), 1000));
+    CHECK(readExpected(ring.reader, record(4, 1800)));
+    CHECK(readExpected(ring.reader, record(5, 1000)));
+
+    CHECK(!ring.writer.write(record(6, 2100).data(), 2100));    // more than half the ring
+}
+
+void testRandomSizes()
+{
+    Pair ring("test-random");
+    std::mt19937 random(11);
+    std::vector<std::vector<unsigned char>> pending;
+    size_t front = 0;
+    uint32_t number = 0;
+
+    for(int step = 0; step < 50000; step++) {
+        if(random() % 2 == 0) {
+            const size_t size = random() % 1500;
+            std::vector<unsigned char> bytes = record(number, size);
+            if(ring.writer.write(bytes.data(), size)) {
+                pending.push_back(std::move(bytes));
+                number++;
+            } else {
+                CHECK(front < pending.size());  // only refused when something is unread
+            }
+        } else if(front < pending.size()) {
+            CHECK(readExpected(ring.reader, pending[front]));
+            pending[front].clear();
+            front++;
+        } else {
+            size_t size = 0;
+            CHECK(ring.reader.peek(size) == nullptr);
+        }
+    }
+    while(front < pending.size()) {
+        CHECK(readExpected(ring.reader, pending[front++]));
+    }
+    CHECK(number > 10000);
+}
+
+} // namespace
+
+int main()
+{
+    testSkipMarkerWrap();
+    testExactFitAndFull();
+    testRandomSizes();
+    return testResult("shm_ring_test");
+}
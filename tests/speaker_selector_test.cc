@@ -0,0 +1,116 @@
+// SpeakerSelector: free slots, hysteresis, minimum hold and timeouts
+
+#include "SpeakerSelector.hpp"
+#include "TestCheck.hpp"
+
+namespace {
+
+using Clock = SpeakerSelector::Clock;
+
+constexpr std::chrono::milliseconds kStep{20};     // one datagram per stream and step
+
+// Streams sending at a fixed pace, the selector updated after every round like the bridge does
+struct Room
+{
+    SpeakerSelector selector;
+    Clock::time_point now = Clock::time_point() + std::chrono::seconds(1);
+
+    Room(size_t maxSpeakers, std::chrono::milliseconds timeout) : selector(maxSpeakers, timeout) {}
+
+    bool send(uint32_t ssrc, uint8_t level) { return selector.onLevel(ssrc, level, now); }
+
+    void step()
+    {
+        selector.update(now);
+        now += kStep;
+    }
+};
+
+void testFreeSlotsRightAway()
+{
+    Room room(2, std::chrono::seconds(2));
+    CHECK(room.send(1, 60));
+    CHECK(room.send(2, 60));
+    CHECK(!room.send(3, 10));       // louder, but both slots are held
+
+    // More slots than streams: everyone is forwarded
+    Room all(4, std::chrono::seconds(2));
+    for(int i = 0; i < 50; i++) {
+        CHECK(all.send(1, 20));
+        CHECK(all.send(2, 40));
+        CHECK(all.send(3, 127));
+        all.step();
+    }
+}
+
+void testLouderTakesSlotAfterHold()
+{
+    Room room(1, std::chrono::seconds(2));
+    const Clock::time_point start = room.now;
+    Clock::time_point switchedAt;
+    for(int i = 0; i < 100 && switchedAt == Clock::time_point(); i++) {
+        const bool quietSelected = room.send(1, 40);
+        if(room.send(2, 20)) {          // 20 dB louder
+            CHECK(!quietSelected);
+            switchedAt = room.now;
+        }
+        room.step();
+    }
+    CHECK(switchedAt != Clock::time_point());
+    CHECK(switchedAt - start > SpeakerSelector::kMinHold);
+    CHECK(switchedAt - start <= SpeakerSelector::kMinHold + SpeakerSelector::kReselectInterval + kStep);
+
+    // The new holder keeps its slot for kMinHold, however loud the old one gets
+    Clock::time_point backAt;
+    for(int i = 0; i < 150 && backAt == Clock::time_point(); i++) {
+        if(room.send(1, 0)) {
+            backAt = room.now;
+        }
+        room.send(2, 20);
+        room.step();
+    }
+    CHECK(backAt != Clock::time_point());
+    CHECK(backAt - switchedAt >= SpeakerSelector::kMinHold);
+}
+
+void testHysteresis()
+{
+    Room room(1, std::chrono::seconds(2));
+    for(int i = 0; i < 200; i++) {     // 4 s, long past kMinHold
+        CHECK(room.send(1, 30));
+        CHECK(!room.send(2, 26));       // 4 dB louder is not enough
+        room.step();
+    }
+}
+
+void testSilentStreamFreesSlot()
+{
+    const std::chrono::milliseconds timeout(500);
+    Room room(1, timeout);
+    CHECK(room.send(1, 40));
+    CHECK(!room.send(2, 50));
+    room.step();
+
+    const Clock::time_point lastHeard = room.now - kStep;
+    Clock::time_point selectedAt;
+    for(int i = 0; i < 50 && selectedAt == Clock::time_point(); i++) {
+        if(room.send(2, 50)) {          // quieter, it only gets the slot once stream 1 is gone
+            selectedAt = room.now;
+        }
+        room.step();
+    }
+    CHECK(selectedAt != Clock::time_point());
+    CHECK(selectedAt - lastHeard > timeout);
+    CHECK(selectedAt - lastHeard <= timeout + SpeakerSelector::kReselectInterval + kStep);
+}
+
+} // namespace
+
+int main()
+{
+    testFreeSlotsRightAway();
+    testLouderTakesSlotAfterHold();
+    testHysteresis();
+    testSilentStreamFreesSlot();
+    return testResult("speaker_selector_test");
+}
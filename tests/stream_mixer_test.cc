@@ -0,0 +1,209 @@
+// StreamMixer: passthrough, summing with clipping, late and stopped streams; and two SSRCs
+// through the DecodeStage still give one frame per frame period
+
+#include "AudioCodec.hpp"
+#include "PacketHeader.hpp"
+#include "PipelineStages.hpp"
+#include "StreamMixer.hpp"
+#include "TestCheck.hpp"
+
+#include <algorithm>
+
+namespace {
+
+constexpr int kFrameSize = 480;
+
+AudioFrame constant(opus_int16 value, int traceId = -1)
+{
+    AudioFrame frame(kFrameSize, value);
+    frame.traceId = traceId;
+    return frame;
+}
+
+bool allEqual(const AudioFrame& frame, opus_int16 value)
+{
+    for(opus_int16 sample : frame) {
+        if(sample != value) {
+            return false;
+        }
+    }
+    return !frame.empty();
+}
+
+struct Output
+{
+    std::vector<AudioFrame> frames;
+
+    void operator()(AudioFrame&& frame) { frames.push_back(std::move(frame)); }
+};
+
+void testSingleStreamPassesThrough()
+{
+    StreamMixer mixer;
+    Output out;
+    for(int i = 0; i < 10; i++) {
+        mixer.push(1, constant(static_cast<opus_int16>(100 + i), i), out);
+        CHECK(out.frames.size() == static_cast<size_t>(i + 1));
+    }
+    CHECK(allEqual(out.frames[3], 103));
+    CHECK(out.frames[3].traceId == 3);
+    CHECK(mixer.queuedFrames(1) == 0);
+}
+
+void testStreamsSummedAndClipped()
+{
+    StreamMixer mixer;
+    Output out;
+    mixer.push(1, constant(1000, 7), out);       // alone so far, passed through
+    mixer.push(2, constant(2000, 9), out);       // waits for stream 1
+    CHECK(out.frames.size() == 1);
+    CHECK(mixer.queuedFrames(2) == 1);
+    mixer.push(1, constant(1000, 8), out);
+    CHECK(out.frames.size() == 2);
+    CHECK(allEqual(out.frames[1], 3000));
+    CHECK(out.frames[1].traceId == 8);
+
+    mixer.push(1, constant(30000), out);
+    mixer.push(2, constant(30000), out);
+    CHECK(out.frames.size() == 3);
+    CHECK(allEqual(out.frames[2], 32767));
+    mixer.push(1, constant(-30000), out);
+    mixer.push(2, constant(-30000), out);
+    CHECK(allEqual(out.frames[3], -32768));
+}
+
+void testLateStreamSkipped()
+{
+    StreamMixer mixer;
+    Output out;
+    mixer.push(1, constant(1000), out);
+    mixer.push(2, constant(2000), out);
+    mixer.push(1, constant(1000), out);
+    CHECK(out.frames.size() == 2);
+
+    // Stream 2 goes quiet: stream 1 waits kJitterFrames, then goes out alone
+    for(size_t i = 0; i < StreamMixer::kJitterFrames; i++) {
+        mixer.push(1, constant(1000), out);
+    }
+    CHECK(out.frames.size() == 2);
+    mixer.push(1, constant(1000), out);
+    CHECK(out.frames.size() == 3);
+    CHECK(allEqual(out.frames[2], 1000));
+
+    // The late frame joins the next mix
+    mixer.push(2, constant(2000), out);
+    CHECK(out.frames.size() == 4);
+    CHECK(allEqual(out.frames[3], 3000));
+}
+
+void testStoppedStreamLeaves()
+{
+    StreamMixer mixer;
+    Output out;
+    mixer.push(1, constant(1000), out);
+    mixer.push(2, constant(2000), out);
+    CHECK(mixer.streamCount() == 2);
+
+    // Stream 2 stopped: stream 1 is held back kJitterFrames, then mixed alone until 2 is dropped
+    int pushed = 0;
+    while(mixer.streamCount() == 2 && pushed < 100) {
+        mixer.push(1, constant(1000), out);
+        pushed++;
+    }
+    CHECK(mixer.streamCount() == 1);
+    CHECK(pushed < 100);
+    // The backlog drains once stream 1 is alone again
+    mixer.push(1, constant(1000), out);
+    CHECK(mixer.queuedFrames(1) == 0);
+    CHECK(out.frames.size() == static_cast<size_t>(pushed + 2));
+}
+
+void testFastStreamBounded()
+{
+    StreamMixer mixer;
+    Output out;
+    mixer.push(1, constant(1000), out);
+    mixer.push(2, constant(2000), out);
+    mixer.push(1, constant(1000), out);
+    CHECK(out.frames.size() == 2);
+
+    // A burst (or a sender clock running fast) never queues more than kJitterFrames
+    for(int i = 0; i < 20; i++) {
+        mixer.push(2, constant(2000), out);
+        CHECK(mixer.queuedFrames(2) <= StreamMixer::kJitterFrames);
+    }
+    CHECK(out.frames.size() == 2 + 20 - StreamMixer::kJitterFrames);
+}
+
+// Exposes consume() so datagrams can be fed without the stage thread
+struct TestDecodeStage : DecodeStage
+{
+    using DecodeStage::DecodeStage;
+    using DecodeStage::consume;
+};
+
+Datagram encodedDatagram(AudioCodec& encoder, uint32_t ssrc, uint16_t sequence, opus_int16 value)
+{
+    const AudioFrame pcm = constant(value);
+    unsigned char packet[1500];
+    const int size = encoder.encode(pcm.data(), kFrameSize, packet, sizeof(packet));
+    CHECK(size > 0);
+
+    PacketHeader header;
+    header.type = PacketType::Audio;
+    header.sequence = sequence;
+    header.timestamp = static_cast<uint32_t>(sequence) * kFrameSize;
+    header.ssrc = ssrc;
+    Datagram datagram;
+    datagram.payload.assign(PacketHeader::kSize + static_cast<size_t>(std::max(size, 0)), 0);
+    header.write(reinterpret_cast<unsigned char*>(datagram.payload.data()));
+    std::copy(packet, packet + std::max(size, 0), datagram.payload.begin() + PacketHeader::kSize);
+    datagram.peer = asio::ip::udp::endpoint(asio::ip::make_address("10.0.0.2"), 5000);
+    return datagram;
+}
+
+void testTwoStreamsOneFramePerPeriod()
+{
+    PeerManagerConfig config;
+    config.channels = 1;
+    auto input = std::make_shared<ThreadSafeQueue<Datagram>>();
+    auto output = std::make_shared<ThreadSafeQueue<AudioFrame>>();
+    TestDecodeStage decode(config, kFrameSize, 1, input, output);
+
+    AudioCodec first, second;
+    CHECK(first.initEncoder(config.sampleRate, 1, OPUS_APPLICATION_VOIP));
+    CHECK(second.initEncoder(config.sampleRate, 1, OPUS_APPLICATION_VOIP));
+
+    // Both participants talk at once, one datagram each per frame period
+    const int periods = 50;
+    for(int i = 0; i < periods; i++) {
+        Datagram a = encodedDatagram(first, 0x1111, static_cast<uint16_t>(i), 1000);
+        Datagram b = encodedDatagram(second, 0x2222, static_cast<uint16_t>(i + 300), 2000);
+        decode.consume(a);
+        decode.consume(b);
+    }
+
+    // One frame per period, not one per datagram: the last frame of the second stream waits
+    CHECK(output->size() == static_cast<size_t>(periods));
+    AudioFrame frame;
+    size_t wrongSize = 0;
+    while(output->try_pop(frame)) {
+        wrongSize += frame.size() != static_cast<size_t>(kFrameSize);
+    }
+    CHECK(wrongSize == 0);
+    input->Shutdown();
+    output->Shutdown();
+}
+
+} // namespace
+
+int main()
+{
+    testSingleStreamPassesThrough();
+    testStreamsSummedAndClipped();
+    testLateStreamSkipped();
+    testStoppedStreamLeaves();
+    testFastStreamBounded();
+    testTwoStreamsOneFramePerPeriod();
+    return testResult("stream_mixer_test");
+}
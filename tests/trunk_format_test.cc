@@ -0,0 +1,108 @@
+// TrunkFormat: entries written by append() read back, truncated or inconsistent trunk datagrams
+// rejected
+
+#include "Bridge.hpp"
+#include "PacketHeader.hpp"
+#include "TestCheck.hpp"
+
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+std::vector<unsigned char> audioPacket(uint32_t ssrc, uint16_t sequence, size_t payloadSize)
+{
+    PacketHeader header;
+    header.type = PacketType::Audio;
+    header.sequence = sequence;
+    header.ssrc = ssrc;
+    std::vector<unsigned char> packet(PacketHeader::kSize + payloadSize, 0x5A);
+    header.write(packet.data());
+    return packet;
+}
+
+NetworkPacket trunkHeader()
+{
+    PacketHeader header;
+    header.type = PacketType::Trunk;
+    header.ssrc = 0x0B0B;
+    NetworkPacket out(PacketHeader::kSize);
+    header.write(reinterpret_cast<unsigned char*>(out.data()));
+    return out;
+}
+
+const unsigned char* bytesOf(const NetworkPacket& packet)
+{
+    return reinterpret_cast<const unsigned char*>(packet.data());
+}
+
+void testRoundTrip()
+{
+    const std::vector<unsigned char> first = audioPacket(1, 10, 40);
+    const std::vector<unsigned char> second = audioPacket(2, 20, 300);
+    NetworkPacket trunk = trunkHeader();
+    TrunkFormat::append({0xA1A2A3A4, 1, first.data(), first.size()}, trunk);
+    TrunkFormat::append({0xB1B2B3B4, 7, second.data(), second.size()}, trunk);
+    CHECK(trunk.size() == PacketHeader::kSize + 2 * TrunkFormat::kEntryHeaderSize + first.size() + second.size());
+
+    std::vector<TrunkFormat::Entry> entries;
+    CHECK(TrunkFormat::read(bytesOf(trunk), trunk.size(), entries));
+    CHECK(entries.size() == 2);
+    if(entries.size() == 2) {
+        CHECK(entries[0].origin == 0xA1A2A3A4 && entries[0].hops == 1 && entries[0].size == first.size());
+        CHECK(std::equal(first.begin(), first.end(), entries[0].data));
+        CHECK(entries[1].origin == 0xB1B2B3B4 && entries[1].hops == 7 && entries[1].size == second.size());
+        CHECK(std::equal(second.begin(), second.end(), entries[1].data));
+    }
+
+    // A keepalive is the header alone
+    const NetworkPacket keepalive = trunkHeader();
+    CHECK(TrunkFormat::read(bytesOf(keepalive), keepalive.size(), entries));
+    CHECK(entries.empty());
+}
+
+void testTruncated()
+{
+    const std::vector<unsigned char> first = audioPacket(1, 10, 40);
+    const std::vector<unsigned char> second = audioPacket(2, 20, 300);
+    NetworkPacket trunk = trunkHeader();
+    TrunkFormat::append({1, 0, first.data(), first.size()}, trunk);
+    const size_t boundary = trunk.size();
+    TrunkFormat::append({2, 0, second.data(), second.size()}, trunk);
+
+    // Only prefixes that end on an entry boundary are complete trunk datagrams
+    std::vector<TrunkFormat::Entry> entries;
+    for(size_t size = 0; size < trunk.size(); size++) {
+        const bool complete = size == PacketHeader::kSize || size == boundary;
+        CHECK(TrunkFormat::read(bytesOf(trunk), size, entries) == complete);
+    }
+    CHECK(TrunkFormat::read(bytesOf(trunk), boundary, entries) && entries.size() == 1);
+}
+
+void testMalformedEntries()
+{
+    std::vector<TrunkFormat::Entry> entries;
+
+    // An entry too short to hold a PacketHeader
+    const std::vector<unsigned char> tiny(PacketHeader::kSize - 1, 0);
+    NetworkPacket trunk = trunkHeader();
+    TrunkFormat::append({1, 0, tiny.data(), tiny.size()}, trunk);
+    CHECK(!TrunkFormat::read(bytesOf(trunk), trunk.size(), entries));
+
+    // A length that runs past the datagram
+    const std::vector<unsigned char> packet = audioPacket(1, 10, 40);
+    trunk = trunkHeader();
+    TrunkFormat::append({1, 0, packet.data(), packet.size()}, trunk);
+    trunk[PacketHeader::kSize + 6] = static_cast<char>(packet.size() + 1);
+    CHECK(!TrunkFormat::read(bytesOf(trunk), trunk.size(), entries));
+}
+
+} // namespace
+
+int main()
+{
+    testRoundTrip();
+    testTruncated();
+    testMalformedEntries();
+    return testResult("trunk_format_test");
+}
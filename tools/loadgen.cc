@@ -0,0 +1,600 @@
+// echo-link-loadgen: simulates many echo-link clients against a server on the same machine.
+//
+// Every virtual client sends a paced stream of pre-encoded Opus packets (with the usual
+// PacketHeader) to the server and receives the stream it sends back (`--server` mode reflects
+// every datagram to its sender). From the returned packets we measure loss, round-trip and
+// one-way delay, per-client jitter and, given the server pid, the server CPU used per stream.
+//
+// Encoding happens once up front, so the generator itself stays cheap enough to drive
+// thousands of streams from one core.
+
+#include "AudioCodec.hpp"
+#include "PacketHeader.hpp"
+#include "Repacketizer.hpp"
+#include "opus_defines.h"
+
+#include <asio.hpp>
+#include <asio/io_context.hpp>
+
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr double kPi = 3.14159265358979323846;
+
+struct LoadgenConfig
+{
+    std::string serverIp = "127.0.0.1";
+    unsigned short serverPort = 12345;
+    int clients = 100;
+    int sockets = 0;                // 0 = min(clients, 64)
+    int sendThreads = 1;
+    int receiveThreads = 1;
+    double durationSeconds = 10.0;
+    int drainMs = 500;
+    std::string inputPath;          // raw interleaved 16-bit PCM, empty = generated tone
+    double clipSeconds = 5.0;
+    int sampleRate = 48000;
+    int channels = 2;
+    int frameSize = 480;
+    int framesPerPacket = 1;
+    int serverPid = 0;
+};
+
+// --- Pre-encoded clip ---
+
+std::vector<opus_int16> loadPcm(const LoadgenConfig& config)
+{
+    const size_t samples = static_cast<size_t>(config.clipSeconds * config.sampleRate) * config.channels;
+    std::vector<opus_int16> pcm(samples);
+
+    if(config.inputPath.empty()) {
+        // Slowly sweeping tone with an envelope, so the encoder sees something speech-like in size
+        for(size_t i = 0; i < samples / config.channels; i++) {
+            double t = static_cast<double>(i) / config.sampleRate;
+            double frequency = 220.0 + 200.0 * std::sin(2.0 * kPi * 0.25 * t);
+            double envelope = 0.5 + 0.5 * std::sin(2.0 * kPi * 1.5 * t);
+            auto value = static_cast<opus_int16>(8000.0 * envelope * std::sin(2.0 * kPi * frequency * t));
+            for(int ch = 0; ch < config.channels; ch++) {
+                pcm[i * config.channels + ch] = value;
+            }
+        }
+        return pcm;
+    }
+
+    std::ifstream file(config.inputPath, std::ios::binary);
+    if(!file.is_open()) {
+        throw std::runtime_error("Failed to open input file: " + config.inputPath);
+    }
+    file.read(reinterpret_cast<char*>(pcm.data()), static_cast<std::streamsize>(pcm.size() * sizeof(opus_int16)));
+    pcm.resize(static_cast<size_t>(file.gcount()) / sizeof(opus_int16));
+    return pcm;
+}
+
+// Encodes the clip once into the Opus payloads of consecutive datagrams
+std::vector<std::vector<unsigned char>> encodeClip(const LoadgenConfig& config)
+{
+    std::vector<opus_int16> pcm = loadPcm(config);
+    const size_t samplesPerFrame = static_cast<size_t>(config.frameSize) * config.channels;
+    const size_t frameCount = pcm.size() / samplesPerFrame;
+    if(frameCount < static_cast<size_t>(config.framesPerPacket)) {
+        throw std::runtime_error("Input is shorter than one packet.");
+    }
+
+    AudioCodec codec;
+    if(!codec.initEncoder(config.sampleRate, config.channels, OPUS_APPLICATION_VOIP)) {
+        throw std::runtime_error("Failed to initialize the Opus encoder.");
+    }
+
+    Repacketizer packetizer(config.framesPerPacket);
+    std::vector<unsigned char> frame(Repacketizer::kMaxFrameBytes * 2);
+    std::vector<unsigned char> bundle(Repacketizer::kMaxFramesPerPacket * Repacketizer::kMaxFrameBytes + 64);
+    std::vector<std::vector<unsigned char>> packets;
+
+    auto flush = [&]() {
+        int bytes = packetizer.flush(bundle.data(), static_cast<int>(bundle.size()));
+        if(bytes > 0) {
+            packets.emplace_back(bundle.begin(), bundle.begin() + bytes);
+        }
+    };
+
+    for(size_t f = 0; f < frameCount; f++) {
+        int bytes = codec.encode(pcm.data() + f * samplesPerFrame, config.frameSize, frame.data(), static_cast<int>(frame.size()));
+        if(bytes < 0) {
+            throw std::runtime_error(std::string("Opus encoding failed: ") + opus_strerror(bytes));
+        }
+        if(packetizer.append(frame.data(), bytes) == OPUS_INVALID_PACKET) {
+            flush();
+            packetizer.append(frame.data(), bytes);
+        }
+        if(packetizer.isFull()) {
+            flush();
+        }
+    }
+    flush();
+    return packets;
+}
+
+// --- Statistics ---
+
+// Fixed-bucket latency histogram, safe to update from several threads
+class LatencyHistogram
+{
+public:
+    static constexpr int64_t kBucketUs = 10;
+    static constexpr size_t kBuckets = 200000;   // up to 2 s, anything above lands in the last bucket
+
+    LatencyHistogram() : m_Buckets(new std::atomic<uint32_t>[kBuckets]())
+    {
+        for(size_t i = 0; i < kBuckets; i++) {
+            m_Buckets[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void add(int64_t microseconds)
+    {
+        size_t bucket = static_cast<size_t>(std::clamp<int64_t>(microseconds / kBucketUs, 0, kBuckets - 1));
+        m_Buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        m_Count.fetch_add(1, std::memory_order_relaxed);
+        int64_t max = m_MaxUs.load(std::memory_order_relaxed);
+        while(microseconds > max && !m_MaxUs.compare_exchange_weak(max, microseconds, std::memory_order_relaxed)) {}
+    }
+
+    // Upper edge of the bucket holding the given percentile, in microseconds
+    int64_t percentile(double p) const
+    {
+        uint64_t count = m_Count.load();
+        if(count == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(std::ceil(p / 100.0 * count));
+        uint64_t seen = 0;
+        for(size_t i = 0; i < kBuckets; i++) {
+            seen += m_Buckets[i].load(std::memory_order_relaxed);
+            if(seen >= rank) {
+                return std::min<int64_t>((static_cast<int64_t>(i) + 1) * kBucketUs, m_MaxUs.load());
+            }
+        }
+        return m_MaxUs.load();
+    }
+
+    uint64_t count() const { return m_Count.load(); }
+    int64_t max() const { return m_MaxUs.load(); }
+
+private:
+    std::unique_ptr<std::atomic<uint32_t>[]> m_Buckets;
+    std::atomic<uint64_t> m_Count{0};
+    std::atomic<int64_t> m_MaxUs{0};
+};
+
+struct VirtualClient
+{
+    // Send times of the last kSendRing datagrams, packed as (send time ns << 16 | sequence).
+    // Written by the sender thread, claimed (exchanged to 0) by the receive handler.
+    static constexpr size_t kSendRing = 256;
+
+    uint32_t ssrc = 0;
+    size_t clipOffset = 0;
+    asio::ip::udp::socket* socket = nullptr;
+
+    // Sender side
+    PacketHeader header;
+    std::atomic<uint64_t> sent{0};
+    std::array<std::atomic<uint64_t>, kSendRing> sendTimes{};
+
+    // Receive side, only touched by the handler of `socket` (one receive outstanding per socket)
+    uint64_t received = 0;
+    uint64_t late = 0;          // came back after its send slot was reused
+    uint64_t duplicates = 0;
+    uint64_t reordered = 0;
+    int32_t highestSequence = -1;
+    bool haveTransit = false;
+    int64_t lastTransitNs = 0;
+    double jitterNs = 0.0;      // RFC 3550 interarrival jitter
+};
+
+struct ClientSocket
+{
+    explicit ClientSocket(asio::io_context& context) : socket(context) {}
+
+    asio::ip::udp::socket socket;
+    std::array<char, 2048> buffer;
+    asio::ip::udp::endpoint sender;
+};
+
+class LoadGenerator
+{
+public:
+    LoadGenerator(const LoadgenConfig& config, std::vector<std::vector<unsigned char>> clip)
+        : m_Config(config), m_Clip(std::move(clip)),
+        m_Server(asio::ip::address::from_string(config.serverIp), config.serverPort),
+        m_PacketPeriod(std::chrono::nanoseconds(static_cast<int64_t>(
+            1e9 * config.frameSize * config.framesPerPacket / config.sampleRate)))
+    {
+        const int socketCount = std::max(1, m_Config.sockets > 0 ? m_Config.sockets : std::min(m_Config.clients, 64));
+        for(int i = 0; i < socketCount; i++) {
+            auto clientSocket = std::make_unique<ClientSocket>(m_Context);
+            clientSocket->socket.open(asio::ip::udp::v4());
+            clientSocket->socket.bind(asio::ip::udp::endpoint(asio::ip::address_v4::loopback(), 0));
+            m_Sockets.push_back(std::move(clientSocket));
+        }
+
+        m_FirstSsrc = PacketHeader::randomSsrc() & 0x7FFFFFFFu;
+        for(int i = 0; i < m_Config.clients; i++) {
+            auto client = std::make_unique<VirtualClient>();
+            client->ssrc = m_FirstSsrc + static_cast<uint32_t>(i);
+            client->header.ssrc = client->ssrc;
+            client->clipOffset = static_cast<size_t>(i) % m_Clip.size();
+            client->socket = &m_Sockets[static_cast<size_t>(i) % m_Sockets.size()]->socket;
+            m_Clients.push_back(std::move(client));
+        }
+
+        std::cout << "[Loadgen] " << m_Config.clients << " clients on " << m_Sockets.size() << " sockets -> "
+            << m_Server << ", packet every " << std::chrono::duration<double, std::milli>(m_PacketPeriod).count()
+            << " ms, clip of " << m_Clip.size() << " packets" << std::endl;
+    }
+
+    void run()
+    {
+        for(auto& clientSocket : m_Sockets) {
+            receiveNext(*clientSocket);
+        }
+        std::vector<std::thread> receivers;
+        for(int i = 0; i < std::max(1, m_Config.receiveThreads); i++) {
+            receivers.emplace_back([this]() { m_Context.run(); });
+        }
+
+        m_Start = Clock::now() + std::chrono::milliseconds(100);   // let every thread get going first
+        const auto end = m_Start + std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(m_Config.durationSeconds));
+        const uint64_t serverCpuBefore = serverCpuTicks();
+        const double ownCpuBefore = ownCpuSeconds();
+
+        std::vector<std::thread> senders;
+        for(int t = 0; t < std::max(1, m_Config.sendThreads); t++) {
+            senders.emplace_back(&LoadGenerator::sendLoop, this, t, end);
+        }
+
+        // Progress once per second
+        uint64_t lastSent = 0;
+        uint64_t lastReceived = 0;
+        for(auto tick = m_Start + std::chrono::seconds(1); tick <= end; tick += std::chrono::seconds(1)) {
+            std::this_thread::sleep_until(tick);
+            uint64_t sent = m_TotalSent.load();
+            uint64_t received = m_RoundTrip.count();
+            std::cout << "[Loadgen] sent " << (sent - lastSent) << " pkt/s, received " << (received - lastReceived)
+                << " pkt/s, RTT p99 " << m_RoundTrip.percentile(99.0) << " us" << std::endl;
+            lastSent = sent;
+            lastReceived = received;
+        }
+
+        for(auto& sender : senders) {
+            sender.join();
+        }
+        const uint64_t serverCpuAfter = serverCpuTicks();
+        const double ownCpu = ownCpuSeconds() - ownCpuBefore;
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(m_Config.drainMs));
+        m_Context.stop();
+        for(auto& receiver : receivers) {
+            receiver.join();
+        }
+
+        const double wallSeconds = std::chrono::duration<double>(end - m_Start).count();
+        report(wallSeconds, serverCpuAfter - serverCpuBefore, ownCpu);
+    }
+
+private:
+    void sendLoop(int threadIndex, Clock::time_point end)
+    {
+        const int threads = std::max(1, m_Config.sendThreads);
+        const int clients = m_Config.clients;
+        std::vector<unsigned char> packet(PacketHeader::kSize + Repacketizer::kMaxFramesPerPacket * Repacketizer::kMaxFrameBytes + 64);
+        const uint32_t timestampStep = static_cast<uint32_t>(m_Config.frameSize * m_Config.framesPerPacket);
+
+        for(uint64_t round = 0;; round++) {
+            const auto roundStart = m_Start + m_PacketPeriod * static_cast<int64_t>(round);
+            if(roundStart >= end) {
+                break;
+            }
+            for(int i = threadIndex; i < clients; i += threads) {
+                // Spread the clients evenly over the packet period, like independent callers would be
+                const auto due = roundStart + m_PacketPeriod * i / clients;
+                if(due > Clock::now()) {
+                    std::this_thread::sleep_until(due);
+                }
+
+                VirtualClient& client = *m_Clients[static_cast<size_t>(i)];
+                const std::vector<unsigned char>& payload = m_Clip[(client.clipOffset + round) % m_Clip.size()];
+                client.header.write(packet.data());
+                std::memcpy(packet.data() + PacketHeader::kSize, payload.data(), payload.size());
+
+                const auto now = Clock::now();
+                // Never 0, a zero slot marks an already received packet
+                const uint64_t sendNs = std::max<int64_t>(1, std::chrono::duration_cast<std::chrono::nanoseconds>(now - m_Start).count());
+                client.sendTimes[client.header.sequence % VirtualClient::kSendRing].store(
+                    (sendNs << 16) | client.header.sequence, std::memory_order_release);
+
+                // Plain sendto on the native handle: the socket's asio object is busy with the receive side
+                ssize_t result = ::sendto(client.socket->native_handle(), packet.data(), PacketHeader::kSize + payload.size(), 0,
+                    m_Server.data(), static_cast<socklen_t>(m_Server.size()));
+                if(result < 0) {
+                    m_SendErrors.fetch_add(1, std::memory_order_relaxed);
+                }
+                if(now - due > m_PacketPeriod) {
+                    m_SendsBehind.fetch_add(1, std::memory_order_relaxed);
+                }
+
+                client.header.sequence++;
+                client.header.timestamp += timestampStep;
+                client.sent.fetch_add(1, std::memory_order_relaxed);
+                m_TotalSent.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void receiveNext(ClientSocket& clientSocket)
+    {
+        clientSocket.socket.async_receive_from(asio::buffer(clientSocket.buffer), clientSocket.sender,
+            [this, &clientSocket](const asio::error_code& error, std::size_t bytes) {
+                if(error) {
+                    return;     // io_context stopped or socket closed
+                }
+                handlePacket(reinterpret_cast<const unsigned char*>(clientSocket.buffer.data()), bytes);
+                receiveNext(clientSocket);
+            });
+    }
+
+    void handlePacket(const unsigned char* data, size_t bytes)
+    {
+        const auto now = Clock::now();
+        PacketHeader header;
+        if(!PacketHeader::read(data, bytes, header) || header.ssrc - m_FirstSsrc >= m_Clients.size()) {
+            m_Foreign.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        VirtualClient& client = *m_Clients[header.ssrc - m_FirstSsrc];
+
+        // A claimed slot means we've seen this sequence already, a slot holding another
+        // sequence means the sender has wrapped around the ring since this one was sent
+        std::atomic<uint64_t>& slot = client.sendTimes[header.sequence % VirtualClient::kSendRing];
+        uint64_t entry = slot.load(std::memory_order_acquire);
+        if(entry == 0) {
+            client.duplicates++;
+            return;
+        }
+        if((entry & 0xFFFF) != header.sequence || !slot.compare_exchange_strong(entry, 0, std::memory_order_acq_rel)) {
+            client.late++;
+            return;
+        }
+        client.received++;
+
+        const int64_t sendNs = static_cast<int64_t>(entry >> 16);
+        const int64_t arrivalNs = std::chrono::duration_cast<std::chrono::nanoseconds>(now - m_Start).count();
+        const int64_t transitNs = arrivalNs - sendNs;
+        m_RoundTrip.add(transitNs / 1000);
+
+        // RFC 3550 jitter on the transit time, J += (|D| - J) / 16
+        if(client.haveTransit) {
+            double d = std::fabs(static_cast<double>(transitNs - client.lastTransitNs));
+            client.jitterNs += (d - client.jitterNs) / 16.0;
+        }
+        client.haveTransit = true;
+        client.lastTransitNs = transitNs;
+
+        if(client.highestSequence >= 0 && static_cast<int16_t>(header.sequence - client.highestSequence) < 0) {
+            client.reordered++;
+        } else {
+            client.highestSequence = header.sequence;
+        }
+    }
+
+    uint64_t serverCpuTicks() const
+    {
+        if(m_Config.serverPid <= 0) {
+            return 0;
+        }
+        std::ifstream stat("/proc/" + std::to_string(m_Config.serverPid) + "/stat");
+        std::string line;
+        if(!std::getline(stat, line)) {
+            return 0;
+        }
+        // Skip "pid (comm)", the command name may contain spaces
+        std::istringstream fields(line.substr(line.rfind(')') + 2));
+        std::string field;
+        uint64_t utime = 0, stime = 0;
+        for(int index = 3; fields >> field; index++) {
+            if(index == 14) {
+                utime = std::stoull(field);
+            } else if(index == 15) {
+                stime = std::stoull(field);
+                break;
+            }
+        }
+        return utime + stime;
+    }
+
+    static double ownCpuSeconds()
+    {
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+    }
+
+    void report(double wallSeconds, uint64_t serverTicks, double ownCpu) const
+    {
+        uint64_t sent = 0, received = 0, late = 0, duplicates = 0, reordered = 0;
+        double worstLoss = 0.0;
+        std::vector<double> jitterUs;
+        for(const auto& client : m_Clients) {
+            uint64_t clientSent = client->sent.load();
+            sent += clientSent;
+            received += client->received;
+            late += client->late;
+            duplicates += client->duplicates;
+            reordered += client->reordered;
+            if(clientSent > 0) {
+                worstLoss = std::max(worstLoss, 100.0 * (clientSent - std::min(clientSent, client->received)) / clientSent);
+            }
+            jitterUs.push_back(client->jitterNs / 1000.0);
+        }
+        std::sort(jitterUs.begin(), jitterUs.end());
+        auto jitterPercentile = [&](double p) {
+            size_t index = std::min(jitterUs.size() - 1, static_cast<size_t>(p / 100.0 * jitterUs.size()));
+            return jitterUs[index];
+        };
+
+        const uint64_t lost = sent - std::min(sent, received);
+        std::cout << std::fixed << std::setprecision(2);
+        std::cout << "[Loadgen] ---- Results (" << m_Config.clients << " streams, " << wallSeconds << " s) ----" << std::endl;
+        std::cout << "[Loadgen] Packets: sent " << sent << ", received " << received << ", lost " << lost
+            << " (" << (sent ? 100.0 * lost / sent : 0.0) << "%, worst client " << worstLoss << "%)"
+            << ", late " << late << ", duplicate " << duplicates << ", reordered " << reordered
+            << ", foreign " << m_Foreign.load() << std::endl;
+        std::cout << "[Loadgen] Round-trip delay (us): p50 " << m_RoundTrip.percentile(50) << ", p90 " << m_RoundTrip.percentile(90)
+            << ", p99 " << m_RoundTrip.percentile(99) << ", p99.9 " << m_RoundTrip.percentile(99.9)
+            << ", max " << m_RoundTrip.max() << std::endl;
+        // Both directions cross the same loopback and scheduler, so half the round trip is the one-way estimate
+        std::cout << "[Loadgen] One-way delay (us, RTT/2): p50 " << m_RoundTrip.percentile(50) / 2
+            << ", p99 " << m_RoundTrip.percentile(99) / 2 << ", max " << m_RoundTrip.max() / 2 << std::endl;
+        std::cout << "[Loadgen] Jitter per client (us, RFC 3550): p50 " << jitterPercentile(50) << ", p95 " << jitterPercentile(95)
+            << ", p99 " << jitterPercentile(99) << ", max " << jitterUs.back() << std::endl;
+        std::cout << "[Loadgen] Sender: " << m_SendErrors.load() << " send errors, " << m_SendsBehind.load()
+            << " sends more than one packet period late, " << (100.0 * ownCpu / wallSeconds) << "% CPU" << std::endl;
+
+        if(m_Config.serverPid > 0) {
+            const double serverCpuSeconds = static_cast<double>(serverTicks) / sysconf(_SC_CLK_TCK);
+            const double serverPercent = 100.0 * serverCpuSeconds / wallSeconds;
+            std::cout << "[Loadgen] Server (pid " << m_Config.serverPid << "): " << serverPercent << "% CPU, "
+                << std::setprecision(4) << (serverPercent / m_Config.clients) << "% CPU per stream" << std::endl;
+        }
+    }
+
+    LoadgenConfig m_Config;
+    std::vector<std::vector<unsigned char>> m_Clip;
+    asio::ip::udp::endpoint m_Server;
+    Clock::duration m_PacketPeriod;
+
+    asio::io_context m_Context;
+    std::vector<std::unique_ptr<ClientSocket>> m_Sockets;
+    std::vector<std::unique_ptr<VirtualClient>> m_Clients;
+    uint32_t m_FirstSsrc = 0;
+    Clock::time_point m_Start;
+
+    LatencyHistogram m_RoundTrip;
+    std::atomic<uint64_t> m_TotalSent{0};
+    std::atomic<uint64_t> m_SendErrors{0};
+    std::atomic<uint64_t> m_SendsBehind{0};
+    std::atomic<uint64_t> m_Foreign{0};
+};
+
+void printUsage(const char* program)
+{
+    std::cerr << "Usage: " << program << " [options]" << std::endl;
+    std::cerr << "Simulates N echo-link clients against a server on this machine (run it with --server <port>)." << std::endl;
+    std::cerr << "Options:" << std::endl;
+    std::cerr << "  --server <ip:port>         Server to load (default 127.0.0.1:12345)" << std::endl;
+    std::cerr << "  --clients <n>              Virtual clients, one stream each (default 100)" << std::endl;
+    std::cerr << "  --duration <seconds>       Send duration (default 10)" << std::endl;
+    std::cerr << "  --input <raw_pcm>          Clip to send, raw interleaved 16-bit PCM (default: generated tone)" << std::endl;
+    std::cerr << "  --frame-size <samples>     Samples per channel per frame (default 480)" << std::endl;
+    std::cerr << "  --frames-per-packet <n>    Encoded frames per datagram, 1-6 (default 1)" << std::endl;
+    std::cerr << "  --channels <n>             1 or 2 (default 2)" << std::endl;
+    std::cerr << "  --sockets <n>              Client sockets the streams are spread over (default min(clients, 64))" << std::endl;
+    std::cerr << "  --send-threads <n>         Pacing threads (default 1)" << std::endl;
+    std::cerr << "  --receive-threads <n>      Receive threads (default 1)" << std::endl;
+    std::cerr << "  --server-pid <pid>         Report the server's CPU use per stream" << std::endl;
+    std::cerr << "Example:" << std::endl;
+    std::cerr << "  ./echo-link --server 12345 &" << std::endl;
+    std::cerr << "  " << program << " --clients 2000 --duration 30 --server-pid $!" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    LoadgenConfig config;
+
+    try {
+        for(int i = 1; i < argc; i++) {
+            std::string option = argv[i];
+            if(option == "--help" || option == "-h") {
+                printUsage(argv[0]);
+                return 0;
+            }
+            if(i + 1 >= argc) {
+                std::cerr << "Missing value for " << option << std::endl;
+                printUsage(argv[0]);
+                return 1;
+            }
+            std::string value = argv[++i];
+            if(option == "--server") {
+                size_t colon = value.rfind(':');
+                if(colon == std::string::npos) {
+                    throw std::invalid_argument("--server expects <ip:port>");
+                }
+                config.serverIp = value.substr(0, colon);
+                config.serverPort = static_cast<unsigned short>(std::stoi(value.substr(colon + 1)));
+            } else if(option == "--clients") {
+                config.clients = std::stoi(value);
+            } else if(option == "--duration") {
+                config.durationSeconds = std::stod(value);
+            } else if(option == "--input") {
+                config.inputPath = value;
+            } else if(option == "--frame-size") {
+                config.frameSize = std::stoi(value);
+            } else if(option == "--frames-per-packet") {
+                config.framesPerPacket = std::stoi(value);
+            } else if(option == "--channels") {
+                config.channels = std::stoi(value);
+            } else if(option == "--sockets") {
+                config.sockets = std::stoi(value);
+            } else if(option == "--send-threads") {
+                config.sendThreads = std::stoi(value);
+            } else if(option == "--receive-threads") {
+                config.receiveThreads = std::stoi(value);
+            } else if(option == "--server-pid") {
+                config.serverPid = std::stoi(value);
+            } else {
+                std::cerr << "Unknown option: " << option << std::endl;
+                printUsage(argv[0]);
+                return 1;
+            }
+        }
+
+        if(config.clients <= 0 || config.durationSeconds <= 0.0) {
+            throw std::invalid_argument("--clients and --duration must be positive");
+        }
+        if(!Repacketizer::isValidPacketTime(config.framesPerPacket, config.frameSize, config.sampleRate)) {
+            throw std::invalid_argument("Packet time out of range (frame size x frames per packet must be at most 120 ms)");
+        }
+
+        LoadGenerator generator(config, encodeClip(config));
+        generator.run();
+    } catch(const std::exception& e) {
+        std::cerr << "Loadgen error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}